@@ -0,0 +1,63 @@
+#ifndef RNARK_COMPACT_ENERGY_HPP
+#define RNARK_COMPACT_ENERGY_HPP
+
+#include <energy.hpp>
+#include <cstdint>
+#include <limits>
+
+namespace librnary {
+
+/**
+ * A 16-bit DP table cell, for the big tables of folders that offer compact tables (see
+ * AsymmetryFolder::SetCompactTables). Halves the memory of a table of energy_t.
+ *
+ * The largest value, Inf, stands for the infinite energy every table is initialised with (MaxMFE), and reads back
+ * as it. Values too big or small to store saturate to Inf or -Inf. Folders store through StoreEnergy, which notes
+ * when a finite energy saturated, so the fold can be redone with energy_t tables.
+ */
+class CompactEnergy {
+	int16_t v;
+
+public:
+	/// The stored value of infinite energies.
+	static const int16_t Inf = std::numeric_limits<int16_t>::max();
+
+	/// The energy Inf reads back as. Equal to NNModel::MaxMFE.
+	static energy_t Infinity() {
+		return std::numeric_limits<energy_t>::max() / 3;
+	}
+
+	/**
+	 * Whether e is stored exactly, or is infinite. Sums involving an infinite cell stay above Infinity() / 2, as the
+	 * finite terms are far smaller, so such values never decide a minimum against a finite one and are all stored
+	 * as Inf.
+	 */
+	static bool Holds(energy_t e) {
+		return (e > -Inf && e < Inf) || e >= Infinity() / 2;
+	}
+
+	CompactEnergy() = default;
+
+	CompactEnergy(energy_t e)
+		: v(static_cast<int16_t>(e >= Inf ? Inf : (e <= -Inf ? -Inf : e))) {}
+
+	operator energy_t() const {
+		return v == Inf ? Infinity() : v;
+	}
+};
+
+/// Stores e in cell. The energy_t overload for folders templated on their cell type; it always holds e.
+inline void StoreEnergy(energy_t &cell, energy_t e, bool &) {
+	cell = e;
+}
+
+/// Stores e in cell, clearing exact if e saturated.
+inline void StoreEnergy(CompactEnergy &cell, energy_t e, bool &exact) {
+	cell = e;
+	if (!CompactEnergy::Holds(e))
+		exact = false;
+}
+
+}
+
+#endif //RNARK_COMPACT_ENERGY_HPP
@@ -15,6 +15,12 @@ typedef double kcalmol_t;
 /// Currently desgiend to be the same as RNAstructure for compatibility.
 const kcalmol_t EnergyIota = 0.1; // TODO: Change this when RNAstructure is no longer relied on.
 
+/// The gas constant in kcal/(mol K).
+const kcalmol_t GasConstant = 0.0019872;
+
+/// RT at 37 C in kcal/mol. The free energy parameters are for this temperature.
+const kcalmol_t RT37 = GasConstant * 310.15;
+
 /// Standard energy representation. Needs to be an integer type, and stores energy as a multiple of EnergyIota.
 typedef int energy_t;
 
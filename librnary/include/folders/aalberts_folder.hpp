@@ -10,6 +10,8 @@
 #include "primary_structure.hpp"
 #include "models/aalberts_model.hpp"
 #include "vector_types.hpp"
+#include "multi_array.hpp"
+#include "folders/fold_workspace.hpp"
 
 namespace librnary {
 
@@ -20,14 +22,16 @@ class AalbertsFolder {
 
 	/// P stands for "Paired" and is the same as the V table.
 	/// P[i][j]: MFE of structures closed by the bond i,j.
-	VVE P;
+	TriangularArray<energy_t> P;
 	/// The "Multiloop" table.
-	_5DVE ML;
+	/// ML[br][b][a][i][j]: MFE of multiloop fragments from i to j with >= br branches, b length-b segments,
+	/// and a length-a segments.
+	VVV<TriangularArray<energy_t>> ML;
 	/// The external loop table.
 	/// E[i]: The MFE external loop from 0 to i.
 	VE E;
 	/// The coaxial stacking table.
-	VVE Cx;
+	TriangularArray<energy_t> Cx;
 
 	PrimeStructure rna;
 
@@ -94,6 +98,17 @@ class AalbertsFolder {
 	/// This flag toggles whether lonely pairs are allowed.
 	bool lonely_pairs = true;
 
+	/// Workspace the DP tables live in. Null means the folder owns its tables.
+	FoldWorkspace *workspace = nullptr;
+
+	/// The maximum j - i of a base pair (i,j). The 2D tables only keep cells within this span.
+	int max_span = std::numeric_limits<int>::max() / 3;
+
+	/// Whether (i,j) is within the maximum span, so its cells are stored.
+	bool InSpan(int i, int j) const {
+		return j - i <= max_span;
+	}
+
 public:
 
 	/// Set the max length-b segments in the internal part of a multi-loop.
@@ -112,12 +127,20 @@ public:
 	/// Get the max length-a segments in the internal part of a multi-loop.
 	int MaxALength() const;
 
+	/** See NNAffineFolder::SetWorkspace. */
+	void SetWorkspace(FoldWorkspace *ws);
+
 	/// Set the max unpaired nucleotides in a bulge/internal loop.
 	void SetMaxTwoLoop(unsigned max_up);
 
 	/// Get the max unpaired nucleotides in a bulge/internal loop.
 	int MaxTwoLoop() const;
 
+	/// See NNAffineFolder::SetMaxSpan.
+	void SetMaxSpan(unsigned span);
+
+	int MaxSpan() const;
+
 	AalbertsFolder(const AalbertsModel &_em)
 		: em(_em) {}
 
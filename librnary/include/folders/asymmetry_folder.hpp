@@ -8,6 +8,8 @@
 #include "models/asymmetry_model.hpp"
 #include "vector_types.hpp"
 #include "multi_array.hpp"
+#include "folders/fold_workspace.hpp"
+#include "compact_energy.hpp"
 
 #include <stack>
 
@@ -22,20 +24,40 @@ namespace librnary {
         /// The External loop table.
         VE E;
         /// The paired table.
-        VVE P;
+        TriangularArray<energy_t> P;
         /// The Coaxial Flush table.
-        VVE CxFl;
+        TriangularArray<energy_t> CxFl;
         /// The Coaxial Mismatch 5' unpaired table.
-        VVE CxMM5;
+        TriangularArray<energy_t> CxMM5;
         /// The Coaxial Mismatch 3' unpaired table.
-        VVE CxMM3;
+        TriangularArray<energy_t> CxMM3;
+
+        /// The multi-loop tables, with cells of type CellT.
+        template<typename CellT>
+        struct MLTables {
+            /// These arrays are hybrid flat/nested to optimize speed. The outer [br][used_mask] dimensions are flat,
+            /// the [up][upr] dimensions are nested vectors, and each [i][j] slice is a flat triangle.
+            /// The Multi-Loop Unpaired table
+            Array2D<VV<TriangularArray<CellT>>> Up;
+            /// The Multi-Loop Branch table. Every layer but br = req_br - 2 is only read at most up_lim + 1 rows
+            /// below the row being filled, so energy-only folds keep just a window of rows of those layers.
+            Array2D<VV<RowWindowArray<CellT>>> Br;
+
+            size_t Bytes() const {
+                size_t bytes = 0;
+                for (size_t br = 0; br < Up.Rows(); ++br)
+                    for (size_t s = 0; s < Up.Cols(); ++s)
+                        for (size_t up = 0; up < Up[br][s].size(); ++up)
+                            for (size_t upr = 0; upr < Up[br][s][up].size(); ++upr)
+                                bytes += Up[br][s][up][upr].Bytes() + Br[br][s][up][upr].Bytes();
+                return bytes;
+            }
+        };
 
-        /// These arrays are hybrid flat/nested vector to optimize speed. This is empirically
-        /// faster than all flat, or all nested vectors, or other hybrids.
-        /// The Multi-Loop Unpaired table
-        Array2D<_4DVE> ML_Up;
-        /// The Multi-Loop Branch table.
-        Array2D<_4DVE> ML_Br;
+        /// The multi-loop tables of a fold with energy_t cells, and of one with compact cells. Only the set used
+        /// by the last Fold holds anything.
+        MLTables<energy_t> full_ml;
+        MLTables<CompactEnergy> compact_ml;
 
 
         enum Table {
@@ -68,6 +90,22 @@ namespace librnary {
         int max_twoloop_unpaired = std::numeric_limits<int>::max() / 3;
         bool lonely_pairs = true;
         bool stacking = true;
+        /// Workspace the DP tables live in. Null means the folder owns its tables.
+        FoldWorkspace *workspace = nullptr;
+        /// Whether Fold only keeps the table rows needed to compute the MFE, leaving nothing to trace back through.
+        bool energy_only = false;
+
+        /// The maximum j - i of a base pair (i,j). The 2D tables only keep cells within this span.
+        int max_span = std::numeric_limits<int>::max() / 3;
+        /// Whether Fold tries compact multi-loop tables first.
+        bool compact_tables = false;
+        /// Whether the last Fold kept its multi-loop tables in compact_ml.
+        bool used_compact = false;
+
+        /// Whether (i,j) is within the maximum span, so its cells are stored.
+        bool InSpan(int i, int j) const {
+            return j - i <= max_span;
+        }
 
         /**
          * The optimal sub-surface score of the structure closed by (i,j). Designed for external-loop branches.
@@ -106,11 +144,24 @@ namespace librnary {
         void Relax(Table parent, energy_t &best, std::vector<TState> &best_decomp,
                    const std::vector<TState> &decomp, energy_t aux_e) const;
 
+        /// The ML_Up or ML_Br cell of d, from whichever multi-loop tables the last Fold used.
+        energy_t MLCell(const TState &d) const;
+
+        /**
+         * Fills every DP table, with the multi-loop tables in tables.
+         * @return Whether every multi-loop cell was stored exactly. The fill stops early when one was not.
+         */
+        template<typename CellT>
+        bool FillTables(MLTables<CellT> &tables);
+
     public:
         void SetModel(const AsymmetryModel &_em);
 
         energy_t Fold(const PrimeStructure &rna);
-        /// Trace-back through the DP tables and produce the secondary structure.
+        /**
+         * Trace-back through the DP tables and produce the secondary structure.
+         * @throws std::logic_error If the last Fold was energy-only, as the multi-loop tables no longer hold every row.
+         */
         Matching Traceback();
         AsymmetryFolder(const AsymmetryModel &_em)
                 : em(_em) {}
@@ -129,12 +180,40 @@ namespace librnary {
 
         bool LonelyPairs() const;
 
+        /** See NNAffineFolder::SetWorkspace. */
+        void SetWorkspace(FoldWorkspace *ws);
+
         /// Set the max unpaired nucleotides in a bulge/internal loop.
         void SetMaxTwoLoop(unsigned max_up);
 
         /// Get the max unpaired nucleotides in a bulge/internal loop.
         int MaxTwoLoop() const;
 
+        /// See NNAffineFolder::SetMaxSpan.
+        void SetMaxSpan(unsigned span);
+
+        int MaxSpan() const;
+
+        /// See NNAffineFolder::SetEnergyOnly.
+        void SetEnergyOnly(bool v);
+
+        bool EnergyOnly() const;
+
+        /// Bytes of DP table memory used by the last Fold. The tables are allocated up front, so this is also the peak.
+        size_t TableBytes() const;
+
+        /**
+         * Keeps the multi-loop tables, which hold most of the memory of a fold, in 16-bit cells (see CompactEnergy).
+         * This halves their size. If an energy of the fold does not fit in 16 bits, the fold is redone with 32-bit
+         * tables, so the MFE and traceback are always those of a fold without compact tables.
+         */
+        void SetCompactTables(bool v);
+
+        bool CompactTables() const;
+
+        /// Whether the last Fold kept compact tables, i.e. they were enabled and every energy fit.
+        bool UsedCompactTables() const;
+
 
         VVE GetP() const;
     };
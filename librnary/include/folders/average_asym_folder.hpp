@@ -6,6 +6,9 @@
 #define RNARK_AVERAGE_ASYM_FOLDER_HPP_HPP
 
 #include "vector_types.hpp"
+#include "multi_array.hpp"
+#include "folders/fold_workspace.hpp"
+#include "compact_energy.hpp"
 #include "models/average_asym_model.hpp"
 
 #include <stack>
@@ -26,24 +29,53 @@ class AverageAsymmetryFolder {
 	/// The External loop table.
 	VE E;
 	/// The paired table.
-	VVE P;
+	TriangularArray<energy_t> P;
 	/// The Coaxial Flush table.
-	VVE CxFl;
+	TriangularArray<energy_t> CxFl;
 	/// The Coaxial Mismatch 5' unpaired table.
-	VVE CxMM5;
+	TriangularArray<energy_t> CxMM5;
 	/// The Coaxial Mismatch 3' unpaired table.
-	VVE CxMM3;
-	/// The Multi-Loop Unpaired table
-	/// ML_Up[bs][br][sum_asym][up_left][up_right][i][j] =
-	/// The optimal multi-loop fragment between i and j given that 0 or more consecutive unpaired start at i.
-	/// Also, the fragment has exactly br branches, and has exactly sum_asym asymmetry.
-	/// Also, has up_left unpaired nucleotides for the preceding branch.
-	/// Also has up_right unpaired nucleotides between the closing branch and the rightmost internal branch.
-	/// Finally, the bs bitset represents whether certain unpaired nucleotides were used.
-	_7DVE ML_Up;
-	/// The Multi-Loop Branch table.
-	/// Similar to ML_Up but assumes a branch starts at i.
-	_7DVE ML_Br;
+	TriangularArray<energy_t> CxMM3;
+	/// The multi-loop tables, with cells of type CellT.
+	template<typename CellT>
+	struct MLTables {
+		/// The Multi-Loop Unpaired table
+		/// Up[bs][br][sum_asym][up_left][up_right][i][j] =
+		/// The optimal multi-loop fragment between i and j given that 0 or more consecutive unpaired start at i.
+		/// Also, the fragment has exactly br branches, and has exactly sum_asym asymmetry.
+		/// Also, has up_left unpaired nucleotides for the preceding branch.
+		/// Also has up_right unpaired nucleotides between the closing branch and the rightmost internal branch.
+		/// Finally, the bs bitset represents whether certain unpaired nucleotides were used.
+		/// The [i][j] dimensions of each slice are stored as a flat triangle.
+		_5DV<TriangularArray<CellT>> Up;
+		/// The Multi-Loop Branch table.
+		/// Similar to Up but assumes a branch starts at i.
+		/// Only the br layers 1 to br_lim - 3 are read at arbitrary rows (by the P fill). The rest are read at most
+		/// up_lim + 1 rows below the row being filled, so energy-only folds keep just a window of their rows.
+		_5DV<RowWindowArray<CellT>> Br;
+
+		size_t Bytes() const {
+			size_t bytes = 0;
+			for (const auto &by_bs : Up)
+				for (const auto &by_br : by_bs)
+					for (const auto &by_asym : by_br)
+						for (const auto &by_l : by_asym)
+							for (const auto &tbl : by_l)
+								bytes += tbl.Bytes();
+			for (const auto &by_bs : Br)
+				for (const auto &by_br : by_bs)
+					for (const auto &by_asym : by_br)
+						for (const auto &by_l : by_asym)
+							for (const auto &tbl : by_l)
+								bytes += tbl.Bytes();
+			return bytes;
+		}
+	};
+
+	/// The multi-loop tables of a fold with energy_t cells, and of one with compact cells. Only the set used by the
+	/// last Fold holds anything.
+	MLTables<energy_t> full_ml;
+	MLTables<CompactEnergy> compact_ml;
 
 
 	enum Table {
@@ -81,6 +113,23 @@ class AverageAsymmetryFolder {
 	int max_nonclosing_ml_sum_asym_ = std::numeric_limits<int>::max() / 3;
 	bool lonely_pairs = true;
 	bool stacking = true;
+	/// Workspace the DP tables live in. Null means the folder owns its tables.
+	FoldWorkspace *workspace = nullptr;
+	/// Whether Fold only keeps the table rows needed to compute the MFE, leaving nothing to trace back through.
+	bool energy_only = false;
+
+	/// The maximum j - i of a base pair (i,j). The 2D tables only keep cells within this span.
+	int max_span = std::numeric_limits<int>::max() / 3;
+
+	/// Whether Fold tries compact multi-loop tables first.
+	bool compact_tables = false;
+	/// Whether the last Fold kept its multi-loop tables in compact_ml.
+	bool used_compact = false;
+
+	/// Whether (i,j) is within the maximum span, so its cells are stored.
+	bool InSpan(int i, int j) const {
+		return j - i <= max_span;
+	}
 
 	/**
 	 * @return The upper bound on number of branches in a multi-loop.
@@ -124,9 +173,22 @@ class AverageAsymmetryFolder {
 	void Relax(Table parent, energy_t &best, std::vector<TState> &best_decomp,
 			   const std::vector<TState> &decomp, energy_t aux_e) const;
 
+	/// The ML_Up or ML_Br cell of d, from whichever multi-loop tables the last Fold used.
+	energy_t MLCell(const TState &d) const;
+
+	/**
+	 * Fills every DP table, with the multi-loop tables in tables.
+	 * @return Whether every multi-loop cell was stored exactly. The fill stops early when one was not.
+	 */
+	template<typename CellT>
+	bool FillTables(MLTables<CellT> &tables);
+
 public:
 	energy_t Fold(const PrimeStructure &rna);
-	/// Trace-back through the DP tables and produce the secondary structure.
+	/**
+	 * Trace-back through the DP tables and produce the secondary structure.
+	 * @throws std::logic_error If the last Fold was energy-only, as the multi-loop tables no longer hold every row.
+	 */
 	Matching Traceback();
 	AverageAsymmetryFolder(const AverageAsymmetryModel &_em)
 		: em(_em) {}
@@ -145,12 +207,36 @@ public:
 
 	bool LonelyPairs() const;
 
+	/** See NNAffineFolder::SetWorkspace. */
+	void SetWorkspace(FoldWorkspace *ws);
+
 	/// Set the max unpaired nucleotides in a bulge/internal loop.
 	void SetMaxTwoLoop(unsigned max_up);
 
 	/// Get the max unpaired nucleotides in a bulge/internal loop.
 	int MaxTwoLoop() const;
 
+	/// See NNAffineFolder::SetMaxSpan.
+	void SetMaxSpan(unsigned span);
+
+	int MaxSpan() const;
+
+	/// See NNAffineFolder::SetEnergyOnly.
+	void SetEnergyOnly(bool v);
+
+	bool EnergyOnly() const;
+
+	/// Bytes of DP table memory used by the last Fold. The tables are allocated up front, so this is also the peak.
+	size_t TableBytes() const;
+
+	/// See AsymmetryFolder::SetCompactTables. The multi-loop tables of this folder are larger still.
+	void SetCompactTables(bool v);
+
+	bool CompactTables() const;
+
+	/// Whether the last Fold kept compact tables, i.e. they were enabled and every energy fit.
+	bool UsedCompactTables() const;
+
 	/// Gets the max number of multi-loop branches for the internal part of a multi-loop.
 	int MaxMLBranches() const;
 
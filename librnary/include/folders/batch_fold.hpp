@@ -0,0 +1,98 @@
+#ifndef RNARK_BATCH_FOLD_HPP
+#define RNARK_BATCH_FOLD_HPP
+
+#include <functional>
+#include <ostream>
+#include <vector>
+
+#include "primary_structure.hpp"
+#include "secondary_structure.hpp"
+#include "folders/fold_workspace.hpp"
+
+namespace librnary {
+
+/**
+ * Rough relative cost of an MFE fold, for ordering work. Only ratios between estimates mean anything.
+ * Each of the ~n^2/2 cells pays O(n) for multi-loop and coaxial stack decompositions and O(c^2) for two-loops,
+ * where c is the two-loop cap (or n if smaller).
+ * @param n Length of the RNA.
+ * @param max_twoloop_unpaired The folder's MaxTwoLoop().
+ */
+double EstimateFoldCost(size_t n, int max_twoloop_unpaired);
+
+/**
+ * How well a batch of folds was spread over threads.
+ */
+struct BatchReport {
+	size_t threads = 1;
+	size_t items = 0;
+	/// Wall time of the whole batch, in seconds.
+	double makespan = 0;
+	/// Sum of the times of the individual items, in seconds.
+	double total_work = 0;
+	/// Time of the slowest single item, in seconds.
+	double longest_item = 0;
+	/**
+	 * What the makespan would have been had the items been split into one contiguous block per thread in input
+	 * order (as parallel_transform used to), worked out from the measured item times.
+	 */
+	double static_makespan = 0;
+
+	/// Lower bound on the makespan: perfect balance, but no item can be split.
+	double IdealMakespan() const;
+
+	/// IdealMakespan() / makespan. 1 means the threads were never idle before the batch ended.
+	double Efficiency() const;
+};
+
+/// Prints a one line summary of r.
+std::ostream &operator<<(std::ostream &os, const BatchReport &r);
+
+/**
+ * Calls f(i) for every i in [0, costs.size()) on the given number of threads, largest cost first. Each thread
+ * takes the most expensive item left whenever it becomes free (longest processing time scheduling), so one long
+ * RNA does not end up queued behind many short ones. f should write its result into slot i of some output, so
+ * results stay in input order regardless of the order they are computed in.
+ * @param costs Estimated cost of each item, e.g. from EstimateFoldCost.
+ * @return Timings of the batch.
+ */
+BatchReport ScheduleLongestFirst(const std::vector<double> &costs, const std::function<void(size_t)> &f,
+								 size_t threads);
+
+/**
+ * Splits RNAs into groups of at most width RNAs of similar length, for folders that fold a group in lockstep and so
+ * take about as long as folding its longest RNA width times over, like NNAffineBatchFolder. Groups are taken from the
+ * RNAs in order of length, and a group ends early rather than take an RNA more than an eighth longer than its first.
+ * @return The indices into lengths of the RNAs of each group.
+ */
+std::vector<std::vector<size_t>> BucketByLength(const std::vector<size_t> &lengths, size_t width);
+
+/**
+ * Folds every RNA in rnas with a copy of folder, longest first, and returns the traced structures in input order.
+ * Each thread reuses DP table memory across its folds.
+ * @param report If not null, receives the timings of the batch.
+ */
+template<typename FolderT>
+std::vector<Matching> BatchFold(const FolderT &folder, const std::vector<PrimeStructure> &rnas, size_t threads,
+								BatchReport *report = nullptr) {
+	std::vector<double> costs(rnas.size());
+	for (size_t i = 0; i < rnas.size(); ++i)
+		costs[i] = EstimateFoldCost(rnas[i].size(), folder.MaxTwoLoop());
+	std::vector<Matching> res(rnas.size());
+	FoldWorkspacePool workspaces;
+	BatchReport r = ScheduleLongestFirst(costs, [&](size_t i) {
+		FolderT local_folder = folder;
+		FoldWorkspace *ws = workspaces.Acquire();
+		local_folder.SetWorkspace(ws);
+		local_folder.Fold(rnas[i]);
+		res[i] = local_folder.Traceback();
+		workspaces.Release(ws);
+	}, threads);
+	if (report != nullptr)
+		*report = r;
+	return res;
+}
+
+}
+
+#endif //RNARK_BATCH_FOLD_HPP
@@ -8,6 +8,7 @@
 #include "ss_enumeration.hpp"
 #include "ss_tree.hpp"
 
+#include <cmath>
 #include <queue>
 
 namespace librnary {
@@ -96,6 +97,31 @@ public:
 		}
 		return res;
 	}
+	/**
+	 * Returns the partition function of a primary sequence, the sum of exp(-E / kt) over every structure, where E is
+	 * its free energy in kcal/mol and kt is RT in kcal/mol. Uses exhaustive search.
+	 * @param pair_weights If not null, set to an N*N table where [i][j] is the part of the sum from structures that
+	 * pair i with j, so dividing it by the partition function gives the probability of the pair.
+	 */
+	template<typename EnergyModel>
+	double PartitionFunction(EnergyModel &em, const PrimeStructure &primary, kcalmol_t kt,
+							 std::vector<std::vector<double>> *pair_weights = nullptr) {
+		em.SetRNA(primary);
+		if (pair_weights != nullptr)
+			pair_weights->assign(primary.size(), std::vector<double>(primary.size(), 0.0));
+		double z = 0.0;
+		auto f = [&](const Matching &m) {
+			SSTree sstree(m);
+			const double w = std::exp(-EnergyToKCal(em.ScoreExterior(sstree.RootSurface())) / kt);
+			z += w;
+			if (pair_weights != nullptr)
+				for (size_t i = 0; i < m.size(); ++i)
+					if (m[i] != static_cast<int>(i))
+						(*pair_weights)[i][m[i]] += w;
+		};
+		enumer.Enumerate(primary, f);
+		return z;
+	}
 };
 }
 
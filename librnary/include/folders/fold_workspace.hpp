@@ -0,0 +1,118 @@
+#ifndef RNARK_FOLD_WORKSPACE_HPP
+#define RNARK_FOLD_WORKSPACE_HPP
+
+#include <energy.hpp>
+#include <compact_energy.hpp>
+#include <multi_array.hpp>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace librnary {
+/**
+ * Memory for the DP tables of a folder, kept alive across Fold calls. A folder that adopts a workspace (see the
+ * SetWorkspace method of each folder) binds its tables to buffers here instead of allocating them on every fold.
+ * Buffers only ever grow, so once the longest sequence has been folded no further allocation happens, and each fold
+ * only re-initialises the part of each buffer its length actually needs.
+ *
+ * A workspace must only be used by one fold at a time, so give each thread its own (or use FoldWorkspacePool).
+ */
+class FoldWorkspace {
+	std::vector<std::vector<energy_t, AlignedAllocator<energy_t>>> buffers;
+	/// Buffers of the compact tables, handed out in their own order.
+	std::vector<std::vector<CompactEnergy, AlignedAllocator<CompactEnergy>>> compact_buffers;
+	/// Index of the next buffer handed out by Bind, and of the next compact one.
+	size_t next = 0, next_compact = 0;
+	size_t bytes_allocated = 0;
+
+	/// The next buffer of bufs, grown to at least cells elements.
+	template<typename T>
+	T *NextBuffer(std::vector<std::vector<T, AlignedAllocator<T>>> &bufs, size_t &nxt, size_t cells);
+
+public:
+	/**
+	 * Starts a new fold. Tables bound after this reuse the buffers of the previous fold in the same order.
+	 * Any tables bound before this call must no longer be used.
+	 */
+	void Rewind();
+
+	/**
+	 * Binds tbl to the next buffer, growing it if needed, and sets every cell of the n*n triangle to init.
+	 * A band less than n only keeps the cells with j - i < band.
+	 */
+	void Bind(TriangularArray<energy_t> &tbl, size_t n, energy_t init,
+			  size_t band = std::numeric_limits<size_t>::max());
+
+	/// As above, for a table keeping window rows.
+	void Bind(RowWindowArray<energy_t> &tbl, size_t n, size_t window, energy_t init,
+			  size_t band = std::numeric_limits<size_t>::max());
+
+	/// As above, for a column-major table.
+	void Bind(TriangularArray<energy_t, TriangularLayout::ColumnMajor> &tbl, size_t n, energy_t init,
+			  size_t band = std::numeric_limits<size_t>::max());
+
+	/// As above, for compact tables.
+	void Bind(TriangularArray<CompactEnergy> &tbl, size_t n, energy_t init,
+			  size_t band = std::numeric_limits<size_t>::max());
+
+	void Bind(RowWindowArray<CompactEnergy> &tbl, size_t n, size_t window, energy_t init,
+			  size_t band = std::numeric_limits<size_t>::max());
+
+	/// Total bytes this workspace has ever requested from the allocator. Constant once it is warmed up.
+	size_t BytesAllocated() const;
+
+	/// Bytes currently held by the buffers.
+	size_t BytesReserved() const;
+
+	/// Frees every buffer. Tables bound to this workspace must no longer be used.
+	void Release();
+};
+
+/**
+ * Shapes tbl for a fold of length n with every cell set to init. Uses the next buffer of ws if ws is not null,
+ * otherwise tbl owns its memory. This is the single point folders use to set up their tables.
+ * A band less than n only keeps the cells with j - i < band, which folds with a maximum pair span use.
+ */
+void PrepareTable(FoldWorkspace *ws, TriangularArray<energy_t> &tbl, size_t n, energy_t init,
+				  size_t band = std::numeric_limits<size_t>::max());
+
+/// As above, for a table keeping window rows. A window of n or more keeps every row.
+void PrepareTable(FoldWorkspace *ws, RowWindowArray<energy_t> &tbl, size_t n, size_t window, energy_t init,
+				  size_t band = std::numeric_limits<size_t>::max());
+
+/// As above, for a column-major table.
+void PrepareTable(FoldWorkspace *ws, TriangularArray<energy_t, TriangularLayout::ColumnMajor> &tbl, size_t n,
+				  energy_t init, size_t band = std::numeric_limits<size_t>::max());
+
+/// As above, for compact tables.
+void PrepareTable(FoldWorkspace *ws, TriangularArray<CompactEnergy> &tbl, size_t n, energy_t init,
+				  size_t band = std::numeric_limits<size_t>::max());
+
+void PrepareTable(FoldWorkspace *ws, RowWindowArray<CompactEnergy> &tbl, size_t n, size_t window, energy_t init,
+				  size_t band = std::numeric_limits<size_t>::max());
+
+/**
+ * A thread-safe pool of workspaces for running many folds in parallel. Each fold acquires a workspace, and releases
+ * it when it has finished its traceback. The pool grows to the number of folds running at once and no further.
+ */
+class FoldWorkspacePool {
+	std::vector<std::unique_ptr<FoldWorkspace>> all;
+	std::vector<FoldWorkspace *> free_list;
+	mutable std::mutex mtx;
+
+public:
+	/// A workspace not in use by anyone else. Must be handed back with Release.
+	FoldWorkspace *Acquire();
+
+	void Release(FoldWorkspace *ws);
+
+	/// Sum of BytesAllocated over every workspace in the pool.
+	size_t BytesAllocated() const;
+
+	/// Number of workspaces the pool has created.
+	size_t Size() const;
+};
+}
+
+#endif //RNARK_FOLD_WORKSPACE_HPP
@@ -0,0 +1,281 @@
+#ifndef RNARK_LANE_ENERGIES_HPP
+#define RNARK_LANE_ENERGIES_HPP
+
+#include <energy.hpp>
+#include <vector_types.hpp>
+#include <multi_array.hpp>
+#include <secondary_structure.hpp>
+#include <algorithm>
+#include <vector>
+
+namespace librnary {
+
+/// The number of lanes in LaneEnergies, so the number of folds the lane folders do at once.
+const int LaneWidth = 8;
+
+/**
+ * An energy for each of LaneWidth folds done together, e.g. of different RNAs (NNAffineBatchFolder) or under different
+ * parameters (NNAffineParamBatchFolder). The sums and minimums are loops over the lanes, which the compiler turns into
+ * SIMD instructions.
+ */
+struct alignas(32) LaneEnergies {
+	energy_t v[LaneWidth];
+
+	/// Every lane set to e.
+	static LaneEnergies All(energy_t e) {
+		LaneEnergies r;
+		std::fill(r.v, r.v + LaneWidth, e);
+		return r;
+	}
+
+	LaneEnergies operator+(const LaneEnergies &o) const {
+		LaneEnergies r;
+		for (int w = 0; w < LaneWidth; ++w)
+			r.v[w] = v[w] + o.v[w];
+		return r;
+	}
+
+	LaneEnergies operator+(energy_t e) const {
+		LaneEnergies r;
+		for (int w = 0; w < LaneWidth; ++w)
+			r.v[w] = v[w] + e;
+		return r;
+	}
+
+	/// Lowers each lane to that of o, where o's is less.
+	void Min(const LaneEnergies &o) {
+		for (int w = 0; w < LaneWidth; ++w)
+			v[w] = std::min(v[w], o.v[w]);
+	}
+};
+
+/// Which lanes an energy term is needed in.
+struct LaneMask {
+	bool v[LaneWidth];
+};
+
+/// The lane versions of the tables of NNAffineFolder, which FillLaneTables fills.
+struct LaneTables {
+	TriangularArray<LaneEnergies> P, Cx;
+	V<TriangularArray<LaneEnergies>> ML;
+	std::vector<LaneEnergies, AlignedAllocator<LaneEnergies>> E;
+
+	/**
+	 * S[i][j] is P[i][j] plus Branch(i,j), the exterior loop branch closed by (i,j). S5, S3 and SM add its 5'
+	 * dangle, 3' dangle, and terminal mismatch. Multi-loop branches add the multi-loop costs to these.
+	 */
+	TriangularArray<LaneEnergies> S, S5, S3, SM;
+
+	/// Sizes the tables for n nucleotides, keeping the cells of span less than band. Only E starts at 0.
+	void Assign(size_t n, const LaneEnergies &inf, size_t band, bool stacking) {
+		P.Assign(n, inf, band);
+		Cx.Assign(n, inf, band);
+		S.Assign(n, inf, band);
+		ML.resize(3);
+		for (auto &tbl : ML)
+			tbl.Assign(n, inf, band);
+		if (stacking) {
+			S5.Assign(n, inf, band);
+			S3.Assign(n, inf, band);
+			SM.Assign(n, inf, band);
+		} else {
+			S5.Clear();
+			S3.Clear();
+			SM.Clear();
+		}
+		E.assign(n, LaneEnergies::All(0));
+	}
+
+	size_t Bytes() const {
+		size_t bytes = P.Bytes() + Cx.Bytes() + E.size() * sizeof(LaneEnergies) + S.Bytes() + S5.Bytes()
+			+ S3.Bytes() + SM.Bytes();
+		for (const auto &tbl : ML)
+			bytes += tbl.Bytes();
+		return bytes;
+	}
+};
+
+/*
+ * The recursions of NNAffineFolder::FillCell and NNAffineFolder::FillExterior over every lane at once, with
+ * MLSSScore(m, p, q) read as S[p][q] plus the multi-loop branch cost. The lane folders differ in where the energy
+ * terms of the lanes come from, so the recursions take a lane energy source src, which has:
+ *
+ *  - Mask, the type naming the lanes a term is needed in, with Live(j) those whose RNA reaches nucleotide j.
+ *  - Pairable(i, j, mask), which sets mask to the lanes where (i,j) can pair, and returns whether there are any.
+ *  - A function for each term the recursions read, such as OneLoop(mask, i, j), giving the model's term in the lanes
+ *    of mask. FiveDangle, ThreeDangle and Mismatch give 0 where the nucleotide they stack is past the RNA.
+ *  - MLInit(), MLBranch() and MLUnpaired(), the multi-loop costs of the lanes, as LaneEnergies, or as an energy_t
+ *    when every lane has the same.
+ *  - TwoLoops(mask, t, i, j), the best bulge or internal loop closed by (i,j).
+ *  - Store(mask, from, to), which copies the lanes of mask from from to to.
+ *  - PairFilled(mask, t, i, j), called with the live lanes once S[i][j] is filled, for tables of its own.
+ *  - Stacking(), MaxSpan() and InSpan(i, j), the settings of the folder.
+ */
+
+/// Computes the cells of the lane tables at (i,j), which need every cell with a smaller span j - i filled.
+template<typename Source>
+void FillLaneCell(Source &src, LaneTables &t, int i, int j) {
+	const bool stacking = src.Stacking();
+	const auto ml_branch = src.MLBranch(), ml_unpaired = src.MLUnpaired();
+	// The multi-loop costs each decomposition adds, in every lane.
+	const auto branch_unpaired = ml_branch + ml_unpaired, two_unpaired = ml_unpaired + ml_unpaired;
+	const auto branch_two_unpaired = ml_branch + two_unpaired;
+
+	typename Source::Mask pairable;
+	if (src.Pairable(i, j, pairable)) {
+		LaneEnergies best = src.OneLoop(pairable, i, j); // Hairpin.
+		// Multi-loops.
+		const LaneEnergies init = src.Branch(pairable, i, j) + (src.MLInit() + ml_branch);
+		best.Min(init + t.ML[2][i + 1][j - 1]);
+		if (stacking) {
+			if (i + 2 < j - 1) // Left dangle.
+				best.Min(init + t.ML[2][i + 2][j - 1] + ml_unpaired + src.ClosingThreeDangle(pairable, i, j));
+			if (i + 1 < j - 2) // Right dangle.
+				best.Min(init + t.ML[2][i + 1][j - 2] + ml_unpaired + src.ClosingFiveDangle(pairable, i, j));
+			if (i + 2 < j - 2) // Mismatch.
+				best.Min(init + t.ML[2][i + 2][j - 2] + two_unpaired + src.ClosingMismatch(pairable, i, j));
+			// Coaxial stacks with the closing branch.
+			const LaneEnergies init_branch = init + ml_branch, init_branch_two_unpaired = init + branch_two_unpaired;
+			for (int k = i + 1; k < j; ++k) {
+				if (k + 1 < j - 1 && i + 1 < k) // ((_)_)
+					best.Min(t.ML[1][k + 1][j - 1] + t.S[i + 1][k] + init_branch
+								 + src.FlushCoax(pairable, i, j, i + 1, k));
+				if (i + 2 < k && k + 1 < j - 2) // (.(_)_.)
+					best.Min(t.ML[1][k + 1][j - 2] + t.S[i + 2][k] + init_branch_two_unpaired
+								 + src.MismatchCoax(pairable, i, j, i + 2, k));
+				if (i + 2 < k && k + 2 < j - 1) // (.(_)._)
+					best.Min(t.ML[1][k + 2][j - 1] + t.S[i + 2][k] + init_branch_two_unpaired
+								 + src.MismatchCoax(pairable, i + 2, k, i, j));
+				if (i + 1 < k - 1 && k < j - 1) // (_(_))
+					best.Min(t.ML[1][i + 1][k - 1] + t.S[k][j - 1] + init_branch
+								 + src.FlushCoax(pairable, i, j, k, j - 1));
+				if (k < j - 2 && i + 2 < k - 1) // (._(_).)
+					best.Min(t.ML[1][i + 2][k - 1] + t.S[k][j - 2] + init_branch_two_unpaired
+								 + src.MismatchCoax(pairable, i, j, k, j - 2));
+				if (k < j - 2 && i + 1 < k - 2) // (_.(_).)
+					best.Min(t.ML[1][i + 1][k - 2] + t.S[k][j - 2] + init_branch_two_unpaired
+								 + src.MismatchCoax(pairable, k, j - 2, i, j));
+			}
+		}
+		// Bulges and internal loops.
+		best.Min(src.TwoLoops(pairable, t, i, j));
+		src.Store(pairable, best, t.P[i][j]);
+	}
+
+	// The terms that read P[i][j], in every live lane whether or not it can pair here, as NNAffineFolder's sums
+	// include P[i][j] either way.
+	const typename Source::Mask live = src.Live(j);
+	t.S[i][j] = t.P[i][j] + src.Branch(live, i, j);
+	if (stacking) {
+		t.S5[i][j] = t.S[i][j] + src.FiveDangle(live, i, j);
+		t.S3[i][j] = t.S[i][j] + src.ThreeDangle(live, i, j);
+		t.SM[i][j] = t.S[i][j] + src.Mismatch(live, i, j);
+	}
+	src.PairFilled(live, t, i, j);
+
+	// Fill the coaxial stack table if stacking is enabled.
+	const auto two_branch = ml_branch + ml_branch, two_branch_two_unpaired = two_branch + two_unpaired;
+	LaneEnergies best = t.Cx[i][j];
+	for (int k = i + 1; k + 1 < j && stacking; ++k) {
+		best.Min(t.S[i][k] + t.S[k + 1][j] + two_branch + src.FlushCoax(live, i, k, k + 1, j));
+		if (i + 1 < k - 1)
+			best.Min(t.S[i + 1][k - 1] + t.S[k + 1][j] + two_branch_two_unpaired
+					 + src.MismatchCoax(live, i + 1, k - 1, k + 1, j));
+		if (k + 2 < j - 1)
+			best.Min(t.S[i][k] + t.S[k + 2][j - 1] + two_branch_two_unpaired
+					 + src.MismatchCoax(live, k + 2, j - 1, i, k));
+	}
+	t.Cx[i][j] = best;
+
+	// The multi-loop tables only read the tables, and the multi-loop costs of each lane.
+	for (int b = 0; b < 3; ++b) { // b is the branches needed for valid ML.
+		best = t.ML[b][i][j - 1] + ml_unpaired;
+		if (b < 2) { // End on branch cases.
+			best.Min(t.S[i][j] + ml_branch);
+			if (stacking) {
+				if (i + 1 < j) {
+					best.Min(t.S5[i + 1][j] + branch_unpaired);
+					best.Min(t.S3[i][j - 1] + branch_unpaired);
+				}
+				if (i + 1 < j - 1)
+					best.Min(t.SM[i + 1][j - 1] + branch_two_unpaired);
+			}
+		}
+		// End on coaxial stack.
+		if (stacking)
+			best.Min(t.Cx[i][j]);
+		// bprime is the number of branches required after one has been placed.
+		const int bprime = std::max(0, b - 1);
+		const auto ml = t.ML[bprime][i], ml0 = t.ML[0][i];
+		for (int k = i; k + 2 <= j; ++k) { // Try all decompositions into 5' ML fragment and 3' branch.
+			best.Min(ml[k] + t.S[k + 1][j] + ml_branch);
+			// From here on is stacking.
+			if (stacking) {
+				if (k + 2 < j)
+					best.Min(ml[k] + t.S5[k + 2][j] + branch_unpaired);
+				if (k + 1 < j - 1)
+					best.Min(ml[k] + t.S3[k + 1][j - 1] + branch_unpaired);
+				if (k + 2 < j - 1)
+					best.Min(ml[k] + t.SM[k + 2][j - 1] + branch_two_unpaired);
+				// Coaxial stack decomposition.
+				best.Min(ml0[k] + t.Cx[k + 1][j]);
+			}
+		}
+		t.ML[b][i][j] = best;
+	}
+}
+
+/// Fills the exterior loop table of every lane, given the other tables.
+template<typename Source>
+void FillLaneExterior(Source &src, LaneTables &t) {
+	const bool stacking = src.Stacking();
+	const int max_span = src.MaxSpan();
+	const auto N = static_cast<int>(t.E.size());
+	const LaneEnergies zero = LaneEnergies::All(0);
+	for (int i = 1; i < N; ++i) {
+		const typename Source::Mask live = src.Live(i);
+		LaneEnergies best = t.E[i - 1];
+		// As NNAffineFolder::FillExterior, with SSScore(m, p, q) read as S[p][q].
+		for (int k = std::max(-1, i - ExteriorReach(max_span, stacking)); k < i; ++k) {
+			const LaneEnergies &decomp = k == -1 ? zero : t.E[k];
+			if (src.InSpan(k + 1, i))
+				best.Min(decomp + t.S[k + 1][i]);
+			if (stacking) {
+				if (k + 2 < i && src.InSpan(k + 2, i))
+					best.Min(decomp + t.S5[k + 2][i]);
+				if (k + 1 < i - 1 && src.InSpan(k + 1, i - 1))
+					best.Min(decomp + t.S3[k + 1][i - 1]);
+				if (k + 2 < i - 1 && src.InSpan(k + 2, i - 1))
+					best.Min(decomp + t.SM[k + 2][i - 1]);
+				// Coaxial stack decompositions.
+				for (int j = std::max(k + 1, i - max_span - 3); j + 1 < i && j - k <= max_span + 3; ++j) {
+					if (k + 1 < j && src.InSpan(k + 1, j) && src.InSpan(j + 1, i))
+						best.Min(decomp + t.S[k + 1][j] + t.S[j + 1][i] + src.FlushCoax(live, k + 1, j, j + 1, i));
+					if (k + 2 < j - 1 && src.InSpan(k + 2, j - 1) && src.InSpan(j + 1, i))
+						best.Min(decomp + t.S[k + 2][j - 1] + t.S[j + 1][i]
+									 + src.MismatchCoax(live, k + 2, j - 1, j + 1, i));
+					if (k + 1 < j && j + 2 < i - 1 && src.InSpan(k + 1, j) && src.InSpan(j + 2, i - 1))
+						best.Min(decomp + t.S[k + 1][j] + t.S[j + 2][i - 1]
+									 + src.MismatchCoax(live, j + 2, i - 1, k + 1, j));
+				}
+			}
+		}
+		t.E[i] = best;
+	}
+}
+
+/// Fills the lane tables, sized by LaneTables::Assign for n nucleotides, with the energies of src.
+template<typename Source>
+void FillLaneTables(Source &src, LaneTables &t, int n) {
+	// Special base for for ML. End on a single unpaired.
+	for (int i = 0; i < n; ++i)
+		t.ML[0][i][i] = LaneEnergies::All(0) + src.MLUnpaired();
+	for (int i = n - 2; i >= 0; --i)
+		for (int j = i + 1; j < n && src.InSpan(i, j); ++j)
+			FillLaneCell(src, t, i, j);
+	FillLaneExterior(src, t);
+}
+
+}
+
+#endif //RNARK_LANE_ENERGIES_HPP
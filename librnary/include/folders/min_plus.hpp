@@ -0,0 +1,45 @@
+#ifndef RNARK_MIN_PLUS_HPP
+#define RNARK_MIN_PLUS_HPP
+
+#include <energy.hpp>
+
+namespace librnary {
+
+/// The implementations of MinPlus, from slowest to fastest.
+enum class MinPlusKernel {
+	/// Portable C++. Always supported.
+	Scalar,
+	/// 4 cells at a time, on x86 CPUs with SSE4.1.
+	SSE41,
+	/// 16 cells at a time, on x86 CPUs with AVX2.
+	AVX2
+};
+
+/**
+ * The min-plus product of a row and a column, min(init, a[0] + b[0], ..., a[n-1] + b[n-1]). The split decompositions
+ * of the multi-loop fills are these products of a row of an ML table with a column of a folder's column-major shadow
+ * of its branch terms, so both are contiguous.
+ *
+ * Runs the kernel chosen with SetMinPlusKernel, by default the fastest one the CPU supports, found at run time. Every
+ * kernel gives the same result. The sums must not overflow, which they do not for energies below MaxMFE.
+ */
+energy_t MinPlus(const energy_t *a, const energy_t *b, int n, energy_t init);
+
+/// Whether the CPU running the program supports kernel k.
+bool MinPlusKernelSupported(MinPlusKernel k);
+
+/**
+ * Makes MinPlus run kernel k, or the fastest supported kernel slower than k if the CPU does not support it.
+ * For benchmarks and tests. Applies to every thread, so must not be called while folds are running.
+ */
+void SetMinPlusKernel(MinPlusKernel k);
+
+/// The kernel MinPlus runs.
+MinPlusKernel ActiveMinPlusKernel();
+
+/// The name of k, e.g. "AVX2".
+const char *MinPlusKernelName(MinPlusKernel k);
+
+}
+
+#endif //RNARK_MIN_PLUS_HPP
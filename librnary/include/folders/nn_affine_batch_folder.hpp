@@ -0,0 +1,83 @@
+#ifndef RNARK_NN_AFFINE_BATCH_FOLDER_HPP
+#define RNARK_NN_AFFINE_BATCH_FOLDER_HPP
+
+#include <folders/nn_affine_folder.hpp>
+#include <folders/lane_energies.hpp>
+
+namespace librnary {
+
+/**
+ * Folds up to Width RNAs at once with the recursions of NNAffineFolder, one RNA in each lane. Every cell of the tables
+ * holds the energies of all the lanes side by side, so the sums and minimums of the fill are done for every lane
+ * together, in loops the compiler turns into SIMD instructions. Energy terms that depend on the sequence are looked up
+ * separately in each lane, from a model with that lane's RNA loaded, and only in the lanes that need them.
+ *
+ * So that the inner loops need few lookups, the folder also keeps, for each pair (i,j), the energy of the branch it
+ * closes with each choice of dangles, and with the term of each split two-loop shape (see TwoLoopShape) it can be the
+ * inner pair of. The loops over multi-loop splits, and over most bulges and internal loops, then only read tables.
+ *
+ * The MFE and traceback of each RNA are identical to those of NNAffineFolder with the same settings. The RNAs need
+ * not be the same length, but the fill runs to the end of the longest, so lanes of similar lengths (see
+ * BucketByLength) waste little. Fills serially, and does not keep the exterior coaxial stack table, so has no
+ * Suboptimal.
+ */
+class NNAffineBatchFolder : protected NNAffineFolder {
+public:
+	/// The number of RNAs folded at once.
+	static const int Width = LaneWidth;
+
+private:
+	typedef DevirtualizedModel<NNAffineModel> LaneModel;
+
+	/// The lane versions of the tables of NNAffineFolder.
+	LaneTables lanes;
+
+	/// TL[s][k][l] is P[k][l] plus the inner pair term of a two-loop of shape s + 1 closed inside by (k,l).
+	V<TriangularArray<LaneEnergies>> TL;
+
+	/// The RNAs of the last Fold, and a model with each loaded.
+	std::vector<PrimeStructure> rnas;
+	std::vector<LaneModel> models;
+
+	/// live[j] has the lanes whose RNA reaches nucleotide j.
+	std::vector<LaneMask> live;
+
+	/// The energies f(m) from the model m of each lane in mask, and 0 in the other lanes.
+	template<typename F>
+	LaneEnergies Lookup(const LaneMask &mask, const F &f) const;
+
+	/// The lane energy source of FillLaneTables, which looks up each lane's terms in the model of its RNA.
+	struct Source;
+
+public:
+	using NNAffineFolder::SetMaxTwoLoop;
+	using NNAffineFolder::MaxTwoLoop;
+	using NNAffineFolder::SetStacking;
+	using NNAffineFolder::Stacking;
+	using NNAffineFolder::SetLonelyPairs;
+	using NNAffineFolder::LonelyPairs;
+	using NNAffineFolder::SetMaxSpan;
+	using NNAffineFolder::MaxSpan;
+	using NNAffineFolder::SetModel;
+
+	explicit NNAffineBatchFolder(const NNAffineModel &_em);
+
+	/// Takes the model and settings of folder.
+	explicit NNAffineBatchFolder(const NNAffineFolder &folder);
+
+	/**
+	 * Folds up to Width RNAs together.
+	 * @return The MFE of each RNA, in order.
+	 */
+	std::vector<energy_t> Fold(const std::vector<PrimeStructure> &_rnas);
+
+	/// Trace back an MFE structure of the RNA in the given lane of the last Fold.
+	Matching Traceback(size_t lane);
+
+	/// Bytes of lane table memory used by the last Fold.
+	size_t TableBytes() const;
+};
+
+}
+
+#endif //RNARK_NN_AFFINE_BATCH_FOLDER_HPP
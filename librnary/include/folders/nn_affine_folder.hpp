@@ -6,9 +6,18 @@
 #define RNARK_NN_AFFINE_FOLDER_HPP
 
 #include <models/nn_affine_model.hpp>
+#include <models/devirtualized_model.hpp>
 #include <energy.hpp>
 #include <vector_types.hpp>
+#include <multi_array.hpp>
+#include <parallel.hpp>
+#include <folders/fold_workspace.hpp>
+#include <folders/min_plus.hpp>
 #include <stack>
+#include <memory>
+#include <functional>
+#include <tuple>
+#include <utility>
 
 namespace librnary {
 /**
@@ -17,6 +26,10 @@ namespace librnary {
  * stable stem for a single nucleotide bulge.
  */
 class NNAffineFolder {
+public:
+	/// Called with each structure Suboptimal finds, and its energy. Returning false stops the enumeration.
+	typedef std::function<bool(energy_t, const Matching &)> SuboptimalVisitor;
+
 protected:
 	PrimeStructure rna;
 	NNAffineModel em;
@@ -24,31 +37,46 @@ protected:
 	/**
 	 * The 'Paired' table. P[i][j] is the optimal substructure closed by a pair i,j.
 	 */
-	VVE P;
+	TriangularArray<energy_t> P;
 
 	/**
 	 * The 'Multi-Loop' table. ML[b][i][j] is the optimal part of the multi-loop that definitely has
-	 * at least b branches.
+	 * at least b branches. ML[0] is only read in the row being filled, and ML[2] at most two rows below it, so
+	 * energy-only folds keep just those rows of them.
 	 */
-	VVVE ML;
+	V<RowWindowArray<energy_t>> ML;
 
 	/**
 	 * The 'Coaxial stack' table. Cx[i][j] is the optimal multi-loop coaxial stack such that one branch starts at i,
 	 * and the other branch ends at j. Note that it is assumed that these branches are in a multi-loop. This table will
 	 * count the unpaired cost.
 	 */
-	VVE Cx;
+	TriangularArray<energy_t> Cx;
+
+	/**
+	 * Column-major shadows of the terms the ML fill adds to a 5' ML fragment, so that the fill's split decompositions
+	 * read a contiguous column, as MinPlus needs. MLBrCol(i,j) is the optimal multi-loop branch covering exactly
+	 * i..j, with any dangles or terminal mismatch, and CxCol(i,j) is Cx[i][j]. Both are written by FillCell(i,j).
+	 * Energy-only folds keep neither, and try each split in turn.
+	 */
+	TriangularArray<energy_t, TriangularLayout::ColumnMajor> MLBrCol, CxCol;
 
 	/**
 	 * The 'External loop' table. E[i] is the optimal external loop fragment 0..i.
 	 */
 	VE E;
 
+	/**
+	 * The 'Exterior coaxial stack' table. X[i][j] is the optimal coaxial stack of two exterior loop branches covering
+	 * i..j. Only filled for Suboptimal and NNAffineScanner, which take the exterior loop apart a branch at a time.
+	 */
+	TriangularArray<energy_t> X;
+
 	/**
 	 * Represents a particular table during a traceback.
 	 */
 	enum Table {
-		ET, PT, MLT, CxT
+		ET, PT, MLT, CxT, XT
 	};
 
 	/**
@@ -96,9 +124,43 @@ protected:
 	 */
 	void TraceML(std::stack<TState> &s);
 
+	/// The DP table entry of a trace state.
+	energy_t TableValue(const TState &s) const;
+
+	/// A key unique to each trace state of an RNA, for hashing.
+	static uint64_t StateKey(const TState &s);
+
+	/**
+	 * Calls f(e, children) for every decomposition of a trace state, where e is the energy of the decomposition
+	 * itself and children are the states left to decompose, so the state's table entry is the least e plus the entries
+	 * of its children. The Trace functions take the best of these. Only reads the tables to find the exterior loop
+	 * cells within the span, so other recursions over the same grammar, like NNAffinePFFolder, can use it too.
+	 * Defined below the class, as the callbacks come from other translation units.
+	 */
+	template<typename ModelT, typename F>
+	void Decompositions(const ModelT &m, const TState &s, const F &f) const;
+
+	/**
+	 * Whether a traceback of match is its canonical one. With stacking, a structure has a traceback for each choice of
+	 * dangles and coaxial stacks. Its canonical traceback takes, at each state, the first decomposition (in the order
+	 * of Decompositions) that derives match with the least energy, so each structure has exactly one, and it has the
+	 * structure's best stacking. Keeps a table of the states that can derive match while checking.
+	 * @param steps Each state the traceback decomposed, and the index of the decomposition it took.
+	 */
+	template<typename ModelT>
+	bool IsCanonicalTraceback(const ModelT &m, const Matching &match,
+							  const std::vector<std::pair<TState, int>> &steps) const;
+
+	/// A Suboptimal enumeration in progress.
+	template<typename ModelT>
+	struct SuboptimalSearch;
+
 	/// This flag toggles whether lonely pairs are allowed.
 	bool lonely_pairs = true;
 
+	/// Workspace the DP tables live in. Null means the folder owns its tables.
+	FoldWorkspace *workspace = nullptr;
+
 
 	/// This flag toggles whether stacking interactions (dangles, terminal mismatch, and coaxial stacking) are used.
 	bool stacking = true;
@@ -106,17 +168,53 @@ protected:
 	/// The maximum number of unpaired in a bulge or internal loop.
 	int max_twoloop_unpaired = std::numeric_limits<int>::max() / 3;
 
+	/// Whether Fold fills the tables through DevirtualizedModel rather than the model's virtual interface.
+	bool static_dispatch = true;
+
+	/// Threads that fill the tables. Null means the fill runs serially on the calling thread.
+	std::shared_ptr<ThreadPool> pool;
+
+	/// Whether Fold only keeps the table rows needed to compute the MFE, leaving nothing to trace back through.
+	bool energy_only = false;
+
+	/// The maximum j - i of a base pair (i,j). The 2D tables only keep cells within this span.
+	int max_span = std::numeric_limits<int>::max() / 3;
+
+	/// Whether (i,j) is within the maximum span, so its cells are stored.
+	bool InSpan(int i, int j) const {
+		return j - i <= max_span;
+	}
+
+	/// Whether (i,j) may pair under the current settings, so P[i][j] is filled. Every other P cell stays infinite.
+	bool CanPair(int i, int j) const {
+		return ValidPair(rna[i], rna[j]) && (lonely_pairs || !MustBeLonelyPair(rna, i, j, em.MIN_HAIRPIN_UNPAIRED));
+	}
+
+	/*
+	 * The helpers below, and Fill, are templates over the energy model so the fill loops can be instantiated with
+	 * either NNAffineModel or DevirtualizedModel<NNAffineModel>. The traceback uses em directly.
+	 */
+
 	/**
 	 * The optimal sub-surface score of the structure closed by (i,j). Designed for external-loop branches.
 	 * Accounts for AU/GU penalty.
 	 */
-	energy_t SSScore(int i, int j) const;
+	template<typename ModelT>
+	energy_t SSScore(const ModelT &m, int i, int j) const;
 
 	/**
 	 * The optimal sub-surface score of the structure closed by (i,j) in a multi-loop.
 	 * Accounts for AU/GU penalty, and multi-loop branch cost.
 	 */
-	virtual energy_t MLSSScore(int i, int j) const;
+	template<typename ModelT>
+	energy_t MLSSScore(const ModelT &m, int i, int j) const;
+
+	/**
+	 * The optimal multi-loop branch covering exactly i..j, with any dangles or terminal mismatch. These are the end on
+	 * branch cases of the ML table.
+	 */
+	template<typename ModelT>
+	energy_t MLBranchScore(const ModelT &m, int i, int j) const;
 
 	/**
 	 * Computes Multi-loop closure free energy change. Also includes the cost of the closing branch.
@@ -124,10 +222,80 @@ protected:
 	 * @param j 3' nucleotide of closing pair for multi-loop.
 	 * @return The free energy change of multi-loop closure.
 	 */
-	virtual energy_t MLClosingBranchScore(int i, int j) const;
+	template<typename ModelT>
+	energy_t MLClosingBranchScore(const ModelT &m, int i, int j) const;
+
+	/// Computes P[i][j], for a pair (i,j) that CanPair. Requires every cell with a smaller span j - i to be filled.
+	template<typename ModelT>
+	void FillPaired(const ModelT &m, int i, int j);
+
+	/**
+	 * Computes P[i][j], Cx[i][j] and ML[b][i][j] for all b. Requires every cell with a smaller span j - i to be
+	 * filled already.
+	 */
+	template<typename ModelT>
+	void FillCell(const ModelT &m, int i, int j);
+
+	/**
+	 * The optimal coaxial stack of two exterior loop branches covering i..j, the entry of X.
+	 * @param branches If not null, set to the pairs closing the two branches.
+	 */
+	template<typename ModelT>
+	energy_t ExteriorCoax(const ModelT &m, int i, int j, std::vector<TState> *branches) const;
+
+	/// Fills X for the RNA of the last Fold, with the cells the exterior loop can use.
+	template<typename ModelT>
+	void FillExteriorCoax(const ModelT &m);
+
+	/// Suboptimal with the given energy model, which has the RNA of the last Fold loaded.
+	template<typename ModelT>
+	size_t Suboptimal(const ModelT &m, energy_t delta, const SuboptimalVisitor &visit);
+
+	/// TracebackKBest with the given energy model, which has the RNA of the last Fold loaded.
+	template<typename ModelT>
+	std::vector<std::tuple<energy_t, Matching>> TracebackKBest(const ModelT &m, size_t k);
+
+	/**
+	 * Fills E[i] for every i >= from, given the other tables and E below from.
+	 */
+	template<typename ModelT>
+	void FillExterior(const ModelT &m, int from);
+
+	/**
+	 * Fills the DP tables, which must already be sized, and returns the MFE.
+	 * @param m The energy model, with the current RNA loaded.
+	 */
+	template<typename ModelT>
+	energy_t Fill(const ModelT &m);
+
+	/// Refills the cells (i,j) with i <= row_hi and j >= col_lo, then E from col_lo.
+	template<typename ModelT>
+	void Refill(const ModelT &m, int row_hi, int col_lo);
+
+	/**
+	 * Applies the mutations to rna and em, and refills every cell they can change, with E from the first such
+	 * position. Returns the MFE. Used by FoldMutants on copies of a folded folder.
+	 */
+	energy_t Refold(const std::vector<PointMutation> &mutations);
+
+	/**
+	 * Finds the cells that may depend on mutations at positions lo..hi of rna, which are those (i,j) with
+	 * i <= row_hi and j >= col_lo. Only the nucleotides outside lo..hi are read.
+	 */
+	void MutatedRegion(int lo, int hi, int &row_hi, int &col_lo) const;
+
+	/// A folder with the model and settings of folder, but none of its tables, workspace or threads.
+	static NNAffineFolder SettingsOf(const NNAffineFolder &folder);
 
 public:
 
+	/**
+	 * Stores the DP tables in ws instead of memory owned by the folder, so they are not reallocated on every fold.
+	 * The tables stay valid until ws is next used, so ws must not be shared by folders running at the same time.
+	 * Note that copies of the folder share the workspace. Pass nullptr to go back to owned tables.
+	 */
+	void SetWorkspace(FoldWorkspace *ws);
+
 	/// Set the max unpaired nucleotides in a bulge/internal loop.
 	void SetMaxTwoLoop(unsigned max_up);
 
@@ -142,8 +310,85 @@ public:
 
 	bool LonelyPairs() const;
 
+	/**
+	 * Chooses how the fill loops reach the energy model. When on (the default) they are compiled against
+	 * DevirtualizedModel so energy terms are inlined. When off they go through the model's virtual functions.
+	 * The results are identical.
+	 */
+	void SetStaticDispatch(bool v);
+
+	bool StaticDispatch() const;
+
+	/**
+	 * Sets the number of threads used to fill the DP tables. With more than one, cells are filled an anti-diagonal
+	 * (cells of equal span j - i) at a time, spread over a pool of threads kept for the life of the folder.
+	 * The results are identical to the serial fill. Copies of the folder share the pool, and folds from different
+	 * copies take turns using it. Defaults to 1.
+	 */
+	void SetThreads(size_t threads);
+
+	size_t Threads() const;
+
+	/**
+	 * Toggles energy-only folding. When on, Fold keeps only the rows of the multi-loop tables that the fill can
+	 * still read, and always fills serially. The MFE is identical, but Traceback throws. Defaults to off.
+	 */
+	void SetEnergyOnly(bool v);
+
+	bool EnergyOnly() const;
+
+	/**
+	 * Only allows base pairs (i,j) with j - i <= span. The DP tables are then banded, so a fold takes O(N*span^2)
+	 * time and O(N*span) memory instead of O(N^3) and O(N^2). Defaults to unlimited.
+	 */
+	void SetMaxSpan(unsigned span);
+
+	int MaxSpan() const;
+
+	/// Bytes of DP table memory used by the last Fold. The tables are allocated up front, so this is also the peak.
+	size_t TableBytes() const;
+
 	energy_t Fold(const PrimeStructure &_rna);
 
+	/**
+	 * Visits every structure within delta of the MFE of the last Fold, which must not have been energy-only. Follows
+	 * each decomposition of the DP tables that can still finish within delta, depth first (Wuchty et al., 1999), so
+	 * the memory used is linear in the length of the RNA. With stacking, a structure can be reached through several
+	 * choices of dangles and coaxial stacks, so it is only visited when reached through its canonical traceback (see
+	 * IsCanonicalTraceback), once, with the energy of its best stacking. Checking this takes a table of the states
+	 * that can derive the structure, which is freed before the next one.
+	 * @return The number of structures visited.
+	 * @throws std::logic_error If the last Fold was energy-only.
+	 */
+	size_t Suboptimal(energy_t delta, const SuboptimalVisitor &visit);
+
+	/**
+	 * Returns the k lowest free energy structures of the RNA of the last Fold, which must not have been energy-only,
+	 * best first, with their energies (or all of them, if there are fewer). Searches partial tracebacks through the
+	 * tables best first with a priority queue. The tables give the lowest energy each partial traceback can finish
+	 * with exactly, so only the tracebacks leading to the k structures are extended. Each step of the search extends
+	 * one traceback and queues its next alternative, sharing the rest of the traceback with its parent. With stacking,
+	 * a structure can be reached through several stackings, and is only returned when reached through its canonical
+	 * traceback (see IsCanonicalTraceback), once, with its best. Memory is linear in the steps taken, which are about
+	 * N for each traceback finished, including those of the other stackings of the structures returned. Each state
+	 * reached also keeps its ranked decompositions: O(N) for exterior and multi-loop states, and for a pair up to one
+	 * per bulge and internal loop it closes, O(N^2), or O(L^2) for a maximum of L unpaired in them.
+	 * @throws std::logic_error If the last Fold was energy-only.
+	 */
+	std::vector<std::tuple<energy_t, Matching>> TracebackKBest(size_t k);
+
+	/**
+	 * Folds variants of the RNA of the last Fold, each given by the point mutations that make it, and returns their
+	 * MFEs in order. A cell only depends on the nucleotides of its subsequence, and those just outside it read by the
+	 * lonely pair check and the GU closure bonus, so only the cells covering a mutation are refilled. The rest are
+	 * reused from the last Fold, which must not have been energy-only. Variants are spread over the folder's threads.
+	 * The folder's own tables are left as they were.
+	 * @param structures If not null, set to the MFE structure of each variant.
+	 * @throws std::logic_error If the last Fold was energy-only.
+	 */
+	std::vector<energy_t> FoldMutants(const std::vector<std::vector<PointMutation>> &variants,
+									  std::vector<Matching> *structures = nullptr);
+
 	/**
 	 * Note that this method may make the previous call to fold invalid, as it will still assume the old model.
 	 * @param _em Sets the model to use internally to this.
@@ -153,6 +398,7 @@ public:
 	/**
 	 * Trace back through the DP tables and produce a MFE secondary structure.
 	 * @return The traced secondary structure.
+	 * @throws std::logic_error If the last Fold was energy-only, as the multi-loop tables no longer hold every row.
 	 */
 	Matching Traceback();
 
@@ -161,6 +407,141 @@ public:
 
 };
 
+template<typename ModelT, typename F>
+void NNAffineFolder::Decompositions(const ModelT &m, const TState &s, const F &f) const {
+	const int i = s.i, j = s.j;
+	// The energy of a multi-loop branch closed by (bi,bj), outside the substructure it closes.
+	auto ml_branch = [&](int bi, int bj) {
+		return m.Branch(bi, bj) + m.MLBranchCost();
+	};
+	if (s.t == ET) {
+		if (i == 0) {
+			f(0, {});
+			return;
+		}
+		f(0, {TState(i - 1)}); // Unpaired 3'.
+		// Branches ending at i, after the fragment 0..k.
+		auto after = [&](int k, energy_t e, TState a) {
+			if (k == -1)
+				f(e, {a});
+			else
+				f(e, {a, TState(k)});
+		};
+		for (int k = std::max(-1, i - ExteriorReach(max_span, stacking)); k < i; ++k) {
+			if (InSpan(k + 1, i))
+				after(k, m.Branch(k + 1, i), TState(PT, k + 1, i));
+			if (!stacking)
+				continue;
+			if (k + 2 < i && InSpan(k + 2, i))
+				after(k, m.Branch(k + 2, i) + m.FiveDangle(k + 2, i), TState(PT, k + 2, i));
+			if (k + 1 < i - 1 && InSpan(k + 1, i - 1))
+				after(k, m.Branch(k + 1, i - 1) + m.ThreeDangle(k + 1, i - 1), TState(PT, k + 1, i - 1));
+			if (k + 2 < i - 1 && InSpan(k + 2, i - 1))
+				after(k, m.Branch(k + 2, i - 1) + m.Mismatch(k + 2, i - 1), TState(PT, k + 2, i - 1));
+			if (k + 2 < i) // Coaxial stack.
+				after(k, 0, TState(XT, k + 1, i));
+		}
+	} else if (s.t == XT) {
+		for (int k = std::max(i, j - max_span - 3); k + 1 < j && k <= i + max_span + 2; ++k) {
+			if (i < k && InSpan(i, k) && InSpan(k + 1, j))
+				f(m.FlushCoax(i, k, k + 1, j) + m.Branch(i, k) + m.Branch(k + 1, j),
+				  {TState(PT, i, k), TState(PT, k + 1, j)});
+			if (i + 1 < k - 1 && InSpan(i + 1, k - 1) && InSpan(k + 1, j))
+				f(m.MismatchCoax(i + 1, k - 1, k + 1, j) + m.Branch(i + 1, k - 1) + m.Branch(k + 1, j),
+				  {TState(PT, i + 1, k - 1), TState(PT, k + 1, j)});
+			if (i < k && k + 2 < j - 1 && InSpan(i, k) && InSpan(k + 2, j - 1))
+				f(m.MismatchCoax(k + 2, j - 1, i, k) + m.Branch(i, k) + m.Branch(k + 2, j - 1),
+				  {TState(PT, i, k), TState(PT, k + 2, j - 1)});
+		}
+	} else if (s.t == PT) {
+		f(m.OneLoop(i, j), {}); // Hairpin.
+		const energy_t init = m.MLInitCost() + m.Branch(i, j) + m.MLBranchCost(); // As MLClosingBranchScore.
+		f(init, {TState(MLT, 2, i + 1, j - 1)});
+		if (stacking) {
+			if (i + 2 < j - 1) // Left dangle.
+				f(init + m.ClosingThreeDangle(i, j) + m.MLUnpairedCost(), {TState(MLT, 2, i + 2, j - 1)});
+			if (i + 1 < j - 2) // Right dangle.
+				f(init + m.ClosingFiveDangle(i, j) + m.MLUnpairedCost(), {TState(MLT, 2, i + 1, j - 2)});
+			if (i + 2 < j - 2) // Mismatch.
+				f(init + m.ClosingMismatch(i, j) + m.MLUnpairedCost() * 2, {TState(MLT, 2, i + 2, j - 2)});
+			// Coaxial stacks with the closing branch.
+			for (int k = i + 1; k < j; ++k) {
+				if (k + 1 < j - 1 && i + 1 < k) // ((_)_)
+					f(init + m.FlushCoax(i, j, i + 1, k) + ml_branch(i + 1, k),
+					  {TState(MLT, 1, k + 1, j - 1), TState(PT, i + 1, k)});
+				if (i + 2 < k && k + 1 < j - 2) // (.(_)_.)
+					f(init + m.MismatchCoax(i, j, i + 2, k) + ml_branch(i + 2, k) + m.MLUnpairedCost() * 2,
+					  {TState(MLT, 1, k + 1, j - 2), TState(PT, i + 2, k)});
+				if (i + 2 < k && k + 2 < j - 1) // (.(_)._)
+					f(init + m.MismatchCoax(i + 2, k, i, j) + ml_branch(i + 2, k) + m.MLUnpairedCost() * 2,
+					  {TState(MLT, 1, k + 2, j - 1), TState(PT, i + 2, k)});
+				if (i + 1 < k - 1 && k < j - 1) // (_(_))
+					f(init + m.FlushCoax(i, j, k, j - 1) + ml_branch(k, j - 1),
+					  {TState(MLT, 1, i + 1, k - 1), TState(PT, k, j - 1)});
+				if (k < j - 2 && i + 2 < k - 1) // (._(_).)
+					f(init + m.MismatchCoax(i, j, k, j - 2) + ml_branch(k, j - 2) + m.MLUnpairedCost() * 2,
+					  {TState(MLT, 1, i + 2, k - 1), TState(PT, k, j - 2)});
+				if (k < j - 2 && i + 1 < k - 2) // (_.(_).)
+					f(init + m.MismatchCoax(k, j - 2, i, j) + ml_branch(k, j - 2) + m.MLUnpairedCost() * 2,
+					  {TState(MLT, 1, i + 1, k - 2), TState(PT, k, j - 2)});
+			}
+		}
+		// Bulges and internal loops.
+		for (int k = i + 1; k + 1 < j && (k - i - 1) <= max_twoloop_unpaired; ++k)
+			for (int l = j - 1; l > k && (j - l - 1) + (k - i - 1) <= max_twoloop_unpaired; --l)
+				f(m.TwoLoop(i, k, l, j), {TState(PT, k, l)});
+	} else if (s.t == CxT) {
+		for (int k = i + 1; k + 1 < j; ++k) {
+			f(m.FlushCoax(i, k, k + 1, j) + ml_branch(i, k) + ml_branch(k + 1, j),
+			  {TState(PT, i, k), TState(PT, k + 1, j)});
+			if (i + 1 < k - 1)
+				f(m.MismatchCoax(i + 1, k - 1, k + 1, j) + ml_branch(i + 1, k - 1) + ml_branch(k + 1, j)
+					  + m.MLUnpairedCost() * 2, {TState(PT, i + 1, k - 1), TState(PT, k + 1, j)});
+			if (k + 2 < j - 1)
+				f(m.MismatchCoax(k + 2, j - 1, i, k) + ml_branch(i, k) + ml_branch(k + 2, j - 1)
+					  + m.MLUnpairedCost() * 2, {TState(PT, i, k), TState(PT, k + 2, j - 1)});
+		}
+	} else { // MLT
+		const int b = s.extra;
+		if (i == j) {
+			if (b == 0)
+				f(m.MLUnpairedCost(), {});
+			return;
+		}
+		f(m.MLUnpairedCost(), {TState(MLT, b, i, j - 1)}); // Unpaired on the right.
+		if (b < 2) { // End on a branch.
+			f(ml_branch(i, j), {TState(PT, i, j)});
+			if (stacking) {
+				if (i + 1 < j) {
+					f(ml_branch(i + 1, j) + m.FiveDangle(i + 1, j) + m.MLUnpairedCost(), {TState(PT, i + 1, j)});
+					f(ml_branch(i, j - 1) + m.ThreeDangle(i, j - 1) + m.MLUnpairedCost(), {TState(PT, i, j - 1)});
+				}
+				if (i + 1 < j - 1)
+					f(ml_branch(i + 1, j - 1) + m.Mismatch(i + 1, j - 1) + m.MLUnpairedCost() * 2,
+					  {TState(PT, i + 1, j - 1)});
+			}
+		}
+		if (stacking) // End on a coaxial stack.
+			f(0, {TState(CxT, i, j)});
+		const int bprime = std::max(0, b - 1);
+		for (int k = i; k + 2 <= j; ++k) { // A 5' fragment and a 3' branch.
+			const TState rest(MLT, bprime, i, k);
+			f(ml_branch(k + 1, j), {rest, TState(PT, k + 1, j)});
+			if (!stacking)
+				continue;
+			if (k + 2 < j)
+				f(ml_branch(k + 2, j) + m.FiveDangle(k + 2, j) + m.MLUnpairedCost(), {rest, TState(PT, k + 2, j)});
+			if (k + 1 < j - 1)
+				f(ml_branch(k + 1, j - 1) + m.ThreeDangle(k + 1, j - 1) + m.MLUnpairedCost(),
+				  {rest, TState(PT, k + 1, j - 1)});
+			if (k + 2 < j - 1)
+				f(ml_branch(k + 2, j - 1) + m.Mismatch(k + 2, j - 1) + m.MLUnpairedCost() * 2,
+				  {rest, TState(PT, k + 2, j - 1)});
+			f(0, {TState(MLT, 0, i, k), TState(CxT, k + 1, j)});
+		}
+	}
+}
+
 }
 
 #endif //RNARK_NN_AFFINE_FOLDER_HPP
\ No newline at end of file
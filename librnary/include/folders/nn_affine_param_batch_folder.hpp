@@ -0,0 +1,79 @@
+#ifndef RNARK_NN_AFFINE_PARAM_BATCH_FOLDER_HPP
+#define RNARK_NN_AFFINE_PARAM_BATCH_FOLDER_HPP
+
+#include <folders/nn_affine_folder.hpp>
+#include <folders/lane_energies.hpp>
+
+namespace librnary {
+
+/**
+ * Folds one RNA under up to Width sets of multi-loop parameters at once with the recursions of NNAffineFolder, one
+ * parameter set in each lane. This is the fold IBF training repeats most, as its parameter sets only change the
+ * multi-loop costs. Every energy term but the multi-loop costs is the same in every lane, so is looked up once per
+ * cell and added to all the lanes, while the sums and minimums are done for every lane together, in loops the compiler
+ * turns into SIMD instructions.
+ *
+ * The MFE and traceback under each parameter set are identical to those of NNAffineFolder, with the same settings and
+ * the model's multi-loop parameters set to those of the lane. Fills serially, and does not keep the exterior coaxial
+ * stack table, so has no Suboptimal.
+ */
+class NNAffineParamBatchFolder : protected NNAffineFolder {
+public:
+	/// The number of parameter sets folded under at once.
+	static const int Width = LaneWidth;
+
+	/// The multi-loop parameters of a lane, as taken by NNAffineModel::SetMLParams.
+	struct MLParams {
+		energy_t init, branch, unpaired;
+	};
+
+private:
+	/// The lane versions of the tables of NNAffineFolder.
+	LaneTables lanes;
+
+	/// The parameter sets of the last Fold.
+	std::vector<MLParams> params;
+
+	/// The multi-loop costs of each lane. Unused lanes repeat the first parameter set.
+	LaneEnergies ml_init, ml_branch, ml_unpaired;
+
+	/**
+	 * The lane energy source of FillLaneTables. Every term but the multi-loop costs is the same in every lane, so is
+	 * looked up once and added to all of them.
+	 */
+	struct Source;
+
+public:
+	using NNAffineFolder::SetMaxTwoLoop;
+	using NNAffineFolder::MaxTwoLoop;
+	using NNAffineFolder::SetStacking;
+	using NNAffineFolder::Stacking;
+	using NNAffineFolder::SetLonelyPairs;
+	using NNAffineFolder::LonelyPairs;
+	using NNAffineFolder::SetMaxSpan;
+	using NNAffineFolder::MaxSpan;
+	using NNAffineFolder::SetModel;
+
+	/// The multi-loop parameters of the model are ignored, as each lane has its own.
+	explicit NNAffineParamBatchFolder(const NNAffineModel &_em);
+
+	/// Takes the model and settings of folder.
+	explicit NNAffineParamBatchFolder(const NNAffineFolder &folder);
+
+	/**
+	 * Folds an RNA under 1 to Width sets of multi-loop parameters together.
+	 * @return The MFE under each parameter set, in order.
+	 * @throws std::invalid_argument If there are no parameter sets or more than Width.
+	 */
+	std::vector<energy_t> Fold(const PrimeStructure &_rna, const std::vector<MLParams> &_params);
+
+	/// Trace back an MFE structure under the parameter set in the given lane of the last Fold.
+	Matching Traceback(size_t lane);
+
+	/// Bytes of lane table memory used by the last Fold.
+	size_t TableBytes() const;
+};
+
+}
+
+#endif //RNARK_NN_AFFINE_PARAM_BATCH_FOLDER_HPP
@@ -0,0 +1,166 @@
+#ifndef RNARK_NN_AFFINE_PF_FOLDER_HPP
+#define RNARK_NN_AFFINE_PF_FOLDER_HPP
+
+#include <folders/nn_affine_folder.hpp>
+#include <cmath>
+#include <random>
+#include <unordered_map>
+
+namespace librnary {
+
+/**
+ * Computes the partition function of an RNA (McCaskill, 1990), and from it the probability of each base pair, over
+ * the same energy model and decomposition as NNAffineFolder.
+ *
+ * With stacking, this is a partition function over stacking states, not structures. A stacking state is a structure
+ * with one choice of its dangles, terminal mismatches and coaxial stacks, which is one traceback of the decomposition.
+ * The weight of a structure is the sum of the weights of its stacking states, rather than the weight of its best
+ * stacking, which NNScorer and the MFE folds use. So Z is at least the sum over structures of their best weights, and
+ * the base pair probabilities and samples are those of the stacking state ensemble. Without stacking, each structure
+ * is a single state, and this is the partition function over structures.
+ *
+ * The tables hold partition functions divided by a scale factor per nucleotide, chosen from the MFE so the whole
+ * partition function is near 1, which keeps them within the range of a double however long the RNA is.
+ */
+class NNAffinePFFolder : protected NNAffineFolder {
+	/// Partition function (or outside) versions of the DP tables of NNAffineFolder.
+	struct PFTables {
+		TriangularArray<double> P, Cx, X;
+		V<TriangularArray<double>> ML;
+		std::vector<double> E;
+
+		/// Sizes the tables for an RNA of n nucleotides, zeroing every cell.
+		void Assign(size_t n, size_t band, size_t x_band, bool stacking);
+
+		double &operator[](const TState &s);
+
+		double operator[](const TState &s) const;
+	};
+
+	/// The thermal energy, RT, in kcal/mol.
+	kcalmol_t kt = RT37;
+
+	/// The partition functions of the last Fold, each divided by scale to the power of the nucleotides it covers.
+	PFTables Q;
+
+	/// The MFE of the last Fold, and the scale factor per nucleotide.
+	energy_t mfe = 0;
+	double scale = 1.0;
+
+	/// unpaired_scale[u] is 1 / scale^u, applied for the u nucleotides of a decomposition its children do not cover.
+	std::vector<double> unpaired_scale;
+
+	/// Boltzmann factors of the energies in [-BoltzmannRange, BoltzmannRange], which cover nearly every loop.
+	static const int BoltzmannRange = 4096;
+	std::vector<double> boltzmann;
+
+	double Boltzmann(energy_t e) const {
+		if (e < -BoltzmannRange || e > BoltzmannRange)
+			return std::exp(-EnergyToKCal(e) / kt);
+		return boltzmann[e + BoltzmannRange];
+	}
+
+	/// The nucleotides covered by a state.
+	static int Length(const TState &s);
+
+	/// The sum over the decompositions of s of their weights, given the cells of Q they read.
+	template<typename ModelT>
+	double Inside(const ModelT &m, const TState &s) const;
+
+	/// Adds the outside weight of s to the outside weights of its children in O.
+	template<typename ModelT>
+	void Outside(const ModelT &m, const TState &s, PFTables &O) const;
+
+	/// Fills the cells of Q at (i,j), which need every cell with a smaller span j - i filled.
+	template<typename ModelT>
+	void FillCell(const ModelT &m, int i, int j);
+
+	/// Fills Q for the RNA loaded in em.
+	template<typename ModelT>
+	void Fill(const ModelT &m);
+
+	/// Fills the outside tables for the RNA of the last Fold.
+	template<typename ModelT>
+	void FillOutside(const ModelT &m, PFTables &O) const;
+
+	/// The spans of the X cells the exterior loop can read.
+	size_t XBand() const;
+
+	/// The decompositions of a state that have any weight, with their cumulative weights, for Sample.
+	struct Choices {
+		std::vector<double> cumulative;
+		/// The children of decomposition d are children[ends[d - 1]] up to children[ends[d]], with ends[-1] = 0.
+		std::vector<TState> children;
+		std::vector<size_t> ends;
+	};
+
+	/// The choices of each state Sample has reached since the last Fold, by StateKey.
+	std::unordered_map<uint64_t, Choices> choices;
+
+	template<typename ModelT>
+	const Choices &StateChoices(const ModelT &m, const TState &s);
+
+	template<typename ModelT>
+	std::vector<Matching> Sample(const ModelT &m, size_t count, std::default_random_engine &re);
+
+public:
+	using NNAffineFolder::SetModel;
+	using NNAffineFolder::SetMaxTwoLoop;
+	using NNAffineFolder::MaxTwoLoop;
+	using NNAffineFolder::SetStacking;
+	using NNAffineFolder::Stacking;
+	using NNAffineFolder::SetLonelyPairs;
+	using NNAffineFolder::LonelyPairs;
+	using NNAffineFolder::SetStaticDispatch;
+	using NNAffineFolder::StaticDispatch;
+	using NNAffineFolder::SetThreads;
+	using NNAffineFolder::Threads;
+	using NNAffineFolder::SetMaxSpan;
+	using NNAffineFolder::MaxSpan;
+
+	explicit NNAffinePFFolder(const NNAffineModel &_em);
+
+	/// Takes the model and settings of folder, so the ensemble is over the structures folder folds.
+	explicit NNAffinePFFolder(const NNAffineFolder &folder);
+
+	/**
+	 * Sets the thermal energy RT, in kcal/mol, that Boltzmann weights exp(-E / RT) use. Defaults to RT37. The energy
+	 * parameters stay the same, so other values just sharpen or flatten the ensemble. Weights are only scaled as a
+	 * whole, so below about 0.02 the weight of a high energy loop inside an MFE structure can underflow to zero.
+	 */
+	void SetKT(kcalmol_t v);
+
+	kcalmol_t KT() const;
+
+	/**
+	 * Fills the partition function tables. With more than one thread, the cells are filled an anti-diagonal at a time,
+	 * as NNAffineFolder::Fold does, with identical results. The MFE that sets the scale is found first by an
+	 * energy-only fold.
+	 * @return The ensemble free energy -RT ln Z, in kcal/mol.
+	 */
+	kcalmol_t Fold(const PrimeStructure &_rna);
+
+	/// The natural log of the partition function Z of the last Fold.
+	double LogPartitionFunction() const;
+
+	/// The MFE of the last Fold.
+	energy_t MFE() const;
+
+	/**
+	 * The probability of each base pair (i,j) in the ensemble of the last Fold, in the cells i < j of the table, which
+	 * keeps the span of the folder. Runs the outside recursions, in O(N^3) time like the fill, on the calling thread.
+	 */
+	TriangularArray<double> BasePairProbabilities() const;
+
+	/**
+	 * Draws count structures from the ensemble of the last Fold, each with its Boltzmann probability (Ding and
+	 * Lawrence, 2003). The samples go down the tables together, sharing each state until they choose different
+	 * decompositions of it. The cumulative weights of a state's decompositions are found the first time a sample
+	 * reaches it, and kept until the next Fold, so later samples only pay for a binary search.
+	 */
+	std::vector<Matching> Sample(size_t count, std::default_random_engine &re);
+};
+
+}
+
+#endif //RNARK_NN_AFFINE_PF_FOLDER_HPP
@@ -0,0 +1,122 @@
+#ifndef RNARK_NN_AFFINE_SCANNER_HPP
+#define RNARK_NN_AFFINE_SCANNER_HPP
+
+#include <folders/nn_affine_folder.hpp>
+#include <functional>
+
+namespace librnary {
+
+/// A window of the sequence given to NNAffineScanner, and its MFE structure.
+struct ScanWindow {
+	/// Index of the first nucleotide of the window in the whole sequence.
+	size_t start;
+	energy_t mfe;
+	/// The MFE structure of the window, indexed from the start of the window.
+	Matching structure;
+};
+
+/**
+ * Folds every window of a fixed width along a sequence that is given a piece at a time, so it never has to be held
+ * in memory. The DP tables are filled a column (3' nucleotide) at a time, so moving the window along by one
+ * nucleotide fills one column, and every cell of the previous windows is reused. Only the last 2 * (width + 1)
+ * nucleotides are kept, in tables banded to the width, so memory is O(width^2) however long the sequence is.
+ *
+ * Pairs inside a window get the same energies as when folding the window on its own with NNAffineFolder, except
+ * where the energy looks outside the pair: the no lonely pairs heuristic, the bonus for a hairpin closed by a GU
+ * pair that follows two Gs, and a single nucleotide bulge, which counts the places it could slide to along a run of
+ * equal nucleotides. These see the whole sequence rather than just the window, except that a bulge may not see
+ * more than the width of a run past the window.
+ */
+class NNAffineScanner : protected NNAffineFolder {
+public:
+	typedef std::function<void(const ScanWindow &)> WindowCallback;
+
+private:
+	/// Nucleotides per window, and nucleotides between the starts of consecutive windows.
+	int width, step;
+
+	/// Index in the whole sequence of rna[0]. rna holds the nucleotides the tables still refer to.
+	size_t base = 0;
+
+	/// Columns of the DP tables filled so far, in the coordinates of rna.
+	int filled = 0;
+
+	/// Index in the whole sequence just past the last window emitted.
+	size_t emitted_end = 0;
+
+	/// The exterior loop of the current window. WE[x - a + 1] is the optimal fragment a..x of a window starting at a.
+	VE WE;
+
+	/// Nucleotides kept in rna before the tables are shifted down.
+	int Capacity() const;
+
+	/// Moves the tables and rna down, dropping the rows no later window can read.
+	void Shift();
+
+	/// Fills the WE table for the window a..b, and returns its MFE.
+	template<typename ModelT>
+	energy_t FillWindow(const ModelT &m, int a, int b);
+
+	/// Traces the MFE structure of the window a..b through WE and the DP tables.
+	Matching TraceWindow(int a, int b);
+
+	/// Folds the window a..b and passes it to emit.
+	template<typename ModelT>
+	void EmitWindow(const ModelT &m, int a, int b, const WindowCallback &emit);
+
+	/**
+	 * Fills the columns of rna up to (but not including) end, emitting every window that is completed.
+	 * @param finish If true this is the end of the sequence, so also emit the last window if it was skipped.
+	 */
+	template<typename ModelT>
+	void Advance(const ModelT &m, int end, bool finish, const WindowCallback &emit);
+
+	/// Loads rna into the model and calls Advance with the chosen dispatch.
+	void Advance(int end, bool finish, const WindowCallback &emit);
+
+public:
+	using NNAffineFolder::SetMaxTwoLoop;
+	using NNAffineFolder::MaxTwoLoop;
+	using NNAffineFolder::SetStacking;
+	using NNAffineFolder::Stacking;
+	using NNAffineFolder::SetLonelyPairs;
+	using NNAffineFolder::LonelyPairs;
+	using NNAffineFolder::SetStaticDispatch;
+	using NNAffineFolder::StaticDispatch;
+	using NNAffineFolder::SetMaxSpan;
+	using NNAffineFolder::MaxSpan;
+
+	/**
+	 * @param _width Nucleotides per window. Pairs can span at most _width - 1, or the max span if that is less.
+	 * @param _step Nucleotides between the starts of consecutive windows.
+	 */
+	NNAffineScanner(const NNAffineModel &_em, unsigned _width, unsigned _step = 1);
+
+	/**
+	 * Appends nucleotides to the sequence, and passes each window completed to emit, in order. The last nucleotide,
+	 * and up to the width of a run of equal nucleotides it ends, are held back until more arrive (or Finish is
+	 * called), since the lonely pair check and single nucleotide bulges read the ones after them.
+	 * Options must not change between Push calls for the same sequence.
+	 */
+	void Push(const PrimeStructure &chunk, const WindowCallback &emit);
+
+	/**
+	 * Ends the sequence, emitting the windows still outstanding. The final window always ends at the last nucleotide,
+	 * and a sequence shorter than the width is folded as a single window. The scanner is then ready for a new sequence.
+	 */
+	void Finish(const WindowCallback &emit);
+
+	/// Drops the sequence given so far without emitting anything more.
+	void Reset();
+
+	unsigned Width() const;
+
+	unsigned Step() const;
+
+	/// Bytes of DP table memory in use. Bounded by the width, not by the length of the sequence.
+	size_t TableBytes() const;
+};
+
+}
+
+#endif //RNARK_NN_AFFINE_SCANNER_HPP
@@ -0,0 +1,89 @@
+#ifndef RNARK_NN_AFFINE_SPARSE_FOLDER_HPP
+#define RNARK_NN_AFFINE_SPARSE_FOLDER_HPP
+
+#include <folders/nn_affine_folder.hpp>
+
+namespace librnary {
+
+/**
+ * Folds with the recursions of NNAffineFolder, but skips the decompositions that cannot win, in the style of the
+ * candidate lists of Wexler et al. (2007) and Backofen et al. (2011).
+ *
+ * The multi-loop tables are split into a 5' ML fragment i..s-1 and a 3' branch s..j. Suppose the branch s..j is no
+ * better than some split of s..j into an ML fragment and a later branch l..j. Then, as two ML fragments make one, the
+ * split at l is as good as that at s for every i. So each column j keeps a list of candidates, the s whose branch (or
+ * coaxial stack) beats every such split, and the ML fill only tries those. Other work is cut with a pair-capable
+ * index, the partners each nucleotide CanPair with: the coaxial stack table and the exterior loop only try branches
+ * closed by such pairs, as all other P cells are infinite.
+ *
+ * The tables hold the same finite energies as those of NNAffineFolder, so the MFE and traceback are identical. Cells
+ * with no structure may hold other infinite energies. Fills serially, and has no Suboptimal or FoldMutants.
+ *
+ * The saving is in time, not memory. Every cell within the span is still visited, as ML[b][i][j] is read by any pair
+ * closing a multi-loop over i..j, and P, Cx and ML are kept whole for the traceback. Memory is that of NNAffineFolder
+ * less its column-major shadows, plus the candidate lists and the index.
+ */
+class NNAffineSparseFolder : protected NNAffineFolder {
+	/// A split point s of the ML decompositions of column j, with the energy of the branch or coaxial stack s..j.
+	struct Candidate {
+		int s;
+		energy_t e;
+	};
+
+	/**
+	 * The candidate lists of each column j, in decreasing s. Branches are the multi-loop branches covering exactly
+	 * s..j, with any dangles or terminal mismatch, as the end on branch cases of ML; coaxial stacks are Cx[s][j].
+	 */
+	std::vector<std::vector<Candidate>> branch_candidates, coax_candidates;
+
+	/**
+	 * The pair-capable index. five_partners[j] holds the i < j within the span that CanPair with j, in decreasing
+	 * order, and three_partners[i] the j > i, in increasing order.
+	 */
+	std::vector<std::vector<int>> five_partners, three_partners;
+
+	/// Builds the pair-capable index for the current RNA and settings.
+	void IndexPairs();
+
+	/// Computes P[i][j], Cx[i][j] and ML[b][i][j], and adds (i,j) to the candidate lists it belongs in.
+	template<typename ModelT>
+	void FillCell(const ModelT &m, int i, int j);
+
+	/// Fills the exterior loop table.
+	template<typename ModelT>
+	void FillExterior(const ModelT &m);
+
+	template<typename ModelT>
+	energy_t Fill(const ModelT &m);
+
+public:
+	using NNAffineFolder::SetMaxTwoLoop;
+	using NNAffineFolder::MaxTwoLoop;
+	using NNAffineFolder::SetStacking;
+	using NNAffineFolder::Stacking;
+	using NNAffineFolder::SetLonelyPairs;
+	using NNAffineFolder::LonelyPairs;
+	using NNAffineFolder::SetStaticDispatch;
+	using NNAffineFolder::StaticDispatch;
+	using NNAffineFolder::SetMaxSpan;
+	using NNAffineFolder::MaxSpan;
+	using NNAffineFolder::SetModel;
+	using NNAffineFolder::Traceback;
+
+	explicit NNAffineSparseFolder(const NNAffineModel &_em);
+
+	/// Takes the model and settings of folder.
+	explicit NNAffineSparseFolder(const NNAffineFolder &folder);
+
+	energy_t Fold(const PrimeStructure &_rna);
+
+	/// Number of candidates in the lists of the last Fold, against the (N^2)/2 split points NNAffineFolder tries.
+	size_t Candidates() const;
+
+	/// Bytes of DP table, candidate list, and pair index memory used by the last Fold.
+	size_t TableBytes() const;
+};
+
+}
+
+#endif //RNARK_NN_AFFINE_SPARSE_FOLDER_HPP
@@ -7,6 +7,9 @@
 
 #include "models/nn_unpaired_model.hpp"
 #include "vector_types.hpp"
+#include "multi_array.hpp"
+#include "folders/fold_workspace.hpp"
+#include "folders/min_plus.hpp"
 
 #include <stack>
 
@@ -19,19 +22,25 @@ namespace librnary {
 class NNUnpairedFolder {
 	/// P stands for "Paired" and is the same as the V table.
 	/// P[i][j]: MFE of structures closed by the bond i,j.
-	VVE P;
+	TriangularArray<energy_t> P;
 
-	/// Rather bafflingly, nested vectors seem faster than flat arrays here.
-	/// Declaring a large flat array seems very exnpensive. Plus the access pattern seems to mess with the pre-fetcher.
 	/// The "Multiloop" table.
 	/// ML[b][up][i][j]: MFE of multiloop fragments from i to j having >= b branches and up unpaired nucleotides.
-	_4DVE ML;
+	/// Each [b][up] slice is its own flat triangle, so the i,j cells of one slice stay contiguous.
+	VV<TriangularArray<energy_t>> ML;
 	/// The external loop table.
 	/// E[i]: The MFE external loop from 0 to i.
 	VE E;
 
-	VVE CxFl;
-	VVE CxMM;
+	TriangularArray<energy_t> CxFl;
+	TriangularArray<energy_t> CxMM;
+
+	/// Column-major shadows of the branch terms of the ML split decompositions, so MinPlus reads contiguous columns.
+	/// MLBrCol(i,j) is the multi-loop branch covering exactly i..j. MLBrDangleCol(i,j) is the best with one dangle
+	/// covering it, and MLBrMismatchCol(i,j) the one with a terminal mismatch. CxFlCol and CxMMCol mirror CxFl and
+	/// CxMM. All but MLBrCol are only kept when stacking.
+	TriangularArray<energy_t, TriangularLayout::ColumnMajor> MLBrCol, MLBrDangleCol, MLBrMismatchCol, CxFlCol,
+		CxMMCol;
 
 	PrimeStructure rna;
 
@@ -94,9 +103,20 @@ class NNUnpairedFolder {
 	/// This flag toggles whether lonely pairs are allowed.
 	bool lonely_pairs = true;
 
+	/// Workspace the DP tables live in. Null means the folder owns its tables.
+	FoldWorkspace *workspace = nullptr;
+
 	/// This flag toggles whether stacking interactions (dangles, terminal mismatch, and coaxial stacking) are used.
 	bool stacking = true;
 
+	/// The maximum j - i of a base pair (i,j). The 2D tables only keep cells within this span.
+	int max_span = std::numeric_limits<int>::max() / 3;
+
+	/// Whether (i,j) is within the maximum span, so its cells are stored.
+	bool InSpan(int i, int j) const {
+		return j - i <= max_span;
+	}
+
 public:
 
 	void SetStacking(bool v);
@@ -113,12 +133,20 @@ public:
 	/// Get the max unpaired nucleotides in a multiloop.
 	int MaxMultiUnpaired() const;
 
+	/** See NNAffineFolder::SetWorkspace. */
+	void SetWorkspace(FoldWorkspace *ws);
+
 	/// Set the max unpaired nucleotides in a bulge/internal loop.
 	void SetMaxTwoLoop(unsigned max_up);
 
 	/// Get the max unpaired nucleotides in a bulge/internal loop.
 	int MaxTwoLoop() const;
 
+	/// See NNAffineFolder::SetMaxSpan.
+	void SetMaxSpan(unsigned span);
+
+	int MaxSpan() const;
+
 	/**
 	 * Note that this method may make the previous call to fold invalid, as it will still assume the old model.
 	 * @param _em Sets the model to use internally to this.
@@ -8,8 +8,12 @@
 #include <stack>
 
 #include "vector_types.hpp"
+#include "multi_array.hpp"
+#include "folders/fold_workspace.hpp"
+#include "folders/min_plus.hpp"
 #include "primary_structure.hpp"
 #include "models/stem_length_model.hpp"
+#include "models/devirtualized_model.hpp"
 
 
 namespace librnary {
@@ -26,26 +30,33 @@ protected:
 	/**
 	 * The 'Stem' table. S[i][j] is the optimal substructure closed by a pair i,j such that i,j are the start of a stem.
 	 */
-	VVE S;
+	TriangularArray<energy_t> S;
 
 	/**
 	 * The 'Loop' table. L[i][j] is the optimal substructure closed by the pair i,j such that i,j close a loop.
 	 * Note that a stacking region is not a loop.
 	 */
-	VVE L;
+	TriangularArray<energy_t> L;
 
 	/**
 	 * The 'Multi-Loop' table. ML[b][i][j] is the optimal part of the multi-loop that definitely has
-	 * at least b branches.
+	 * at least b branches. As in NNAffineFolder, energy-only folds keep one row of ML[0] and three of ML[2].
 	 */
-	VVVE ML;
+	V<RowWindowArray<energy_t>> ML;
 
 	/**
 	 * The 'Coaxial stack' table. Cx[i][j] is the optimal multi-loop coaxial stack such that one branch starts at i,
 	 * and the other branch ends at j. Note that it is assumed that these branches are in a multi-loop. This table will
 	 * count the unpaired cost.
 	 */
-	VVE Cx;
+	TriangularArray<energy_t> Cx;
+
+	/**
+	 * Column-major shadows for the split decompositions of the ML fill, as in NNAffineFolder. MLBrCol(i,j) is the
+	 * optimal multi-loop branch covering exactly i..j, with any dangles or terminal mismatch, and CxCol(i,j) is
+	 * Cx[i][j]. Energy-only folds keep neither.
+	 */
+	TriangularArray<energy_t, TriangularLayout::ColumnMajor> MLBrCol, CxCol;
 
 	/**
 	 * The 'External loop' table. E[i] is the optimal external loop fragment 0..i.
@@ -121,26 +132,63 @@ protected:
 	 */
 	bool lonely_pairs = true;
 
+	/// Workspace the DP tables live in. Null means the folder owns its tables.
+	FoldWorkspace *workspace = nullptr;
+
 	/// This flag toggles whether stacking interactions (dangles, terminal mismatch, and coaxial stacking) are used.
 	bool stacking = true;
 
 	/// The maximum number of unpaired in a bulge or internal loop.
 	int max_twoloop_unpaired = std::numeric_limits<int>::max() / 3;
 
+	/// Whether Fold fills the tables through DevirtualizedModel rather than the model's virtual interface.
+	bool static_dispatch = true;
+
+	/// Whether Fold only keeps the table rows needed to compute the MFE, leaving nothing to trace back through.
+	bool energy_only = false;
+
+	/// The maximum j - i of a base pair (i,j). The 2D tables only keep cells within this span.
+	int max_span = std::numeric_limits<int>::max() / 3;
+
+	/// Whether (i,j) is within the maximum span, so its cells are stored.
+	bool InSpan(int i, int j) const {
+		return j - i <= max_span;
+	}
+
 	/**
 	 * The optimal sub-surface score of the structure closed by (i,j). Designed for external-loop branches.
 	 * Accounts for AU/GU penalty.
 	 */
-	energy_t SSScore(int i, int j) const;
+	template<typename ModelT>
+	energy_t SSScore(const ModelT &m, int i, int j) const;
 
 	/**
 	 * The optimal sub-surface score of the structure closed by (i,j) in a multi-loop.
 	 * Accounts for AU/GU penalty, and multi-loop branch cost.
 	 */
-	energy_t MLSSScore(int i, int j) const;
+	template<typename ModelT>
+	energy_t MLSSScore(const ModelT &m, int i, int j) const;
+
+	/**
+	 * The optimal multi-loop branch covering exactly i..j, with any dangles or terminal mismatch. These are the end on
+	 * branch cases of the ML table.
+	 */
+	template<typename ModelT>
+	energy_t MLBranchScore(const ModelT &m, int i, int j) const;
+
+	/**
+	 * Fills the DP tables, which must already be sized, and returns the MFE. Templated over the model like
+	 * NNAffineFolder::Fill.
+	 * @param m The energy model, with the current RNA loaded.
+	 */
+	template<typename ModelT>
+	energy_t Fill(const ModelT &m);
 
 public:
 
+	/** See NNAffineFolder::SetWorkspace. */
+	void SetWorkspace(FoldWorkspace *ws);
+
 	/// Set the max unpaired nucleotides in a bulge/internal loop.
 	void SetMaxTwoLoop(unsigned max_up);
 
@@ -155,6 +203,24 @@ public:
 
 	bool LonelyPairs() const;
 
+	/// See NNAffineFolder::SetStaticDispatch.
+	void SetStaticDispatch(bool v);
+
+	bool StaticDispatch() const;
+
+	/// See NNAffineFolder::SetEnergyOnly.
+	void SetEnergyOnly(bool v);
+
+	bool EnergyOnly() const;
+
+	/// See NNAffineFolder::SetMaxSpan.
+	void SetMaxSpan(unsigned span);
+
+	int MaxSpan() const;
+
+	/// Bytes of DP table memory used by the last Fold. The tables are allocated up front, so this is also the peak.
+	size_t TableBytes() const;
+
 	void SetModel(const StemLengthModel &_em);
 
 	energy_t Fold(const PrimeStructure &_rna);
@@ -162,6 +228,7 @@ public:
 	/**
 	 * Trace back through the DP tables and produce a MFE secondary structure.
 	 * @return The traced secondary structure.
+	 * @throws std::logic_error If the last Fold was energy-only, as the multi-loop tables no longer hold every row.
 	 */
 	Matching Traceback();
 
@@ -6,6 +6,8 @@
 #ifndef RNARK_AALBERTS_MODEL_HPP
 #define RNARK_AALBERTS_MODEL_HPP
 
+#include <vector>
+
 #include "nn_model.hpp"
 namespace librnary {
 /**
@@ -15,9 +17,28 @@ class AalbertsModel: public NNModel {
 	/// The parameters used in energy calculation. Defaults that that found in the original publication.
 	librnary::kcalmol_t log_mult = (59 / 36.0) * 0.61633135161, C = 0.0;
 	double a = 6.2, b = 15, power = 6.0 / 5;
+
+	/// Whether MLInit reads ml_init_table rather than evaluating the model.
+	bool use_ml_init_table = true;
+	/// MLInit(N, M) for every N < ml_init_rows and M < ml_init_cols, row by row.
+	std::vector<energy_t> ml_init_table;
+	int ml_init_rows = 0, ml_init_cols = 0;
+
+	/// Evaluates the model's initiation cost directly: two pow()s and a log().
+	energy_t ComputeMLInit(int N, int M) const;
+
+	/// Makes the MLInit table cover every multi-loop of an RNA of length n, rebuilding it if it is out of date.
+	void GrowMLInitTable(int n);
+
+	/// Marks the MLInit table out of date after a parameter change. It is rebuilt by the next SetRNA.
+	void InvalidateMLInitTable();
 public:
 	/// The initiation cost of a multi-loop given only the relevant features.
-	energy_t MLInit(int N, int M) const;
+	energy_t MLInit(int N, int M) const {
+		if (N < ml_init_rows && M < ml_init_cols)
+			return ml_init_table[N * ml_init_cols + M];
+		return ComputeMLInit(N, M);
+	}
 	/// The initiation cost of a multi-loop given only the relevant features.
 	energy_t MLInitUpBr(int unpaired, int branches) const;
 	/// The multi-loop initiation cost of a given loop region. Assumed to be a multi-loop.
@@ -39,8 +60,25 @@ public:
 					 double a,
 					 double b,
 					 double power);
+	/**
+	 * Sets the current working RNA, and grows the MLInit table to an (N+2)x(N/2+2) table covering every multi-loop
+	 * of an RNA of length N.
+	 */
+	void SetRNA(const PrimeStructure &rna);
+
+	/**
+	 * Toggles the MLInit table. When on, MLInit is a table lookup for every multi-loop of the longest RNA set so far,
+	 * rather than two pow()s and a log(). Energies are identical either way. Changing a parameter drops the table
+	 * until the next SetRNA, which folders and scorers call before each RNA.
+	 */
+	void SetMLInitTable(bool v);
+
+	bool MLInitTable() const;
+
 	AalbertsModel(const std::string &data_path, const PrimeStructure &_rna)
-		: NNModel(data_path, _rna) {}
+		: NNModel(data_path, _rna) {
+		GrowMLInitTable(static_cast<int>(_rna.size()));
+	}
 	AalbertsModel(const std::string &data_path)
 		: NNModel(data_path) {}
 };
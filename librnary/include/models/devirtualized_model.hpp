@@ -0,0 +1,95 @@
+#ifndef RNARK_DEVIRTUALIZED_MODEL_HPP
+#define RNARK_DEVIRTUALIZED_MODEL_HPP
+
+#include "nn_model.hpp"
+
+#include <limits>
+
+namespace librnary {
+
+/**
+ * Compile-time energy policy for folder fill loops. Wraps a copy of a model whose nearest neighbour energy functions
+ * are final and defined inline on top of NNModel's compiled tables. A fill loop written as a template over its model
+ * type and instantiated with this type has every stack, loop, dangle and coaxial stack term inlined, where the
+ * same loop over ModelT goes through the virtual interface.
+ *
+ * Energies are identical to ModelT's (see NNModel::SetCompiled). Hairpins (OneLoop) and any function ModelT adds
+ * itself still resolve to ModelT's implementation, only statically. ModelT must not override the functions below.
+ * @tparam ModelT A concrete model deriving from NNModel.
+ */
+template<typename ModelT>
+class DevirtualizedModel final : public ModelT {
+public:
+	/**
+	 * Copies m and builds the compiled tables for its current RNA, so SetRNA must have been called on m already.
+	 */
+	explicit DevirtualizedModel(const ModelT &m)
+		: ModelT(m) {
+		this->SetCompiled(true);
+	}
+
+	energy_t TwoLoop(int i, int k, int l, int j) const override {
+		return this->CompiledTwoLoop(i, k, l, j);
+	}
+
+	/*
+	 * The terms a split two-loop's free energy is the sum of (see TwoLoopShape), so fill loops can look up the terms of
+	 * each pair once rather than the whole loop for every pair of pairs. Only for shapes other than Unsplit.
+	 */
+
+	energy_t TwoLoopSize(TwoLoopShape shape, int size1, int size2) const {
+		return this->CompiledTwoLoopSize(shape, size1, size2);
+	}
+
+	energy_t TwoLoopOuter(TwoLoopShape shape, int i, int j) const {
+		return this->CompiledTwoLoopOuter(shape, i, j);
+	}
+
+	energy_t TwoLoopInner(TwoLoopShape shape, int k, int l) const {
+		return this->CompiledTwoLoopInner(shape, k, l);
+	}
+
+	energy_t Branch(int i, int j) const override {
+		return this->CompiledBranch(i, j);
+	}
+
+	energy_t FlushCoax(int i, int j, int k, int l) const override {
+		return this->CompiledFlushCoax(i, j, k, l);
+	}
+
+	energy_t MismatchCoax(int i, int j, int k, int l) const override {
+		return this->CompiledMismatchCoax(i, j, k, l);
+	}
+
+	energy_t FiveDangle(int i, int j) const override {
+		return this->CompiledFiveDangle(i, j);
+	}
+
+	energy_t ClosingFiveDangle(int i, int j) const override {
+		return this->CompiledClosingFiveDangle(i, j);
+	}
+
+	energy_t ThreeDangle(int i, int j) const override {
+		return this->CompiledThreeDangle(i, j);
+	}
+
+	energy_t ClosingThreeDangle(int i, int j) const override {
+		return this->CompiledClosingThreeDangle(i, j);
+	}
+
+	energy_t Mismatch(int i, int j) const override {
+		return this->CompiledMismatch(i, j);
+	}
+
+	energy_t ClosingMismatch(int i, int j) const override {
+		return this->CompiledClosingMismatch(i, j);
+	}
+
+	energy_t MaxMFE() const override {
+		return std::numeric_limits<energy_t>::max() / 3;
+	}
+};
+
+}
+
+#endif //RNARK_DEVIRTUALIZED_MODEL_HPP
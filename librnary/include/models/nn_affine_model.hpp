@@ -30,9 +30,15 @@ public:
 	energy_t MLClosure(const librnary::SSTree &sstree, librnary::SSTreeNodeId node_id) const override;
 	energy_t MLClosure(const librnary::Surface &surf) const override;
 	energy_t MLClosure(int branches, int unpaired) const;
-	energy_t MLInitCost() const;
-	virtual energy_t MLBranchCost() const;
-	energy_t MLUnpairedCost() const;
+	energy_t MLInitCost() const {
+		return ml_init;
+	}
+	virtual energy_t MLBranchCost() const {
+		return ml_branch;
+	}
+	energy_t MLUnpairedCost() const {
+		return ml_unpiared;
+	}
 	void SetMLInitCost(energy_t v);
 	void SetMLBranchCost(energy_t v);
 	void SetMLUnpairedCost(energy_t v);
@@ -10,8 +10,35 @@
 #include "ss_tree.hpp"
 #include "energy.hpp"
 
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
 namespace librnary {
 
+/**
+ * Kinds of two-loop, by the number of unpaired on each side. Stacks, single nucleotide bulges, and internal loops up to
+ * 2x2 are Unsplit, as their free energy reads both closing pairs at once. In the others the closing pairs only add
+ * separate terms: AU/GU closure for Bulge, and a terminal mismatch for each kind of internal loop (1xn with n > 2, 2x3,
+ * and the rest).
+ */
+enum class TwoLoopShape {
+	Unsplit, Bulge, Internal1n, Internal23, Internal
+};
+
+/// The shape of a two-loop with size1 unpaired on its 5' side and size2 on its 3' side.
+inline TwoLoopShape ShapeOfTwoLoop(int size1, int size2) {
+	if (size1 == 0 || size2 == 0)
+		return size1 + size2 <= 1 ? TwoLoopShape::Unsplit : TwoLoopShape::Bulge;
+	if (size1 <= 2 && size2 <= 2)
+		return TwoLoopShape::Unsplit;
+	if (size1 == 1 || size2 == 1)
+		return TwoLoopShape::Internal1n;
+	if ((size1 == 2 && size2 == 3) || (size1 == 3 && size2 == 2))
+		return TwoLoopShape::Internal23;
+	return TwoLoopShape::Internal;
+}
+
 /**
  * An instance of NNModel represents a particular parametrization of the nearest neighbour energy model.
  * Currently based largely on the 2004 version found at http://rna.urmc.rochester.edu/NNDB/.
@@ -28,6 +55,53 @@ protected:
 	PrimeStructure rna;
 	std::shared_ptr<datatable> dt;
 	std::shared_ptr<structure> struc;
+
+	/// Whether the energy functions read the compiled per-sequence tables below instead of calling into RNAstructure.
+	bool compiled = false;
+
+	/**
+	 * RNAstructure base codes of the current RNA. codes[k] is the code of rna[k-1], matching structure::numseq, so
+	 * the compiled functions can mirror RNAstructure's 1-based indexing. codes[0] and codes[rna.size()+1] are padding.
+	 */
+	std::vector<int> codes;
+
+	/// loginc[s] is the log extrapolation RNAstructure adds to a bulge or internal loop of s > 30 unpaired.
+	std::vector<int> loginc;
+
+	/// bulge_states[c] is the free energy bonus of a single nucleotide bulge that can slide between c positions.
+	std::vector<int> bulge_states;
+
+	/// Builds the compiled tables for the current RNA.
+	void Compile();
+
+	/*
+	 * Compiled versions of the energy functions. Each takes the same arguments and gives the same result as the
+	 * virtual function it is named after, but assumes the compiled tables have been built. They are defined inline
+	 * below so that DevirtualizedModel can inline them into folder fill loops.
+	 */
+
+	/// Mirror of RNAstructure's erg1 (stacked pairs). Unlike the others this uses 1-based indices.
+	energy_t CompiledStack(int i, int j, int ip, int jp) const;
+	energy_t CompiledTwoLoop(int i, int k, int l, int j) const;
+	energy_t CompiledBranch(int i, int j) const;
+	energy_t CompiledFlushCoax(int i, int j, int k, int l) const;
+	energy_t CompiledMismatchCoax(int i, int j, int k, int l) const;
+	energy_t CompiledFiveDangle(int i, int j) const;
+	energy_t CompiledClosingFiveDangle(int i, int j) const;
+	energy_t CompiledThreeDangle(int i, int j) const;
+	energy_t CompiledClosingThreeDangle(int i, int j) const;
+	energy_t CompiledMismatch(int i, int j) const;
+	energy_t CompiledClosingMismatch(int i, int j) const;
+
+	/*
+	 * CompiledTwoLoop, split into terms for the loops whose free energy is a sum of a term for the loop size and one
+	 * for each closing pair with its neighbours in the loop. See TwoLoopShape. For such a loop (_(_)_) with pairs i,j
+	 * and k,l, CompiledTwoLoop(i, k, l, j) is the sum of CompiledTwoLoopSize(shape, k - i - 1, j - l - 1),
+	 * CompiledTwoLoopOuter(shape, i, j) and CompiledTwoLoopInner(shape, k, l).
+	 */
+	energy_t CompiledTwoLoopSize(TwoLoopShape shape, int size1, int size2) const;
+	energy_t CompiledTwoLoopOuter(TwoLoopShape shape, int i, int j) const;
+	energy_t CompiledTwoLoopInner(TwoLoopShape shape, int k, int l) const;
 public:
 	/// Minimum number of unpaired nucleotides allowed in a hairpin loop.
 	static const int MIN_HAIRPIN_UNPAIRED = 3;
@@ -193,6 +267,23 @@ public:
 	 */
 	void SetRNA(const PrimeStructure &rna);
 
+	/**
+	 * Changes nucleotide i of the current RNA to b, updating the per-sequence state in place rather than rebuilding
+	 * it as SetRNA does. Copies of a model share that state, so the first change after copying takes a private copy.
+	 */
+	void SetBase(int i, Base b);
+
+	/**
+	 * Toggles the compiled energy path. When on, SetRNA resolves the sequence into flat base code arrays, and stacks,
+	 * bulges, internal loops (including the 1x1, 1x2 and 2x2 tables), dangles, terminal mismatches and coaxial stacks
+	 * become direct reads of the parameter tables rather than calls into RNAstructure.
+	 * Energies are identical either way. Hairpins always go through RNAstructure.
+	 * Since each folder holds its own copy of a model, this can be chosen per folder.
+	 */
+	void SetCompiled(bool v);
+
+	bool Compiled() const;
+
 	/**
 	 * @return The RNA sequence currently being used.
 	 */
@@ -212,6 +303,163 @@ public:
 	}
 
 };
+
+inline energy_t NNModel::CompiledStack(int i, int j, int ip, int jp) const {
+	const auto n = static_cast<int>(rna.size());
+	if (i == n || j == n + 1)
+		return INFINITE_ENERGY;
+	return dt->stack[codes[i]][codes[j]][codes[ip]][codes[jp]] + dt->eparam[1];
+}
+
+inline energy_t NNModel::CompiledTwoLoopSize(TwoLoopShape shape, int size1, int size2) const {
+	const datatable &d = *dt;
+	const int size = size1 + size2;
+	if (shape == TwoLoopShape::Bulge)
+		return (size > 30 ? d.bulge[30] + loginc[size] : d.bulge[size]) + d.eparam[2];
+	const int lopsided = std::min<int>(d.maxpen, std::abs(size1 - size2) * d.poppen[std::min(2, std::min(size1, size2))]);
+	const int init = size > 30 ? d.inter[30] + loginc[size] : d.inter[size];
+	return init + d.eparam[3] + lopsided;
+}
+
+inline energy_t NNModel::CompiledTwoLoopOuter(TwoLoopShape shape, int i, int j) const {
+	const datatable &d = *dt;
+	const int *c = codes.data();
+	i += 1;
+	j += 1;
+	switch (shape) {
+		case TwoLoopShape::Bulge:
+			return c[i] == 4 || c[j] == 4 ? d.auend : 0;
+		case TwoLoopShape::Internal1n:
+			return d.tstki1n[c[i]][c[j]][c[i + 1]][c[j - 1]];
+		case TwoLoopShape::Internal23:
+			return d.tstki23[c[i]][c[j]][c[i + 1]][c[j - 1]];
+		default:
+			return d.tstki[c[i]][c[j]][c[i + 1]][c[j - 1]];
+	}
+}
+
+inline energy_t NNModel::CompiledTwoLoopInner(TwoLoopShape shape, int k, int l) const {
+	const datatable &d = *dt;
+	const int *c = codes.data();
+	const int ip = k + 1, jp = l + 1;
+	switch (shape) {
+		case TwoLoopShape::Bulge:
+			return c[jp] == 4 || c[ip] == 4 ? d.auend : 0;
+		case TwoLoopShape::Internal1n:
+			return d.tstki1n[c[jp]][c[ip]][c[jp + 1]][c[ip - 1]];
+		case TwoLoopShape::Internal23:
+			return d.tstki23[c[jp]][c[ip]][c[jp + 1]][c[ip - 1]];
+		default:
+			return d.tstki[c[jp]][c[ip]][c[jp + 1]][c[ip - 1]];
+	}
+}
+
+inline energy_t NNModel::CompiledTwoLoop(int i, int k, int l, int j) const {
+	const TwoLoopShape shape = ShapeOfTwoLoop(k - i - 1, j - l - 1);
+	if (shape != TwoLoopShape::Unsplit)
+		return CompiledTwoLoopSize(shape, k - i - 1, j - l - 1) + CompiledTwoLoopOuter(shape, i, j)
+			+ CompiledTwoLoopInner(shape, k, l);
+	const datatable &d = *dt;
+	const int *c = codes.data();
+	// Switch to 1-based indices and RNAstructure's names so this reads the same as erg1 and erg2.
+	const int ip = k + 1, jp = l + 1;
+	i += 1;
+	j += 1;
+	const int size1 = ip - i - 1, size2 = j - jp - 1;
+	if (size1 == 0 && size2 == 0)
+		return CompiledStack(i, j, ip, jp);
+
+	if (size1 == 0 || size2 == 0) { // Single nucleotide bulge.
+		energy_t energy = d.stack[c[i]][c[j]][c[ip]][c[jp]] + d.bulge[1] + d.eparam[2];
+		// Count the equivalent positions the bulged nucleotide could slide to.
+		int count = 1;
+		const int bulged = size1 == 1 ? i + 1 : jp + 1;
+		const int lo = size1 == 1 ? i : jp, hi = size1 == 1 ? ip : j;
+		const auto n = static_cast<int>(rna.size());
+		for (int x = lo; c[x] == c[bulged];) {
+			++count;
+			if (--x == n || x == 0)
+				break;
+		}
+		for (int x = hi; c[x] == c[bulged];) {
+			++count;
+			if (++x == n + 1 || x > 2 * n)
+				break;
+		}
+		if (c[bulged] == 2 && count > 1)
+			energy += d.singlecbulge;
+		return energy - bulge_states[count];
+	}
+
+	// Internal loops up to 2x2.
+	if (size1 == 2 && size2 == 2)
+		return d.iloop22[c[i]][c[ip]][c[j]][c[jp]][c[i + 1]][c[i + 2]][c[j - 1]][c[j - 2]];
+	if (size1 == 1 && size2 == 2)
+		return d.iloop21[c[i]][c[j]][c[i + 1]][c[j - 1]][c[jp + 1]][c[ip]][c[jp]];
+	if (size1 == 2 && size2 == 1)
+		return d.iloop21[c[jp]][c[ip]][c[jp + 1]][c[ip - 1]][c[i + 1]][c[j]][c[i]];
+	return d.iloop11[c[i]][c[i + 1]][c[ip]][c[j]][c[j - 1]][c[jp]];
+}
+
+inline energy_t NNModel::CompiledMismatchCoax(int i, int j, int k, int l) const {
+	const datatable &d = *dt;
+	const int *c = codes.data();
+	// Same case analysis as MismatchCoax, with ergcoaxinterbases1/2 expanded in place.
+	i += 1;
+	j += 1;
+	k += 1;
+	l += 1;
+	if (i < k && l < j) {
+		if (k == i + 2) // (.(_)_.), ergcoaxinterbases1(j, i, k, l)
+			return d.tstackcoax[c[i]][c[j]][c[i + 1]][c[j - 1]] + d.coaxstack[c[i + 1]][c[j - 1]][c[k]][c[l]];
+		// (._(_).), ergcoaxinterbases2(k, l, j, i)
+		return d.tstackcoax[c[i]][c[j]][c[i + 1]][c[j - 1]] + d.coaxstack[c[l]][c[k]][c[l + 1]][c[i + 1]];
+	} else if (k < i && j < l) {
+		if (i == k + 2) // (.(_)._), ergcoaxinterbases2(l, k, i, j)
+			return d.tstackcoax[c[j]][c[i]][c[j + 1]][c[i - 1]] + d.coaxstack[c[k]][c[l]][c[k + 1]][c[j + 1]];
+		// (_.(_).), ergcoaxinterbases1(i, j, l, k)
+		return d.tstackcoax[c[j]][c[i]][c[j + 1]][c[i - 1]] + d.coaxstack[c[j + 1]][c[i - 1]][c[l]][c[k]];
+	} else if (j < k) { // .(_).(_), ergcoaxinterbases1(i, j, k, l)
+		return d.tstackcoax[c[j]][c[i]][c[j + 1]][c[i - 1]] + d.coaxstack[c[j + 1]][c[i - 1]][c[k]][c[l]];
+	}
+	// (_).(_)., ergcoaxinterbases2(k, l, i, j)
+	return d.tstackcoax[c[j]][c[i]][c[j + 1]][c[i - 1]] + d.coaxstack[c[l]][c[k]][c[l + 1]][c[j + 1]];
+}
+
+
+inline energy_t NNModel::CompiledBranch(int i, int j) const {
+	return codes[i + 1] == 4 || codes[j + 1] == 4 ? dt->auend : 0;
+}
+
+inline energy_t NNModel::CompiledFlushCoax(int i, int j, int k, int l) const {
+	if (i < k && l < j) // i,j close a multi-loop.
+		return CompiledStack(i + 1, j + 1, k + 1, l + 1);
+	return CompiledStack(j + 1, i + 1, k + 1, l + 1);
+}
+
+inline energy_t NNModel::CompiledFiveDangle(int i, int j) const {
+	return dt->dangle[codes[j + 1]][codes[i + 1]][codes[i]][2];
+}
+
+inline energy_t NNModel::CompiledClosingFiveDangle(int i, int j) const {
+	return dt->dangle[codes[i + 1]][codes[j + 1]][codes[j]][2];
+}
+
+inline energy_t NNModel::CompiledThreeDangle(int i, int j) const {
+	return dt->dangle[codes[j + 1]][codes[i + 1]][codes[j + 2]][1];
+}
+
+inline energy_t NNModel::CompiledClosingThreeDangle(int i, int j) const {
+	return dt->dangle[codes[i + 1]][codes[j + 1]][codes[i + 2]][1];
+}
+
+inline energy_t NNModel::CompiledMismatch(int i, int j) const {
+	return dt->tstkm[codes[j + 1]][codes[i + 1]][codes[j + 2]][codes[i]];
+}
+
+inline energy_t NNModel::CompiledClosingMismatch(int i, int j) const {
+	return dt->tstkm[codes[i + 1]][codes[j + 1]][codes[i + 2]][codes[j]];
+}
 }
 
 #endif //RNARK_NN_MODEL_HPP
@@ -5,6 +5,8 @@
 #ifndef RNARK_NN_UNPAIRED_MODEL_HPP
 #define RNARK_NN_UNPAIRED_MODEL_HPP
 
+#include <vector>
+
 #include "nn_model.hpp"
 
 namespace librnary {
@@ -17,12 +19,27 @@ protected:
 	energy_t ml_init = 101, ml_br_cost = -3, ml_up_cost = -3;
 	kcalmol_t ml_log_mult = 1.1;
 	int ml_up_pivot = 6;
+
+	/// Marks the multi-loop closure table out of date after a parameter change. It is rebuilt by the next SetRNA.
+	void InvalidateMLClosureTable();
+private:
+	/// MLClosure(up, 0) for every up < ml_closure_table.size().
+	std::vector<energy_t> ml_closure_table;
 public:
 
 	/// The constant cost of a branch in a multi-loop.
 	energy_t MLBranchCost() const;
 	/// The initiation cost of a multi-loop exlcluding the cost of branches.
-	energy_t MLClosure(int unpaired) const;
+	energy_t MLClosure(int unpaired) const {
+		if (unpaired < static_cast<int>(ml_closure_table.size()))
+			return ml_closure_table[unpaired];
+		return MLClosure(unpaired, 0);
+	}
+	/**
+	 * MLClosure(up) for every up from 0 to the length of the longest RNA set since the parameters last changed, as one
+	 * contiguous array. Folders read this in their multi-loop loops instead of calling MLClosure per unpaired count.
+	 */
+	const std::vector<energy_t> &MLClosureTable() const;
 	/// The initiation cost of a multi-loop given only the relevant features.
 	virtual energy_t MLClosure(int unpaired, int branches) const;
 	/// The multi-loop initiation cost of a given loop region. Assumed to be a multi-loop.
@@ -42,6 +59,9 @@ public:
 	int MLUnpairedPivot() const;
 	void SetMLUnpairedPivot(int ml_up_pivot);
 
+	/// Sets the current working RNA, and extends the closure table to cover every multi-loop in it.
+	void SetRNA(const PrimeStructure &rna);
+
 	NNUnpairedModel(const std::string &_data_path, const PrimeStructure &_rna)
 		: NNModel(_data_path, _rna) {}
 	NNUnpairedModel(const std::string &_data_path)
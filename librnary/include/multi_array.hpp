@@ -7,7 +7,13 @@
 
 #include <vector>
 #include <array>
+#include <algorithm>
 #include <cstdarg>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <new>
 
 namespace librnary {
 /**
@@ -53,7 +59,7 @@ class Array1D {
 	bool owner = false;
 public:
 	Array1D()
-		: c(0) {}
+		: arr(nullptr), c(0) {}
 	Array1D(T *_arr, size_t _c)
 		: arr(_arr), c(_c) {}
 	Array1D(size_t _c, T base_val)
@@ -63,6 +69,8 @@ public:
 		std::fill(arr, arr + c, base_val);
 	}
 	void operator=(const Array1D<T> &base) {
+		if (this == &base)
+			return;
 		if (owner)
 			delete[] arr;
 		c = base.c;
@@ -71,6 +79,8 @@ public:
 			arr = new T[c];
 			std::copy(base.arr, base.arr + c, arr);
 		} else {
+			// A view of storage owned elsewhere, which this must not free.
+			owner = false;
 			arr = base.arr;
 		}
 	}
@@ -99,7 +109,7 @@ class Array2D {
 	bool owner = false;
 public:
 	Array2D()
-		: r(0) {}
+		: arr(nullptr), r(0), c(0) {}
 	Array2D(T *_arr, size_t _r, size_t _c)
 		: arr(_arr), r(_r), c(_c) {}
 	Array2D(size_t _r, size_t _c, T base_val)
@@ -109,6 +119,8 @@ public:
 		owner = true;
 	}
 	void operator=(const Array2D<T> &base) {
+		if (this == &base)
+			return;
 		if (owner)
 			delete[] arr;
 		c = base.c;
@@ -118,6 +130,8 @@ public:
 			arr = new T[r*c];
 			std::copy(base.arr, base.arr + r*c, arr);
 		} else {
+			// A view of storage owned elsewhere, which this must not free.
+			owner = false;
 			arr = base.arr;
 		}
 	}
@@ -128,6 +142,12 @@ public:
 		if (owner)
 			delete[] arr;
 	}
+	size_t Rows() const {
+		return r;
+	}
+	size_t Cols() const {
+		return r == 0 ? 0 : c;
+	}
 	const Array1D<T> operator[](size_t loc) const {
 		assert(loc < r);
 		return Array1D<T>(arr + loc * c, c);
@@ -145,7 +165,7 @@ class Array3D {
 	bool owner = false;
 public:
 	Array3D()
-		: rr(0) {}
+		: arr(nullptr), rr(0), r(0), c(0) {}
 	Array3D(T *_arr, size_t _rr, size_t _r, size_t _c)
 		: arr(_arr), rr(_rr), r(_r), c(_c) {}
 	Array3D(size_t _rr, size_t _r, size_t _c, T base_val)
@@ -158,6 +178,8 @@ public:
 		(*this) = base;
 	}
 	void operator=(const Array3D<T> &base) {
+		if (this == &base)
+			return;
 		if (owner)
 			delete[] arr;
 		c = base.c;
@@ -168,6 +190,8 @@ public:
 			arr = new T[rr * r * c];
 			std::copy(base.arr, base.arr + rr * r * c, arr);
 		} else {
+			// A view of storage owned elsewhere, which this must not free.
+			owner = false;
 			arr = base.arr;
 		}
 	}
@@ -192,7 +216,7 @@ class Array4D {
 	bool owner = false;
 public:
 	Array4D()
-		: rrr(0) {}
+		: arr(nullptr), rrr(0), rr(0), r(0), c(0) {}
 	Array4D(T *_arr, size_t _rrr, size_t _rr, size_t _r, size_t _c)
 		: arr(_arr), rrr(_rrr), rr(_rr), r(_r), c(_c) {}
 	Array4D(size_t _rrr, size_t _rr, size_t _r, size_t _c, T base_val)
@@ -205,6 +229,8 @@ public:
 		(*this) = base;
 	}
 	void operator=(const Array4D<T> &base) {
+		if (this == &base)
+			return;
 		if (owner)
 			delete[] arr;
 		c = base.c;
@@ -216,6 +242,8 @@ public:
 			arr = new T[rrr * rr * r * c];
 			std::copy(base.arr, base.arr + rrr * rr * r * c, arr);
 		} else {
+			// A view of storage owned elsewhere, which this must not free.
+			owner = false;
 			arr = base.arr;
 		}
 	}
@@ -233,6 +261,454 @@ public:
 	}
 };
 
+/**
+ * A minimal allocator that hands out storage aligned to Alignment bytes. The default of 64 matches the cache line
+ * size of every x86 machine we run on, so a table allocated with this never straddles a line at its start.
+ * The original pointer from operator new is stashed just before the aligned block so it can be freed later.
+ */
+template<typename T, size_t Alignment = 64>
+class AlignedAllocator {
+public:
+	typedef T value_type;
+	template<typename U>
+	struct rebind {
+		typedef AlignedAllocator<U, Alignment> other;
+	};
+	AlignedAllocator() = default;
+	template<typename U>
+	AlignedAllocator(const AlignedAllocator<U, Alignment> &) {}
+	T *allocate(size_t n) {
+		void *raw = ::operator new(n * sizeof(T) + Alignment + sizeof(void *));
+		auto addr = reinterpret_cast<uintptr_t>(raw) + sizeof(void *);
+		auto aligned = (addr + Alignment - 1) & ~static_cast<uintptr_t>(Alignment - 1);
+		reinterpret_cast<void **>(aligned)[-1] = raw;
+		return reinterpret_cast<T *>(aligned);
+	}
+	void deallocate(T *p, size_t) {
+		::operator delete(reinterpret_cast<void **>(p)[-1]);
+	}
+	template<typename U>
+	bool operator==(const AlignedAllocator<U, Alignment> &) const {
+		return true;
+	}
+	template<typename U>
+	bool operator!=(const AlignedAllocator<U, Alignment> &) const {
+		return false;
+	}
+};
+
+/// Memory layouts available to TriangularArray.
+enum class TriangularLayout {
+	/// Cells (i,i-1), (i,i), ..., (i,n-1) of a row are contiguous. Suits fills with i descending and j ascending.
+	RowMajor,
+	/// Cells with the same span j-i are contiguous. Suits fills that sweep anti-diagonals.
+	DiagonalMajor,
+	/// Cells (0,j), (1,j), ..., (j+1,j) of a column are contiguous. Suits tables read down a column, like the
+	/// transposed shadows the folders keep for MinPlus.
+	ColumnMajor
+};
+
+/**
+ * An upper-triangular n*n table stored in one flat, cache aligned block. Nearly every DP table in an RNA folding
+ * algorithm is indexed by a range [i,j] with i<=j, so nested vectors waste half their memory on the j<i part and
+ * pay for a pointer chase on every row. This class stores only cells with j >= i-1. The extra sub-diagonal j = i-1
+ * is kept because empty fragments [i,i-1] are read (and sometimes written) as base cases by the folders.
+ * Indexing is done as arr[i][j], so it is a drop-in replacement for VV<T>.
+ * Like Array2D, the table can either own its cells or view a block of memory owned by someone else (see Bind).
+ * Copying a view copies the pointer, not the cells.
+ *
+ * The table can also be banded, keeping only cells with j - i < band, for folds that limit how far apart paired
+ * nucleotides may be. A banded row-major table gives every row band+1 cells, so it holds O(n*band) cells.
+ * @tparam T Element type.
+ * @tparam Layout Storage order of the cells. See TriangularLayout.
+ */
+template<typename T, TriangularLayout Layout = TriangularLayout::RowMajor>
+class TriangularArray {
+	std::vector<T, AlignedAllocator<T>> elems;
+	/// Either elems.data() or the external block passed to Bind.
+	T *data = nullptr;
+	int n = 0, band = 0;
+	bool owner = true;
+
+	/**
+	 * Offset of the first cell in row i of a row-major table. Unbanded, row r holds n-r+1 cells starting at j = r-1.
+	 * Banded, every row holds bd+1 cells.
+	 */
+	static size_t RowStart(int sz, int bd, int i) {
+		if (bd >= sz)
+			return static_cast<size_t>(i) * (sz + 1) - static_cast<size_t>(i) * (i - 1) / 2;
+		return static_cast<size_t>(i) * (bd + 1);
+	}
+
+	/// Offset of the first cell on diagonal d = j-i of a diagonal-major table. Diagonal d holds n-d cells.
+	static size_t DiagonalStart(int sz, int d) {
+		return static_cast<size_t>(d + 1) * sz + 1 - static_cast<size_t>((d - 1) * d / 2);
+	}
+
+	/**
+	 * Offset of the (possibly unstored) cell (0,j) of a column-major table. Unbanded, column j holds the j+2 cells
+	 * i = 0..j+1, from column -1 on. Banded, every column holds bd+1 cells, from i = j-bd+1.
+	 */
+	static size_t ColumnStart(int sz, int bd, int j) {
+		if (bd >= sz)
+			return static_cast<size_t>(j + 1) * (j + 2) / 2;
+		return static_cast<size_t>(j + 2) * bd;
+	}
+
+	/// Flat index of the cell (i,j).
+	size_t Index(int i, int j) const {
+		assert(i >= 0 && i <= n && j >= i - 1 && j < n && j - i < band);
+		if (Layout == TriangularLayout::RowMajor)
+			return RowStart(n, band, i) + (j - i + 1);
+		if (Layout == TriangularLayout::ColumnMajor)
+			return ColumnStart(n, band, j) + i;
+		return DiagonalStart(n, j - i) + i;
+	}
+
+	void Shape(size_t _n, size_t _band) {
+		n = static_cast<int>(_n);
+		band = static_cast<int>(std::max<size_t>(1, std::min(_n, _band)));
+	}
+
+public:
+	/// Number of cells needed to store an n*n table. The +1 is the sub-diagonal cell (n,n-1).
+	static size_t Cells(size_t sz) {
+		return sz * (sz + 3) / 2 + 1;
+	}
+
+	/// Number of cells needed to store an n*n table keeping the cells with j - i < band.
+	static size_t Cells(size_t sz, size_t bd) {
+		if (bd >= sz)
+			return Cells(sz);
+		bd = std::max<size_t>(1, bd);
+		if (Layout != TriangularLayout::DiagonalMajor)
+			return (sz + 1) * (bd + 1);
+		return DiagonalStart(static_cast<int>(sz), static_cast<int>(bd));
+	}
+
+	/**
+	 * A single row of a TriangularArray. Only valid while the parent array is alive and unresized.
+	 * For row-major tables the row start is resolved once, so row[j] is a plain pointer offset.
+	 */
+	template<typename PtrT>
+	class RowRef {
+		PtrT *base;
+		int n, band, i;
+	public:
+		RowRef(PtrT *data, int _n, int _band, int _i)
+			: base(data), n(_n), band(_band), i(_i) {
+			assert(i >= 0 && i <= n);
+			if (Layout == TriangularLayout::RowMajor)
+				base += RowStart(n, band, i) - (i - 1);
+		}
+		PtrT &operator[](int j) const {
+			assert(j >= i - 1 && j < n && j - i < band);
+			if (Layout == TriangularLayout::RowMajor)
+				return base[j];
+			if (Layout == TriangularLayout::ColumnMajor)
+				return base[ColumnStart(n, band, j) + i];
+			return base[DiagonalStart(n, j - i) + i];
+		}
+	};
+
+	typedef RowRef<T> Row;
+	typedef RowRef<const T> ConstRow;
+
+	TriangularArray() = default;
+
+	/**
+	 * @param _n Number of rows (and columns) in the table.
+	 * @param initv Value every cell starts with.
+	 */
+	TriangularArray(size_t _n, const T &initv) {
+		Assign(_n, initv);
+	}
+
+	TriangularArray(const TriangularArray &o)
+		: elems(o.elems), data(o.owner ? elems.data() : o.data), n(o.n), band(o.band), owner(o.owner) {}
+
+	TriangularArray(TriangularArray &&o) noexcept
+		: elems(std::move(o.elems)), data(o.owner ? elems.data() : o.data), n(o.n), band(o.band), owner(o.owner) {
+		o.data = nullptr;
+		o.n = o.band = 0;
+	}
+
+	TriangularArray &operator=(TriangularArray &&o) noexcept {
+		if (this != &o) {
+			elems = std::move(o.elems);
+			data = o.owner ? elems.data() : o.data;
+			n = o.n;
+			band = o.band;
+			owner = o.owner;
+			o.data = nullptr;
+			o.n = o.band = 0;
+		}
+		return *this;
+	}
+
+	TriangularArray &operator=(const TriangularArray &o) {
+		if (this != &o) {
+			elems = o.elems;
+			data = o.owner ? elems.data() : o.data;
+			n = o.n;
+			band = o.band;
+			owner = o.owner;
+		}
+		return *this;
+	}
+
+	/**
+	 * Reshapes the table to _n*_n and sets every cell to initv. The table owns its cells afterwards.
+	 * Only touches the cells used by the new shape, and only allocates if the shape is larger than any before it.
+	 * @param _band If less than _n, only cells with j - i < _band are kept.
+	 */
+	void Assign(size_t _n, const T &initv, size_t _band = std::numeric_limits<size_t>::max()) {
+		Shape(_n, _band);
+		owner = true;
+		elems.assign(Cells(_n, _band), initv);
+		data = elems.data();
+	}
+
+	/**
+	 * Reshapes the table to _n*_n over external storage and sets every cell to initv.
+	 * Any cells the table owned are freed.
+	 * @param storage Block of at least Cells(_n, _band) elements. Must outlive every use of the table.
+	 * @param _band If less than _n, only cells with j - i < _band are kept.
+	 */
+	void Bind(size_t _n, const T &initv, T *storage, size_t _band = std::numeric_limits<size_t>::max()) {
+		Shape(_n, _band);
+		owner = false;
+		std::vector<T, AlignedAllocator<T>>().swap(elems);
+		data = storage;
+		std::fill(data, data + Cells(_n, _band), initv);
+	}
+
+	/// Releases all memory held by the table. A view is simply detached from its storage.
+	void Clear() {
+		n = band = 0;
+		owner = true;
+		std::vector<T, AlignedAllocator<T>>().swap(elems);
+		data = nullptr;
+	}
+
+	/// Whether the cells are owned by this table, as opposed to viewed through Bind.
+	bool Owner() const {
+		return owner;
+	}
+
+	/// The number of rows (and columns) in the table.
+	size_t Size() const {
+		return static_cast<size_t>(n);
+	}
+
+	/// Cells (i,j) are kept for j - i < Band(). Equal to Size() for an unbanded table.
+	size_t Band() const {
+		return static_cast<size_t>(band);
+	}
+
+	/// Bytes of memory used by the cells of the current shape.
+	size_t Bytes() const {
+		return n == 0 ? 0 : Cells(n, band) * sizeof(T);
+	}
+
+	/// Pointer to the first cell. Owned tables are guaranteed to be 64 byte aligned, views are as aligned as their storage.
+	const T *Data() const {
+		return data;
+	}
+
+	T &operator()(int i, int j) {
+		return data[Index(i, j)];
+	}
+
+	const T &operator()(int i, int j) const {
+		return data[Index(i, j)];
+	}
+
+	Row operator[](int i) {
+		return Row(data, n, band, i);
+	}
+
+	ConstRow operator[](int i) const {
+		return ConstRow(data, n, band, i);
+	}
+
+	/**
+	 * Expands the table into nested vectors. Cells below the stored triangle, or outside the band, are given the
+	 * value fill. Useful for debugging and for APIs that predate this class.
+	 */
+	std::vector<std::vector<T>> ToNested(const T &fill) const {
+		std::vector<std::vector<T>> res(Size(), std::vector<T>(Size(), fill));
+		for (int i = 0; i < n; ++i)
+			for (int j = i; j < n && j - i < band; ++j)
+				res[i][j] = (*this)(i, j);
+		return res;
+	}
+};
+
+/**
+ * An upper-triangular n*n table like a row-major TriangularArray, except that it can keep just a window of its rows.
+ * Folders fill their tables with i descending, and some tables are only ever read a few rows below the row being
+ * filled. With a window of w rows, row i shares its storage with rows i+w, i+2w, ..., so only w*(n+1) cells are
+ * held. Such a row must be cleared with ResetRow before it is filled. With a window of n or more every row is kept,
+ * in the same triangle TriangularArray uses.
+ * Like TriangularArray, the table can also be banded, in which case each row holds band+1 cells.
+ * Indexing is done as arr[i][j]. Like TriangularArray, the table can own its cells or view external memory.
+ * @tparam T Element type.
+ */
+template<typename T>
+class RowWindowArray {
+	std::vector<T, AlignedAllocator<T>> elems;
+	/// Either elems.data() or the external block passed to Bind.
+	T *data = nullptr;
+	int n = 0, window = 0, band = 0;
+	bool owner = true;
+
+	/// Offset of the cell (i,i-1), the first stored cell of row i.
+	size_t RowStart(int i) const {
+		assert(i >= 0 && i <= n);
+		if (window >= n && band >= n)
+			return static_cast<size_t>(i) * (n + 1) - static_cast<size_t>(i) * (i - 1) / 2;
+		size_t slot = window >= n ? i : i % window;
+		return slot * (band + 1);
+	}
+
+	void Shape(size_t _n, size_t _window, size_t _band) {
+		n = static_cast<int>(_n);
+		window = static_cast<int>(std::max<size_t>(1, std::min(_n, _window)));
+		band = static_cast<int>(std::max<size_t>(1, std::min(_n, _band)));
+	}
+
+public:
+	/**
+	 * A single row of a RowWindowArray. Only valid while the parent array is alive and unresized, and until the row's
+	 * storage is given to another row.
+	 */
+	template<typename PtrT>
+	class RowRef {
+		/// The cell (i,i-1).
+		PtrT *start;
+		int n, band, i;
+	public:
+		RowRef(PtrT *_start, int _n, int _band, int _i)
+			: start(_start), n(_n), band(_band), i(_i) {}
+		PtrT &operator[](int j) const {
+			assert(j >= i - 1 && j < n && j - i < band);
+			return start[j - i + 1];
+		}
+	};
+
+	typedef RowRef<T> Row;
+	typedef RowRef<const T> ConstRow;
+
+	/// Number of cells needed to store an n*n table keeping window rows, and the cells with j - i < band.
+	static size_t Cells(size_t sz, size_t window, size_t band = std::numeric_limits<size_t>::max()) {
+		if (window >= sz && band >= sz)
+			return TriangularArray<T>::Cells(sz);
+		size_t rows = window >= sz ? sz + 1 : std::max<size_t>(1, window);
+		return rows * (std::max<size_t>(1, std::min(sz, band)) + 1);
+	}
+
+	RowWindowArray() = default;
+
+	RowWindowArray(const RowWindowArray &o)
+		: elems(o.elems), data(o.owner ? elems.data() : o.data), n(o.n), window(o.window), band(o.band),
+		  owner(o.owner) {}
+
+	RowWindowArray &operator=(const RowWindowArray &o) {
+		if (this != &o) {
+			elems = o.elems;
+			data = o.owner ? elems.data() : o.data;
+			n = o.n;
+			window = o.window;
+			band = o.band;
+			owner = o.owner;
+		}
+		return *this;
+	}
+
+	/**
+	 * Reshapes the table to _n*_n keeping _window rows, and sets every cell to initv. The table owns its cells
+	 * afterwards.
+	 * @param _band If less than _n, only cells with j - i < _band are kept.
+	 */
+	void Assign(size_t _n, size_t _window, const T &initv, size_t _band = std::numeric_limits<size_t>::max()) {
+		Shape(_n, _window, _band);
+		owner = true;
+		elems.assign(Cells(_n, _window, _band), initv);
+		data = elems.data();
+	}
+
+	/**
+	 * Reshapes the table over external storage, as Assign does. Any cells the table owned are freed.
+	 * @param storage Block of at least Cells(_n, _window, _band) elements. Must outlive every use of the table.
+	 */
+	void Bind(size_t _n, size_t _window, const T &initv, T *storage,
+			  size_t _band = std::numeric_limits<size_t>::max()) {
+		Shape(_n, _window, _band);
+		owner = false;
+		std::vector<T, AlignedAllocator<T>>().swap(elems);
+		data = storage;
+		std::fill(data, data + Cells(_n, _window, _band), initv);
+	}
+
+	/// Releases all memory held by the table. A view is simply detached from its storage.
+	void Clear() {
+		n = window = band = 0;
+		owner = true;
+		std::vector<T, AlignedAllocator<T>>().swap(elems);
+		data = nullptr;
+	}
+
+	/// Sets the stored cells of row i to initv, discarding whichever row shared their storage.
+	void ResetRow(int i, const T &initv) {
+		T *row = data + RowStart(i);
+		std::fill(row, row + (std::min(n, i + band) - i + 1), initv);
+	}
+
+	/// Whether rows are being recycled, as opposed to every row being kept.
+	bool Windowed() const {
+		return window < n;
+	}
+
+	/// The number of rows kept.
+	size_t Window() const {
+		return static_cast<size_t>(window);
+	}
+
+	/// Cells (i,j) are kept for j - i < Band(). Equal to Size() for an unbanded table.
+	size_t Band() const {
+		return static_cast<size_t>(band);
+	}
+
+	/// The number of rows (and columns) in the table.
+	size_t Size() const {
+		return static_cast<size_t>(n);
+	}
+
+	/// Bytes of memory used by the cells of the current shape.
+	size_t Bytes() const {
+		return n == 0 ? 0 : Cells(n, window, band) * sizeof(T);
+	}
+
+	T &operator()(int i, int j) {
+		assert(j >= i - 1 && j < n && j - i < band);
+		return data[RowStart(i) + (j - i + 1)];
+	}
+
+	const T &operator()(int i, int j) const {
+		assert(j >= i - 1 && j < n && j - i < band);
+		return data[RowStart(i) + (j - i + 1)];
+	}
+
+	Row operator[](int i) {
+		return Row(data + RowStart(i), n, band, i);
+	}
+
+	ConstRow operator[](int i) const {
+		return ConstRow(data + RowStart(i), n, band, i);
+	}
+};
+
 }
 
 #endif //RNARK_MULTI_ARRAY_HPP
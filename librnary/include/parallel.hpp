@@ -7,13 +7,105 @@
 
 #include <iterator>
 #include <thread>
-#include <future>
 #include <vector>
 #include <algorithm>
-#include <cmath>
+#include <cassert>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <utility>
 
 namespace librnary {
 
+/**
+ * A fixed set of worker threads that stay alive between jobs, so loops can be split across threads without
+ * spawning threads per loop. The calling thread also takes part in every job, so a pool of size n starts n - 1
+ * workers.
+ *
+ * Each job's index range is split evenly between the threads. A thread works through its own part from the front,
+ * a few indices at a time, and once it runs out it steals the back half of another thread's remaining part. Uneven
+ * work, like folding a mix of tRNAs and 23S rRNAs, therefore keeps every thread busy until the job is done.
+ */
+class ThreadPool {
+	/// The part of the current job's index range owned by one thread.
+	struct Range {
+		std::mutex m;
+		size_t lo = 0, hi = 0;
+	};
+
+	std::vector<std::thread> workers;
+	/// One range per thread. Slot 0 belongs to the caller of ParallelFor, slot t to workers[t - 1].
+	std::unique_ptr<Range[]> ranges;
+	/// Serialises ParallelFor calls from different threads sharing the pool.
+	std::mutex job_mutex;
+	/// Guards the fields below, which describe the current job.
+	std::mutex state_mutex;
+	std::condition_variable start_cv, done_cv;
+	const std::function<void(size_t)> *job = nullptr;
+	/// Indices a thread takes from its own range at a time.
+	size_t grain = 1;
+	/// Bumped for every job so sleeping workers can tell a new job from a spurious wake up.
+	size_t generation = 0;
+	/// Workers still running the current job.
+	size_t busy = 0;
+	bool stopping = false;
+
+	/// Takes up to grain indices from the front of slot's range into [lo, hi). Returns false if it was empty.
+	bool Take(size_t slot, size_t &lo, size_t &hi);
+
+	/// Moves the back half of another thread's range into slot's range, then takes from it like Take.
+	bool Steal(size_t slot, size_t &lo, size_t &hi);
+
+	/// Runs indices of the current job from slot's range, then from other ranges, until there are none left.
+	void RunJob(size_t slot);
+
+	void WorkerLoop(size_t slot);
+
+public:
+	/**
+	 * @param threads Total threads to use, including the caller of ParallelFor. Values below 1 are treated as 1.
+	 */
+	explicit ThreadPool(size_t threads = std::thread::hardware_concurrency());
+
+	ThreadPool(const ThreadPool &) = delete;
+
+	ThreadPool &operator=(const ThreadPool &) = delete;
+
+	~ThreadPool();
+
+	/// Total threads used by ParallelFor, including the caller.
+	size_t Size() const;
+
+	/**
+	 * Calls f(i) for every i in [begin, end), spread across the pool, and returns once all calls have finished.
+	 * Calls may run in any order and concurrently, so f must be safe to call from several threads at once.
+	 * A ParallelFor on this pool from inside f runs serially on the calling thread.
+	 * @param grain Indices a thread claims at a time. Zero picks a grain from the range size.
+	 */
+	void ParallelFor(size_t begin, size_t end, const std::function<void(size_t)> &f, size_t grain = 0);
+};
+
+/**
+ * A process-wide pool with the given number of threads, created on first use and kept until exit.
+ * This is what the parallel_* functions below run on.
+ */
+ThreadPool &SharedThreadPool(size_t threads);
+
+/**
+ * Calls f(i) for every i in [begin, end) using a shared pool. Indices are handed out dynamically, so f may take
+ * very different times for different i.
+ * @param threads Number of threads to use.
+ */
+template<typename Func>
+void parallel_for(size_t begin, size_t end, const Func &f, size_t threads = std::thread::hardware_concurrency()) {
+	assert(threads >= 1);
+	SharedThreadPool(threads).ParallelFor(begin, end, [&](size_t i) {
+		f(i);
+	});
+}
+
 /**
  * Transforms one vector into another. Similar to (but not the same as) std::transform.
  * @tparam T1 Type of elements in the source vector.
@@ -29,66 +121,72 @@ void parallel_transform(const std::vector<T1> &A,
 						std::vector<T2> &B,
 						const Func &f,
 						size_t threads = std::thread::hardware_concurrency()) {
-	using namespace std;
-	auto block_sz = static_cast<size_t>(ceil(A.size() / static_cast<double>(threads)));
-	auto execute = [&](size_t iA, size_t jA) {
-		for (size_t i = iA; i < jA; ++i) {
-			B[i] = f(A[i]);
-		}
-	};
-	vector<thread> thread_list;
-	for (size_t i = 0; i < threads; ++i) {
-		thread_list.emplace_back(execute, i * block_sz, min(A.size(), (i + 1) * block_sz));
-	}
-	for (size_t i = 0; i < threads; ++i) {
-		thread_list[i].join();
-	}
+	assert(B.size() >= A.size());
+	parallel_for(0, A.size(), [&](size_t i) {
+		B[i] = f(A[i]);
+	}, threads);
 }
 
-namespace {
-template<typename It>
-It p_max_helper(It begin, It end, size_t threads) {
-	if (threads == 1 || std::distance(begin, end) <= 1)
-		return std::max_element(begin, end);
-	else {
-		It l, r;
-		std::thread left([&]() {
-			l = p_max_helper(begin, begin+std::distance(begin, end)/2, threads/2);
-		});
-		std::thread right([&]() {
-			r = p_max_helper(begin+std::distance(begin, end)/2, end, threads/2);
-		});
-		left.join();
-		right.join();
-		if (*r > *l)
-			return r;
-		return l;
-	}
-}
-template<typename It>
-It p_min_helper(It begin, It end, size_t threads) {
-	if (threads == 1 || std::distance(begin, end) <= 1)
-		return std::min_element(begin, end);
-	else {
-		It l, r;
-		std::thread left([&]() {
-			l = p_min_helper(begin, begin+std::distance(begin, end)/2, threads/2);
-		});
-		std::thread right([&]() {
-			r = p_min_helper(begin+std::distance(begin, end)/2, end, threads/2);
-		});
-		left.join();
-		right.join();
-		if (*r < *l)
-			return r;
-		return l;
-	}
+/**
+ * Combines f(begin), ..., f(end - 1) with combine, starting from identity.
+ * The range is reduced in fixed blocks whose results are combined in order, so combine only needs to be
+ * associative and the result does not depend on scheduling, even for floating point.
+ * @param identity Value such that combine(identity, x) == x.
+ * @param f Maps an index to a value.
+ * @param combine Combines two values.
+ * @param threads Number of threads to use.
+ */
+template<typename T, typename Func, typename Combine>
+T parallel_reduce(size_t begin, size_t end, T identity, const Func &f, const Combine &combine,
+				  size_t threads = std::thread::hardware_concurrency()) {
+	if (begin >= end)
+		return identity;
+	size_t n = end - begin;
+	size_t blocks = std::min(n, threads * 16);
+	size_t block_sz = (n + blocks - 1) / blocks;
+	blocks = (n + block_sz - 1) / block_sz;
+	std::vector<T> partial(blocks, identity);
+	parallel_for(0, blocks, [&](size_t b) {
+		size_t lo = begin + b * block_sz, hi = std::min(end, lo + block_sz);
+		T acc = f(lo);
+		for (size_t i = lo + 1; i < hi; ++i)
+			acc = combine(acc, f(i));
+		partial[b] = acc;
+	}, threads);
+	T res = identity;
+	for (const auto &p : partial)
+		res = combine(res, p);
+	return res;
 }
+
+/**
+ * The index i in [begin, end) maximising score(i), or end if the range is empty. Ties go to the smallest index.
+ * @param score Maps an index to a default constructible value comparable with <. Called once per index.
+ * @param threads Number of threads to use.
+ */
+template<typename Func>
+size_t parallel_argmax(size_t begin, size_t end, const Func &score,
+					   size_t threads = std::thread::hardware_concurrency()) {
+	// Reduce over (score, index) pairs so each index is scored once. Index end marks the identity.
+	typedef typename std::decay<decltype(score(begin))>::type Score;
+	typedef std::pair<Score, size_t> Scored;
+	return parallel_reduce(begin, end, Scored(Score(), end), [&](size_t i) {
+		return Scored(score(i), i);
+	}, [&](const Scored &a, const Scored &b) {
+		if (a.second == end)
+			return b;
+		if (b.second == end)
+			return a;
+		// Keep the earlier index unless the later one is strictly better.
+		if (a.second < b.second)
+			return a.first < b.first ? b : a;
+		return b.first < a.first ? a : b;
+	}, threads).second;
 }
 
 /**
  * The same as to std::max_element.
- * @tparam It Iterator type.
+ * @tparam It Random access iterator type.
  * @param begin Begin iterator.
  * @param end End iterator.
  * @return Iterator to the maximum element.
@@ -96,20 +194,34 @@ It p_min_helper(It begin, It end, size_t threads) {
 template<typename It>
 It parallel_max_element(It begin, It end, size_t threads = std::thread::hardware_concurrency()) {
 	assert(threads >= 1);
-	return p_max_helper(begin, end, threads);
+	auto n = static_cast<size_t>(std::distance(begin, end));
+	return begin + parallel_argmax(0, n, [&](size_t i) {
+		return begin[i];
+	}, threads);
 }
 
 /**
  * The same as to std::min_element.
- * @tparam It Iterator type.
+ * @tparam It Random access iterator type.
  * @param begin Begin iterator.
  * @param end End iterator.
- * @return Iterator to the maximum element.
+ * @return Iterator to the minimum element.
  */
 template<typename It>
 It parallel_min_element(It begin, It end, size_t threads = std::thread::hardware_concurrency()) {
 	assert(threads >= 1);
-	return p_min_helper(begin, end, threads);
+	auto n = static_cast<size_t>(std::distance(begin, end));
+	return begin + parallel_reduce(0, n, n, [](size_t i) {
+		return i;
+	}, [&](size_t a, size_t b) {
+		if (a == n)
+			return b;
+		if (b == n)
+			return a;
+		if (a < b)
+			return begin[b] < begin[a] ? b : a;
+		return begin[a] < begin[b] ? a : b;
+	}, threads);
 }
 }
 
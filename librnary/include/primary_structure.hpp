@@ -29,6 +29,15 @@ PrimeStructure StringToPrimary(const std::string &seq);
 std::string PrimaryToString(const PrimeStructure &primary);
 /// Generates a random primary structure of particular length.
 PrimeStructure RandomPrimary(std::default_random_engine &re, unsigned length);
+/// A change of the base at pos.
+struct PointMutation {
+	int pos;
+	Base base;
+};
+/// Returns primary with the mutations applied.
+PrimeStructure Mutate(PrimeStructure primary, const std::vector<PointMutation> &mutations);
+/// Every single nucleotide variant of primary, three per position, each as a list of one mutation.
+std::vector<std::vector<PointMutation>> SingleMutants(const PrimeStructure &primary);
 }
 
 #endif //RNARK_PRIMARY_STRUCTURE_HPP
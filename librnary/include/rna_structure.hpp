@@ -30,6 +30,9 @@ std::unique_ptr<datatable> LoadDatatable(const std::string &path);
  */
 std::unique_ptr<structure> LoadStructure(const PrimeStructure &primary_seq);
 
+/// Sets nucleotide i (from 0) of a structure loaded by LoadStructure to b.
+void SetStructureBase(structure &struc, int i, Base b);
+
 std::unique_ptr<structure> LoadStructure(const PrimeStructure &primary_seq, const Matching &match);
 
 std::unique_ptr<structure> LoadStructure(const std::string &ct_file);
@@ -11,6 +11,7 @@
 #ifndef RNARK_SECONDARY_STRUCTURE_HPP
 #define RNARK_SECONDARY_STRUCTURE_HPP
 
+#include <cstdint>
 #include <vector>
 #include <memory>
 #include <string>
@@ -80,9 +81,22 @@ std::vector<BondPair> MatchingToBondPairs(const Matching &match);
 bool WatsonCrick(Base a, Base b);
 bool ContainsPseudoknot(const Matching &match);
 
+/**
+ * A 64-bit hash of a structure, for telling structures apart without keeping them. Distinct structures of the same
+ * RNA collide with probability around 2^-64 per pair.
+ */
+uint64_t MatchingHash(const Matching &match);
+
 /// Returns true iff the pair (i,j) has to be a lonley pair by nature of its neighbours.
 bool MustBeLonelyPair(const PrimeStructure &rna, int i, int j, int min_hairpin_unpaired);
 
+/**
+ * How far back from i the exterior loop recursions look for the first nucleotide k + 1 of the branches ending at i,
+ * when base pairs span at most max_span. A coaxial stack of two branches can reach back twice max_span; other
+ * branches reach less.
+ */
+int ExteriorReach(int max_span, bool stacking);
+
 /**
  * Finds all the stems in an RNA secondary structure. See the Stem struct.
  * @param match A matching representing a secondary structure.
@@ -18,39 +18,20 @@ class IBFMultiLoopAalberts: public IBFMultiLoop<ParamSetT, AalbertsModel, Aalber
 
 protected:
 
-	/**
-	 * Processes whatever is in fold results.
-	 * This involves storing the structural information and energy.
-	 * @return The average f-score of the fold results.
-	 */
-	double ProcessFoldResults() override {
-		double sum_f_score_avgs = 0;
-		for (size_t ctg = 0; ctg < this->cts.size(); ++ctg) {
-			double sum_f_scores = 0;
-			for (size_t i = 0; i < this->cts[ctg].size(); ++i) {
-				double fscore = librnary::F1Score(this->fold_results[ctg][i], this->cts[ctg][i].match);
-				sum_f_scores += fscore;
-				if (this->fold_results[ctg][i] != this->cts[ctg][i].match
-					&& this->false_multi_sets[ctg][i].count(this->fold_results[ctg][i]) == 0) {
-					this->false_fscores[ctg][i].push_back(fscore);
-					this->false_multi_sets[ctg][i].insert(this->fold_results[ctg][i]);
-					librnary::SSTree sst(this->fold_results[ctg][i]);
-					this->zero_ml_scorer.SetRNA(this->cts[ctg][i].primary);
-					this->false_multi_base_energies[ctg][i].push_back(
-						this->zero_ml_scorer.ScoreExterior(sst.RootSurface()));
+	/// As in IBFMultiLoop, but AalbertsMultiInfo needs the scorer to measure each loop.
+	void StoreFalseStructure(size_t ctg, size_t i, double fscore) override {
+		this->false_fscores[ctg][i].push_back(fscore);
+		librnary::SSTree sst(this->fold_results[ctg][i]);
+		this->zero_ml_scorer.SetRNA(this->cts[ctg][i].primary);
+		this->false_multi_base_energies[ctg][i].push_back(this->zero_ml_scorer.ScoreExterior(sst.RootSurface()));
 
-					this->false_multi_info[ctg][i].emplace_back();
+		this->false_multi_info[ctg][i].emplace_back();
 
-					std::vector<librnary::Surface> loops;
-					librnary::ExtractMultiLoopSurfaces(loops, sst.RootSurface());
-					for (const auto &loop : loops) {
-						this->false_multi_info[ctg][i].back().emplace_back(this->zero_ml_scorer, loop);
-					}
-				}
-			}
-			sum_f_score_avgs += sum_f_scores / this->cts[ctg].size();
+		std::vector<librnary::Surface> loops;
+		librnary::ExtractMultiLoopSurfaces(loops, sst.RootSurface());
+		for (const auto &loop : loops) {
+			this->false_multi_info[ctg][i].back().emplace_back(this->zero_ml_scorer, loop);
 		}
-		return sum_f_score_avgs / this->cts.size();
 	}
 
 
@@ -8,7 +8,11 @@
 
 #include <vector>
 #include <iostream>
-#include <set>
+#include <limits>
+#include <functional>
+#include <random>
+#include <stdexcept>
+#include <utility>
 
 #include "read_cts.hpp"
 #include "energy.hpp"
@@ -17,6 +21,10 @@
 #include "parallel.hpp"
 #include "vector_types.hpp"
 #include "pseudoknot_removal.hpp"
+#include "folders/fold_workspace.hpp"
+#include "folders/batch_fold.hpp"
+#include "structure_hash_set.hpp"
+#include "param_search.hpp"
 
 namespace librnary {
 
@@ -42,66 +50,181 @@ protected:
 
 	std::vector<double> param_scores;
 
-	VV<std::set<librnary::Matching>> false_sets;
+	/// Structures already stored for each RNA, so each is only added once.
+	VV<StructureHashSet> false_sets;
 	VV<Matching> fold_results;
 
+	/// DP table memory for the folds, reused across epochs.
+	FoldWorkspacePool workspaces;
+
+	/// Load balance of the most recent FoldAllRNA.
+	BatchReport fold_report;
+
+	/// How FindBestParams looks for the best parameter set, and the shape of the parameter list it searches.
+	std::shared_ptr<const ParamSearch> search = std::make_shared<ExhaustiveSearch>();
+	ParamGrid param_grid;
+	/// Work done by the most recent FindBestParams.
+	SearchReport search_report;
+	/// Index of the parameter set used for the most recent folds.
+	size_t current_param = 0;
+
 	size_t threads = std::thread::hardware_concurrency();
 
 	int num_seeds = 0;
 	int random_seed = 0;
 
+public:
+	/**
+	 * Gives count structures of an RNA under a model, e.g. drawn from its ensemble by NNAffinePFFolder::Sample, or the
+	 * lowest free energy ones from NNAffineFolder::TracebackKBest. Called from several threads at once.
+	 */
+	typedef std::function<std::vector<Matching>(const ModelT &, const PrimeStructure &, size_t,
+												std::default_random_engine &)> SeedSampler;
+
+	/**
+	 * Folds a group of RNAs of similar length under a model together, with the settings of a folder, and gives the MFE
+	 * structure of each, e.g. in the lanes of an NNAffineBatchFolder. Called from several threads at once.
+	 */
+	typedef std::function<std::vector<Matching>(const FolderT &, const ModelT &,
+												const std::vector<PrimeStructure> &)> GroupFolder;
+
+	/**
+	 * Folds an RNA under several models, which differ only in what parameter sets load into them, together, with the
+	 * settings of a folder, and gives the MFE structure under each, e.g. in the lanes of an NNAffineParamBatchFolder.
+	 * Called from several threads at once.
+	 */
+	typedef std::function<std::vector<Matching>(const FolderT &, const std::vector<ModelT> &,
+												const PrimeStructure &)> ParamGroupFolder;
+
+protected:
+	SeedSampler seed_sampler;
+	int num_sampled_seeds = 0;
+
+	GroupFolder group_folder;
+	size_t group_width = 1;
+
+	ParamGroupFolder param_group_folder;
+	size_t param_group_width = 1;
+
 	GenericIBFTrainer(const ModelT &_zero_model, std::ostream &stream)
 		: zero_model(_zero_model), log_stream(stream), zero_scorer(zero_model) {}
 
-	virtual long FindBestParams(const std::vector<ParamSetT> &params) {
-		librnary::parallel_transform(params, param_scores, [=](const ParamSetT &pset) {
-			auto local_model = zero_model;
-			pset.LoadInto(local_model);
+	/// The average over groups of the average F-score of the structures predicted under pset.
+	virtual double ScoreParams(const ParamSetT &pset) const {
+		auto local_model = zero_model;
+		pset.LoadInto(local_model);
 
-			double sum_averages = 0;
+		double sum_averages = 0;
 
-			for (size_t ctg = 0; ctg < cts.size(); ++ctg) {
-				VE true_energies = true_base_energies[ctg];
-				auto min_base_energies = true_energies;
+		for (size_t ctg = 0; ctg < cts.size(); ++ctg) {
+			VE true_energies = true_base_energies[ctg];
+			auto min_base_energies = true_energies;
 
-				V<int> min_energy_choice(cts[ctg].size(), -1);
+			V<int> min_energy_choice(cts[ctg].size(), -1);
 
-				for (size_t i = 0; i < cts[ctg].size(); ++i) {
-					true_energies[i] = true_info[ctg][i].EnergyCost(local_model);
-				}
+			for (size_t i = 0; i < cts[ctg].size(); ++i) {
+				true_energies[i] = true_info[ctg][i].EnergyCost(local_model);
+			}
 
-				std::vector<energy_t> min_energies = true_energies;
-				for (size_t i = 0; i < cts[ctg].size(); ++i) {
-					for (size_t j = 0; j < false_info[ctg][i].size(); ++j) {
-						energy_t e = false_base_energies[ctg][i][j];
-						min_base_energies[i] = std::min(min_base_energies[i], e);
-						e += false_info[ctg][i][j].EnergyCost(local_model);
-						// This is <= so that, if the true structure is MFE but non-unique, there is a penalty.
-						if (e <= min_energies[i]) {
-							min_energies[i] = e;
-							min_energy_choice[i] = static_cast<int>(j);
-						}
+			std::vector<energy_t> min_energies = true_energies;
+			for (size_t i = 0; i < cts[ctg].size(); ++i) {
+				for (size_t j = 0; j < false_info[ctg][i].size(); ++j) {
+					energy_t e = false_base_energies[ctg][i][j];
+					min_base_energies[i] = std::min(min_base_energies[i], e);
+					e += false_info[ctg][i][j].EnergyCost(local_model);
+					// This is <= so that, if the true structure is MFE but non-unique, there is a penalty.
+					if (e <= min_energies[i]) {
+						min_energies[i] = e;
+						min_energy_choice[i] = static_cast<int>(j);
 					}
 				}
-				double sum_fscores = 0;
-				for (size_t i = 0; i < cts[ctg].size(); ++i) {
-					if (min_energy_choice[i] == -1) {
-						sum_fscores += 1;
-					} else {
-						sum_fscores += false_fscores[ctg][i][min_energy_choice[i]];
-					}
+			}
+			double sum_fscores = 0;
+			for (size_t i = 0; i < cts[ctg].size(); ++i) {
+				if (min_energy_choice[i] == -1) {
+					sum_fscores += 1;
+				} else {
+					sum_fscores += false_fscores[ctg][i][min_energy_choice[i]];
 				}
-				sum_averages += sum_fscores / cts[ctg].size();
 			}
-			return sum_averages / cts.size();
-		}, threads);
+			sum_averages += sum_fscores / cts[ctg].size();
+		}
+		return sum_averages / cts.size();
+	}
+
+	/**
+	 * An upper bound on ScoreParams over a box of parameter sets, given the parameter sets at its corners. Each
+	 * structure's energy is bounded by its lowest and highest energy over the corners, which is valid as long as the
+	 * box only spans dimensions the energy is monotone in (see ParamGrid).
+	 */
+	virtual double BoundParams(const std::vector<ParamSetT> &params, const std::vector<size_t> &corners) const {
+		std::vector<ModelT> models(corners.size(), zero_model);
+		for (size_t k = 0; k < corners.size(); ++k)
+			params[corners[k]].LoadInto(models[k]);
+		auto energy_range = [&](energy_t base, const typename ParamSetT::SSInfo &info) {
+			std::pair<energy_t, energy_t> range(std::numeric_limits<energy_t>::max(),
+												std::numeric_limits<energy_t>::min());
+			for (const auto &model : models) {
+				energy_t e = base + info.EnergyCost(model);
+				range.first = std::min(range.first, e);
+				range.second = std::max(range.second, e);
+			}
+			return range;
+		};
+
+		double sum_averages = 0;
+		std::vector<std::pair<energy_t, energy_t>> ranges;
+		for (size_t ctg = 0; ctg < cts.size(); ++ctg) {
+			double sum_fscores = 0;
+			for (size_t i = 0; i < cts[ctg].size(); ++i) {
+				// As in ScoreParams, the true structure is scored without its base energy.
+				auto true_range = energy_range(0, true_info[ctg][i]);
+				energy_t min_high = true_range.second;
+				ranges.clear();
+				for (size_t j = 0; j < false_info[ctg][i].size(); ++j) {
+					ranges.push_back(energy_range(false_base_energies[ctg][i][j], false_info[ctg][i][j]));
+					min_high = std::min(min_high, ranges.back().second);
+				}
+				// Only structures that can reach the lowest upper bound can be predicted somewhere in the box.
+				double best = true_range.first <= min_high ? 1 : 0;
+				for (size_t j = 0; j < ranges.size(); ++j)
+					if (ranges[j].first <= min_high)
+						best = std::max(best, false_fscores[ctg][i][j]);
+				sum_fscores += best;
+			}
+			sum_averages += sum_fscores / cts[ctg].size();
+		}
+		return sum_averages / cts.size();
+	}
 
-		auto it = librnary::parallel_max_element(begin(param_scores), end(param_scores), threads);
-		return distance(begin(param_scores), it);
+	virtual long FindBestParams(const std::vector<ParamSetT> &params) {
+		size_t ind = search->Search(param_grid, params.size(), current_param, [&](size_t i) {
+			return param_scores[i] = ScoreParams(params[i]);
+		}, [&](const std::vector<size_t> &corners) {
+			return BoundParams(params, corners);
+		}, threads, search_report);
+		return static_cast<long>(ind);
 	}
 
 	virtual void SeedStructures(const V<ParamSetT> &params, FolderT folder) {
 		std::default_random_engine re(random_seed);
+		if (seed_sampler && num_sampled_seeds > 0) {
+			SampleSeedStructures(params[re() % params.size()], folder, re);
+			return;
+		}
+		if (param_group_folder && num_seeds > 1) {
+			// The same parameter sets as the folds below, but every RNA is folded under all of them at once.
+			V<ParamSetT> seed_sets;
+			for (int seed = 0; seed < num_seeds; ++seed)
+				seed_sets.push_back(params[re() % params.size()]);
+			auto seed_results = FoldAllRNAUnderEach(folder, seed_sets);
+			for (int seed = 0; seed < num_seeds; ++seed) {
+				fold_results = std::move(seed_results[seed]);
+				double fscore = this->ProcessFoldResults();
+				log_stream << "Seed #" << seed+1 << " " << seed_sets[seed].to_string() << ": " << fscore << std::endl;
+			}
+			return;
+		}
 		for (int seed = 0; seed < num_seeds; ++seed) {
 			auto param_set = params[re()%params.size()];
 			FoldAllRNA(folder, param_set);
@@ -110,16 +233,53 @@ protected:
 		}
 	}
 
+	/// Seeds with num_sampled_seeds structures of each RNA drawn by seed_sampler under param_set.
+	virtual void SampleSeedStructures(const ParamSetT &param_set, const FolderT &folder,
+									  std::default_random_engine &re) {
+		auto model = zero_model;
+		param_set.LoadInto(model);
+		V<std::pair<size_t, size_t>> rnas;
+		std::vector<double> costs;
+		for (size_t ctg = 0; ctg < cts.size(); ++ctg) {
+			for (size_t i = 0; i < cts[ctg].size(); ++i) {
+				rnas.emplace_back(ctg, i);
+				costs.push_back(EstimateFoldCost(cts[ctg][i].primary.size(), folder.MaxTwoLoop()));
+			}
+		}
+		// Each RNA gets its own engine, so the samples do not depend on the order the threads take them in.
+		std::vector<std::default_random_engine::result_type> rna_seeds(rnas.size());
+		for (auto &seed : rna_seeds)
+			seed = re();
+		VV<Matching> samples(rnas.size());
+		fold_report = ScheduleLongestFirst(costs, [&](size_t r) {
+			std::default_random_engine rna_re(rna_seeds[r]);
+			samples[r] = seed_sampler(model, cts[rnas[r].first][rnas[r].second].primary,
+									  static_cast<size_t>(num_sampled_seeds), rna_re);
+		}, threads);
+		for (const auto &sample : samples) {
+			if (sample.size() < static_cast<size_t>(num_sampled_seeds))
+				throw std::runtime_error("Seed sampler returned fewer structures than asked for");
+		}
+		double sum_fscores = 0;
+		for (int k = 0; k < num_sampled_seeds; ++k) {
+			for (size_t r = 0; r < rnas.size(); ++r)
+				fold_results[rnas[r].first][rnas[r].second] = samples[r][k];
+			sum_fscores += this->ProcessFoldResults();
+		}
+		log_stream << "Sampled " << num_sampled_seeds << " seeds " << param_set.to_string() << ": "
+				   << sum_fscores / num_sampled_seeds << std::endl;
+	}
+
 	virtual void InitTraining(const V<ParamSetT> &params, FolderT folder) {
 		using namespace std;
-		false_sets = VV<set<librnary::Matching>>(cts.size());
+		false_sets = VV<StructureHashSet>(cts.size());
 		false_fscores = VVV<double>(cts.size());
 		false_info = VVV<typename ParamSetT::SSInfo>(cts.size());
 		false_base_energies = VVVE(cts.size());
 		fold_results = VV<Matching>(cts.size());
 
 		for (size_t ctg = 0; ctg < cts.size(); ++ctg) {
-			false_sets[ctg] = V<set<librnary::Matching>>(cts[ctg].size());
+			false_sets[ctg] = V<StructureHashSet>(cts[ctg].size());
 			false_fscores[ctg] = VV<double>(cts[ctg].size());
 			false_info[ctg] = VV<typename ParamSetT::SSInfo>(cts[ctg].size());
 			false_base_energies[ctg] = VVE(cts[ctg].size());
@@ -133,14 +293,91 @@ protected:
 	virtual void FoldAllRNA(FolderT folder, ParamSetT param_set) {
 		auto model = zero_model;
 		param_set.LoadInto(model);
+		// Fold every group in one batch, longest RNAs first, so threads are not left idle behind a few long folds.
+		V<std::pair<size_t, size_t>> rnas;
+		std::vector<double> costs;
 		for (size_t ctg = 0; ctg < cts.size(); ++ctg) {
-			librnary::parallel_transform(cts[ctg], fold_results[ctg], [=](const librnary::CTData &ct_data) {
-				auto local_folder = folder;
-				local_folder.SetModel(model);
-				local_folder.Fold(ct_data.primary);
-				return local_folder.Traceback();
+			for (size_t i = 0; i < cts[ctg].size(); ++i) {
+				rnas.emplace_back(ctg, i);
+				costs.push_back(EstimateFoldCost(cts[ctg][i].primary.size(), folder.MaxTwoLoop()));
+			}
+		}
+		if (group_folder) {
+			// RNAs of similar length are folded together instead, each group costing about its longest fold.
+			std::vector<size_t> lengths;
+			for (const auto &r : rnas)
+				lengths.push_back(cts[r.first][r.second].primary.size());
+			auto groups = BucketByLength(lengths, group_width);
+			std::vector<double> group_costs;
+			for (const auto &g : groups)
+				group_costs.push_back(costs[g.back()]);
+			fold_report = ScheduleLongestFirst(group_costs, [&](size_t g) {
+				V<PrimeStructure> primaries;
+				for (size_t r : groups[g])
+					primaries.push_back(cts[rnas[r].first][rnas[r].second].primary);
+				auto structures = group_folder(folder, model, primaries);
+				for (size_t x = 0; x < groups[g].size(); ++x)
+					fold_results[rnas[groups[g][x]].first][rnas[groups[g][x]].second] = std::move(structures[x]);
 			}, threads);
+			return;
+		}
+		fold_report = ScheduleLongestFirst(costs, [&](size_t r) {
+			size_t ctg = rnas[r].first, i = rnas[r].second;
+			auto local_folder = folder;
+			FoldWorkspace *ws = workspaces.Acquire();
+			local_folder.SetWorkspace(ws);
+			local_folder.SetModel(model);
+			local_folder.Fold(cts[ctg][i].primary);
+			fold_results[ctg][i] = local_folder.Traceback();
+			workspaces.Release(ws);
+		}, threads);
+	}
+
+	/**
+	 * Folds every RNA under each of param_sets with param_group_folder, under up to param_group_width of them at once.
+	 * @return The structures under each parameter set, arranged as fold_results.
+	 */
+	virtual V<VV<Matching>> FoldAllRNAUnderEach(const FolderT &folder, const V<ParamSetT> &param_sets) {
+		std::vector<ModelT> models(param_sets.size(), zero_model);
+		for (size_t k = 0; k < param_sets.size(); ++k)
+			param_sets[k].LoadInto(models[k]);
+		V<VV<Matching>> results(param_sets.size(), VV<Matching>(cts.size()));
+		for (auto &result : results)
+			for (size_t ctg = 0; ctg < cts.size(); ++ctg)
+				result[ctg].resize(cts[ctg].size());
+		// One fold of an RNA per group of parameter sets, each costing about one fold, as the lanes fill together.
+		const size_t groups = (param_sets.size() + param_group_width - 1) / param_group_width;
+		V<std::pair<size_t, size_t>> rnas;
+		std::vector<double> costs;
+		for (size_t ctg = 0; ctg < cts.size(); ++ctg) {
+			for (size_t i = 0; i < cts[ctg].size(); ++i) {
+				rnas.emplace_back(ctg, i);
+				for (size_t g = 0; g < groups; ++g)
+					costs.push_back(EstimateFoldCost(cts[ctg][i].primary.size(), folder.MaxTwoLoop()));
+			}
 		}
+		fold_report = ScheduleLongestFirst(costs, [&](size_t t) {
+			size_t ctg = rnas[t / groups].first, i = rnas[t / groups].second;
+			size_t first = t % groups * param_group_width;
+			size_t last = std::min(first + param_group_width, param_sets.size());
+			std::vector<ModelT> group(models.begin() + first, models.begin() + last);
+			auto structures = param_group_folder(folder, group, cts[ctg][i].primary);
+			for (size_t k = first; k < last; ++k)
+				results[k][ctg][i] = std::move(structures[k - first]);
+		}, threads);
+		return results;
+	}
+
+	/**
+	 * Stores what FindBestParams needs about fold_results[ctg][i], a false structure not seen before.
+	 * @param fscore F-score of the structure against the true structure.
+	 */
+	virtual void StoreFalseStructure(size_t ctg, size_t i, double fscore) {
+		false_fscores[ctg][i].push_back(fscore);
+		librnary::SSTree sst(fold_results[ctg][i]);
+		zero_scorer.SetRNA(cts[ctg][i].primary);
+		false_base_energies[ctg][i].push_back(zero_scorer.ScoreExterior(sst.RootSurface()));
+		false_info[ctg][i].emplace_back(fold_results[ctg][i]);
 	}
 
 	/**
@@ -155,16 +392,8 @@ protected:
 			for (size_t i = 0; i < cts[ctg].size(); ++i) {
 				double fscore = librnary::F1Score(fold_results[ctg][i], cts[ctg][i].match);
 				sum_f_scores += fscore;
-				if (fold_results[ctg][i] != cts[ctg][i].match
-					&& false_sets[ctg][i].count(fold_results[ctg][i]) == 0) {
-					false_fscores[ctg][i].push_back(fscore);
-					false_sets[ctg][i].insert(fold_results[ctg][i]);
-					librnary::SSTree sst(fold_results[ctg][i]);
-					zero_scorer.SetRNA(cts[ctg][i].primary);
-					false_base_energies[ctg][i].push_back(zero_scorer.ScoreExterior(sst.RootSurface()));
-
-					false_info[ctg][i].emplace_back(fold_results[ctg][i]);
-				}
+				if (fold_results[ctg][i] != cts[ctg][i].match && false_sets[ctg][i].Insert(fold_results[ctg][i]))
+					StoreFalseStructure(ctg, i, fscore);
 			}
 			sum_f_score_avgs += sum_f_scores / cts[ctg].size();
 		}
@@ -180,9 +409,57 @@ public:
 	void SetRandomSeed(int rnd) {
 		random_seed = rnd;
 	}
+	/**
+	 * Seeds the false structures with num structures of each RNA drawn by sampler, under one parameter set chosen at
+	 * random, instead of the num_seeds folds with random parameter sets. Pass a null sampler to go back to folds.
+	 */
+	void SetSeedSampler(SeedSampler sampler, int num) {
+		assert(num >= 0);
+		seed_sampler = std::move(sampler);
+		num_sampled_seeds = num;
+	}
+	/**
+	 * Makes FoldAllRNA fold RNAs of similar length in groups of up to width with folder, instead of one at a time with
+	 * copies of the folder passed to Train, which should give the same structures. Pass a null folder to go back to
+	 * single folds.
+	 */
+	void SetGroupFolder(GroupFolder folder, size_t width) {
+		assert(width >= 1);
+		group_folder = std::move(folder);
+		group_width = width;
+	}
+	/**
+	 * Makes SeedStructures fold each RNA under up to width of the seed parameter sets at once with folder, instead of
+	 * one FoldAllRNA per seed, which should give the same structures. Pass a null folder to go back to single folds.
+	 */
+	void SetParamGroupFolder(ParamGroupFolder folder, size_t width) {
+		assert(width >= 1);
+		param_group_folder = std::move(folder);
+		param_group_width = width;
+	}
 	void SetThreads(size_t num_threads) {
 		threads = num_threads;
 	}
+	/**
+	 * Sets how the best parameter set is found each epoch. Exhaustive search is used by default.
+	 * @param grid Shape of the parameter list passed to Train, needed by every search but ExhaustiveSearch.
+	 */
+	void SetParamSearch(std::shared_ptr<const ParamSearch> _search, ParamGrid grid = ParamGrid()) {
+		search = std::move(_search);
+		param_grid = std::move(grid);
+	}
+	/// Work done by the most recent parameter search.
+	const SearchReport &LastSearchReport() const {
+		return search_report;
+	}
+	/// Load balance of the most recent batch of folds.
+	const BatchReport &LastFoldReport() const {
+		return fold_report;
+	}
+	/// Bytes allocated for DP tables by all folds so far. Stops growing once every thread has folded the longest RNA.
+	size_t FoldBytesAllocated() const {
+		return workspaces.BytesAllocated();
+	}
 	/**
 	 * @param params List of parameters to optimize.
 	 * @param init Starting parameter set.
@@ -205,6 +482,9 @@ public:
 
 		// Training loop.
 		InitTraining(params, folder);
+		current_param = static_cast<size_t>(std::find(params.begin(), params.end(), init) - params.begin());
+		if (current_param == params.size())
+			current_param = 0;
 
 
 		for (int epoch = 0; epoch < num_epochs; ++epoch) {
@@ -222,6 +502,7 @@ public:
 			}
 
 			log_stream << "Epoch #" << epoch << ": " << endl << "\tAverage F-Score = " << avg_f_score << endl;
+			log_stream << "\tFolding: " << fold_report << endl;
 
 			// Find a parameter set that minimises the RMSE over all fold results.
 
@@ -229,12 +510,14 @@ public:
 
 			log_stream << "\tBest score = " << param_scores[ind] << endl;
 			log_stream << "\t" << params[ind].to_string() << endl;
+			log_stream << "\tSearch (" << search->Name() << "): " << search_report << endl;
 
 
 			// If we're stuck in a loop, break.
 			if (params[ind] == param_set)
 				break;
 			param_set = params[ind];
+			current_param = static_cast<size_t>(ind);
 		}
 		return best_set;
 	}
@@ -0,0 +1,83 @@
+#ifndef RNARK_GENERIC_IBF_TRAINER_LINEAR_HPP
+#define RNARK_GENERIC_IBF_TRAINER_LINEAR_HPP
+
+#include <tuple>
+#include <utility>
+
+#include "generic_ibf_trainer.hpp"
+#include "linear_ibf_table.hpp"
+
+namespace librnary {
+/**
+ * GenericIBFTrainer for models whose trained energy term is linear in the parameters. Picks the same parameters
+ * as GenericIBFTrainer, much faster, by scoring parameter sets against a LinearIBFTable instead of an energy model.
+ * New false structures are added to the table as they are found, so only the table is kept of them.
+ *
+ * As well as what GenericIBFTrainer needs, ParamSetT must have a Weights() method returning a
+ * std::array<energy_t, K>, and ParamSetT::SSInfo a Features() method returning a std::array<int, K>, such that
+ * EnergyCost(model) equals the dot product of the two for a model loaded with the parameters.
+ */
+template<typename ParamSetT, typename ModelT, typename ScorerT, typename FolderT>
+class GenericIBFTrainerLinear : public GenericIBFTrainer<ParamSetT, ModelT, ScorerT, FolderT> {
+	static const size_t K = std::tuple_size<decltype(std::declval<ParamSetT>().Weights())>::value;
+	typedef LinearIBFTable<K> Table;
+
+	Table table;
+	/// Table id of each RNA.
+	VV<size_t> table_ids;
+
+	/// Goes straight into the table, rather than keeping the SSInfo of every structure.
+	void StoreFalseStructure(size_t ctg, size_t i, double fscore) override {
+		SSTree sst(this->fold_results[ctg][i]);
+		this->zero_scorer.SetRNA(this->cts[ctg][i].primary);
+		energy_t base_energy = this->zero_scorer.ScoreExterior(sst.RootSurface());
+		typename ParamSetT::SSInfo info(this->fold_results[ctg][i]);
+		table.AddFalse(table_ids[ctg][i], base_energy, info.Features(), fscore);
+	}
+
+	double ScoreParams(const ParamSetT &pset) const override {
+		return table.Score(pset.Weights());
+	}
+
+	/// Bounds the weights over the box by their extremes at its corners, so each weight must be monotone in it.
+	double BoundParams(const std::vector<ParamSetT> &params, const std::vector<size_t> &corners) const override {
+		auto lo = params[corners.front()].Weights(), hi = lo;
+		for (size_t corner : corners) {
+			auto w = params[corner].Weights();
+			for (size_t k = 0; k < K; ++k) {
+				lo[k] = std::min(lo[k], w[k]);
+				hi[k] = std::max(hi[k], w[k]);
+			}
+		}
+		return table.Bound(lo, hi);
+	}
+
+	long FindBestParams(const std::vector<ParamSetT> &params) override {
+		table.Pack();
+		this->log_stream << "\tScoring table: " << table.Rows() << " rows, " << table.DistinctFeatures()
+						 << " distinct feature vectors" << std::endl;
+		return GenericIBFTrainer<ParamSetT, ModelT, ScorerT, FolderT>::FindBestParams(params);
+	}
+
+public:
+	/// Candidate rows left in the scoring table after merging structures with equal features.
+	size_t TableRows() const {
+		return table.Rows();
+	}
+
+	GenericIBFTrainerLinear(const ModelT &_zero_model, VV<CTData> _cts, std::ostream &_log)
+		: GenericIBFTrainer<ParamSetT, ModelT, ScorerT, FolderT>(_zero_model, std::move(_cts), _log) {
+		table_ids.resize(this->cts.size());
+		for (size_t ctg = 0; ctg < this->cts.size(); ++ctg) {
+			size_t group = table.AddGroup();
+			for (size_t i = 0; i < this->cts[ctg].size(); ++i) {
+				// GenericIBFTrainer::FindBestParams scores the true structure by EnergyCost alone, without its base
+				// energy, so do the same to pick the same parameters.
+				table_ids[ctg].push_back(table.AddRNA(group, 0, this->true_info[ctg][i].Features()));
+			}
+		}
+	}
+};
+}
+
+#endif //RNARK_GENERIC_IBF_TRAINER_LINEAR_HPP
@@ -0,0 +1,244 @@
+#ifndef RNARK_LINEAR_IBF_TABLE_HPP
+#define RNARK_LINEAR_IBF_TABLE_HPP
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <limits>
+#include <map>
+#include <vector>
+
+#include "energy.hpp"
+
+namespace librnary {
+
+/**
+ * The candidate structures of an IBF training set, for models whose trained energy term is linear in the
+ * parameters: the energy of a structure is base + sum_k w[k] * f[k], where w are the parameters and f counts
+ * features of the structure (for the linear multi-loop model, f = (multi-loops, branches, unpaired)).
+ *
+ * Scoring a parameter set then needs no energy model at all. Each candidate is reduced to its base energy, F-score
+ * and the id of its feature vector. Feature vectors are interned across the whole data set, since structures of
+ * different RNAs very often have the same counts, so a parameter set costs one dot product per distinct vector
+ * plus one streaming pass over the candidates. Candidates of each RNA that share a feature vector are merged, since
+ * only the one with the lowest base energy can ever be the MFE.
+ *
+ * Selection matches the IBF trainers: the lowest energy candidate is predicted, and ties go to the false
+ * structure found latest, with the true structure losing every tie.
+ * @tparam K Number of features.
+ */
+template<size_t K>
+class LinearIBFTable {
+public:
+	typedef std::array<int, K> Features;
+	typedef std::array<energy_t, K> Weights;
+
+private:
+	struct Candidate {
+		energy_t base;
+		/// Id of the interned feature vector.
+		int features;
+		/// When the structure was found. -1 for the true structure.
+		int order;
+		double fscore;
+	};
+
+	struct RNA {
+		/// The true structure first, then one candidate per distinct false feature vector.
+		std::vector<Candidate> candidates;
+		int false_structures = 0;
+	};
+
+	std::vector<RNA> rnas;
+	/// The RNAs of each group.
+	std::vector<std::vector<size_t>> groups;
+
+	/// Id of each distinct feature vector.
+	std::map<Features, int> feature_ids;
+	/// Column k holds feature k of every distinct feature vector, by id.
+	std::array<std::vector<int>, K> feature_columns;
+
+	// Packed copy of every candidate, grouped by RNA and RNAs grouped by group.
+	std::vector<energy_t> base;
+	std::vector<int> features;
+	std::vector<int> orders;
+	std::vector<double> fscores;
+	/// Candidates of the r-th packed RNA are [rna_begin[r], rna_begin[r + 1]).
+	std::vector<size_t> rna_begin;
+	bool packed = true;
+
+	int Intern(const Features &f) {
+		auto it = feature_ids.find(f);
+		if (it != feature_ids.end())
+			return it->second;
+		int id = static_cast<int>(feature_ids.size());
+		feature_ids.emplace(f, id);
+		for (size_t k = 0; k < K; ++k)
+			feature_columns[k].push_back(f[k]);
+		return id;
+	}
+
+public:
+	/// Starts a new group. Score averages the F-scores in each group, then averages the groups.
+	size_t AddGroup() {
+		groups.emplace_back();
+		return groups.size() - 1;
+	}
+
+	/**
+	 * Adds an RNA to a group.
+	 * @param true_base Energy of the true structure, less the trained terms.
+	 * @param true_features Feature counts of the true structure.
+	 * @return An id to pass to AddFalse.
+	 */
+	size_t AddRNA(size_t group, energy_t true_base, const Features &true_features) {
+		assert(group < groups.size());
+		groups[group].push_back(rnas.size());
+		rnas.emplace_back();
+		rnas.back().candidates.push_back({true_base, Intern(true_features), -1, 1.0});
+		packed = false;
+		return rnas.size() - 1;
+	}
+
+	/**
+	 * Adds the next false structure found for an RNA.
+	 * @param base_energy Energy of the structure, less the trained terms.
+	 * @param f Feature counts of the structure.
+	 * @param fscore F-score of the structure against the true structure.
+	 */
+	void AddFalse(size_t rna, energy_t base_energy, const Features &f, double fscore) {
+		RNA &r = rnas[rna];
+		int order = r.false_structures++;
+		int id = Intern(f);
+		packed = false;
+		for (size_t c = 1; c < r.candidates.size(); ++c) {
+			if (r.candidates[c].features == id) {
+				// Same features, so energies differ by the same amount for every parameter set. Keep the lower, or
+				// the later one on a tie, as that is what would be predicted.
+				if (base_energy <= r.candidates[c].base)
+					r.candidates[c] = {base_energy, id, order, fscore};
+				return;
+			}
+		}
+		r.candidates.push_back({base_energy, id, order, fscore});
+	}
+
+	/// Number of false structures added for an RNA.
+	int FalseStructures(size_t rna) const {
+		return rnas[rna].false_structures;
+	}
+
+	/// Number of candidates left after merging, over all RNAs.
+	size_t Rows() const {
+		size_t rows = 0;
+		for (const auto &r : rnas)
+			rows += r.candidates.size();
+		return rows;
+	}
+
+	/// Number of distinct feature vectors over all candidates.
+	size_t DistinctFeatures() const {
+		return feature_ids.size();
+	}
+
+	/// Lays the candidates out for Score. Must be called after adding anything, before scoring again.
+	void Pack() {
+		base.clear();
+		features.clear();
+		orders.clear();
+		fscores.clear();
+		rna_begin.assign(1, 0);
+		for (const auto &group : groups) {
+			for (size_t rna : group) {
+				for (const auto &c : rnas[rna].candidates) {
+					base.push_back(c.base);
+					features.push_back(c.features);
+					orders.push_back(c.order);
+					fscores.push_back(c.fscore);
+				}
+				rna_begin.push_back(base.size());
+			}
+		}
+		packed = true;
+	}
+
+	/**
+	 * The average over groups of the average F-score of the predicted structures in each group, under parameters w.
+	 * Safe to call from several threads at once.
+	 */
+	double Score(const Weights &w) const {
+		assert(packed);
+		static thread_local std::vector<energy_t> feature_energies;
+		const size_t distinct = feature_columns[0].size();
+		feature_energies.assign(distinct, 0);
+		energy_t *fe = feature_energies.data();
+		for (size_t k = 0; k < K; ++k) {
+			const int *column = feature_columns[k].data();
+			const energy_t wk = w[k];
+			for (size_t u = 0; u < distinct; ++u)
+				fe[u] += wk * column[u];
+		}
+
+		double sum_averages = 0;
+		size_t r = 0;
+		for (const auto &group : groups) {
+			double sum_fscores = 0;
+			for (size_t n = 0; n < group.size(); ++n, ++r) {
+				size_t best = rna_begin[r];
+				energy_t best_e = base[best] + fe[features[best]];
+				for (size_t i = best + 1; i < rna_begin[r + 1]; ++i) {
+					energy_t e = base[i] + fe[features[i]];
+					if (e < best_e || (e == best_e && orders[i] > orders[best])) {
+						best = i;
+						best_e = e;
+					}
+				}
+				sum_fscores += fscores[best];
+			}
+			sum_averages += sum_fscores / group.size();
+		}
+		return sum_averages / groups.size();
+	}
+
+	/**
+	 * An upper bound on Score(w) over every w with lo[k] <= w[k] <= hi[k]. Each candidate's energy is bounded over
+	 * the box, and only candidates whose lowest energy reaches the lowest upper bound of their RNA can be predicted.
+	 */
+	double Bound(const Weights &lo, const Weights &hi) const {
+		assert(packed);
+		static thread_local std::vector<energy_t> feature_lows, feature_highs;
+		const size_t distinct = feature_columns[0].size();
+		feature_lows.assign(distinct, 0);
+		feature_highs.assign(distinct, 0);
+		for (size_t k = 0; k < K; ++k) {
+			const int *column = feature_columns[k].data();
+			for (size_t u = 0; u < distinct; ++u) {
+				energy_t a = lo[k] * column[u], b = hi[k] * column[u];
+				feature_lows[u] += std::min(a, b);
+				feature_highs[u] += std::max(a, b);
+			}
+		}
+
+		double sum_averages = 0;
+		size_t r = 0;
+		for (const auto &group : groups) {
+			double sum_fscores = 0;
+			for (size_t n = 0; n < group.size(); ++n, ++r) {
+				energy_t min_high = std::numeric_limits<energy_t>::max();
+				for (size_t i = rna_begin[r]; i < rna_begin[r + 1]; ++i)
+					min_high = std::min(min_high, base[i] + feature_highs[features[i]]);
+				double best = 0;
+				for (size_t i = rna_begin[r]; i < rna_begin[r + 1]; ++i)
+					if (base[i] + feature_lows[features[i]] <= min_high)
+						best = std::max(best, fscores[i]);
+				sum_fscores += best;
+			}
+			sum_averages += sum_fscores / group.size();
+		}
+		return sum_averages / groups.size();
+	}
+};
+
+}
+
+#endif //RNARK_LINEAR_IBF_TABLE_HPP
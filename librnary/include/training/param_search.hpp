@@ -0,0 +1,169 @@
+#ifndef RNARK_PARAM_SEARCH_HPP
+#define RNARK_PARAM_SEARCH_HPP
+
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace librnary {
+
+/**
+ * The shape of a parameter list built by nested loops, one loop per dimension with the last dimension innermost.
+ * The parameter set at coordinates (c_0, ..., c_{D-1}) is then at index ((c_0 * e_1 + c_1) * e_2 + c_2) ...,
+ * where e_d is the extent of dimension d.
+ *
+ * A dimension is monotone if the energy of every structure only moves one way as its coordinate increases (which
+ * way may differ between structures). Energy bounds over a box of parameters can then be taken from its corners.
+ */
+class ParamGrid {
+	std::vector<size_t> extents;
+	std::vector<bool> monotone;
+
+public:
+	ParamGrid() = default;
+
+	/// A grid with one monotone dimension per extent.
+	explicit ParamGrid(const std::vector<size_t> &_extents);
+
+	/// Adds an inner dimension, i.e. one looped over inside all those added before.
+	ParamGrid &AddDimension(size_t extent, bool is_monotone = true);
+
+	size_t Dimensions() const;
+
+	size_t Extent(size_t d) const;
+
+	bool Monotone(size_t d) const;
+
+	/// Number of parameter sets in the grid.
+	size_t Size() const;
+
+	size_t Index(const std::vector<size_t> &coords) const;
+
+	std::vector<size_t> Coords(size_t index) const;
+};
+
+/**
+ * Work done by one parameter search.
+ */
+struct SearchReport {
+	/// Parameter sets scored.
+	size_t evaluations = 0;
+	/// Boxes of parameter sets bounded (branch and bound only).
+	size_t bounds = 0;
+	/// Size of the parameter list.
+	size_t points = 0;
+	/// Wall time of the search, in seconds.
+	double seconds = 0;
+};
+
+/// Prints a one line summary of r.
+std::ostream &operator<<(std::ostream &os, const SearchReport &r);
+
+/**
+ * A way of finding the parameter set with the highest score, used by the IBF trainers every epoch.
+ * The parameter sets are indices into a ParamGrid, and the best is the highest scoring one, with ties going to the
+ * lowest index, as with an exhaustive scan.
+ */
+class ParamSearch {
+public:
+	/// Score of the parameter set at an index. Called from several threads at once.
+	typedef std::function<double(size_t)> ScoreFn;
+	/**
+	 * An upper bound on the score of every parameter set in a box of the grid, given the indices of the box's corners.
+	 * The box only spans more than one value of monotone dimensions. An empty function means bounds are unavailable.
+	 */
+	typedef std::function<double(const std::vector<size_t> &)> BoundFn;
+
+	virtual ~ParamSearch() = default;
+
+	/**
+	 * @param grid Shape of the parameter list. If it has no dimensions, the list is treated as one dimension of n.
+	 * @param n Size of the parameter list.
+	 * @param start Index of the current parameter set, where local searches start.
+	 * @param report Receives the work done.
+	 * @return Index of the best parameter set found.
+	 * @throws std::invalid_argument If the search uses grid, and grid has dimensions but a size other than n.
+	 */
+	virtual size_t Search(const ParamGrid &grid, size_t n, size_t start, const ScoreFn &score, const BoundFn &bound,
+						  size_t threads, SearchReport &report) const = 0;
+
+	/// Whether Search always returns what an exhaustive scan would.
+	virtual bool Exact() const = 0;
+
+	virtual std::string Name() const = 0;
+};
+
+/// Scores every parameter set.
+class ExhaustiveSearch : public ParamSearch {
+public:
+	size_t Search(const ParamGrid &grid, size_t n, size_t start, const ScoreFn &score, const BoundFn &bound,
+				  size_t threads, SearchReport &report) const override;
+
+	bool Exact() const override;
+
+	std::string Name() const override;
+};
+
+/**
+ * Starting from the current parameter set, repeatedly scores every value of one dimension with the others fixed and
+ * moves to the best, cycling through the dimensions until none improves the score. Finds a local optimum only.
+ */
+class CoordinateDescentSearch : public ParamSearch {
+public:
+	size_t Search(const ParamGrid &grid, size_t n, size_t start, const ScoreFn &score, const BoundFn &bound,
+				  size_t threads, SearchReport &report) const override;
+
+	bool Exact() const override;
+
+	std::string Name() const override;
+};
+
+/**
+ * Scores a coarse sub-grid with the same stride in every dimension, then repeatedly scores the 3^D neighbours of the
+ * best point found at the current stride and halves the stride, down to 1. Finds a local optimum only.
+ */
+class MultiResolutionSearch : public ParamSearch {
+	size_t max_coarse_points;
+
+public:
+	/// @param _max_coarse_points Upper limit on the size of the initial coarse grid.
+	explicit MultiResolutionSearch(size_t _max_coarse_points = 4096);
+
+	size_t Search(const ParamGrid &grid, size_t n, size_t start, const ScoreFn &score, const BoundFn &bound,
+				  size_t threads, SearchReport &report) const override;
+
+	bool Exact() const override;
+
+	std::string Name() const override;
+};
+
+/**
+ * Exact search that splits the grid into boxes and skips every box whose score bound cannot beat the best parameter
+ * set found so far. Boxes are split along non-monotone dimensions first, then along their longest dimension, and
+ * boxes of at most leaf_points parameter sets are scored outright. Without a bound function this scores everything.
+ */
+class BranchAndBoundSearch : public ParamSearch {
+	size_t leaf_points;
+
+public:
+	explicit BranchAndBoundSearch(size_t _leaf_points = 64);
+
+	size_t Search(const ParamGrid &grid, size_t n, size_t start, const ScoreFn &score, const BoundFn &bound,
+				  size_t threads, SearchReport &report) const override;
+
+	bool Exact() const override;
+
+	std::string Name() const override;
+};
+
+/**
+ * The search named by name: "exhaustive", "coordinate", "multires" or "bnb".
+ * @return Null if the name is not recognised.
+ */
+std::shared_ptr<const ParamSearch> MakeParamSearch(const std::string &name);
+
+}
+
+#endif //RNARK_PARAM_SEARCH_HPP
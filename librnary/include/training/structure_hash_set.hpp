@@ -0,0 +1,41 @@
+#ifndef RNARK_STRUCTURE_HASH_SET_HPP
+#define RNARK_STRUCTURE_HASH_SET_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "secondary_structure.hpp"
+
+namespace librnary {
+
+/**
+ * The set of structures already seen for one RNA, kept as a sorted array of 64-bit hashes instead of the structures
+ * themselves. Takes 8 bytes per structure, rather than a tree node plus a copy of the Matching.
+ */
+class StructureHashSet {
+	std::vector<uint64_t> hashes;
+
+public:
+	/// Adds match to the set. Returns false if it was already there.
+	bool Insert(const Matching &match) {
+		uint64_t h = MatchingHash(match);
+		auto it = std::lower_bound(hashes.begin(), hashes.end(), h);
+		if (it != hashes.end() && *it == h)
+			return false;
+		hashes.insert(it, h);
+		return true;
+	}
+
+	bool Contains(const Matching &match) const {
+		return std::binary_search(hashes.begin(), hashes.end(), MatchingHash(match));
+	}
+
+	size_t Size() const {
+		return hashes.size();
+	}
+};
+
+}
+
+#endif //RNARK_STRUCTURE_HASH_SET_HPP
@@ -23,18 +23,21 @@ void librnary::AalbertsFolder::TraceE(stack<TState> &s) {
 	// Maintain best decomposition.
 	vector<TState> best_decomp = {TState(i - 1)}; // Unpaired 3'.
 	librnary::energy_t be = E[i - 1];
-	for (int k = -1; k < i; ++k) {
+	for (int k = max(-1, i - ExteriorReach(max_span, true)); k < i; ++k) {
 		int decomp = k == -1 ? 0 : E[k];
 		vector<TState> decomp_state;
 		if (k != -1)
 			decomp_state.push_back(TState(k));
-		librnary::energy_t e = decomp + SSScore(k + 1, i);
-		if (e < be) {
-			be = e;
-			best_decomp = {TState(k + 1, i)};
-			best_decomp.insert(best_decomp.end(), decomp_state.begin(), decomp_state.end());
+		librnary::energy_t e;
+		if (InSpan(k + 1, i)) {
+			e = decomp + SSScore(k + 1, i);
+			if (e < be) {
+				be = e;
+				best_decomp = {TState(k + 1, i)};
+				best_decomp.insert(best_decomp.end(), decomp_state.begin(), decomp_state.end());
+			}
 		}
-		if (k + 2 < i) {
+		if (k + 2 < i && InSpan(k + 2, i)) {
 			e = decomp + SSScore(k + 2, i) + em.FiveDangle(k + 2, i);
 			if (e < be) {
 				be = e;
@@ -42,7 +45,7 @@ void librnary::AalbertsFolder::TraceE(stack<TState> &s) {
 				best_decomp.insert(best_decomp.end(), decomp_state.begin(), decomp_state.end());
 			}
 		}
-		if (k + 1 < i - 1) {
+		if (k + 1 < i - 1 && InSpan(k + 1, i - 1)) {
 			e = decomp + SSScore(k + 1, i - 1) + em.ThreeDangle(k + 1, i - 1);
 			if (e < be) {
 				be = e;
@@ -50,7 +53,7 @@ void librnary::AalbertsFolder::TraceE(stack<TState> &s) {
 				best_decomp.insert(best_decomp.end(), decomp_state.begin(), decomp_state.end());
 			}
 		}
-		if (k + 2 < i - 1) {
+		if (k + 2 < i - 1 && InSpan(k + 2, i - 1)) {
 			e = decomp + SSScore(k + 2, i - 1) + em.Mismatch(k + 2, i - 1);
 			if (e < be) {
 				be = e;
@@ -60,13 +63,42 @@ void librnary::AalbertsFolder::TraceE(stack<TState> &s) {
 		}
 
 		// Coaxial stack decompositions.
-		e = decomp + Cx[k + 1][i];
-		if (e < be) {
-			be = e;
-			best_decomp = {TState(CxT, k + 1, i)};
-			best_decomp.insert(best_decomp.end(), decomp_state.begin(), decomp_state.end());
+		if (InSpan(k + 1, i)) {
+			e = decomp + Cx[k + 1][i];
+			if (e < be) {
+				be = e;
+				best_decomp = {TState(CxT, k + 1, i)};
+				best_decomp.insert(best_decomp.end(), decomp_state.begin(), decomp_state.end());
+			}
+			continue;
+		}
+		// Cx only holds stacks within max_span, so trace wider ones here.
+		for (int j = max(k + 1, i - max_span - 3); j + 1 < i && j - k <= max_span + 3; ++j) {
+			if (k + 1 < j && InSpan(k + 1, j) && InSpan(j + 1, i)) {
+				e = decomp + em.FlushCoax(k + 1, j, j + 1, i) + SSScore(k + 1, j) + SSScore(j + 1, i);
+				if (e < be) {
+					be = e;
+					best_decomp = {TState(k + 1, j), TState(j + 1, i)};
+					best_decomp.insert(best_decomp.end(), decomp_state.begin(), decomp_state.end());
+				}
+			}
+			if (k + 2 < j - 1 && InSpan(k + 2, j - 1) && InSpan(j + 1, i)) {
+				e = decomp + em.MismatchCoax(k + 2, j - 1, j + 1, i) + SSScore(k + 2, j - 1) + SSScore(j + 1, i);
+				if (e < be) {
+					be = e;
+					best_decomp = {TState(k + 2, j - 1), TState(j + 1, i)};
+					best_decomp.insert(best_decomp.end(), decomp_state.begin(), decomp_state.end());
+				}
+			}
+			if (k + 1 < j && j + 2 < i - 1 && InSpan(k + 1, j) && InSpan(j + 2, i - 1)) {
+				e = decomp + em.MismatchCoax(j + 2, i - 1, k + 1, j) + SSScore(k + 1, j) + SSScore(j + 2, i - 1);
+				if (e < be) {
+					be = e;
+					best_decomp = {TState(k + 1, j), TState(j + 2, i - 1)};
+					best_decomp.insert(best_decomp.end(), decomp_state.begin(), decomp_state.end());
+				}
+			}
 		}
-
 	}
 
 	for (const TState &state : best_decomp)
@@ -371,18 +403,24 @@ int librnary::AalbertsFolder::Fold(const PrimeStructure &primary) {
 	if (N == 0)
 		return 0;
 
-	// Clear the DP tables.
-	P.clear();
-	ML.clear();
-	E.clear();
-	Cx.clear();
-
 	// Reset the DP tables.
-	P.resize(RSZ, V<librnary::energy_t>(RSZ, em.MaxMFE()));
-	ML.resize(3, _4DVE((unsigned long) MaxBLengthSegs(N) + 1,
-					   VVVE((unsigned long) MaxALengthSegs(N) + 1, VVE(RSZ, VE(RSZ, em.MaxMFE())))));
-	E.resize(RSZ, 0);
-	Cx.resize(RSZ, VE(RSZ, em.MaxMFE()));
+	if (workspace != nullptr)
+		workspace->Rewind();
+	// Cells (i,j) are only needed for j - i <= max_span, so ML fragments have at most max_span + 1 nucleotides.
+	const size_t band = static_cast<size_t>(max_span) + 1;
+	const int frag_len = min(N, max_span + 1);
+	PrepareTable(workspace, P, RSZ, em.MaxMFE(), band);
+	ML.resize(3);
+	for (auto &by_b : ML) {
+		by_b.resize((unsigned long) MaxBLengthSegs(frag_len) + 1);
+		for (auto &by_a : by_b) {
+			by_a.resize((unsigned long) MaxALengthSegs(frag_len) + 1);
+			for (auto &tbl : by_a)
+				PrepareTable(workspace, tbl, RSZ, em.MaxMFE(), band);
+		}
+	}
+	E.assign(RSZ, 0);
+	PrepareTable(workspace, Cx, RSZ, em.MaxMFE(), band);
 
 	// Special base case for ML table.
 	// Can only end on a single unpaired nucleotide. No other states are base cases.
@@ -390,7 +428,7 @@ int librnary::AalbertsFolder::Fold(const PrimeStructure &primary) {
 		ML[0][0][1][i][i] = 0;
 
 	for (int i = N - 2; i >= 0; --i) { // i is 5' nucleotide.
-		for (int j = i + 1; j < N; ++j) { // j is 3' nucleotide.
+		for (int j = i + 1; j < N && InSpan(i, j); ++j) { // j is 3' nucleotide.
 			if (ValidPair(rna[i], rna[j]) &&
 				(lonely_pairs || !MustBeLonelyPair(rna, i, j, em.MIN_HAIRPIN_UNPAIRED))) {
 				librnary::energy_t best = em.OneLoop(i, j); // Hairpins.
@@ -531,17 +569,33 @@ int librnary::AalbertsFolder::Fold(const PrimeStructure &primary) {
 
 	for (int i = 1; i < N; ++i) {
 		librnary::energy_t best = E[i - 1];
-		for (int k = -1; k < i; ++k) {
+		for (int k = max(-1, i - ExteriorReach(max_span, true)); k < i; ++k) {
 			int decomp = k == -1 ? 0 : E[k];
-			best = min(best, decomp + SSScore(k + 1, i));
-			if (k + 2 < i)
+			if (InSpan(k + 1, i))
+				best = min(best, decomp + SSScore(k + 1, i));
+			if (k + 2 < i && InSpan(k + 2, i))
 				best = min(best, decomp + SSScore(k + 2, i) + em.FiveDangle(k + 2, i));
-			if (k + 1 < i - 1)
+			if (k + 1 < i - 1 && InSpan(k + 1, i - 1))
 				best = min(best, decomp + SSScore(k + 1, i - 1) + em.ThreeDangle(k + 1, i - 1));
-			if (k + 2 < i - 1)
+			if (k + 2 < i - 1 && InSpan(k + 2, i - 1))
 				best = min(best, decomp + SSScore(k + 2, i - 1) + em.Mismatch(k + 2, i - 1));
 			// Coaxial stack decompositions.
-			best = min(best, decomp + Cx[k + 1][i]);
+			if (InSpan(k + 1, i)) {
+				best = min(best, decomp + Cx[k + 1][i]);
+				continue;
+			}
+			// Cx only holds stacks within max_span, so score wider ones here.
+			for (int j = max(k + 1, i - max_span - 3); j + 1 < i && j - k <= max_span + 3; ++j) {
+				if (k + 1 < j && InSpan(k + 1, j) && InSpan(j + 1, i))
+					best = min(best, decomp + em.FlushCoax(k + 1, j, j + 1, i)
+						+ SSScore(k + 1, j) + SSScore(j + 1, i));
+				if (k + 2 < j - 1 && InSpan(k + 2, j - 1) && InSpan(j + 1, i))
+					best = min(best, decomp + em.MismatchCoax(k + 2, j - 1, j + 1, i)
+						+ SSScore(k + 2, j - 1) + SSScore(j + 1, i));
+				if (k + 1 < j && j + 2 < i - 1 && InSpan(k + 1, j) && InSpan(j + 2, i - 1))
+					best = min(best, decomp + em.MismatchCoax(j + 2, i - 1, k + 1, j)
+						+ SSScore(k + 1, j) + SSScore(j + 2, i - 1));
+			}
 		}
 		E[i] = best;
 	}
@@ -550,7 +604,7 @@ int librnary::AalbertsFolder::Fold(const PrimeStructure &primary) {
 }
 
 librnary::VVE librnary::AalbertsFolder::GetP() const {
-	return P;
+	return P.ToNested(em.MaxMFE());
 }
 
 librnary::VE librnary::AalbertsFolder::GetE() const {
@@ -581,10 +635,22 @@ void librnary::AalbertsFolder::SetMaxTwoLoop(unsigned max_up) {
 	max_twoloop_unpaired = max_up;
 }
 
+void librnary::AalbertsFolder::SetWorkspace(FoldWorkspace *ws) {
+	workspace = ws;
+}
+
 int librnary::AalbertsFolder::MaxTwoLoop() const {
 	return max_twoloop_unpaired;
 }
 
+void librnary::AalbertsFolder::SetMaxSpan(unsigned span) {
+	max_span = static_cast<int>(min<unsigned>(span, numeric_limits<int>::max() / 3));
+}
+
+int librnary::AalbertsFolder::MaxSpan() const {
+	return max_span;
+}
+
 void librnary::AalbertsFolder::SetLonelyPairs(bool v) {
 	lonely_pairs = v;
 }
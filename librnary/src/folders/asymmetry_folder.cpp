@@ -2,6 +2,7 @@
 // Created by max on 7/9/16.
 //
 #include "folders/asymmetry_folder.hpp"
+#include <stdexcept>
 
 using namespace std;
 
@@ -45,6 +46,43 @@ void librnary::AsymmetryFolder::SetMaxTwoLoop(unsigned max_up) {
 	max_twoloop_unpaired = max_up;
 }
 
+void librnary::AsymmetryFolder::SetWorkspace(FoldWorkspace *ws) {
+	workspace = ws;
+}
+
+void librnary::AsymmetryFolder::SetMaxSpan(unsigned span) {
+	max_span = static_cast<int>(min<unsigned>(span, numeric_limits<int>::max() / 3));
+}
+
+int librnary::AsymmetryFolder::MaxSpan() const {
+	return max_span;
+}
+
+void librnary::AsymmetryFolder::SetEnergyOnly(bool v) {
+	energy_only = v;
+}
+
+bool librnary::AsymmetryFolder::EnergyOnly() const {
+	return energy_only;
+}
+
+size_t librnary::AsymmetryFolder::TableBytes() const {
+	return P.Bytes() + CxFl.Bytes() + CxMM5.Bytes() + CxMM3.Bytes() + E.size() * sizeof(energy_t) + full_ml.Bytes()
+		+ compact_ml.Bytes();
+}
+
+void librnary::AsymmetryFolder::SetCompactTables(bool v) {
+	compact_tables = v;
+}
+
+bool librnary::AsymmetryFolder::CompactTables() const {
+	return compact_tables;
+}
+
+bool librnary::AsymmetryFolder::UsedCompactTables() const {
+	return used_compact;
+}
+
 int librnary::AsymmetryFolder::MaxTwoLoop() const {
 	return max_twoloop_unpaired;
 }
@@ -67,7 +105,18 @@ bool librnary::AsymmetryFolder::Stacking() const {
 
 
 librnary::VVE librnary::AsymmetryFolder::GetP() const {
-	return P;
+	return P.ToNested(em.MaxMFE());
+}
+
+librnary::energy_t librnary::AsymmetryFolder::MLCell(const TState &d) const {
+	if (d.t == ML_UpT) {
+		if (used_compact)
+			return compact_ml.Up[d.br][d.used_mask][d.up][d.upr][d.i][d.j];
+		return full_ml.Up[d.br][d.used_mask][d.up][d.upr][d.i][d.j];
+	}
+	if (used_compact)
+		return compact_ml.Br[d.br][d.used_mask][d.up][d.upr][d.i][d.j];
+	return full_ml.Br[d.br][d.used_mask][d.up][d.upr][d.i][d.j];
 }
 
 void librnary::AsymmetryFolder::Relax(Table parent, int &best, vector<TState> &best_decomp,
@@ -76,10 +125,8 @@ void librnary::AsymmetryFolder::Relax(Table parent, int &best, vector<TState> &b
 	for (const auto &d : decomp) {
 		switch (d.t) {
 			case ML_UpT:
-				e += ML_Up[d.br][d.used_mask][d.up][d.upr][d.i][d.j];
-				break;
 			case ML_BrT:
-				e += ML_Br[d.br][d.used_mask][d.up][d.upr][d.i][d.j];
+				e += MLCell(d);
 				break;
 			case PT:
 				if (parent == ET)
@@ -120,19 +167,22 @@ void librnary::AsymmetryFolder::TraceE(std::stack<TState> &s) {
 	// Maintain best decomposition.
 	vector<TState> best_decomp = {TState(i - 1)}; // Unpaired 3'.
 	energy_t be = E[i - 1];
-	for (int k = -1; k < i; ++k) {
+	for (int k = max(-1, i - ExteriorReach(max_span, stacking)); k < i; ++k) {
 		int decomp = k == -1 ? 0 : E[k];
 		vector<TState> decomp_state;
 		if (k != -1)
 			decomp_state.push_back(TState(k));
-		energy_t e = decomp + SSScore(k + 1, i);
-		if (e < be) {
-			be = e;
-			best_decomp = {TState(k + 1, i)};
-			best_decomp.insert(best_decomp.end(), decomp_state.begin(), decomp_state.end());
+		energy_t e;
+		if (InSpan(k + 1, i)) {
+			e = decomp + SSScore(k + 1, i);
+			if (e < be) {
+				be = e;
+				best_decomp = {TState(k + 1, i)};
+				best_decomp.insert(best_decomp.end(), decomp_state.begin(), decomp_state.end());
+			}
 		}
 		if (stacking) {
-			if (k + 2 < i) {
+			if (k + 2 < i && InSpan(k + 2, i)) {
 				e = decomp + SSScore(k + 2, i) + em.FiveDangle(k + 2, i);
 				if (e < be) {
 					be = e;
@@ -140,7 +190,7 @@ void librnary::AsymmetryFolder::TraceE(std::stack<TState> &s) {
 					best_decomp.insert(best_decomp.end(), decomp_state.begin(), decomp_state.end());
 				}
 			}
-			if (k + 1 < i - 1) {
+			if (k + 1 < i - 1 && InSpan(k + 1, i - 1)) {
 				e = decomp + SSScore(k + 1, i - 1) + em.ThreeDangle(k + 1, i - 1);
 				if (e < be) {
 					be = e;
@@ -148,7 +198,7 @@ void librnary::AsymmetryFolder::TraceE(std::stack<TState> &s) {
 					best_decomp.insert(best_decomp.end(), decomp_state.begin(), decomp_state.end());
 				}
 			}
-			if (k + 2 < i - 1) {
+			if (k + 2 < i - 1 && InSpan(k + 2, i - 1)) {
 				e = decomp + SSScore(k + 2, i - 1) + em.Mismatch(k + 2, i - 1);
 				if (e < be) {
 					be = e;
@@ -158,8 +208,8 @@ void librnary::AsymmetryFolder::TraceE(std::stack<TState> &s) {
 			}
 
 			// Coaxial stack decompositions.
-			for (int j = k + 1; j + 1 < i; ++j) {
-				if (k + 1 < j) {
+			for (int j = max(k + 1, i - max_span - 3); j + 1 < i && j - k <= max_span + 3; ++j) {
+				if (k + 1 < j && InSpan(k + 1, j) && InSpan(j + 1, i)) {
 					e = decomp + em.FlushCoax(k + 1, j, j + 1, i)
 						+ SSScore(k + 1, j) + SSScore(j + 1, i);
 					if (e < be) {
@@ -168,7 +218,7 @@ void librnary::AsymmetryFolder::TraceE(std::stack<TState> &s) {
 						best_decomp.insert(best_decomp.end(), decomp_state.begin(), decomp_state.end());
 					}
 				}
-				if (k + 2 < j - 1) {
+				if (k + 2 < j - 1 && InSpan(k + 2, j - 1) && InSpan(j + 1, i)) {
 					e = decomp + em.MismatchCoax(k + 2, j - 1, j + 1, i)
 						+ SSScore(k + 2, j - 1) + SSScore(j + 1, i);
 					if (e < be) {
@@ -177,7 +227,7 @@ void librnary::AsymmetryFolder::TraceE(std::stack<TState> &s) {
 						best_decomp.insert(best_decomp.end(), decomp_state.begin(), decomp_state.end());
 					}
 				}
-				if (j + 2 < i - 1 && k + 1 < j) {
+				if (j + 2 < i - 1 && k + 1 < j && InSpan(k + 1, j) && InSpan(j + 2, i - 1)) {
 					e = decomp + em.MismatchCoax(j + 2, i - 1, k + 1, j)
 						+ SSScore(k + 1, j) + SSScore(j + 2, i - 1);
 					if (e < be) {
@@ -435,6 +485,8 @@ void librnary::AsymmetryFolder::TraceMLBr(std::stack<TState> &s) {
 }
 
 librnary::Matching librnary::AsymmetryFolder::Traceback() {
+	if (energy_only) // ML_Br no longer holds every row.
+		throw logic_error("Traceback after an energy-only fold");
 	const int N = static_cast<int>(rna.size());
 	Matching m = EmptyMatching(static_cast<unsigned>(rna.size()));
 	if (N == 0)
@@ -471,38 +523,64 @@ int librnary::AsymmetryFolder::Fold(const PrimeStructure &primary) {
 
 	const int N = static_cast<int>(rna.size());
 
+	// Ignore empty RNAs.
+	if (N == 0)
+		return 0;
+
+	// Fall back to 32-bit tables if an energy does not fit the compact ones.
+	used_compact = compact_tables && FillTables(compact_ml);
+	if (!used_compact)
+		FillTables(full_ml);
+	return E[N - 1];
+}
+
+template<typename CellT>
+bool librnary::AsymmetryFolder::FillTables(MLTables<CellT> &tables) {
+	const int N = static_cast<int>(rna.size());
+
 	const int req_br = DefaultRequiredMultiInternalBranches();
 
 	assert(req_br >= 2); // Otherwise we're not making multi-loops, and also seg-faults.
 
-	// Ignore empty RNAs.
-	if (N == 0)
-		return 0;
+	// Whether every multi-loop cell so far was stored exactly.
+	bool exact = true;
 
-	// Clear DP tables.
-	E.clear();
-	P.clear();
-	if (stacking) {
-		CxFl.clear();
-		CxMM3.clear();
-		CxMM5.clear();
-	}
+	// Only one set of multi-loop tables is kept.
+	full_ml = MLTables<energy_t>();
+	compact_ml = MLTables<CompactEnergy>();
+	auto &ML_Up = tables.Up;
+	auto &ML_Br = tables.Br;
 
 	// Resize DP tables.
-	E.resize(rna.size(), 0);
-	P.resize(rna.size(), VE(rna.size(), em.MaxMFE()));
+	if (workspace != nullptr)
+		workspace->Rewind();
+	E.assign(rna.size(), 0);
+	// Cells (i,j) are only needed for j - i <= max_span.
+	const size_t band = static_cast<size_t>(max_span) + 1;
+	PrepareTable(workspace, P, rna.size(), em.MaxMFE(), band);
 	int up_lim = UnpairedGapLimit();
 	unsigned up_sz = static_cast<unsigned>(up_lim + 1);
-	ML_Up = Array2D<_4DVE>(static_cast<size_t>(req_br),
-						   4,
-						   _4DVE(up_sz + 1, VVVE(up_sz + 1, VVE(rna.size(), VE(rna.size(), em.MaxMFE())))));
-	ML_Br = Array2D<_4DVE>(static_cast<size_t>(req_br),
-						   4,
-						   _4DVE(up_sz + 1, VVVE(up_sz + 1, VVE(rna.size(), VE(rna.size(), em.MaxMFE())))));
+	ML_Up = Array2D<VV<TriangularArray<CellT>>>(static_cast<size_t>(req_br), 4,
+		VV<TriangularArray<CellT>>(up_sz + 1, V<TriangularArray<CellT>>(up_sz + 1)));
+	ML_Br = Array2D<VV<RowWindowArray<CellT>>>(static_cast<size_t>(req_br), 4,
+		VV<RowWindowArray<CellT>>(up_sz + 1, V<RowWindowArray<CellT>>(up_sz + 1)));
+	for (int br = 0; br < req_br; ++br) {
+		// P reads ML_Br[req_br - 1] at rows up to i + 1 + up_lim, and ML_Up reads ML_Br[br - 1] at rows up to
+		// i + up_lim. Only ML_Br[req_br - 2] is also read by P at arbitrary rows.
+		size_t window = energy_only && br != req_br - 2 ? up_sz + 1 : rna.size();
+		for (int s = 0; s < 4; ++s) {
+			for (auto &tbl_r : ML_Up[br][s])
+				for (auto &tbl : tbl_r)
+					PrepareTable(workspace, tbl, rna.size(), em.MaxMFE(), band);
+			for (auto &tbl_r : ML_Br[br][s])
+				for (auto &tbl : tbl_r)
+					PrepareTable(workspace, tbl, rna.size(), window, em.MaxMFE(), band);
+		}
+	}
 	if (stacking) {
-		CxFl.resize(rna.size(), VE(rna.size(), em.MaxMFE()));
-		CxMM5.resize(rna.size(), VE(rna.size(), em.MaxMFE()));
-		CxMM3.resize(rna.size(), VE(rna.size(), em.MaxMFE()));
+		PrepareTable(workspace, CxFl, rna.size(), em.MaxMFE(), band);
+		PrepareTable(workspace, CxMM5, rna.size(), em.MaxMFE(), band);
+		PrepareTable(workspace, CxMM3, rna.size(), em.MaxMFE(), band);
 	}
 
 	// Base case that allows the [i,i] fragment to end on a single unpaired.
@@ -511,16 +589,23 @@ int librnary::AsymmetryFolder::Fold(const PrimeStructure &primary) {
 		// Number of forced unpaired.
 		for (int up = 0; up <= up_lim; ++up) {
 			// Either 5' unpaired is used, or closing 3' is unpaired is used, or neither are. Both can't be.
-			ML_Up[0][0][up][1][i][i] = AsymScore(up, 1) + em.MLUnpairedCost();
-			ML_Up[0][1][up][1][i][i] = AsymScore(up, 1) + em.MLUnpairedCost();
-			ML_Up[0][2][up][1][i][i] = AsymScore(up, 1) + em.MLUnpairedCost();
+			StoreEnergy(ML_Up[0][0][up][1][i][i], AsymScore(up, 1) + em.MLUnpairedCost(), exact);
+			StoreEnergy(ML_Up[0][1][up][1][i][i], AsymScore(up, 1) + em.MLUnpairedCost(), exact);
+			StoreEnergy(ML_Up[0][2][up][1][i][i], AsymScore(up, 1) + em.MLUnpairedCost(), exact);
 			// Empty fragment case. No unpaired can be used.
-			ML_Up[0][0][up][0][i][i - 1] = AsymScore(up, 0);
+			StoreEnergy(ML_Up[0][0][up][0][i][i - 1], AsymScore(up, 0), exact);
 		}
 	}
 
-	for (int i = N - 1; i >= 0; --i) {
-		for (int j = i + 1; j < N; ++j) {
+	for (int i = N - 1; i >= 0 && exact; --i) {
+		// Windowed tables hand row i the storage of a row that can no longer be read.
+		for (int br = 0; br < req_br; ++br)
+			for (int s = 0; s < 4; ++s)
+				for (auto &tbl_r : ML_Br[br][s])
+					for (auto &tbl : tbl_r)
+						if (tbl.Windowed())
+							tbl.ResetRow(i, em.MaxMFE());
+		for (int j = i + 1; j < N && InSpan(i, j); ++j) {
 			librnary::energy_t best;
 			// Paired table.
 			if (ValidPair(rna[i], rna[j]) &&
@@ -679,7 +764,7 @@ int librnary::AsymmetryFolder::Fold(const PrimeStructure &primary) {
 										}
 									}
 								}
-								ML_Br[br][used_mask][up][upr][i][j] = best;
+								StoreEnergy(ML_Br[br][used_mask][up][upr][i][j], best, exact);
 
 								// ML_Up stuff.
 								best = em.MaxMFE();
@@ -695,7 +780,7 @@ int librnary::AsymmetryFolder::Fold(const PrimeStructure &primary) {
 									best = min(best, em.MLUnpairedCost() * (k - i) + AsymScore(up, k - i)
 										+ ML_Br[br_prime][used_mask][k - i][upr][k][j]);
 								}
-								ML_Up[br][used_mask][up][upr][i][j] = best;
+								StoreEnergy(ML_Up[br][used_mask][up][upr][i][j], best, exact);
 							}
 						}
 					}
@@ -704,27 +789,31 @@ int librnary::AsymmetryFolder::Fold(const PrimeStructure &primary) {
 		}
 	}
 
+	if (!exact)
+		return false;
+
 	for (int i = 1; i < N; ++i) {
 		energy_t best = E[i - 1];
-		for (int k = -1; k < i; ++k) {
+		for (int k = max(-1, i - ExteriorReach(max_span, stacking)); k < i; ++k) {
 			int decomp = k == -1 ? 0 : E[k];
-			best = min(best, decomp + SSScore(k + 1, i));
+			if (InSpan(k + 1, i))
+				best = min(best, decomp + SSScore(k + 1, i));
 			if (stacking) {
-				if (k + 2 < i)
+				if (k + 2 < i && InSpan(k + 2, i))
 					best = min(best, decomp + SSScore(k + 2, i) + em.FiveDangle(k + 2, i));
-				if (k + 1 < i - 1)
+				if (k + 1 < i - 1 && InSpan(k + 1, i - 1))
 					best = min(best, decomp + SSScore(k + 1, i - 1) + em.ThreeDangle(k + 1, i - 1));
-				if (k + 2 < i - 1)
+				if (k + 2 < i - 1 && InSpan(k + 2, i - 1))
 					best = min(best, decomp + SSScore(k + 2, i - 1) + em.Mismatch(k + 2, i - 1));
 				// Coaxial stack decompositions.
-				for (int j = k + 1; j + 1 < i; ++j) {
-					if (k + 1 < j)
+				for (int j = max(k + 1, i - max_span - 3); j + 1 < i && j - k <= max_span + 3; ++j) {
+					if (k + 1 < j && InSpan(k + 1, j) && InSpan(j + 1, i))
 						best = min(best, decomp + em.FlushCoax(k + 1, j, j + 1, i)
 							+ SSScore(k + 1, j) + SSScore(j + 1, i));
-					if (k + 2 < j - 1)
+					if (k + 2 < j - 1 && InSpan(k + 2, j - 1) && InSpan(j + 1, i))
 						best = min(best, decomp + em.MismatchCoax(k + 2, j - 1, j + 1, i)
 							+ SSScore(k + 2, j - 1) + SSScore(j + 1, i));
-					if (k + 1 < j && j + 2 < i - 1)
+					if (k + 1 < j && j + 2 < i - 1 && InSpan(k + 1, j) && InSpan(j + 2, i - 1))
 						best = min(best, decomp + em.MismatchCoax(j + 2, i - 1, k + 1, j)
 							+ SSScore(k + 1, j) + SSScore(j + 2, i - 1));
 				}
@@ -733,5 +822,5 @@ int librnary::AsymmetryFolder::Fold(const PrimeStructure &primary) {
 		E[i] = best;
 	}
 
-	return E[N - 1];
+	return exact;
 }
\ No newline at end of file
@@ -8,6 +8,7 @@
 #include <scorers/nn_scorer.hpp>
 #include "models/nn_affine_model.hpp"
 #include "scorers/average_asym_scorer.hpp"
+#include <stdexcept>
 
 using namespace std;
 
@@ -64,6 +65,43 @@ void librnary::AverageAsymmetryFolder::SetMaxTwoLoop(unsigned max_up) {
 	max_twoloop_unpaired = max_up;
 }
 
+void librnary::AverageAsymmetryFolder::SetWorkspace(FoldWorkspace *ws) {
+	workspace = ws;
+}
+
+void librnary::AverageAsymmetryFolder::SetMaxSpan(unsigned span) {
+	max_span = static_cast<int>(min<unsigned>(span, numeric_limits<int>::max() / 3));
+}
+
+int librnary::AverageAsymmetryFolder::MaxSpan() const {
+	return max_span;
+}
+
+void librnary::AverageAsymmetryFolder::SetEnergyOnly(bool v) {
+	energy_only = v;
+}
+
+bool librnary::AverageAsymmetryFolder::EnergyOnly() const {
+	return energy_only;
+}
+
+size_t librnary::AverageAsymmetryFolder::TableBytes() const {
+	return P.Bytes() + CxFl.Bytes() + CxMM5.Bytes() + CxMM3.Bytes() + E.size() * sizeof(energy_t) + full_ml.Bytes()
+		+ compact_ml.Bytes();
+}
+
+void librnary::AverageAsymmetryFolder::SetCompactTables(bool v) {
+	compact_tables = v;
+}
+
+bool librnary::AverageAsymmetryFolder::CompactTables() const {
+	return compact_tables;
+}
+
+bool librnary::AverageAsymmetryFolder::UsedCompactTables() const {
+	return used_compact;
+}
+
 int librnary::AverageAsymmetryFolder::MaxTwoLoop() const {
 	return max_twoloop_unpaired;
 }
@@ -86,7 +124,18 @@ bool librnary::AverageAsymmetryFolder::Stacking() const {
 
 
 librnary::VVE librnary::AverageAsymmetryFolder::GetP() const {
-	return P;
+	return P.ToNested(em.MaxMFE());
+}
+
+librnary::energy_t librnary::AverageAsymmetryFolder::MLCell(const TState &d) const {
+	if (d.t == ML_UpT) {
+		if (used_compact)
+			return compact_ml.Up[d.used_mask][d.br][d.sum_asym][d.up][d.upr][d.i][d.j];
+		return full_ml.Up[d.used_mask][d.br][d.sum_asym][d.up][d.upr][d.i][d.j];
+	}
+	if (used_compact)
+		return compact_ml.Br[d.used_mask][d.br][d.sum_asym][d.up][d.upr][d.i][d.j];
+	return full_ml.Br[d.used_mask][d.br][d.sum_asym][d.up][d.upr][d.i][d.j];
 }
 
 void librnary::AverageAsymmetryFolder::Relax(Table parent, int &best, vector<TState> &best_decomp,
@@ -95,10 +144,8 @@ void librnary::AverageAsymmetryFolder::Relax(Table parent, int &best, vector<TSt
 	for (const auto &d : decomp) {
 		switch (d.t) {
 			case ML_UpT:
-				e += ML_Up[d.used_mask][d.br][d.sum_asym][d.up][d.upr][d.i][d.j];
-				break;
 			case ML_BrT:
-				e += ML_Br[d.used_mask][d.br][d.sum_asym][d.up][d.upr][d.i][d.j];
+				e += MLCell(d);
 				break;
 			case PT:
 				if (parent == ET)
@@ -139,19 +186,22 @@ void librnary::AverageAsymmetryFolder::TraceE(std::stack<TState> &s) {
 	// Maintain best decomposition.
 	vector<TState> best_decomp = {TState(i - 1)}; // Unpaired 3'.
 	int be = E[i - 1];
-	for (int k = -1; k < i; ++k) {
+	for (int k = max(-1, i - ExteriorReach(max_span, stacking)); k < i; ++k) {
 		int decomp = k == -1 ? 0 : E[k];
 		vector<TState> decomp_state;
 		if (k != -1)
 			decomp_state.push_back(TState(k));
-		int e = decomp + SSScore(k + 1, i);
-		if (e < be) {
-			be = e;
-			best_decomp = {TState(k + 1, i)};
-			best_decomp.insert(best_decomp.end(), decomp_state.begin(), decomp_state.end());
+		int e;
+		if (InSpan(k + 1, i)) {
+			e = decomp + SSScore(k + 1, i);
+			if (e < be) {
+				be = e;
+				best_decomp = {TState(k + 1, i)};
+				best_decomp.insert(best_decomp.end(), decomp_state.begin(), decomp_state.end());
+			}
 		}
 		if (stacking) {
-			if (k + 2 < i) {
+			if (k + 2 < i && InSpan(k + 2, i)) {
 				e = decomp + SSScore(k + 2, i) + em.FiveDangle(k + 2, i);
 				if (e < be) {
 					be = e;
@@ -159,7 +209,7 @@ void librnary::AverageAsymmetryFolder::TraceE(std::stack<TState> &s) {
 					best_decomp.insert(best_decomp.end(), decomp_state.begin(), decomp_state.end());
 				}
 			}
-			if (k + 1 < i - 1) {
+			if (k + 1 < i - 1 && InSpan(k + 1, i - 1)) {
 				e = decomp + SSScore(k + 1, i - 1) + em.ThreeDangle(k + 1, i - 1);
 				if (e < be) {
 					be = e;
@@ -167,7 +217,7 @@ void librnary::AverageAsymmetryFolder::TraceE(std::stack<TState> &s) {
 					best_decomp.insert(best_decomp.end(), decomp_state.begin(), decomp_state.end());
 				}
 			}
-			if (k + 2 < i - 1) {
+			if (k + 2 < i - 1 && InSpan(k + 2, i - 1)) {
 				e = decomp + SSScore(k + 2, i - 1) + em.Mismatch(k + 2, i - 1);
 				if (e < be) {
 					be = e;
@@ -177,8 +227,8 @@ void librnary::AverageAsymmetryFolder::TraceE(std::stack<TState> &s) {
 			}
 
 			// Coaxial stack decompositions.
-			for (int j = k + 1; j + 1 < i; ++j) {
-				if (k + 1 < j) {
+			for (int j = max(k + 1, i - max_span - 3); j + 1 < i && j - k <= max_span + 3; ++j) {
+				if (k + 1 < j && InSpan(k + 1, j) && InSpan(j + 1, i)) {
 					e = decomp + em.FlushCoax(k + 1, j, j + 1, i)
 						+ SSScore(k + 1, j) + SSScore(j + 1, i);
 					if (e < be) {
@@ -187,7 +237,7 @@ void librnary::AverageAsymmetryFolder::TraceE(std::stack<TState> &s) {
 						best_decomp.insert(best_decomp.end(), decomp_state.begin(), decomp_state.end());
 					}
 				}
-				if (k + 2 < j - 1) {
+				if (k + 2 < j - 1 && InSpan(k + 2, j - 1) && InSpan(j + 1, i)) {
 					e = decomp + em.MismatchCoax(k + 2, j - 1, j + 1, i)
 						+ SSScore(k + 2, j - 1) + SSScore(j + 1, i);
 					if (e < be) {
@@ -196,7 +246,7 @@ void librnary::AverageAsymmetryFolder::TraceE(std::stack<TState> &s) {
 						best_decomp.insert(best_decomp.end(), decomp_state.begin(), decomp_state.end());
 					}
 				}
-				if (j + 2 < i - 1 && k + 1 < j) {
+				if (j + 2 < i - 1 && k + 1 < j && InSpan(k + 1, j) && InSpan(j + 2, i - 1)) {
 					e = decomp + em.MismatchCoax(j + 2, i - 1, k + 1, j)
 						+ SSScore(k + 1, j) + SSScore(j + 2, i - 1);
 					if (e < be) {
@@ -530,6 +580,8 @@ void librnary::AverageAsymmetryFolder::TraceMLBr(std::stack<TState> &s) {
 }
 
 librnary::Matching librnary::AverageAsymmetryFolder::Traceback() {
+	if (energy_only) // ML_Br no longer holds every row.
+		throw logic_error("Traceback after an energy-only fold");
 	const int N = static_cast<int>(rna.size());
 	Matching m = EmptyMatching(static_cast<unsigned>(rna.size()));
 	if (N == 0)
@@ -568,18 +620,33 @@ int librnary::AverageAsymmetryFolder::Fold(const PrimeStructure &primary) {
 	if (N == 0)
 		return 0;
 
-	// Clear DP tables.
-	E.clear();
-	P.clear();
-	ML_Up.clear();
-	ML_Br.clear();
-	CxFl.clear();
-	CxMM3.clear();
-	CxMM5.clear();
+	// Fall back to 32-bit tables if an energy does not fit the compact ones.
+	used_compact = compact_tables && FillTables(compact_ml);
+	if (!used_compact)
+		FillTables(full_ml);
+	return E[N - 1];
+}
+
+template<typename CellT>
+bool librnary::AverageAsymmetryFolder::FillTables(MLTables<CellT> &tables) {
+	const int N = static_cast<int>(rna.size());
+
+	// Whether every multi-loop cell so far was stored exactly.
+	bool exact = true;
+
+	// Only one set of multi-loop tables is kept.
+	full_ml = MLTables<energy_t>();
+	compact_ml = MLTables<CompactEnergy>();
+	auto &ML_Up = tables.Up;
+	auto &ML_Br = tables.Br;
 
 	// Resize DP tables.
-	E.resize(rna.size(), 0);
-	P.resize(rna.size(), VI(rna.size(), em.MaxMFE()));
+	if (workspace != nullptr)
+		workspace->Rewind();
+	E.assign(rna.size(), 0);
+	// Cells (i,j) are only needed for j - i <= max_span.
+	const size_t band = static_cast<size_t>(max_span) + 1;
+	PrepareTable(workspace, P, rna.size(), em.MaxMFE(), band);
 	int up_lim = UnpairedGapUB();
 	// The maximum number of multi-loop branches we need to consider.
 	int br_lim = BranchesUB();
@@ -592,18 +659,36 @@ int librnary::AverageAsymmetryFolder::Fold(const PrimeStructure &primary) {
 	size_t max_br = static_cast<size_t>(br_lim);
 	size_t max_sum_asym = static_cast<size_t>(sum_asym_lim);
 	// Note, we can only store up to max_br-1 because the closing and first branch is always done in the P table.
-	ML_Up.resize(4, _6DVE(max_br - 1, _5DVE(max_sum_asym + 1, _4DVE(up_sz + 1,
-																	VVVE(up_sz + 1,
-																		 VVE(rna.size(),
-																			 VE(rna.size(), em.MaxMFE())))))));
-	ML_Br.resize(4, _6DVE(max_br - 1, _5DVE(max_sum_asym + 1, _4DVE(up_sz + 1,
-																	VVVE(up_sz + 1,
-																		 VVE(rna.size(),
-																			 VE(rna.size(), em.MaxMFE())))))));
+	ML_Up.assign(4, _4DV<TriangularArray<CellT>>(max_br - 1, VVV<TriangularArray<CellT>>(
+		max_sum_asym + 1, VV<TriangularArray<CellT>>(up_sz + 1, V<TriangularArray<CellT>>(up_sz + 1)))));
+	ML_Br.assign(4, _4DV<RowWindowArray<CellT>>(max_br - 1, VVV<RowWindowArray<CellT>>(
+		max_sum_asym + 1, VV<RowWindowArray<CellT>>(up_sz + 1, V<RowWindowArray<CellT>>(up_sz + 1)))));
+	for (auto &by_bs : ML_Up)
+		for (auto &by_br : by_bs)
+			for (auto &by_asym : by_br)
+				for (auto &by_l : by_asym)
+					for (auto &tbl : by_l)
+						PrepareTable(workspace, tbl, rna.size(), em.MaxMFE(), band);
+	for (auto &by_bs : ML_Br) {
+		for (int br = 0; br < br_lim - 1; ++br) {
+			// P reads ML_Br[_][br - 2] at arbitrary rows, but ML_Br[_][br - 1] only up to row i + 1 + up_lim, and
+			// ML_Up reads ML_Br[_][br - 1] only up to row i + up_lim.
+			bool windowed = energy_only && (br == 0 || br > br_lim - 3);
+			for (auto &by_asym : by_bs[br])
+				for (auto &by_l : by_asym)
+					for (auto &tbl : by_l)
+						PrepareTable(workspace, tbl, rna.size(), windowed ? up_sz + 2 : rna.size(), em.MaxMFE(),
+									 band);
+		}
+	}
 	if (stacking) {
-		CxFl.resize(rna.size(), VI(rna.size(), em.MaxMFE()));
-		CxMM5.resize(rna.size(), VI(rna.size(), em.MaxMFE()));
-		CxMM3.resize(rna.size(), VI(rna.size(), em.MaxMFE()));
+		PrepareTable(workspace, CxFl, rna.size(), em.MaxMFE(), band);
+		PrepareTable(workspace, CxMM5, rna.size(), em.MaxMFE(), band);
+		PrepareTable(workspace, CxMM3, rna.size(), em.MaxMFE(), band);
+	} else {
+		CxFl.Clear();
+		CxMM5.Clear();
+		CxMM3.Clear();
 	}
 
 	// Base case that allows the [i,i] fragment to end on a single unpaired.
@@ -615,16 +700,24 @@ int librnary::AverageAsymmetryFolder::Fold(const PrimeStructure &primary) {
 			// Also ensure the cases have the right amount of sum asymmetry.
 			for (int bs = 0; bs < 3; ++bs) {
 				if (up_lim >= 1 && sum_asym_lim >= abs(up - 1))
-					ML_Up[bs][0][abs(up - 1)][up][1][i][i] = em.MLUnpairedCost();
+					StoreEnergy(ML_Up[bs][0][abs(up - 1)][up][1][i][i], em.MLUnpairedCost(), exact);
 			}
 			// Empty fragment case. No unpaired can be used. Ensure min sum asym = 0.
 			if (sum_asym_lim >= up)
-				ML_Up[0][0][up][up][0][i][i - 1] = 0;
+				StoreEnergy(ML_Up[0][0][up][up][0][i][i - 1], 0, exact);
 		}
 	}
 
-	for (int i = N - 1; i >= 0; --i) {
-		for (int j = i + 1; j < N; ++j) {
+	for (int i = N - 1; i >= 0 && exact; --i) {
+		// Windowed tables hand row i the storage of a row that can no longer be read.
+		for (auto &by_bs : ML_Br)
+			for (auto &by_br : by_bs)
+				for (auto &by_asym : by_br)
+					for (auto &by_l : by_asym)
+						for (auto &tbl : by_l)
+							if (tbl.Windowed())
+								tbl.ResetRow(i, em.MaxMFE());
+		for (int j = i + 1; j < N && InSpan(i, j); ++j) {
 			energy_t best;
 			// Paired table.
 			if (ValidPair(rna[i], rna[j]) &&
@@ -850,7 +943,7 @@ int librnary::AverageAsymmetryFolder::Fold(const PrimeStructure &primary) {
 										}
 									}
 
-									ML_Br[used_mask][br][sum_asym][up][upr][i][j] = best;
+									StoreEnergy(ML_Br[used_mask][br][sum_asym][up][upr][i][j], best, exact);
 
 
 									// ML_Up stuff.
@@ -872,7 +965,7 @@ int librnary::AverageAsymmetryFolder::Fold(const PrimeStructure &primary) {
 														- i][upr][k][j]);
 										}
 									}
-									ML_Up[used_mask][br][sum_asym][up][upr][i][j] = best;
+									StoreEnergy(ML_Up[used_mask][br][sum_asym][up][upr][i][j], best, exact);
 								}
 							}
 						}
@@ -882,27 +975,31 @@ int librnary::AverageAsymmetryFolder::Fold(const PrimeStructure &primary) {
 		}
 	}
 
+	if (!exact)
+		return false;
+
 	for (int i = 1; i < N; ++i) {
 		energy_t best = E[i - 1];
-		for (int k = -1; k < i; ++k) {
+		for (int k = max(-1, i - ExteriorReach(max_span, stacking)); k < i; ++k) {
 			energy_t decomp = k == -1 ? 0 : E[k];
-			best = min(best, decomp + SSScore(k + 1, i));
+			if (InSpan(k + 1, i))
+				best = min(best, decomp + SSScore(k + 1, i));
 			if (stacking) {
-				if (k + 2 < i)
+				if (k + 2 < i && InSpan(k + 2, i))
 					best = min(best, decomp + SSScore(k + 2, i) + em.FiveDangle(k + 2, i));
-				if (k + 1 < i - 1)
+				if (k + 1 < i - 1 && InSpan(k + 1, i - 1))
 					best = min(best, decomp + SSScore(k + 1, i - 1) + em.ThreeDangle(k + 1, i - 1));
-				if (k + 2 < i - 1)
+				if (k + 2 < i - 1 && InSpan(k + 2, i - 1))
 					best = min(best, decomp + SSScore(k + 2, i - 1) + em.Mismatch(k + 2, i - 1));
 				// Coaxial stack decompositions.
-				for (int j = k + 1; j + 1 < i; ++j) {
-					if (k + 1 < j)
+				for (int j = max(k + 1, i - max_span - 3); j + 1 < i && j - k <= max_span + 3; ++j) {
+					if (k + 1 < j && InSpan(k + 1, j) && InSpan(j + 1, i))
 						best = min(best, decomp + em.FlushCoax(k + 1, j, j + 1, i)
 							+ SSScore(k + 1, j) + SSScore(j + 1, i));
-					if (k + 2 < j - 1)
+					if (k + 2 < j - 1 && InSpan(k + 2, j - 1) && InSpan(j + 1, i))
 						best = min(best, decomp + em.MismatchCoax(k + 2, j - 1, j + 1, i)
 							+ SSScore(k + 2, j - 1) + SSScore(j + 1, i));
-					if (k + 1 < j && j + 2 < i - 1)
+					if (k + 1 < j && j + 2 < i - 1 && InSpan(k + 1, j) && InSpan(j + 2, i - 1))
 						best = min(best, decomp + em.MismatchCoax(j + 2, i - 1, k + 1, j)
 							+ SSScore(k + 1, j) + SSScore(j + 2, i - 1));
 				}
@@ -911,5 +1008,5 @@ int librnary::AverageAsymmetryFolder::Fold(const PrimeStructure &primary) {
 		E[i] = best;
 	}
 
-	return E[N - 1];
+	return exact;
 }
\ No newline at end of file
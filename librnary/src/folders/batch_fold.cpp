@@ -0,0 +1,92 @@
+#include "folders/batch_fold.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <numeric>
+
+using namespace std;
+
+double librnary::EstimateFoldCost(size_t n, int max_twoloop_unpaired) {
+	auto len = static_cast<double>(n);
+	double c = min(len, static_cast<double>(max(max_twoloop_unpaired, 0)));
+	return len * len * (len + c * c / 4);
+}
+
+double librnary::BatchReport::IdealMakespan() const {
+	return max(total_work / threads, longest_item);
+}
+
+double librnary::BatchReport::Efficiency() const {
+	return items > 0 && makespan > 0 ? IdealMakespan() / makespan : 1;
+}
+
+std::ostream &librnary::operator<<(std::ostream &os, const BatchReport &r) {
+	auto flags = os.flags();
+	auto precision = os.precision();
+	os << fixed << setprecision(3) << r.items << " folds on " << r.threads << " threads: makespan " << r.makespan
+	   << "s, ideal " << r.IdealMakespan() << "s (" << setprecision(1) << r.Efficiency() * 100
+	   << "% efficient), contiguous blocks would take " << setprecision(3) << r.static_makespan << "s";
+	os.flags(flags);
+	os.precision(precision);
+	return os;
+}
+
+vector<vector<size_t>> librnary::BucketByLength(const vector<size_t> &lengths, size_t width) {
+	vector<size_t> order(lengths.size());
+	iota(order.begin(), order.end(), 0);
+	stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+		return lengths[a] < lengths[b];
+	});
+	vector<vector<size_t>> groups;
+	for (size_t r : order) {
+		if (groups.empty() || groups.back().size() >= width
+			|| lengths[r] > lengths[groups.back().front()] + lengths[groups.back().front()] / 8)
+			groups.emplace_back();
+		groups.back().push_back(r);
+	}
+	return groups;
+}
+
+librnary::BatchReport librnary::ScheduleLongestFirst(const vector<double> &costs, const function<void(size_t)> &f,
+													 size_t threads) {
+	typedef chrono::steady_clock Clock;
+	threads = max<size_t>(threads, 1);
+	const size_t n = costs.size();
+
+	vector<size_t> order(n);
+	iota(order.begin(), order.end(), 0);
+	stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+		return costs[a] > costs[b];
+	});
+
+	vector<double> seconds(n, 0);
+	atomic<size_t> next(0);
+	auto start = Clock::now();
+	// One task per thread, each pulling the largest remaining item from a shared queue.
+	SharedThreadPool(threads).ParallelFor(0, threads, [&](size_t) {
+		for (size_t k = next++; k < n; k = next++) {
+			auto item_start = Clock::now();
+			f(order[k]);
+			seconds[order[k]] = chrono::duration<double>(Clock::now() - item_start).count();
+		}
+	}, 1);
+
+	BatchReport r;
+	r.threads = threads;
+	r.items = n;
+	r.makespan = chrono::duration<double>(Clock::now() - start).count();
+	for (size_t i = 0; i < n; ++i) {
+		r.total_work += seconds[i];
+		r.longest_item = max(r.longest_item, seconds[i]);
+	}
+	for (size_t t = 0; t < threads; ++t) {
+		double block = 0;
+		for (size_t i = n * t / threads; i < n * (t + 1) / threads; ++i)
+			block += seconds[i];
+		r.static_makespan = max(r.static_makespan, block);
+	}
+	return r;
+}
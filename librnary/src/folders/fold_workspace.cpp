@@ -0,0 +1,140 @@
+#include <folders/fold_workspace.hpp>
+
+using namespace std;
+
+void librnary::FoldWorkspace::Rewind() {
+	next = 0;
+	next_compact = 0;
+}
+
+template<typename T>
+T *librnary::FoldWorkspace::NextBuffer(vector<vector<T, AlignedAllocator<T>>> &bufs, size_t &nxt, size_t cells) {
+	if (nxt == bufs.size())
+		bufs.emplace_back();
+	auto &buf = bufs[nxt++];
+	if (buf.size() < cells) {
+		size_t old_cap = buf.capacity();
+		buf.resize(cells);
+		if (buf.capacity() != old_cap)
+			bytes_allocated += buf.capacity() * sizeof(T);
+	}
+	return buf.data();
+}
+
+void librnary::FoldWorkspace::Bind(TriangularArray<energy_t> &tbl, size_t n, energy_t init, size_t band) {
+	tbl.Bind(n, init, NextBuffer(buffers, next, TriangularArray<energy_t>::Cells(n, band)), band);
+}
+
+void librnary::FoldWorkspace::Bind(RowWindowArray<energy_t> &tbl, size_t n, size_t window, energy_t init,
+								   size_t band) {
+	tbl.Bind(n, window, init, NextBuffer(buffers, next, RowWindowArray<energy_t>::Cells(n, window, band)), band);
+}
+
+void librnary::FoldWorkspace::Bind(TriangularArray<energy_t, TriangularLayout::ColumnMajor> &tbl, size_t n,
+								   energy_t init, size_t band) {
+	tbl.Bind(n, init,
+			 NextBuffer(buffers, next, TriangularArray<energy_t, TriangularLayout::ColumnMajor>::Cells(n, band)),
+			 band);
+}
+
+void librnary::FoldWorkspace::Bind(TriangularArray<CompactEnergy> &tbl, size_t n, energy_t init, size_t band) {
+	tbl.Bind(n, init, NextBuffer(compact_buffers, next_compact, TriangularArray<CompactEnergy>::Cells(n, band)),
+			 band);
+}
+
+void librnary::FoldWorkspace::Bind(RowWindowArray<CompactEnergy> &tbl, size_t n, size_t window, energy_t init,
+								   size_t band) {
+	tbl.Bind(n, window, init,
+			 NextBuffer(compact_buffers, next_compact, RowWindowArray<CompactEnergy>::Cells(n, window, band)), band);
+}
+
+size_t librnary::FoldWorkspace::BytesAllocated() const {
+	return bytes_allocated;
+}
+
+size_t librnary::FoldWorkspace::BytesReserved() const {
+	size_t res = 0;
+	for (const auto &buf : buffers)
+		res += buf.capacity() * sizeof(energy_t);
+	for (const auto &buf : compact_buffers)
+		res += buf.capacity() * sizeof(CompactEnergy);
+	return res;
+}
+
+void librnary::FoldWorkspace::Release() {
+	buffers.clear();
+	buffers.shrink_to_fit();
+	compact_buffers.clear();
+	compact_buffers.shrink_to_fit();
+	next = 0;
+	next_compact = 0;
+}
+
+void librnary::PrepareTable(FoldWorkspace *ws, TriangularArray<energy_t> &tbl, size_t n, energy_t init,
+							size_t band) {
+	if (ws != nullptr)
+		ws->Bind(tbl, n, init, band);
+	else
+		tbl.Assign(n, init, band);
+}
+
+void librnary::PrepareTable(FoldWorkspace *ws, RowWindowArray<energy_t> &tbl, size_t n, size_t window,
+							energy_t init, size_t band) {
+	if (ws != nullptr)
+		ws->Bind(tbl, n, window, init, band);
+	else
+		tbl.Assign(n, window, init, band);
+}
+
+void librnary::PrepareTable(FoldWorkspace *ws, TriangularArray<energy_t, TriangularLayout::ColumnMajor> &tbl,
+							size_t n, energy_t init, size_t band) {
+	if (ws != nullptr)
+		ws->Bind(tbl, n, init, band);
+	else
+		tbl.Assign(n, init, band);
+}
+
+void librnary::PrepareTable(FoldWorkspace *ws, TriangularArray<CompactEnergy> &tbl, size_t n, energy_t init,
+							size_t band) {
+	if (ws != nullptr)
+		ws->Bind(tbl, n, init, band);
+	else
+		tbl.Assign(n, init, band);
+}
+
+void librnary::PrepareTable(FoldWorkspace *ws, RowWindowArray<CompactEnergy> &tbl, size_t n, size_t window,
+							energy_t init, size_t band) {
+	if (ws != nullptr)
+		ws->Bind(tbl, n, window, init, band);
+	else
+		tbl.Assign(n, window, init, band);
+}
+
+librnary::FoldWorkspace *librnary::FoldWorkspacePool::Acquire() {
+	lock_guard<mutex> lock(mtx);
+	if (free_list.empty()) {
+		all.emplace_back(new FoldWorkspace());
+		return all.back().get();
+	}
+	FoldWorkspace *ws = free_list.back();
+	free_list.pop_back();
+	return ws;
+}
+
+void librnary::FoldWorkspacePool::Release(FoldWorkspace *ws) {
+	lock_guard<mutex> lock(mtx);
+	free_list.push_back(ws);
+}
+
+size_t librnary::FoldWorkspacePool::BytesAllocated() const {
+	lock_guard<mutex> lock(mtx);
+	size_t res = 0;
+	for (const auto &ws : all)
+		res += ws->BytesAllocated();
+	return res;
+}
+
+size_t librnary::FoldWorkspacePool::Size() const {
+	lock_guard<mutex> lock(mtx);
+	return all.size();
+}
@@ -0,0 +1,156 @@
+#include <folders/min_plus.hpp>
+
+#include <algorithm>
+#include <atomic>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LIBRNARY_MIN_PLUS_X86
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace {
+using librnary::energy_t;
+using librnary::MinPlusKernel;
+
+typedef energy_t (*KernelFn)(const energy_t *, const energy_t *, int, energy_t);
+
+energy_t MinPlusScalar(const energy_t *a, const energy_t *b, int n, energy_t init) {
+	for (int t = 0; t < n; ++t)
+		init = min(init, a[t] + b[t]);
+	return init;
+}
+
+#ifdef LIBRNARY_MIN_PLUS_X86
+
+/// The least of the 4 lanes of v. Needs SSE4.1.
+__attribute__((target("sse4.1")))
+inline energy_t HorizontalMin(__m128i v) {
+	v = _mm_min_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+	v = _mm_min_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtsi128_si32(v);
+}
+
+__attribute__((target("sse4.1")))
+energy_t MinPlusSSE41(const energy_t *a, const energy_t *b, int n, energy_t init) {
+	__m128i best = _mm_set1_epi32(init);
+	int t = 0;
+	for (; t + 4 <= n; t += 4) {
+		__m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + t));
+		__m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + t));
+		best = _mm_min_epi32(best, _mm_add_epi32(va, vb));
+	}
+	return MinPlusScalar(a + t, b + t, n - t, HorizontalMin(best));
+}
+
+__attribute__((target("avx2")))
+energy_t MinPlusAVX2(const energy_t *a, const energy_t *b, int n, energy_t init) {
+	// Two accumulators, so consecutive minimums do not wait on each other.
+	__m256i best0 = _mm256_set1_epi32(init), best1 = best0;
+	int t = 0;
+	for (; t + 16 <= n; t += 16) {
+		__m256i a0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + t));
+		__m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + t));
+		__m256i a1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + t + 8));
+		__m256i b1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + t + 8));
+		best0 = _mm256_min_epi32(best0, _mm256_add_epi32(a0, b0));
+		best1 = _mm256_min_epi32(best1, _mm256_add_epi32(a1, b1));
+	}
+	if (t + 8 <= n) {
+		__m256i a0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + t));
+		__m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + t));
+		best0 = _mm256_min_epi32(best0, _mm256_add_epi32(a0, b0));
+		t += 8;
+	}
+	best0 = _mm256_min_epi32(best0, best1);
+	__m128i best = _mm_min_epi32(_mm256_castsi256_si128(best0), _mm256_extracti128_si256(best0, 1));
+	if (t + 4 <= n) {
+		__m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + t));
+		__m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + t));
+		best = _mm_min_epi32(best, _mm_add_epi32(va, vb));
+		t += 4;
+	}
+	return MinPlusScalar(a + t, b + t, n - t, HorizontalMin(best));
+}
+
+#endif
+
+KernelFn KernelFunction(MinPlusKernel k) {
+	switch (k) {
+#ifdef LIBRNARY_MIN_PLUS_X86
+		case MinPlusKernel::AVX2:
+			return MinPlusAVX2;
+		case MinPlusKernel::SSE41:
+			return MinPlusSSE41;
+#endif
+		default:
+			return MinPlusScalar;
+	}
+}
+
+/// The fastest kernel no faster than k that the CPU supports.
+MinPlusKernel SupportedAtMost(MinPlusKernel k) {
+	if (k == MinPlusKernel::AVX2 && !librnary::MinPlusKernelSupported(k))
+		k = MinPlusKernel::SSE41;
+	if (k == MinPlusKernel::SSE41 && !librnary::MinPlusKernelSupported(k))
+		k = MinPlusKernel::Scalar;
+	return k;
+}
+
+/// The kernel MinPlus runs, and its function. Null until the first MinPlus or SetMinPlusKernel.
+atomic<KernelFn> active_fn(nullptr);
+atomic<MinPlusKernel> active_kernel(MinPlusKernel::Scalar);
+
+KernelFn Activate(MinPlusKernel k) {
+	k = SupportedAtMost(k);
+	KernelFn fn = KernelFunction(k);
+	active_kernel.store(k, memory_order_relaxed);
+	active_fn.store(fn, memory_order_release);
+	return fn;
+}
+}
+
+librnary::energy_t librnary::MinPlus(const energy_t *a, const energy_t *b, int n, energy_t init) {
+	KernelFn fn = active_fn.load(memory_order_acquire);
+	// Two threads may both get here first. They choose the same kernel, so either store will do.
+	if (fn == nullptr)
+		fn = Activate(MinPlusKernel::AVX2);
+	return fn(a, b, n, init);
+}
+
+bool librnary::MinPlusKernelSupported(MinPlusKernel k) {
+	switch (k) {
+		case MinPlusKernel::Scalar:
+			return true;
+#ifdef LIBRNARY_MIN_PLUS_X86
+		case MinPlusKernel::SSE41:
+			return __builtin_cpu_supports("sse4.1");
+		case MinPlusKernel::AVX2:
+			return __builtin_cpu_supports("avx2");
+#endif
+		default:
+			return false;
+	}
+}
+
+void librnary::SetMinPlusKernel(MinPlusKernel k) {
+	Activate(k);
+}
+
+librnary::MinPlusKernel librnary::ActiveMinPlusKernel() {
+	if (active_fn.load(memory_order_acquire) == nullptr)
+		Activate(MinPlusKernel::AVX2);
+	return active_kernel.load(memory_order_relaxed);
+}
+
+const char *librnary::MinPlusKernelName(MinPlusKernel k) {
+	switch (k) {
+		case MinPlusKernel::SSE41:
+			return "SSE4.1";
+		case MinPlusKernel::AVX2:
+			return "AVX2";
+		default:
+			return "Scalar";
+	}
+}
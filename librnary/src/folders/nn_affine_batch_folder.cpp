@@ -0,0 +1,242 @@
+#include "folders/nn_affine_batch_folder.hpp"
+
+using namespace std;
+
+const int librnary::NNAffineBatchFolder::Width;
+
+librnary::NNAffineBatchFolder::NNAffineBatchFolder(const NNAffineModel &_em)
+	: NNAffineFolder(_em) {}
+
+librnary::NNAffineBatchFolder::NNAffineBatchFolder(const NNAffineFolder &folder)
+	: NNAffineFolder(SettingsOf(folder)) {}
+
+template<typename F>
+librnary::LaneEnergies librnary::NNAffineBatchFolder::Lookup(const LaneMask &mask, const F &f) const {
+	LaneEnergies e;
+	for (int w = 0; w < Width; ++w)
+		e.v[w] = mask.v[w] ? f(models[w]) : 0;
+	return e;
+}
+
+struct librnary::NNAffineBatchFolder::Source {
+	typedef LaneMask Mask;
+
+	NNAffineBatchFolder &folder;
+
+	explicit Source(NNAffineBatchFolder &_folder)
+		: folder(_folder) {}
+
+	bool Stacking() const {
+		return folder.stacking;
+	}
+
+	int MaxSpan() const {
+		return folder.max_span;
+	}
+
+	bool InSpan(int i, int j) const {
+		return folder.InSpan(i, j);
+	}
+
+	Mask Live(int j) const {
+		return folder.live[j];
+	}
+
+	bool Pairable(int i, int j, Mask &pairable) const {
+		const Mask &lv = folder.live[j];
+		bool any = false;
+		for (int w = 0; w < Width; ++w) {
+			pairable.v[w] = lv.v[w] && ValidPair(folder.rnas[w][i], folder.rnas[w][j]) &&
+				(folder.lonely_pairs || !MustBeLonelyPair(folder.rnas[w], i, j, folder.em.MIN_HAIRPIN_UNPAIRED));
+			any = any || pairable.v[w];
+		}
+		return any;
+	}
+
+	void Store(const Mask &mask, const LaneEnergies &from, LaneEnergies &to) const {
+		for (int w = 0; w < Width; ++w)
+			if (mask.v[w])
+				to.v[w] = from.v[w];
+	}
+
+	energy_t MLInit() const {
+		return folder.em.MLInitCost();
+	}
+
+	energy_t MLBranch() const {
+		return folder.em.MLBranchCost();
+	}
+
+	energy_t MLUnpaired() const {
+		return folder.em.MLUnpairedCost();
+	}
+
+	LaneEnergies OneLoop(const Mask &mask, int i, int j) const {
+		return folder.Lookup(mask, [&](const LaneModel &m) {
+			return m.OneLoop(i, j);
+		});
+	}
+
+	LaneEnergies Branch(const Mask &mask, int i, int j) const {
+		return folder.Lookup(mask, [&](const LaneModel &m) {
+			return m.Branch(i, j);
+		});
+	}
+
+	LaneEnergies ClosingThreeDangle(const Mask &mask, int i, int j) const {
+		return folder.Lookup(mask, [&](const LaneModel &m) {
+			return m.ClosingThreeDangle(i, j);
+		});
+	}
+
+	LaneEnergies ClosingFiveDangle(const Mask &mask, int i, int j) const {
+		return folder.Lookup(mask, [&](const LaneModel &m) {
+			return m.ClosingFiveDangle(i, j);
+		});
+	}
+
+	LaneEnergies ClosingMismatch(const Mask &mask, int i, int j) const {
+		return folder.Lookup(mask, [&](const LaneModel &m) {
+			return m.ClosingMismatch(i, j);
+		});
+	}
+
+	LaneEnergies FlushCoax(const Mask &mask, int i, int j, int k, int l) const {
+		return folder.Lookup(mask, [&](const LaneModel &m) {
+			return m.FlushCoax(i, j, k, l);
+		});
+	}
+
+	LaneEnergies MismatchCoax(const Mask &mask, int i, int j, int k, int l) const {
+		return folder.Lookup(mask, [&](const LaneModel &m) {
+			return m.MismatchCoax(i, j, k, l);
+		});
+	}
+
+	/// The lanes of mask whose RNA has a nucleotide before i, after j, or both.
+	Mask Outside(Mask mask, int i, int j, bool before, bool after) const {
+		for (int w = 0; w < Width; ++w)
+			mask.v[w] = mask.v[w] && (!before || i > 0) && (!after || j + 1 < static_cast<int>(folder.rnas[w].size()));
+		return mask;
+	}
+
+	LaneEnergies FiveDangle(const Mask &mask, int i, int j) const {
+		return folder.Lookup(Outside(mask, i, j, true, false), [&](const LaneModel &m) {
+			return m.FiveDangle(i, j);
+		});
+	}
+
+	LaneEnergies ThreeDangle(const Mask &mask, int i, int j) const {
+		return folder.Lookup(Outside(mask, i, j, false, true), [&](const LaneModel &m) {
+			return m.ThreeDangle(i, j);
+		});
+	}
+
+	LaneEnergies Mismatch(const Mask &mask, int i, int j) const {
+		return folder.Lookup(Outside(mask, i, j, true, true), [&](const LaneModel &m) {
+			return m.Mismatch(i, j);
+		});
+	}
+
+	/// Most bulges and internal loops are the sum of a size term, the closing pair's term, and TL.
+	LaneEnergies TwoLoops(const Mask &pairable, const LaneTables &t, int i, int j) const {
+		LaneEnergies best = LaneEnergies::All(folder.em.MaxMFE()), outer[4];
+		for (int s = 0; s < 4; ++s) {
+			const auto shape = static_cast<TwoLoopShape>(s + 1);
+			outer[s] = folder.Lookup(pairable, [&](const LaneModel &m) {
+				return m.TwoLoopOuter(shape, i, j);
+			});
+		}
+		const int max_up = folder.max_twoloop_unpaired;
+		for (int k = i + 1; k + 1 < j && (k - i - 1) <= max_up; ++k) {
+			for (int l = j - 1; l > k && (j - l - 1) + (k - i - 1) <= max_up; --l) {
+				const TwoLoopShape shape = ShapeOfTwoLoop(k - i - 1, j - l - 1);
+				if (shape == TwoLoopShape::Unsplit) {
+					for (int w = 0; w < Width; ++w)
+						if (pairable.v[w])
+							best.v[w] = min(best.v[w], t.P[k][l].v[w] + folder.models[w].TwoLoop(i, k, l, j));
+				} else {
+					const int s = static_cast<int>(shape) - 1;
+					best.Min(folder.TL[s][k][l] + outer[s]
+								 + folder.models.front().TwoLoopSize(shape, k - i - 1, j - l - 1));
+				}
+			}
+		}
+		return best;
+	}
+
+	void PairFilled(const Mask &live, const LaneTables &t, int i, int j) {
+		for (int s = 0; s < 4; ++s) {
+			const auto shape = static_cast<TwoLoopShape>(s + 1);
+			folder.TL[s][i][j] = t.P[i][j] + folder.Lookup(live, [&](const LaneModel &m) {
+				return m.TwoLoopInner(shape, i, j);
+			});
+		}
+	}
+};
+
+size_t librnary::NNAffineBatchFolder::TableBytes() const {
+	size_t bytes = lanes.Bytes();
+	for (const auto &tbl : TL)
+		bytes += tbl.Bytes();
+	return bytes;
+}
+
+vector<librnary::energy_t> librnary::NNAffineBatchFolder::Fold(const vector<PrimeStructure> &_rnas) {
+	assert(_rnas.size() <= static_cast<size_t>(Width));
+	rnas = _rnas;
+	models.clear();
+	size_t longest = 0;
+	for (const auto &r : rnas) {
+		em.SetRNA(r);
+		models.emplace_back(em);
+		longest = max(longest, r.size());
+	}
+	const auto N = static_cast<int>(longest);
+	live.assign(longest, LaneMask());
+	for (int j = 0; j < N; ++j)
+		for (int w = 0; w < Width; ++w)
+			live[j].v[w] = w < static_cast<int>(rnas.size()) && j < static_cast<int>(rnas[w].size());
+
+	// Cells (i,j) are only needed for j - i <= max_span.
+	const size_t band = static_cast<size_t>(max_span) + 1;
+	const LaneEnergies inf = LaneEnergies::All(em.MaxMFE());
+	lanes.Assign(longest, inf, band, stacking);
+	TL.resize(4);
+	for (auto &tbl : TL)
+		tbl.Assign(longest, inf, band);
+
+	Source src(*this);
+	FillLaneTables(src, lanes, N);
+
+	vector<energy_t> mfes;
+	for (size_t w = 0; w < rnas.size(); ++w)
+		mfes.push_back(rnas[w].empty() ? 0 : lanes.E[rnas[w].size() - 1].v[w]);
+	return mfes;
+}
+
+librnary::Matching librnary::NNAffineBatchFolder::Traceback(size_t lane) {
+	assert(lane < rnas.size());
+	// Load the lane into the tables of NNAffineFolder, and trace back through them as it would.
+	rna = rnas[lane];
+	em.SetRNA(rna);
+	const size_t RSZ = rna.size();
+	const auto N = static_cast<int>(RSZ);
+	const size_t band = static_cast<size_t>(max_span) + 1;
+	P.Assign(RSZ, em.MaxMFE(), band);
+	Cx.Assign(RSZ, em.MaxMFE(), band);
+	ML.resize(3);
+	for (auto &tbl : ML)
+		tbl.Assign(RSZ, RSZ, em.MaxMFE(), band);
+	E.assign(RSZ, 0);
+	for (int i = 0; i < N; ++i) {
+		for (int j = i; j < N && InSpan(i, j); ++j) {
+			P[i][j] = lanes.P[i][j].v[lane];
+			Cx[i][j] = lanes.Cx[i][j].v[lane];
+			for (int b = 0; b < 3; ++b)
+				ML[b][i][j] = lanes.ML[b][i][j].v[lane];
+		}
+		E[i] = lanes.E[i].v[lane];
+	}
+	return NNAffineFolder::Traceback();
+}
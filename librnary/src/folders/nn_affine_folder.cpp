@@ -3,6 +3,9 @@
 //
 
 #include <folders/nn_affine_folder.hpp>
+#include <unordered_map>
+#include <queue>
+#include <stdexcept>
 
 using namespace std;
 
@@ -30,20 +33,83 @@ void librnary::NNAffineFolder::SetMaxTwoLoop(unsigned max_up) {
 	max_twoloop_unpaired = max_up;
 }
 
+void librnary::NNAffineFolder::SetWorkspace(FoldWorkspace *ws) {
+	workspace = ws;
+}
+
 int librnary::NNAffineFolder::MaxTwoLoop() const {
 	return max_twoloop_unpaired;
 }
 
-librnary::energy_t librnary::NNAffineFolder::SSScore(int i, int j) const {
-	return em.Branch(i, j) + P[i][j];
+void librnary::NNAffineFolder::SetStaticDispatch(bool v) {
+	static_dispatch = v;
+}
+
+bool librnary::NNAffineFolder::StaticDispatch() const {
+	return static_dispatch;
+}
+
+void librnary::NNAffineFolder::SetThreads(size_t threads) {
+	if (threads <= 1)
+		pool.reset();
+	else if (pool == nullptr || pool->Size() != threads)
+		pool = make_shared<ThreadPool>(threads);
+}
+
+size_t librnary::NNAffineFolder::Threads() const {
+	return pool == nullptr ? 1 : pool->Size();
+}
+
+void librnary::NNAffineFolder::SetEnergyOnly(bool v) {
+	energy_only = v;
+}
+
+bool librnary::NNAffineFolder::EnergyOnly() const {
+	return energy_only;
+}
+
+void librnary::NNAffineFolder::SetMaxSpan(unsigned span) {
+	max_span = static_cast<int>(min<unsigned>(span, numeric_limits<int>::max() / 3));
+}
+
+int librnary::NNAffineFolder::MaxSpan() const {
+	return max_span;
+}
+
+size_t librnary::NNAffineFolder::TableBytes() const {
+	size_t bytes = P.Bytes() + Cx.Bytes() + MLBrCol.Bytes() + CxCol.Bytes() + E.size() * sizeof(energy_t);
+	for (const auto &tbl : ML)
+		bytes += tbl.Bytes();
+	return bytes;
+}
+
+template<typename ModelT>
+librnary::energy_t librnary::NNAffineFolder::SSScore(const ModelT &m, int i, int j) const {
+	return m.Branch(i, j) + P[i][j];
+}
+
+template<typename ModelT>
+librnary::energy_t librnary::NNAffineFolder::MLSSScore(const ModelT &m, int i, int j) const {
+	return SSScore(m, i, j) + m.MLBranchCost();
 }
 
-librnary::energy_t librnary::NNAffineFolder::MLSSScore(int i, int j) const {
-	return SSScore(i, j) + em.MLBranchCost();
+template<typename ModelT>
+librnary::energy_t librnary::NNAffineFolder::MLBranchScore(const ModelT &m, int i, int j) const {
+	energy_t branch = MLSSScore(m, i, j);
+	if (stacking) {
+		if (i + 1 < j) {
+			branch = min(branch, MLSSScore(m, i + 1, j) + m.FiveDangle(i + 1, j) + m.MLUnpairedCost());
+			branch = min(branch, MLSSScore(m, i, j - 1) + m.ThreeDangle(i, j - 1) + m.MLUnpairedCost());
+		}
+		if (i + 1 < j - 1)
+			branch = min(branch, MLSSScore(m, i + 1, j - 1) + m.Mismatch(i + 1, j - 1) + m.MLUnpairedCost() * 2);
+	}
+	return branch;
 }
 
-librnary::energy_t librnary::NNAffineFolder::MLClosingBranchScore(int i, int j) const {
-	return em.MLInitCost() + em.Branch(i, j) + em.MLBranchCost();
+template<typename ModelT>
+librnary::energy_t librnary::NNAffineFolder::MLClosingBranchScore(const ModelT &m, int i, int j) const {
+	return m.MLInitCost() + m.Branch(i, j) + m.MLBranchCost();
 }
 
 
@@ -60,36 +126,39 @@ void librnary::NNAffineFolder::TraceE(stack<TState> &s) {
 	// Maintain best decomposition.
 	vector<TState> best_decomp = {TState(i - 1)}; // Unpaired 3'.
 	energy_t be = E[i - 1];
-	for (int k = -1; k < i; ++k) {
+	for (int k = max(-1, i - ExteriorReach(max_span, stacking)); k < i; ++k) {
 		int decomp = k == -1 ? 0 : E[k];
 		vector<TState> decomp_state;
 		if (k != -1)
 			decomp_state.emplace_back(k);
-		energy_t e = decomp + SSScore(k + 1, i);
-		if (e < be) {
-			be = e;
-			best_decomp = {TState(PT, k + 1, i)};
-			best_decomp.insert(best_decomp.end(), decomp_state.begin(), decomp_state.end());
+		energy_t e;
+		if (InSpan(k + 1, i)) {
+			e = decomp + SSScore(em, k + 1, i);
+			if (e < be) {
+				be = e;
+				best_decomp = {TState(PT, k + 1, i)};
+				best_decomp.insert(best_decomp.end(), decomp_state.begin(), decomp_state.end());
+			}
 		}
 		if (stacking) {
-			if (k + 2 < i) {
-				e = decomp + SSScore(k + 2, i) + em.FiveDangle(k + 2, i);
+			if (k + 2 < i && InSpan(k + 2, i)) {
+				e = decomp + SSScore(em, k + 2, i) + em.FiveDangle(k + 2, i);
 				if (e < be) {
 					be = e;
 					best_decomp = {TState(PT, k + 2, i)};
 					best_decomp.insert(best_decomp.end(), decomp_state.begin(), decomp_state.end());
 				}
 			}
-			if (k + 1 < i - 1) {
-				e = decomp + SSScore(k + 1, i - 1) + em.ThreeDangle(k + 1, i - 1);
+			if (k + 1 < i - 1 && InSpan(k + 1, i - 1)) {
+				e = decomp + SSScore(em, k + 1, i - 1) + em.ThreeDangle(k + 1, i - 1);
 				if (e < be) {
 					be = e;
 					best_decomp = {TState(PT, k + 1, i - 1)};
 					best_decomp.insert(best_decomp.end(), decomp_state.begin(), decomp_state.end());
 				}
 			}
-			if (k + 2 < i - 1) {
-				e = decomp + SSScore(k + 2, i - 1) + em.Mismatch(k + 2, i - 1);
+			if (k + 2 < i - 1 && InSpan(k + 2, i - 1)) {
+				e = decomp + SSScore(em, k + 2, i - 1) + em.Mismatch(k + 2, i - 1);
 				if (e < be) {
 					be = e;
 					best_decomp = {TState(PT, k + 2, i - 1)};
@@ -98,28 +167,28 @@ void librnary::NNAffineFolder::TraceE(stack<TState> &s) {
 			}
 
 			// Coaxial stack decompositions.
-			for (int j = k + 1; j + 1 < i; ++j) {
-				if (k + 1 < j) {
+			for (int j = max(k + 1, i - max_span - 3); j + 1 < i && j - k <= max_span + 3; ++j) {
+				if (k + 1 < j && InSpan(k + 1, j) && InSpan(j + 1, i)) {
 					e = decomp + em.FlushCoax(k + 1, j, j + 1, i)
-						+ SSScore(k + 1, j) + SSScore(j + 1, i);
+						+ SSScore(em, k + 1, j) + SSScore(em, j + 1, i);
 					if (e < be) {
 						be = e;
 						best_decomp = {TState(PT, k + 1, j), TState(PT, j + 1, i)};
 						best_decomp.insert(best_decomp.end(), decomp_state.begin(), decomp_state.end());
 					}
 				}
-				if (k + 2 < j - 1) {
+				if (k + 2 < j - 1 && InSpan(k + 2, j - 1) && InSpan(j + 1, i)) {
 					e = decomp + em.MismatchCoax(k + 2, j - 1, j + 1, i)
-						+ SSScore(k + 2, j - 1) + SSScore(j + 1, i);
+						+ SSScore(em, k + 2, j - 1) + SSScore(em, j + 1, i);
 					if (e < be) {
 						be = e;
 						best_decomp = {TState(PT, k + 2, j - 1), TState(PT, j + 1, i)};
 						best_decomp.insert(best_decomp.end(), decomp_state.begin(), decomp_state.end());
 					}
 				}
-				if (j + 2 < i - 1 && k + 1 < j) {
+				if (j + 2 < i - 1 && k + 1 < j && InSpan(k + 1, j) && InSpan(j + 2, i - 1)) {
 					e = decomp + em.MismatchCoax(j + 2, i - 1, k + 1, j)
-						+ SSScore(k + 1, j) + SSScore(j + 2, i - 1);
+						+ SSScore(em, k + 1, j) + SSScore(em, j + 2, i - 1);
 					if (e < be) {
 						be = e;
 						best_decomp = {TState(PT, k + 1, j), TState(PT, j + 2, i - 1)};
@@ -153,7 +222,7 @@ void librnary::NNAffineFolder::TraceP(std::stack<TState> &s) {
 
 	// The L (Loop) table.
 	// Multi-loops.
-	int init = MLClosingBranchScore(i, j);
+	int init = MLClosingBranchScore(em, i, j);
 	// No stacking interactions
 	e = init + ML[2][i + 1][j - 1];
 	if (e < be) {
@@ -189,7 +258,7 @@ void librnary::NNAffineFolder::TraceP(std::stack<TState> &s) {
 			// ((_)_)
 			//    ^ <- k
 			if (k + 1 < j - 1 && i + 1 < k) {
-				e = ML[1][k + 1][j - 1] + init + em.FlushCoax(i, j, i + 1, k) + MLSSScore(i + 1, k);
+				e = ML[1][k + 1][j - 1] + init + em.FlushCoax(i, j, i + 1, k) + MLSSScore(em, i + 1, k);
 				if (e < be) {
 					be = e;
 					best_decomp = {TState(MLT, 1, k + 1, j - 1), TState(PT, i + 1, k)};
@@ -197,7 +266,7 @@ void librnary::NNAffineFolder::TraceP(std::stack<TState> &s) {
 			}
 			// (.(_)_.)
 			if (i + 2 < k && k + 1 < j - 2) {
-				e = ML[1][k + 1][j - 2] + init + em.MismatchCoax(i, j, i + 2, k) + MLSSScore(i + 2, k)
+				e = ML[1][k + 1][j - 2] + init + em.MismatchCoax(i, j, i + 2, k) + MLSSScore(em, i + 2, k)
 					+ em.MLUnpairedCost() * 2;
 				if (e < be) {
 					be = e;
@@ -206,7 +275,7 @@ void librnary::NNAffineFolder::TraceP(std::stack<TState> &s) {
 			}
 			// (.(_)._)
 			if (i + 2 < k && k + 2 < j - 1) {
-				e = ML[1][k + 2][j - 1] + init + em.MismatchCoax(i + 2, k, i, j) + MLSSScore(i + 2, k)
+				e = ML[1][k + 2][j - 1] + init + em.MismatchCoax(i + 2, k, i, j) + MLSSScore(em, i + 2, k)
 					+ em.MLUnpairedCost() * 2;
 				if (e < be) {
 					be = e;
@@ -217,7 +286,7 @@ void librnary::NNAffineFolder::TraceP(std::stack<TState> &s) {
 			// (_(_))
 			//   ^ <- k
 			if (i + 1 < k - 1 && k < j - 1) {
-				e = ML[1][i + 1][k - 1] + init + em.FlushCoax(i, j, k, j - 1) + MLSSScore(k, j - 1);
+				e = ML[1][i + 1][k - 1] + init + em.FlushCoax(i, j, k, j - 1) + MLSSScore(em, k, j - 1);
 				if (e < be) {
 					be = e;
 					best_decomp = {TState(MLT, 1, i + 1, k - 1), TState(PT, k, j - 1)};
@@ -225,7 +294,7 @@ void librnary::NNAffineFolder::TraceP(std::stack<TState> &s) {
 			}
 			// (._(_).)
 			if (k < j - 2 && i + 2 < k - 1) {
-				e = ML[1][i + 2][k - 1] + init + em.MismatchCoax(i, j, k, j - 2) + MLSSScore(k, j - 2)
+				e = ML[1][i + 2][k - 1] + init + em.MismatchCoax(i, j, k, j - 2) + MLSSScore(em, k, j - 2)
 					+ em.MLUnpairedCost() * 2;
 				if (e < be) {
 					be = e;
@@ -234,7 +303,7 @@ void librnary::NNAffineFolder::TraceP(std::stack<TState> &s) {
 			}
 			// (_.(_).)
 			if (k < j - 2 && i + 1 < k - 2) {
-				e = ML[1][i + 1][k - 2] + init + em.MismatchCoax(k, j - 2, i, j) + MLSSScore(k, j - 2)
+				e = ML[1][i + 1][k - 2] + init + em.MismatchCoax(k, j - 2, i, j) + MLSSScore(em, k, j - 2)
 					+ em.MLUnpairedCost() * 2;
 				if (e < be) {
 					be = e;
@@ -278,13 +347,13 @@ void librnary::NNAffineFolder::TraceCx(std::stack<TState> &s) {
 	energy_t be = em.MaxMFE(), e;
 
 	for (int k = i + 1; k + 1 < j; ++k) {
-		e = em.FlushCoax(i, k, k + 1, j) + MLSSScore(i, k) + MLSSScore(k + 1, j);
+		e = em.FlushCoax(i, k, k + 1, j) + MLSSScore(em, i, k) + MLSSScore(em, k + 1, j);
 		if (e < be) {
 			be = e;
 			best_decomp = {TState(PT, i, k), TState(PT, k + 1, j)};
 		}
 		if (i + 1 < k - 1) {
-			e = em.MismatchCoax(i + 1, k - 1, k + 1, j) + MLSSScore(i + 1, k - 1) + MLSSScore(k + 1, j)
+			e = em.MismatchCoax(i + 1, k - 1, k + 1, j) + MLSSScore(em, i + 1, k - 1) + MLSSScore(em, k + 1, j)
 				+ em.MLUnpairedCost() * 2;
 			if (e < be) {
 				be = e;
@@ -292,7 +361,7 @@ void librnary::NNAffineFolder::TraceCx(std::stack<TState> &s) {
 			}
 		}
 		if (k + 2 < j - 1) {
-			e = em.MismatchCoax(k + 2, j - 1, i, k) + MLSSScore(i, k) + MLSSScore(k + 2, j - 1)
+			e = em.MismatchCoax(k + 2, j - 1, i, k) + MLSSScore(em, i, k) + MLSSScore(em, k + 2, j - 1)
 				+ em.MLUnpairedCost() * 2;
 			if (e < be) {
 				be = e;
@@ -326,26 +395,26 @@ void librnary::NNAffineFolder::TraceML(std::stack<TState> &s) {
 	energy_t be = ML[b][i][j - 1] + em.MLUnpairedCost(), e;
 
 	if (b < 2) { // End on branch cases.
-		e = MLSSScore(i, j);
+		e = MLSSScore(em, i, j);
 		if (e < be) {
 			be = e;
 			best_decomp = {TState(PT, i, j)};
 		}
 		if (stacking) {
 			if (i + 1 < j) {
-				e = MLSSScore(i + 1, j) + em.FiveDangle(i + 1, j) + em.MLUnpairedCost();
+				e = MLSSScore(em, i + 1, j) + em.FiveDangle(i + 1, j) + em.MLUnpairedCost();
 				if (e < be) {
 					be = e;
 					best_decomp = {TState(PT, i + 1, j)};
 				}
-				e = MLSSScore(i, j - 1) + em.ThreeDangle(i, j - 1) + em.MLUnpairedCost();
+				e = MLSSScore(em, i, j - 1) + em.ThreeDangle(i, j - 1) + em.MLUnpairedCost();
 				if (e < be) {
 					be = e;
 					best_decomp = {TState(PT, i, j - 1)};
 				}
 			}
 			if (i + 1 < j - 1) {
-				e = MLSSScore(i + 1, j - 1) + em.Mismatch(i + 1, j - 1) + em.MLUnpairedCost() * 2;
+				e = MLSSScore(em, i + 1, j - 1) + em.Mismatch(i + 1, j - 1) + em.MLUnpairedCost() * 2;
 				if (e < be) {
 					be = e;
 					best_decomp = {TState(PT, i + 1, j - 1)};
@@ -364,7 +433,7 @@ void librnary::NNAffineFolder::TraceML(std::stack<TState> &s) {
 	// bprime is the number of branches required after one has been placed.
 	int bprime = max(0, b - 1);
 	for (int k = i; k + 2 <= j; ++k) { // Try all decompositions into 5' ML fragment and 3' branch.
-		e = ML[bprime][i][k] + MLSSScore(k + 1, j);
+		e = ML[bprime][i][k] + MLSSScore(em, k + 1, j);
 		if (e < be) {
 			be = e;
 			best_decomp = {TState(MLT, bprime, i, k), TState(PT, k + 1, j)};
@@ -372,21 +441,21 @@ void librnary::NNAffineFolder::TraceML(std::stack<TState> &s) {
 		// From here on is stacking.
 		if (stacking) {
 			if (k + 2 < j) {
-				e = ML[bprime][i][k] + MLSSScore(k + 2, j) + em.FiveDangle(k + 2, j) + em.MLUnpairedCost();
+				e = ML[bprime][i][k] + MLSSScore(em, k + 2, j) + em.FiveDangle(k + 2, j) + em.MLUnpairedCost();
 				if (e < be) {
 					be = e;
 					best_decomp = {TState(MLT, bprime, i, k), TState(PT, k + 2, j)};
 				}
 			}
 			if (k + 1 < j - 1) {
-				e = ML[bprime][i][k] + MLSSScore(k + 1, j - 1) + em.ThreeDangle(k + 1, j - 1) + em.MLUnpairedCost();
+				e = ML[bprime][i][k] + MLSSScore(em, k + 1, j - 1) + em.ThreeDangle(k + 1, j - 1) + em.MLUnpairedCost();
 				if (e < be) {
 					be = e;
 					best_decomp = {TState(MLT, bprime, i, k), TState(PT, k + 1, j - 1)};
 				}
 			}
 			if (k + 2 < j - 1) {
-				e = ML[bprime][i][k] + MLSSScore(k + 2, j - 1) + em.Mismatch(k + 2, j - 1) + em.MLUnpairedCost() * 2;
+				e = ML[bprime][i][k] + MLSSScore(em, k + 2, j - 1) + em.Mismatch(k + 2, j - 1) + em.MLUnpairedCost() * 2;
 				if (e < be) {
 					be = e;
 					best_decomp = {TState(MLT, bprime, i, k), TState(PT, k + 2, j - 1)};
@@ -409,6 +478,8 @@ void librnary::NNAffineFolder::TraceML(std::stack<TState> &s) {
 
 
 librnary::Matching librnary::NNAffineFolder::Traceback() {
+	if (energy_only) // The multi-loop tables no longer hold every row.
+		throw logic_error("Traceback after an energy-only fold");
 	const auto N = static_cast<int>(rna.size());
 	Matching m = EmptyMatching(static_cast<unsigned>(rna.size()));
 	if (N == 0) {
@@ -431,6 +502,307 @@ librnary::Matching librnary::NNAffineFolder::Traceback() {
 	return m;
 }
 
+librnary::energy_t librnary::NNAffineFolder::TableValue(const TState &s) const {
+	switch (s.t) {
+		case ET:
+			return E[s.i];
+		case PT:
+			return P[s.i][s.j];
+		case MLT:
+			return ML[s.extra][s.i][s.j];
+		case CxT:
+			return Cx[s.i][s.j];
+		default: // XT
+			return X[s.i][s.j];
+	}
+}
+
+uint64_t librnary::NNAffineFolder::StateKey(const TState &s) {
+	const int extra = s.t == MLT ? s.extra : 0;
+	const int j = s.t == ET ? 0 : s.j;
+	return (static_cast<uint64_t>(s.t * 3 + extra) << 56) | (static_cast<uint64_t>(s.i) << 28)
+		| static_cast<uint64_t>(j);
+}
+
+template<typename ModelT>
+bool librnary::NNAffineFolder::IsCanonicalTraceback(const ModelT &m, const Matching &match,
+												   const vector<pair<TState, int>> &steps) const {
+	const long long INF = numeric_limits<long long>::max();
+	// The pairs of match within the nucleotides of a state, which its part of a traceback of match must make.
+	auto pairs_within = [&](const TState &s) {
+		const int lo = s.t == ET ? 0 : s.i, hi = s.t == ET ? s.i : s.j;
+		int pairs = 0;
+		for (int x = lo; x <= hi; ++x)
+			pairs += match[x] > x && match[x] <= hi;
+		return pairs;
+	};
+	// The least energy each state derives its part of match with, or INF if it cannot.
+	unordered_map<uint64_t, long long> least;
+	function<long long(const TState &)> least_energy;
+	// Calls f(d, e) for each decomposition d of s that derives its part of match, with the least energy e it can.
+	auto derivations = [&](const TState &s, const function<void(int, long long)> &f) {
+		const int needed = pairs_within(s) - (s.t == PT ? 1 : 0);
+		int d = -1;
+		Decompositions(m, s, [&](energy_t e, initializer_list<TState> children) {
+			++d;
+			if (e >= em.MaxMFE())
+				return;
+			int made = 0;
+			for (const auto &c : children) {
+				if (c.t == PT && (c.i == c.j || match[c.i] != c.j)) // An unpaired nucleotide is matched to itself.
+					return;
+				made += pairs_within(c);
+			}
+			if (made != needed)
+				return;
+			long long total = e;
+			for (const auto &c : children) {
+				const long long v = least_energy(c);
+				if (v == INF)
+					return;
+				total += v;
+			}
+			f(d, total);
+		});
+	};
+	least_energy = [&](const TState &s) {
+		auto it = least.find(StateKey(s));
+		if (it != least.end())
+			return it->second;
+		long long best = INF;
+		derivations(s, [&](int, long long e) {
+			best = min(best, e);
+		});
+		least[StateKey(s)] = best;
+		return best;
+	};
+	for (const auto &step : steps) {
+		const long long best = least_energy(step.first);
+		int first = -1;
+		derivations(step.first, [&](int d, long long e) {
+			if (first == -1 && e == best)
+				first = d;
+		});
+		if (first != step.second)
+			return false;
+	}
+	return true;
+}
+
+template<typename ModelT>
+struct librnary::NNAffineFolder::SuboptimalSearch {
+	const NNAffineFolder &folder;
+	const ModelT &m;
+	/// The highest energy of a structure to visit.
+	energy_t limit;
+	const SuboptimalVisitor &visit;
+	/// States left to decompose, and the pairs of the states already decomposed.
+	vector<TState> todo;
+	Matching match;
+	/// The states decomposed so far, with the decomposition taken. Only kept with stacking.
+	vector<pair<TState, int>> steps;
+	size_t visited = 0;
+	bool stopped = false;
+
+	SuboptimalSearch(const NNAffineFolder &_folder, const ModelT &_m, energy_t _limit,
+					 const SuboptimalVisitor &_visit)
+		: folder(_folder), m(_m), limit(_limit), visit(_visit),
+		  match(EmptyMatching(static_cast<unsigned>(folder.rna.size()))) {}
+
+	/// Finishes the partial structure every way it can, given the lowest energy it can finish with.
+	void Expand(energy_t bound) {
+		if (todo.empty()) {
+			// Without stacking the grammar is unambiguous, so every traceback is canonical.
+			if (folder.stacking && !folder.IsCanonicalTraceback(m, match, steps))
+				return;
+			++visited;
+			stopped = !visit(bound, match);
+			return;
+		}
+		const TState s = todo.back();
+		todo.pop_back();
+		if (s.t == PT) {
+			match[s.i] = s.j;
+			match[s.j] = s.i;
+		}
+		const energy_t rest = bound - folder.TableValue(s);
+		int d = -1;
+		folder.Decompositions(m, s, [&](energy_t e, initializer_list<TState> children) {
+			++d;
+			long long total = static_cast<long long>(rest) + e;
+			for (const auto &c : children)
+				total += folder.TableValue(c);
+			if (stopped || total > limit)
+				return;
+			if (folder.stacking)
+				steps.emplace_back(s, d);
+			todo.insert(todo.end(), children.begin(), children.end());
+			Expand(static_cast<energy_t>(total));
+			todo.erase(todo.end() - children.size(), todo.end());
+			if (folder.stacking)
+				steps.pop_back();
+		});
+		if (s.t == PT) {
+			match[s.i] = s.i;
+			match[s.j] = s.j;
+		}
+		todo.push_back(s);
+	}
+};
+
+size_t librnary::NNAffineFolder::Suboptimal(energy_t delta, const SuboptimalVisitor &visit) {
+	if (energy_only) // The multi-loop tables no longer hold every row.
+		throw logic_error("Suboptimal after an energy-only fold");
+	if (rna.empty()) {
+		visit(0, Matching());
+		return 1;
+	}
+	if (static_dispatch)
+		return Suboptimal(DevirtualizedModel<NNAffineModel>(em), delta, visit);
+	return Suboptimal(em, delta, visit);
+}
+
+template<typename ModelT>
+size_t librnary::NNAffineFolder::Suboptimal(const ModelT &m, energy_t delta, const SuboptimalVisitor &visit) {
+	const auto N = static_cast<int>(rna.size());
+	if (stacking)
+		FillExteriorCoax(m);
+	SuboptimalSearch<ModelT> search(*this, m, E[N - 1] + delta, visit);
+	search.todo.emplace_back(N - 1);
+	search.Expand(E[N - 1]);
+	return search.visited;
+}
+
+vector<tuple<librnary::energy_t, librnary::Matching>> librnary::NNAffineFolder::TracebackKBest(size_t k) {
+	if (energy_only) // The multi-loop tables no longer hold every row.
+		throw logic_error("TracebackKBest after an energy-only fold");
+	if (rna.empty())
+		return {make_tuple(0, Matching())};
+	if (static_dispatch)
+		return TracebackKBest(DevirtualizedModel<NNAffineModel>(em), k);
+	return TracebackKBest(em, k);
+}
+
+template<typename ModelT>
+vector<tuple<librnary::energy_t, librnary::Matching>> librnary::NNAffineFolder::TracebackKBest(const ModelT &m,
+																							   size_t k) {
+	const auto N = static_cast<int>(rna.size());
+	if (stacking)
+		FillExteriorCoax(m);
+
+	// The decompositions of a state that can be finished, best first, by how much they add to its table entry.
+	struct Ranked {
+		vector<energy_t> delta;
+		/// The index of each decomposition in the order of Decompositions.
+		vector<int> index;
+		/// The children of decomposition d are children[ends[d - 1]] up to children[ends[d]], with ends[-1] = 0.
+		vector<TState> children;
+		vector<size_t> ends;
+	};
+	unordered_map<uint64_t, Ranked> ranked;
+	auto rank = [&](const TState &s) -> const Ranked & {
+		auto it = ranked.find(StateKey(s));
+		if (it != ranked.end())
+			return it->second;
+		vector<tuple<energy_t, size_t, size_t, int>> order; // Delta, the range of children, and the index.
+		vector<TState> children;
+		int d = -1;
+		Decompositions(m, s, [&](energy_t e, initializer_list<TState> cs) {
+			++d;
+			long long total = e;
+			for (const auto &c : cs) {
+				const energy_t v = TableValue(c);
+				if (v >= em.MaxMFE())
+					return;
+				total += v;
+			}
+			if (e >= em.MaxMFE())
+				return;
+			order.emplace_back(static_cast<energy_t>(total - TableValue(s)), children.size(),
+							   children.size() + cs.size(), d);
+			children.insert(children.end(), cs.begin(), cs.end());
+		});
+		stable_sort(order.begin(), order.end(), [](const tuple<energy_t, size_t, size_t, int> &a,
+												   const tuple<energy_t, size_t, size_t, int> &b) {
+			return get<0>(a) < get<0>(b);
+		});
+		Ranked &r = ranked[StateKey(s)];
+		for (const auto &o : order) {
+			r.delta.push_back(get<0>(o));
+			r.index.push_back(get<3>(o));
+			r.children.insert(r.children.end(), children.begin() + get<1>(o), children.begin() + get<2>(o));
+			r.ends.push_back(r.children.size());
+		}
+		return r;
+	};
+
+	// Partial tracebacks. The states left to decompose are a list of cells, whose tails are shared between a
+	// traceback and those extended from it. Each node records the traceback it extends, the index of the decomposition
+	// it took of that traceback's first state, and the pair it adds.
+	struct Cell {
+		TState s;
+		int next;
+	};
+	struct Node {
+		int prev, todo, decomp, pi, pj;
+	};
+	vector<Cell> cells;
+	vector<Node> nodes;
+	// Decomposing the first state of node's list with its rank'th decomposition gives tracebacks of energy bound.
+	struct Item {
+		long long bound;
+		int node;
+		size_t rank;
+
+		bool operator<(const Item &o) const {
+			return bound > o.bound;
+		}
+	};
+	priority_queue<Item> queue;
+	cells.push_back({TState(N - 1), -1});
+	nodes.push_back({-1, 0, -1, -1, -1});
+	queue.push({E[N - 1], 0, 0});
+
+	vector<tuple<energy_t, Matching>> best;
+	vector<pair<TState, int>> steps;
+	while (!queue.empty() && best.size() < k) {
+		const Item item = queue.top();
+		queue.pop();
+		const Node parent = nodes[item.node];
+		const Cell first = cells[parent.todo];
+		const Ranked &r = rank(first.s);
+		if (item.rank + 1 < r.delta.size())
+			queue.push({item.bound - r.delta[item.rank] + r.delta[item.rank + 1], item.node, item.rank + 1});
+		int todo = first.next;
+		for (size_t c = item.rank == 0 ? 0 : r.ends[item.rank - 1]; c < r.ends[item.rank]; ++c) {
+			cells.push_back({r.children[c], todo});
+			todo = static_cast<int>(cells.size()) - 1;
+		}
+		const bool pair = first.s.t == PT;
+		nodes.push_back({item.node, todo, r.index[item.rank], pair ? first.s.i : -1, pair ? first.s.j : -1});
+		const int node = static_cast<int>(nodes.size()) - 1;
+		if (todo != -1) {
+			const Ranked &next = rank(cells[todo].s);
+			if (!next.delta.empty())
+				queue.push({item.bound + next.delta[0], node, 0});
+			continue;
+		}
+		Matching match = EmptyMatching(static_cast<unsigned>(N));
+		steps.clear();
+		for (int x = node; nodes[x].prev != -1; x = nodes[x].prev) {
+			if (nodes[x].pi != -1) {
+				match[nodes[x].pi] = nodes[x].pj;
+				match[nodes[x].pj] = nodes[x].pi;
+			}
+			steps.emplace_back(cells[nodes[nodes[x].prev].todo].s, nodes[x].decomp);
+		}
+		// Without stacking the grammar is unambiguous, so every traceback is canonical.
+		if (!stacking || IsCanonicalTraceback(m, match, steps))
+			best.emplace_back(static_cast<energy_t>(item.bound), move(match));
+	}
+	return best;
+}
+
 librnary::energy_t librnary::NNAffineFolder::Fold(const PrimeStructure &_rna) {
 	// Load the RNA into the energy model.
 	em.SetRNA(_rna);
@@ -448,183 +820,421 @@ librnary::energy_t librnary::NNAffineFolder::Fold(const PrimeStructure &_rna) {
 		return 0;
 	}
 
-	// Clear the DP tables.
-	P.clear();
-	ML.clear();
-	Cx.clear();
-	E.clear();
-
 	// Initialize the DP tables.
-	P.resize(RSZ, VE(RSZ, em.MaxMFE()));
-	Cx = P;
-	ML.resize(3, VVE(RSZ, VE(RSZ, em.MaxMFE())));
-	E.resize(RSZ, 0);
+	if (workspace != nullptr)
+		workspace->Rewind();
+	// Cells (i,j) are only needed for j - i <= max_span.
+	const size_t band = static_cast<size_t>(max_span) + 1;
+	PrepareTable(workspace, P, RSZ, em.MaxMFE(), band);
+	PrepareTable(workspace, Cx, RSZ, em.MaxMFE(), band);
+	if (energy_only) {
+		// The shadows would take as much memory as the tables they mirror.
+		MLBrCol.Clear();
+		CxCol.Clear();
+	} else {
+		PrepareTable(workspace, MLBrCol, RSZ, em.MaxMFE(), band);
+		PrepareTable(workspace, CxCol, RSZ, em.MaxMFE(), band);
+	}
+	ML.resize(3);
+	const size_t ml_windows[3] = {energy_only ? 1 : RSZ, RSZ, energy_only ? 3 : RSZ};
+	for (int b = 0; b < 3; ++b)
+		PrepareTable(workspace, ML[b], RSZ, ml_windows[b], em.MaxMFE(), band);
+	E.assign(RSZ, 0);
+
+	if (static_dispatch)
+		return Fill(DevirtualizedModel<NNAffineModel>(em));
+	return Fill(em);
+}
+
+template<typename ModelT>
+void librnary::NNAffineFolder::FillPaired(const ModelT &m, int i, int j) {
+	// The L (Loop) table.
+	// This must be done before the LS table, as LS[sz][i][j] depends on L[i][j].
+	energy_t best = m.OneLoop(i, j); // Hairpin.
+	// Multi-loops.
+	int init = MLClosingBranchScore(m, i, j);
+	// No stacking interactions
+	best = min(best, init + ML[2][i + 1][j - 1]);
+	// Try stacking interactions with closing branch.
+	if (stacking) {
+		if (i + 2 < j - 1) // Left dangle.
+			best = min(best,
+					   init + ML[2][i + 2][j - 1] + m.ClosingThreeDangle(i, j) + m.MLUnpairedCost());
+		if (i + 1 < j - 2) // Right dangle.
+			best = min(best,
+					   init + ML[2][i + 1][j - 2] + m.ClosingFiveDangle(i, j) + m.MLUnpairedCost());
+		if (i + 2 < j - 2) // Mismatch.
+			best = min(best,
+					   init + ML[2][i + 2][j - 2] + m.ClosingMismatch(i, j) + m.MLUnpairedCost() * 2);
+		// Coaxial stack.
+		for (int k = i + 1; k < j; ++k) {
+			// Five prime.
+			// ((_)_)
+			//    ^ <- k
+			if (k + 1 < j - 1 && i + 1 < k)
+				best = min(best,
+						   ML[1][k + 1][j - 1] + init + m.FlushCoax(i, j, i + 1, k)
+							   + MLSSScore(m, i + 1, k));
+			// (.(_)_.)
+			if (i + 2 < k && k + 1 < j - 2)
+				best = min(best,
+						   ML[1][k + 1][j - 2] + init + m.MismatchCoax(i, j, i + 2, k)
+							   + MLSSScore(m, i + 2, k) + m.MLUnpairedCost() * 2);
+			// (.(_)._)
+			if (i + 2 < k && k + 2 < j - 1)
+				best = min(best,
+						   ML[1][k + 2][j - 1] + init + m.MismatchCoax(i + 2, k, i, j)
+							   + MLSSScore(m, i + 2, k) + m.MLUnpairedCost() * 2);
+			// Three prime.
+			// (_(_))
+			//   ^ <- k
+			if (i + 1 < k - 1 && k < j - 1)
+				best = min(best,
+						   ML[1][i + 1][k - 1] + init + m.FlushCoax(i, j, k, j - 1)
+							   + MLSSScore(m, k, j - 1));
+			// (._(_).)
+			if (k < j - 2 && i + 2 < k - 1)
+				best = min(best,
+						   ML[1][i + 2][k - 1] + init + m.MismatchCoax(i, j, k, j - 2)
+							   + MLSSScore(m, k, j - 2) + m.MLUnpairedCost() * 2);
+			// (_.(_).)
+			if (k < j - 2 && i + 1 < k - 2)
+				best = min(best,
+						   ML[1][i + 1][k - 2] + init + m.MismatchCoax(k, j - 2, i, j)
+							   + MLSSScore(m, k, j - 2) + m.MLUnpairedCost() * 2);
+		}
+	}
+	// Two loops for the two-loops (bulge or internal loop).
+	// Avoids stacks and single nucleotide bulges.
+	for (int k = i + 1; k + 1 < j && (k - i - 1) <= max_twoloop_unpaired; ++k) {
+		for (int l = j - 1; l > k && (j - l - 1) + (k - i - 1) <= max_twoloop_unpaired; --l) {
+			best = min(best, P[k][l] + m.TwoLoop(i, k, l, j));
+		}
+	}
+	P[i][j] = best;
+}
+
+template<typename ModelT>
+void librnary::NNAffineFolder::FillCell(const ModelT &m, int i, int j) {
+	if (CanPair(i, j))
+		FillPaired(m, i, j);
+
+	// Fill the coaxial stack table if stacking is enabled.
+	energy_t best = m.MaxMFE();
+	for (int k = i + 1; k + 1 < j && stacking; ++k) {
+		best = min(best, m.FlushCoax(i, k, k + 1, j) + MLSSScore(m, i, k) + MLSSScore(m, k + 1, j));
+		if (i + 1 < k - 1)
+			best = min(best,
+					   m.MismatchCoax(i + 1, k - 1, k + 1, j) + MLSSScore(m, i + 1, k - 1) + MLSSScore(m, k + 1, j)
+						   + m.MLUnpairedCost() * 2);
+		if (k + 2 < j - 1)
+			best = min(best,
+					   m.MismatchCoax(k + 2, j - 1, i, k) + MLSSScore(m, i, k) + MLSSScore(m, k + 2, j - 1)
+						   + m.MLUnpairedCost() * 2);
+	}
+	Cx[i][j] = best;
+
+	// The end on branch cases.
+	const energy_t branch = MLBranchScore(m, i, j);
+
+	// Try all decompositions into 5' ML fragment i..k and 3' branch k+1..j. ML[0] and ML[1] both need no more
+	// branches after the 3' one.
+	const energy_t none = numeric_limits<energy_t>::max();
+	energy_t split0 = none, split1 = none, split_cx = none;
+	if (energy_only) {
+		// Energy-only folds keep no shadows, so each k is tried in turn.
+		for (int k = i; k + 2 <= j; ++k) {
+			const energy_t br = MLBranchScore(m, k + 1, j);
+			split0 = min(split0, ML[0][i][k] + br);
+			split1 = min(split1, ML[1][i][k] + br);
+			// Coaxial stack decomposition.
+			if (stacking)
+				split_cx = min(split_cx, ML[0][i][k] + Cx[k + 1][j]);
+		}
+	} else {
+		// Each is the min-plus product of row i of an ML table with column j of a shadow, so the best over every k
+		// is found by one MinPlus.
+		CxCol(i, j) = Cx[i][j];
+		MLBrCol(i, j) = branch;
+		const int splits = j - 1 - i;
+		split0 = MinPlus(&ML[0][i][i], &MLBrCol(i + 1, j), splits, none);
+		split1 = MinPlus(&ML[1][i][i], &MLBrCol(i + 1, j), splits, none);
+		// Coaxial stack decomposition.
+		if (stacking)
+			split_cx = MinPlus(&ML[0][i][i], &CxCol(i + 1, j), splits, none);
+	}
+	for (int b = 0; b < 3; ++b) { // b is the branches needed for valid ML.
+		best = ML[b][i][j - 1] + m.MLUnpairedCost();
+		if (b < 2) // End on branch cases.
+			best = min(best, branch);
+		// End on coaxial stack.
+		if (stacking) {
+			best = min(best, Cx[i][j]);
+		}
+		// bprime = max(0, b - 1) is the number of branches required after one has been placed.
+		best = min(best, b < 2 ? split0 : split1);
+		best = min(best, split_cx);
+		ML[b][i][j] = best;
+	}
+}
+
+template<typename ModelT>
+librnary::energy_t librnary::NNAffineFolder::Fill(const ModelT &m) {
+	const auto N = static_cast<int>(rna.size());
 
 	// Special base for for ML. End on a single unpaired.
 	for (int i = 0; i < N; ++i)
-		ML[0][i][i] = em.MLUnpairedCost();
-
-	for (int i = N - 2; i >= 0; --i) { // i is 5' nucleotide.
-		for (int j = i + 1; j < N; ++j) { // j is 3' nucleotide.
-			if (ValidPair(rna[i], rna[j]) &&
-				(lonely_pairs || !MustBeLonelyPair(rna, i, j, em.MIN_HAIRPIN_UNPAIRED))) {
-				// The L (Loop) table.
-				// This must be done before the LS table, as LS[sz][i][j] depends on L[i][j].
-				energy_t best = em.OneLoop(i, j); // Hairpin.
-				// Multi-loops.
-				int init = MLClosingBranchScore(i, j);
-				// No stacking interactions
-				best = min(best, init + ML[2][i + 1][j - 1]);
-				// Try stacking interactions with closing branch.
-				if (stacking) {
-					if (i + 2 < j - 1) // Left dangle.
-						best = min(best,
-								   init + ML[2][i + 2][j - 1] + em.ClosingThreeDangle(i, j) + em.MLUnpairedCost());
-					if (i + 1 < j - 2) // Right dangle.
-						best = min(best,
-								   init + ML[2][i + 1][j - 2] + em.ClosingFiveDangle(i, j) + em.MLUnpairedCost());
-					if (i + 2 < j - 2) // Mismatch.
-						best = min(best,
-								   init + ML[2][i + 2][j - 2] + em.ClosingMismatch(i, j) + em.MLUnpairedCost() * 2);
-					// Coaxial stack.
-					for (int k = i + 1; k < j; ++k) {
-						// Five prime.
-						// ((_)_)
-						//    ^ <- k
-						if (k + 1 < j - 1 && i + 1 < k)
-							best = min(best,
-									   ML[1][k + 1][j - 1] + init + em.FlushCoax(i, j, i + 1, k)
-										   + MLSSScore(i + 1, k));
-						// (.(_)_.)
-						if (i + 2 < k && k + 1 < j - 2)
-							best = min(best,
-									   ML[1][k + 1][j - 2] + init + em.MismatchCoax(i, j, i + 2, k)
-										   + MLSSScore(i + 2, k) + em.MLUnpairedCost() * 2);
-						// (.(_)._)
-						if (i + 2 < k && k + 2 < j - 1)
-							best = min(best,
-									   ML[1][k + 2][j - 1] + init + em.MismatchCoax(i + 2, k, i, j)
-										   + MLSSScore(i + 2, k) + em.MLUnpairedCost() * 2);
-						// Three prime.
-						// (_(_))
-						//   ^ <- k
-						if (i + 1 < k - 1 && k < j - 1)
-							best = min(best,
-									   ML[1][i + 1][k - 1] + init + em.FlushCoax(i, j, k, j - 1)
-										   + MLSSScore(k, j - 1));
-						// (._(_).)
-						if (k < j - 2 && i + 2 < k - 1)
-							best = min(best,
-									   ML[1][i + 2][k - 1] + init + em.MismatchCoax(i, j, k, j - 2)
-										   + MLSSScore(k, j - 2) + em.MLUnpairedCost() * 2);
-						// (_.(_).)
-						if (k < j - 2 && i + 1 < k - 2)
-							best = min(best,
-									   ML[1][i + 1][k - 2] + init + em.MismatchCoax(k, j - 2, i, j)
-										   + MLSSScore(k, j - 2) + em.MLUnpairedCost() * 2);
-					}
-				}
-				// Two loops for the two-loops (bulge or internal loop).
-				// Avoids stacks and single nucleotide bulges.
-				for (int k = i + 1; k + 1 < j && (k - i - 1) <= max_twoloop_unpaired; ++k) {
-					for (int l = j - 1; l > k && (j - l - 1) + (k - i - 1) <= max_twoloop_unpaired; --l) {
-						best = min(best, P[k][l] + em.TwoLoop(i, k, l, j));
-					}
-				}
-				P[i][j] = best;
-
-			}
-
-			// Fill the coaxial stack table if stacking is enabled.
-			energy_t best = em.MaxMFE();
-			for (int k = i + 1; k + 1 < j && stacking; ++k) {
-				best = min(best, em.FlushCoax(i, k, k + 1, j) + MLSSScore(i, k) + MLSSScore(k + 1, j));
-				if (i + 1 < k - 1)
-					best = min(best,
-							   em.MismatchCoax(i + 1, k - 1, k + 1, j) + MLSSScore(i + 1, k - 1) + MLSSScore(k + 1, j)
-								   + em.MLUnpairedCost() * 2);
-				if (k + 2 < j - 1)
-					best = min(best,
-							   em.MismatchCoax(k + 2, j - 1, i, k) + MLSSScore(i, k) + MLSSScore(k + 2, j - 1)
-								   + em.MLUnpairedCost() * 2);
-			}
-			Cx[i][j] = best;
-
-			for (int b = 0; b < 3; ++b) { // b is the branches needed for valid ML.
-				best = ML[b][i][j - 1] + em.MLUnpairedCost();
-				if (b < 2) { // End on branch cases.
-					best = min(best, MLSSScore(i, j));
-					if (stacking) {
-						if (i + 1 < j) {
-							best = min(best, MLSSScore(i + 1, j) + em.FiveDangle(i + 1, j) + em.MLUnpairedCost());
-							best = min(best, MLSSScore(i, j - 1) + em.ThreeDangle(i, j - 1) + em.MLUnpairedCost());
-						}
-						if (i + 1 < j - 1) {
-							best = min(best,
-									   MLSSScore(i + 1, j - 1) + em.Mismatch(i + 1, j - 1) + em.MLUnpairedCost() * 2);
-						}
-					}
-				}
-				// End on coaxial stack.
-				if (stacking) {
-					best = min(best, Cx[i][j]);
-				}
-				// bprime is the number of branches required after one has been placed.
-				int bprime = max(0, b - 1);
-				for (int k = i; k + 2 <= j; ++k) { // Try all decompositions into 5' ML fragment and 3' branch.
-					best = min(best, ML[bprime][i][k] + MLSSScore(k + 1, j));
-					// From here on is stacking.
-					if (stacking) {
-						if (k + 2 < j)
-							best = min(best,
-									   ML[bprime][i][k] + MLSSScore(k + 2, j) + em.FiveDangle(k + 2, j)
-										   + em.MLUnpairedCost());
-						if (k + 1 < j - 1)
-							best = min(best,
-									   ML[bprime][i][k] + MLSSScore(k + 1, j - 1) + em.ThreeDangle(k + 1, j - 1)
-										   + em.MLUnpairedCost());
-						if (k + 2 < j - 1)
-							best = min(best,
-									   ML[bprime][i][k] + MLSSScore(k + 2, j - 1) + em.Mismatch(k + 2, j - 1)
-										   + em.MLUnpairedCost() * 2);
-						// Coaxial stack decomposition.
-						best = min(best, ML[0][i][k] + Cx[k + 1][j]);
-					}
-				}
-				ML[b][i][j] = best;
-			}
+		ML[0][i][i] = m.MLUnpairedCost();
+
+	if (pool != nullptr && pool->Size() > 1 && !energy_only) {
+		// Every cell only depends on cells with a smaller span j - i, so each anti-diagonal can be filled in
+		// parallel once the previous ones are done.
+		for (int span = 1; span < N && span <= max_span; ++span) {
+			pool->ParallelFor(0, static_cast<size_t>(N - span), [&](size_t i) {
+				FillCell(m, static_cast<int>(i), static_cast<int>(i) + span);
+			});
+		}
+	} else {
+		for (int i = N - 2; i >= 0; --i) { // i is 5' nucleotide.
+			// Windowed tables hand row i the storage of a row that can no longer be read.
+			for (auto &tbl : ML)
+				if (tbl.Windowed())
+					tbl.ResetRow(i, m.MaxMFE());
+			ML[0][i][i] = m.MLUnpairedCost();
+			for (int j = i + 1; j < N && InSpan(i, j); ++j) // j is 3' nucleotide.
+				FillCell(m, i, j);
 		}
 	}
 
 
-	for (int i = 1; i < N; ++i) {
+	FillExterior(m, 1);
+	return E[N - 1];
+}
+
+template<typename ModelT>
+void librnary::NNAffineFolder::FillExterior(const ModelT &m, int from) {
+	const auto N = static_cast<int>(rna.size());
+	for (int i = max(from, 1); i < N; ++i) {
 		energy_t best = E[i - 1];
-		for (int k = -1; k < i; ++k) {
+		for (int k = max(-1, i - ExteriorReach(max_span, stacking)); k < i; ++k) {
 			energy_t decomp = k == -1 ? 0 : E[k];
-			best = min(best, decomp + SSScore(k + 1, i));
+			if (InSpan(k + 1, i))
+				best = min(best, decomp + SSScore(m, k + 1, i));
 			if (stacking) {
-				if (k + 2 < i)
-					best = min(best, decomp + SSScore(k + 2, i) + em.FiveDangle(k + 2, i));
-				if (k + 1 < i - 1)
-					best = min(best, decomp + SSScore(k + 1, i - 1) + em.ThreeDangle(k + 1, i - 1));
-				if (k + 2 < i - 1)
-					best = min(best, decomp + SSScore(k + 2, i - 1) + em.Mismatch(k + 2, i - 1));
+				if (k + 2 < i && InSpan(k + 2, i))
+					best = min(best, decomp + SSScore(m, k + 2, i) + m.FiveDangle(k + 2, i));
+				if (k + 1 < i - 1 && InSpan(k + 1, i - 1))
+					best = min(best, decomp + SSScore(m, k + 1, i - 1) + m.ThreeDangle(k + 1, i - 1));
+				if (k + 2 < i - 1 && InSpan(k + 2, i - 1))
+					best = min(best, decomp + SSScore(m, k + 2, i - 1) + m.Mismatch(k + 2, i - 1));
 				// Coaxial stack decompositions.
-				for (int j = k + 1; j + 1 < i; ++j) {
-					if (k + 1 < j)
-						best = min(best, decomp + em.FlushCoax(k + 1, j, j + 1, i)
-							+ SSScore(k + 1, j) + SSScore(j + 1, i));
-					if (k + 2 < j - 1)
-						best = min(best, decomp + em.MismatchCoax(k + 2, j - 1, j + 1, i)
-							+ SSScore(k + 2, j - 1) + SSScore(j + 1, i));
-					if (k + 1 < j && j + 2 < i - 1)
-						best = min(best, decomp + em.MismatchCoax(j + 2, i - 1, k + 1, j)
-							+ SSScore(k + 1, j) + SSScore(j + 2, i - 1));
+				for (int j = max(k + 1, i - max_span - 3); j + 1 < i && j - k <= max_span + 3; ++j) {
+					if (k + 1 < j && InSpan(k + 1, j) && InSpan(j + 1, i))
+						best = min(best, decomp + m.FlushCoax(k + 1, j, j + 1, i)
+							+ SSScore(m, k + 1, j) + SSScore(m, j + 1, i));
+					if (k + 2 < j - 1 && InSpan(k + 2, j - 1) && InSpan(j + 1, i))
+						best = min(best, decomp + m.MismatchCoax(k + 2, j - 1, j + 1, i)
+							+ SSScore(m, k + 2, j - 1) + SSScore(m, j + 1, i));
+					if (k + 1 < j && j + 2 < i - 1 && InSpan(k + 1, j) && InSpan(j + 2, i - 1))
+						best = min(best, decomp + m.MismatchCoax(j + 2, i - 1, k + 1, j)
+							+ SSScore(m, k + 1, j) + SSScore(m, j + 2, i - 1));
 				}
 			}
 		}
 		E[i] = best;
 	}
+}
+
+template<typename ModelT>
+librnary::energy_t librnary::NNAffineFolder::ExteriorCoax(const ModelT &m, int i, int j,
+														  vector<TState> *branches) const {
+	// The coaxial stack decompositions of the exterior loop, for a fragment starting at i.
+	energy_t best = m.MaxMFE(), e;
+	for (int k = max(i, j - max_span - 3); k + 1 < j && k <= i + max_span + 2; ++k) {
+		if (i < k && InSpan(i, k) && InSpan(k + 1, j)) {
+			e = m.FlushCoax(i, k, k + 1, j) + SSScore(m, i, k) + SSScore(m, k + 1, j);
+			if (e < best) {
+				best = e;
+				if (branches != nullptr)
+					*branches = {TState(PT, i, k), TState(PT, k + 1, j)};
+			}
+		}
+		if (i + 1 < k - 1 && InSpan(i + 1, k - 1) && InSpan(k + 1, j)) {
+			e = m.MismatchCoax(i + 1, k - 1, k + 1, j) + SSScore(m, i + 1, k - 1) + SSScore(m, k + 1, j);
+			if (e < best) {
+				best = e;
+				if (branches != nullptr)
+					*branches = {TState(PT, i + 1, k - 1), TState(PT, k + 1, j)};
+			}
+		}
+		if (i < k && k + 2 < j - 1 && InSpan(i, k) && InSpan(k + 2, j - 1)) {
+			e = m.MismatchCoax(k + 2, j - 1, i, k) + SSScore(m, i, k) + SSScore(m, k + 2, j - 1);
+			if (e < best) {
+				best = e;
+				if (branches != nullptr)
+					*branches = {TState(PT, i, k), TState(PT, k + 2, j - 1)};
+			}
+		}
+	}
+	return best;
+}
+
+template<typename ModelT>
+void librnary::NNAffineFolder::FillExteriorCoax(const ModelT &m) {
+	const auto N = static_cast<int>(rna.size());
+	const int band = ExteriorReach(max_span, true);
+	PrepareTable(nullptr, X, rna.size(), m.MaxMFE(), static_cast<size_t>(band));
+	for (int i = 0; i < N; ++i)
+		for (int j = i + 2; j < N && j - i < band; ++j)
+			X[i][j] = ExteriorCoax(m, i, j, nullptr);
+}
+
+void librnary::NNAffineFolder::MutatedRegion(int lo, int hi, int &row_hi, int &col_lo) const {
+	// The GU closure bonus of a hairpin closed by (i,j) reads i - 2 and i - 1, and the lonely pair check j + 1.
+	row_hi = hi + 2;
+	col_lo = lo - 1;
+	// A single nucleotide bulge counts the places it could slide to, reading on past the loop while the nucleotides
+	// match it. So a cell can read a mutation through a run of equal nucleotides next to it.
+	const auto N = static_cast<int>(rna.size());
+	for (int r = hi + 1; r + 1 < N && rna[r + 1] == rna[hi + 1]; ++r)
+		row_hi = max(row_hi, r + 1);
+	for (int s = lo - 1; s > 0 && rna[s - 1] == rna[lo - 1]; --s)
+		col_lo = min(col_lo, s - 1);
+}
+
+template<typename ModelT>
+void librnary::NNAffineFolder::Refill(const ModelT &m, int row_hi, int col_lo) {
+	const auto N = static_cast<int>(rna.size());
+	for (int i = min(row_hi, N - 2); i >= 0; --i)
+		for (int j = max(i + 1, col_lo); j < N && InSpan(i, j); ++j) {
+			// FillCell leaves P alone if the pair is not allowed, which a mutation can change.
+			P[i][j] = m.MaxMFE();
+			FillCell(m, i, j);
+		}
+	FillExterior(m, col_lo);
+}
 
+librnary::energy_t librnary::NNAffineFolder::Refold(const vector<PointMutation> &mutations) {
+	const auto N = static_cast<int>(rna.size());
+	if (mutations.empty())
+		return E[N - 1];
+	int lo = N, hi = -1;
+	for (const auto &mut : mutations) {
+		assert(mut.pos >= 0 && mut.pos < N);
+		rna[mut.pos] = mut.base;
+		em.SetBase(mut.pos, mut.base);
+		lo = min(lo, mut.pos);
+		hi = max(hi, mut.pos);
+	}
+	int row_hi, col_lo;
+	MutatedRegion(lo, hi, row_hi, col_lo);
+	if (static_dispatch)
+		Refill(DevirtualizedModel<NNAffineModel>(em), row_hi, col_lo);
+	else
+		Refill(em, row_hi, col_lo);
 	return E[N - 1];
-}
\ No newline at end of file
+}
+
+namespace {
+/// Copies the cells (i,j) with i <= row_hi and j >= col_lo from src to dst, which have the same size and band.
+template<typename TableT>
+void CopyCells(const TableT &src, TableT &dst, int n, int band, int row_hi, int col_lo) {
+	for (int i = 0; i <= min(row_hi, n - 1); ++i)
+		for (int j = max(i, col_lo); j < min(n, i + band); ++j)
+			dst[i][j] = src[i][j];
+}
+}
+
+librnary::NNAffineFolder librnary::NNAffineFolder::SettingsOf(const NNAffineFolder &folder) {
+	NNAffineFolder res(folder.em);
+	res.lonely_pairs = folder.lonely_pairs;
+	res.stacking = folder.stacking;
+	res.max_twoloop_unpaired = folder.max_twoloop_unpaired;
+	res.static_dispatch = folder.static_dispatch;
+	res.energy_only = folder.energy_only;
+	res.max_span = folder.max_span;
+	return res;
+}
+
+vector<librnary::energy_t> librnary::NNAffineFolder::FoldMutants(const vector<vector<PointMutation>> &variants,
+																 vector<Matching> *structures) {
+	if (energy_only) // Energy-only folds drop the multi-loop rows the variants would reuse.
+		throw logic_error("FoldMutants after an energy-only fold");
+	const auto N = static_cast<int>(rna.size());
+	vector<energy_t> mfes(variants.size(), 0);
+	if (structures != nullptr)
+		structures->assign(variants.size(), EmptyMatching(static_cast<unsigned>(N)));
+	if (N == 0 || variants.empty())
+		return mfes;
+	const int band = max_span + 1;
+	const size_t blocks = min(variants.size(), Threads());
+
+	// Each block refolds its variants in a private copy of the tables, copying back the cells a variant changed
+	// before the next one.
+	auto fold_block = [&](size_t block) {
+		NNAffineFolder w = SettingsOf(*this);
+		w.rna = rna;
+		w.E = E;
+		const auto RSZ = static_cast<size_t>(N);
+		PrepareTable(nullptr, w.P, RSZ, em.MaxMFE(), static_cast<size_t>(band));
+		PrepareTable(nullptr, w.Cx, RSZ, em.MaxMFE(), static_cast<size_t>(band));
+		PrepareTable(nullptr, w.MLBrCol, RSZ, em.MaxMFE(), static_cast<size_t>(band));
+		PrepareTable(nullptr, w.CxCol, RSZ, em.MaxMFE(), static_cast<size_t>(band));
+		CopyCells(P, w.P, N, band, N, 0);
+		CopyCells(Cx, w.Cx, N, band, N, 0);
+		CopyCells(MLBrCol, w.MLBrCol, N, band, N, 0);
+		CopyCells(CxCol, w.CxCol, N, band, N, 0);
+		w.ML.resize(3);
+		for (int b = 0; b < 3; ++b) {
+			PrepareTable(nullptr, w.ML[b], RSZ, RSZ, em.MaxMFE(), static_cast<size_t>(band));
+			CopyCells(ML[b], w.ML[b], N, band, N, 0);
+		}
+		for (size_t v = block; v < variants.size(); v += blocks) {
+			mfes[v] = w.Refold(variants[v]);
+			if (structures != nullptr)
+				(*structures)[v] = w.Traceback();
+			if (variants[v].empty())
+				continue;
+			int lo = N, hi = -1;
+			for (const auto &mut : variants[v]) {
+				w.rna[mut.pos] = rna[mut.pos];
+				w.em.SetBase(mut.pos, rna[mut.pos]);
+				lo = min(lo, mut.pos);
+				hi = max(hi, mut.pos);
+			}
+			int row_hi, col_lo;
+			MutatedRegion(lo, hi, row_hi, col_lo);
+			CopyCells(P, w.P, N, band, row_hi, col_lo);
+			CopyCells(Cx, w.Cx, N, band, row_hi, col_lo);
+			CopyCells(MLBrCol, w.MLBrCol, N, band, row_hi, col_lo);
+			CopyCells(CxCol, w.CxCol, N, band, row_hi, col_lo);
+			for (int b = 0; b < 3; ++b)
+				CopyCells(ML[b], w.ML[b], N, band, row_hi, col_lo);
+			copy(E.begin() + max(col_lo, 0), E.end(), w.E.begin() + max(col_lo, 0));
+		}
+	};
+	if (blocks > 1)
+		pool->ParallelFor(0, blocks, fold_block);
+	else
+		fold_block(0);
+	return mfes;
+}
+
+// NNAffineScanner and NNAffineSparseFolder fill and read cells through these from their own translation units.
+template void librnary::NNAffineFolder::FillCell(const NNAffineModel &m, int i, int j);
+template void librnary::NNAffineFolder::FillCell(const DevirtualizedModel<NNAffineModel> &m, int i, int j);
+template void librnary::NNAffineFolder::FillPaired(const NNAffineModel &m, int i, int j);
+template void librnary::NNAffineFolder::FillPaired(const DevirtualizedModel<NNAffineModel> &m, int i, int j);
+template librnary::energy_t librnary::NNAffineFolder::MLSSScore(const NNAffineModel &m, int i, int j) const;
+template librnary::energy_t librnary::NNAffineFolder::MLSSScore(const DevirtualizedModel<NNAffineModel> &m, int i,
+																  int j) const;
+template librnary::energy_t librnary::NNAffineFolder::MLBranchScore(const NNAffineModel &m, int i, int j) const;
+template librnary::energy_t librnary::NNAffineFolder::MLBranchScore(const DevirtualizedModel<NNAffineModel> &m, int i,
+																	  int j) const;
+template librnary::energy_t librnary::NNAffineFolder::SSScore(const NNAffineModel &m, int i, int j) const;
+template librnary::energy_t librnary::NNAffineFolder::SSScore(const DevirtualizedModel<NNAffineModel> &m, int i,
+																int j) const;
+template librnary::energy_t librnary::NNAffineFolder::ExteriorCoax(const NNAffineModel &m, int i, int j,
+																	vector<TState> *branches) const;
+template librnary::energy_t librnary::NNAffineFolder::ExteriorCoax(const DevirtualizedModel<NNAffineModel> &m, int i,
+																	int j, vector<TState> *branches) const;
@@ -0,0 +1,175 @@
+#include "folders/nn_affine_param_batch_folder.hpp"
+
+#include <stdexcept>
+
+using namespace std;
+
+const int librnary::NNAffineParamBatchFolder::Width;
+
+librnary::NNAffineParamBatchFolder::NNAffineParamBatchFolder(const NNAffineModel &_em)
+	: NNAffineFolder(_em) {}
+
+librnary::NNAffineParamBatchFolder::NNAffineParamBatchFolder(const NNAffineFolder &folder)
+	: NNAffineFolder(SettingsOf(folder)) {}
+
+struct librnary::NNAffineParamBatchFolder::Source {
+	/// The lanes share the RNA, so every lane needs every term.
+	struct Mask {};
+
+	const NNAffineParamBatchFolder &folder;
+	const DevirtualizedModel<NNAffineModel> &m;
+
+	Source(const NNAffineParamBatchFolder &_folder, const DevirtualizedModel<NNAffineModel> &_m)
+		: folder(_folder), m(_m) {}
+
+	bool Stacking() const {
+		return folder.stacking;
+	}
+
+	int MaxSpan() const {
+		return folder.max_span;
+	}
+
+	bool InSpan(int i, int j) const {
+		return folder.InSpan(i, j);
+	}
+
+	Mask Live(int) const {
+		return Mask();
+	}
+
+	bool Pairable(int i, int j, Mask &) const {
+		return ValidPair(folder.rna[i], folder.rna[j]) &&
+			(folder.lonely_pairs || !MustBeLonelyPair(folder.rna, i, j, m.MIN_HAIRPIN_UNPAIRED));
+	}
+
+	void Store(const Mask &, const LaneEnergies &from, LaneEnergies &to) const {
+		to = from;
+	}
+
+	LaneEnergies MLInit() const {
+		return folder.ml_init;
+	}
+
+	LaneEnergies MLBranch() const {
+		return folder.ml_branch;
+	}
+
+	LaneEnergies MLUnpaired() const {
+		return folder.ml_unpaired;
+	}
+
+	LaneEnergies OneLoop(const Mask &, int i, int j) const {
+		return LaneEnergies::All(m.OneLoop(i, j));
+	}
+
+	LaneEnergies Branch(const Mask &, int i, int j) const {
+		return LaneEnergies::All(m.Branch(i, j));
+	}
+
+	LaneEnergies ClosingThreeDangle(const Mask &, int i, int j) const {
+		return LaneEnergies::All(m.ClosingThreeDangle(i, j));
+	}
+
+	LaneEnergies ClosingFiveDangle(const Mask &, int i, int j) const {
+		return LaneEnergies::All(m.ClosingFiveDangle(i, j));
+	}
+
+	LaneEnergies ClosingMismatch(const Mask &, int i, int j) const {
+		return LaneEnergies::All(m.ClosingMismatch(i, j));
+	}
+
+	LaneEnergies FlushCoax(const Mask &, int i, int j, int k, int l) const {
+		return LaneEnergies::All(m.FlushCoax(i, j, k, l));
+	}
+
+	LaneEnergies MismatchCoax(const Mask &, int i, int j, int k, int l) const {
+		return LaneEnergies::All(m.MismatchCoax(i, j, k, l));
+	}
+
+	LaneEnergies FiveDangle(const Mask &, int i, int j) const {
+		return LaneEnergies::All(i > 0 ? m.FiveDangle(i, j) : 0);
+	}
+
+	LaneEnergies ThreeDangle(const Mask &, int i, int j) const {
+		return LaneEnergies::All(j + 1 < static_cast<int>(folder.rna.size()) ? m.ThreeDangle(i, j) : 0);
+	}
+
+	LaneEnergies Mismatch(const Mask &, int i, int j) const {
+		return LaneEnergies::All(i > 0 && j + 1 < static_cast<int>(folder.rna.size()) ? m.Mismatch(i, j) : 0);
+	}
+
+	/// Their energy is the same in every lane.
+	LaneEnergies TwoLoops(const Mask &, const LaneTables &t, int i, int j) const {
+		LaneEnergies best = LaneEnergies::All(m.MaxMFE());
+		const int max_up = folder.max_twoloop_unpaired;
+		for (int k = i + 1; k + 1 < j && (k - i - 1) <= max_up; ++k)
+			for (int l = j - 1; l > k && (j - l - 1) + (k - i - 1) <= max_up; --l)
+				best.Min(t.P[k][l] + m.TwoLoop(i, k, l, j));
+		return best;
+	}
+
+	void PairFilled(const Mask &, const LaneTables &, int, int) const {}
+};
+
+size_t librnary::NNAffineParamBatchFolder::TableBytes() const {
+	return lanes.Bytes();
+}
+
+vector<librnary::energy_t> librnary::NNAffineParamBatchFolder::Fold(const PrimeStructure &_rna,
+																	 const vector<MLParams> &_params) {
+	if (_params.empty() || _params.size() > static_cast<size_t>(Width))
+		throw invalid_argument("Fold needs 1 to Width parameter sets");
+	rna = _rna;
+	params = _params;
+	for (int w = 0; w < Width; ++w) {
+		const MLParams &p = params[static_cast<size_t>(w) < params.size() ? w : 0];
+		ml_init.v[w] = p.init;
+		ml_branch.v[w] = p.branch;
+		ml_unpaired.v[w] = p.unpaired;
+	}
+	em.SetRNA(rna);
+	const size_t RSZ = rna.size();
+	const auto N = static_cast<int>(RSZ);
+	if (N == 0)
+		return vector<energy_t>(params.size(), 0);
+
+	// Cells (i,j) are only needed for j - i <= max_span.
+	const size_t band = static_cast<size_t>(max_span) + 1;
+	lanes.Assign(RSZ, LaneEnergies::All(em.MaxMFE()), band, stacking);
+
+	// Every lane shares the model's terms for the RNA, so they are looked up once.
+	const DevirtualizedModel<NNAffineModel> m(em);
+	Source src(*this, m);
+	FillLaneTables(src, lanes, N);
+
+	vector<energy_t> mfes;
+	for (size_t w = 0; w < params.size(); ++w)
+		mfes.push_back(lanes.E[RSZ - 1].v[w]);
+	return mfes;
+}
+
+librnary::Matching librnary::NNAffineParamBatchFolder::Traceback(size_t lane) {
+	assert(lane < params.size());
+	// Load the lane into the tables of NNAffineFolder, and trace back through them as it would.
+	em.SetMLParams(params[lane].init, params[lane].branch, params[lane].unpaired);
+	const size_t RSZ = rna.size();
+	const auto N = static_cast<int>(RSZ);
+	const size_t band = static_cast<size_t>(max_span) + 1;
+	P.Assign(RSZ, em.MaxMFE(), band);
+	Cx.Assign(RSZ, em.MaxMFE(), band);
+	ML.resize(3);
+	for (auto &tbl : ML)
+		tbl.Assign(RSZ, RSZ, em.MaxMFE(), band);
+	E.assign(RSZ, 0);
+	for (int i = 0; i < N; ++i) {
+		for (int j = i; j < N && InSpan(i, j); ++j) {
+			P[i][j] = lanes.P[i][j].v[lane];
+			Cx[i][j] = lanes.Cx[i][j].v[lane];
+			for (int b = 0; b < 3; ++b)
+				ML[b][i][j] = lanes.ML[b][i][j].v[lane];
+		}
+		E[i] = lanes.E[i].v[lane];
+	}
+	return NNAffineFolder::Traceback();
+}
@@ -0,0 +1,340 @@
+#include <folders/nn_affine_pf_folder.hpp>
+
+#include <algorithm>
+
+using namespace std;
+
+void librnary::NNAffinePFFolder::PFTables::Assign(size_t n, size_t band, size_t x_band, bool stacking) {
+	P.Assign(n, 0.0, band);
+	ML.resize(3);
+	for (auto &tbl : ML)
+		tbl.Assign(n, 0.0, band);
+	if (stacking) {
+		Cx.Assign(n, 0.0, band);
+		X.Assign(n, 0.0, x_band);
+	} else {
+		Cx.Clear();
+		X.Clear();
+	}
+	E.assign(n, 0.0);
+}
+
+double &librnary::NNAffinePFFolder::PFTables::operator[](const TState &s) {
+	switch (s.t) {
+		case ET:
+			return E[s.i];
+		case PT:
+			return P[s.i][s.j];
+		case MLT:
+			return ML[s.extra][s.i][s.j];
+		case CxT:
+			return Cx[s.i][s.j];
+		default: // XT
+			return X[s.i][s.j];
+	}
+}
+
+double librnary::NNAffinePFFolder::PFTables::operator[](const TState &s) const {
+	switch (s.t) {
+		case ET:
+			return E[s.i];
+		case PT:
+			return P[s.i][s.j];
+		case MLT:
+			return ML[s.extra][s.i][s.j];
+		case CxT:
+			return Cx[s.i][s.j];
+		default: // XT
+			return X[s.i][s.j];
+	}
+}
+
+librnary::NNAffinePFFolder::NNAffinePFFolder(const NNAffineModel &_em)
+	: NNAffineFolder(_em) {
+	// Only the MFE is needed from the base folder, to pick the scale.
+	energy_only = true;
+}
+
+librnary::NNAffinePFFolder::NNAffinePFFolder(const NNAffineFolder &folder)
+	: NNAffineFolder(SettingsOf(folder)) {
+	energy_only = true;
+}
+
+void librnary::NNAffinePFFolder::SetKT(kcalmol_t v) {
+	kt = v;
+}
+
+librnary::kcalmol_t librnary::NNAffinePFFolder::KT() const {
+	return kt;
+}
+
+librnary::energy_t librnary::NNAffinePFFolder::MFE() const {
+	return mfe;
+}
+
+double librnary::NNAffinePFFolder::LogPartitionFunction() const {
+	if (rna.empty())
+		return 0.0;
+	return log(Q.E.back()) + static_cast<double>(rna.size()) * log(scale);
+}
+
+size_t librnary::NNAffinePFFolder::XBand() const {
+	return static_cast<size_t>(ExteriorReach(max_span, true));
+}
+
+int librnary::NNAffinePFFolder::Length(const TState &s) {
+	return s.t == ET ? s.i + 1 : s.j - s.i + 1;
+}
+
+template<typename ModelT>
+double librnary::NNAffinePFFolder::Inside(const ModelT &m, const TState &s) const {
+	const int len = Length(s);
+	double q = 0.0;
+	Decompositions(m, s, [&](energy_t e, initializer_list<TState> children) {
+		double w = 1.0;
+		int uncovered = len;
+		for (const auto &c : children) {
+			w *= Q[c];
+			uncovered -= Length(c);
+		}
+		if (w != 0.0)
+			q += w * Boltzmann(e) * unpaired_scale[uncovered];
+	});
+	return q;
+}
+
+template<typename ModelT>
+void librnary::NNAffinePFFolder::Outside(const ModelT &m, const TState &s, PFTables &O) const {
+	const double out = O[s];
+	if (out == 0.0)
+		return;
+	const int len = Length(s);
+	Decompositions(m, s, [&](energy_t e, initializer_list<TState> children) {
+		int uncovered = len;
+		for (const auto &c : children)
+			uncovered -= Length(c);
+		const double w = out * Boltzmann(e) * unpaired_scale[uncovered];
+		// Each child gets the weight of the decomposition times the partition functions of its siblings.
+		for (const auto &c : children) {
+			double contrib = w;
+			for (const auto &sibling : children)
+				if (&sibling != &c)
+					contrib *= Q[sibling];
+			O[c] += contrib;
+		}
+	});
+}
+
+template<typename ModelT>
+void librnary::NNAffinePFFolder::FillCell(const ModelT &m, int i, int j) {
+	if (InSpan(i, j)) {
+		if (i < j && ValidPair(rna[i], rna[j]) &&
+			(lonely_pairs || !MustBeLonelyPair(rna, i, j, m.MIN_HAIRPIN_UNPAIRED)))
+			Q.P[i][j] = Inside(m, TState(PT, i, j));
+		// P[i][j] before Cx and ML, which can end on it.
+		if (stacking)
+			Q.Cx[i][j] = Inside(m, TState(CxT, i, j));
+		for (int b = 0; b < 3; ++b)
+			Q.ML[b][i][j] = Inside(m, TState(MLT, b, i, j));
+	}
+	if (stacking && static_cast<size_t>(j - i) < XBand())
+		Q.X[i][j] = Inside(m, TState(XT, i, j));
+}
+
+template<typename ModelT>
+void librnary::NNAffinePFFolder::Fill(const ModelT &m) {
+	const auto N = static_cast<int>(rna.size());
+	// The exterior coaxial stacks reach further than the other cells.
+	const int max_fill_span = stacking ? static_cast<int>(min<size_t>(XBand() - 1, static_cast<size_t>(N - 1)))
+									   : min(max_span, N - 1);
+	for (int span = 0; span <= max_fill_span; ++span) {
+		if (pool != nullptr && pool->Size() > 1) {
+			pool->ParallelFor(0, static_cast<size_t>(N - span), [&](size_t i) {
+				FillCell(m, static_cast<int>(i), static_cast<int>(i) + span);
+			});
+		} else {
+			for (int i = 0; i + span < N; ++i)
+				FillCell(m, i, i + span);
+		}
+	}
+	for (int i = 0; i < N; ++i)
+		Q.E[i] = Inside(m, TState(i));
+}
+
+librnary::kcalmol_t librnary::NNAffinePFFolder::Fold(const PrimeStructure &_rna) {
+	mfe = NNAffineFolder::Fold(_rna);
+	const auto N = rna.size();
+	if (N == 0)
+		return 0.0;
+
+	// Scale so that the MFE structures have a weight of 1.
+	scale = exp(-EnergyToKCal(mfe) / (kt * static_cast<double>(N)));
+	unpaired_scale.resize(N + 1);
+	unpaired_scale[0] = 1.0;
+	for (size_t u = 1; u <= N; ++u)
+		unpaired_scale[u] = unpaired_scale[u - 1] / scale;
+	boltzmann.resize(2 * BoltzmannRange + 1);
+	for (int e = -BoltzmannRange; e <= BoltzmannRange; ++e)
+		boltzmann[e + BoltzmannRange] = exp(-EnergyToKCal(e) / kt);
+
+	choices.clear();
+	Q.Assign(N, static_cast<size_t>(max_span) + 1, XBand(), stacking);
+	if (static_dispatch)
+		Fill(DevirtualizedModel<NNAffineModel>(em));
+	else
+		Fill(em);
+	return -kt * LogPartitionFunction();
+}
+
+template<typename ModelT>
+void librnary::NNAffinePFFolder::FillOutside(const ModelT &m, PFTables &O) const {
+	const auto N = static_cast<int>(rna.size());
+	O.Assign(static_cast<size_t>(N), static_cast<size_t>(max_span) + 1, XBand(), stacking);
+	O.E[N - 1] = 1.0;
+	for (int i = N - 1; i >= 0; --i)
+		Outside(m, TState(i), O);
+	// The reverse of the fill order. Within a cell, P goes last as the other tables can end on it.
+	const int max_fill_span = stacking ? static_cast<int>(min<size_t>(XBand() - 1, static_cast<size_t>(N - 1)))
+									   : min(max_span, N - 1);
+	for (int span = max_fill_span; span >= 0; --span) {
+		for (int i = 0; i + span < N; ++i) {
+			const int j = i + span;
+			if (stacking && static_cast<size_t>(span) < XBand())
+				Outside(m, TState(XT, i, j), O);
+			if (!InSpan(i, j))
+				continue;
+			for (int b = 0; b < 3; ++b)
+				Outside(m, TState(MLT, b, i, j), O);
+			if (stacking)
+				Outside(m, TState(CxT, i, j), O);
+			if (Q.P[i][j] != 0.0)
+				Outside(m, TState(PT, i, j), O);
+		}
+	}
+}
+
+librnary::TriangularArray<double> librnary::NNAffinePFFolder::BasePairProbabilities() const {
+	const auto N = rna.size();
+	const size_t band = static_cast<size_t>(max_span) + 1;
+	TriangularArray<double> probs;
+	probs.Assign(N, 0.0, band);
+	if (N == 0)
+		return probs;
+	PFTables O;
+	if (static_dispatch)
+		FillOutside(DevirtualizedModel<NNAffineModel>(em), O);
+	else
+		FillOutside(em, O);
+	const double z = Q.E.back();
+	for (int i = 0; i < static_cast<int>(N); ++i)
+		for (int j = i + 1; j < static_cast<int>(N) && InSpan(i, j); ++j)
+			probs[i][j] = Q.P[i][j] * O.P[i][j] / z;
+	return probs;
+}
+
+template<typename ModelT>
+const librnary::NNAffinePFFolder::Choices &librnary::NNAffinePFFolder::StateChoices(const ModelT &m,
+																					   const TState &s) {
+	auto it = choices.find(StateKey(s));
+	if (it != choices.end())
+		return it->second;
+	Choices &c = choices[StateKey(s)];
+	const int len = Length(s);
+	double total = 0.0;
+	Decompositions(m, s, [&](energy_t e, initializer_list<TState> children) {
+		double w = 1.0;
+		int uncovered = len;
+		for (const auto &child : children) {
+			w *= Q[child];
+			uncovered -= Length(child);
+		}
+		w *= Boltzmann(e) * unpaired_scale[uncovered];
+		if (w == 0.0)
+			return;
+		total += w;
+		c.cumulative.push_back(total);
+		c.children.insert(c.children.end(), children.begin(), children.end());
+		c.ends.push_back(c.children.size());
+	});
+	return c;
+}
+
+template<typename ModelT>
+vector<librnary::Matching> librnary::NNAffinePFFolder::Sample(const ModelT &m, size_t count,
+															   default_random_engine &re) {
+	const auto N = static_cast<unsigned>(rna.size());
+	vector<Matching> structures(count, EmptyMatching(N));
+	if (N == 0 || count == 0)
+		return structures;
+	// Samples that have made the same choices so far, and the states they have left to decompose.
+	struct Group {
+		vector<TState> todo;
+		vector<size_t> ids;
+	};
+	vector<Group> groups(1);
+	groups[0].todo.emplace_back(static_cast<int>(N) - 1);
+	for (size_t id = 0; id < count; ++id)
+		groups[0].ids.push_back(id);
+	uniform_real_distribution<double> unif(0.0, 1.0);
+	vector<size_t> picks;
+	while (!groups.empty()) {
+		Group g = std::move(groups.back());
+		groups.pop_back();
+		while (!g.todo.empty()) {
+			const TState s = g.todo.back();
+			g.todo.pop_back();
+			if (s.t == PT) {
+				for (size_t id : g.ids) {
+					structures[id][s.i] = s.j;
+					structures[id][s.j] = s.i;
+				}
+			}
+			const Choices &c = StateChoices(m, s);
+			auto children = [&](size_t d) {
+				return make_pair(c.children.begin() + (d == 0 ? 0 : c.ends[d - 1]), c.children.begin() + c.ends[d]);
+			};
+			if (c.cumulative.empty()) // Only reachable through rounding, as every choice has some weight.
+				continue;
+			if (c.cumulative.size() == 1) {
+				g.todo.insert(g.todo.end(), children(0).first, children(0).second);
+				continue;
+			}
+			picks.resize(g.ids.size());
+			bool split = false;
+			for (size_t k = 0; k < g.ids.size(); ++k) {
+				const double u = unif(re) * c.cumulative.back();
+				picks[k] = min(static_cast<size_t>(upper_bound(c.cumulative.begin(), c.cumulative.end(), u)
+													   - c.cumulative.begin()), c.cumulative.size() - 1);
+				split = split || picks[k] != picks[0];
+			}
+			if (!split) {
+				g.todo.insert(g.todo.end(), children(picks[0]).first, children(picks[0]).second);
+				continue;
+			}
+			// The samples part ways here, into a group per decomposition chosen.
+			vector<size_t> order(g.ids.size());
+			for (size_t k = 0; k < order.size(); ++k)
+				order[k] = k;
+			sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+				return picks[a] < picks[b];
+			});
+			for (size_t start = 0; start < order.size();) {
+				const size_t d = picks[order[start]];
+				Group part;
+				part.todo = g.todo;
+				part.todo.insert(part.todo.end(), children(d).first, children(d).second);
+				for (; start < order.size() && picks[order[start]] == d; ++start)
+					part.ids.push_back(g.ids[order[start]]);
+				groups.push_back(std::move(part));
+			}
+			break;
+		}
+	}
+	return structures;
+}
+
+vector<librnary::Matching> librnary::NNAffinePFFolder::Sample(size_t count, default_random_engine &re) {
+	if (static_dispatch)
+		return Sample(DevirtualizedModel<NNAffineModel>(em), count, re);
+	return Sample(em, count, re);
+}
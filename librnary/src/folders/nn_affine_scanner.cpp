@@ -0,0 +1,230 @@
+#include <folders/nn_affine_scanner.hpp>
+
+using namespace std;
+
+namespace {
+/// Moves every cell (i,j) of tbl to (i - by, j - by). Cells with nothing to move into them are set to initv.
+template<typename TableT>
+void ShiftCells(TableT &tbl, int by, int n, int band, librnary::energy_t initv) {
+	for (int i = 0; i < n; ++i)
+		for (int j = i; j < min(n, i + band); ++j)
+			tbl[i][j] = j + by < n ? tbl[i + by][j + by] : initv;
+}
+}
+
+librnary::NNAffineScanner::NNAffineScanner(const NNAffineModel &_em, unsigned _width, unsigned _step)
+	: NNAffineFolder(_em), width(static_cast<int>(max(_width, 1u))), step(static_cast<int>(max(_step, 1u))) {}
+
+unsigned librnary::NNAffineScanner::Width() const {
+	return static_cast<unsigned>(width);
+}
+
+unsigned librnary::NNAffineScanner::Step() const {
+	return static_cast<unsigned>(step);
+}
+
+int librnary::NNAffineScanner::Capacity() const {
+	return 2 * (width + 1);
+}
+
+size_t librnary::NNAffineScanner::TableBytes() const {
+	return NNAffineFolder::TableBytes() + X.Bytes() + WE.capacity() * sizeof(energy_t);
+}
+
+void librnary::NNAffineScanner::Reset() {
+	rna.clear();
+	base = 0;
+	filled = 0;
+	emitted_end = 0;
+}
+
+void librnary::NNAffineScanner::Shift() {
+	// Later cells have i > filled - width, and the lonely pair check reads the nucleotide before i.
+	const int by = filled - width;
+	const int n = Capacity();
+	ShiftCells(P, by, n, width, em.MaxMFE());
+	ShiftCells(Cx, by, n, width, em.MaxMFE());
+	ShiftCells(MLBrCol, by, n, width, em.MaxMFE());
+	ShiftCells(CxCol, by, n, width, em.MaxMFE());
+	for (auto &tbl : ML)
+		ShiftCells(tbl, by, n, width, em.MaxMFE());
+	if (stacking)
+		ShiftCells(X, by, n, width, em.MaxMFE());
+	rna.erase(rna.begin(), rna.begin() + by);
+	base += by;
+	filled -= by;
+}
+
+void librnary::NNAffineScanner::Push(const PrimeStructure &chunk, const WindowCallback &emit) {
+	const auto n = static_cast<size_t>(Capacity());
+	if (rna.empty() && base == 0) {
+		PrepareTable(nullptr, P, n, em.MaxMFE(), static_cast<size_t>(width));
+		PrepareTable(nullptr, Cx, n, em.MaxMFE(), static_cast<size_t>(width));
+		PrepareTable(nullptr, MLBrCol, n, em.MaxMFE(), static_cast<size_t>(width));
+		PrepareTable(nullptr, CxCol, n, em.MaxMFE(), static_cast<size_t>(width));
+		ML.resize(3);
+		for (auto &tbl : ML)
+			PrepareTable(nullptr, tbl, n, n, em.MaxMFE(), static_cast<size_t>(width));
+		if (stacking)
+			PrepareTable(nullptr, X, n, em.MaxMFE(), static_cast<size_t>(width));
+		else
+			X.Clear();
+		E.clear();
+	}
+	for (size_t pos = 0; pos < chunk.size();) {
+		if (rna.size() == n)
+			Shift();
+		size_t take = min(chunk.size() - pos, n - rna.size());
+		rna.insert(rna.end(), chunk.begin() + pos, chunk.begin() + pos + take);
+		pos += take;
+		// Hold back the last column, as its lonely pair check needs the next nucleotide, and the columns of a run of
+		// equal nucleotides at the end, which a single nucleotide bulge reads past. Stop short of the width, so the
+		// tables can still be shifted.
+		auto end = static_cast<int>(rna.size()) - 1;
+		while (end > 0 && rna[end - 1] == rna.back() && end > static_cast<int>(rna.size()) - width - 1)
+			--end;
+		Advance(end, false, emit);
+	}
+}
+
+void librnary::NNAffineScanner::Finish(const WindowCallback &emit) {
+	if (!rna.empty())
+		Advance(static_cast<int>(rna.size()), true, emit);
+	Reset();
+}
+
+void librnary::NNAffineScanner::Advance(int end, bool finish, const WindowCallback &emit) {
+	if (filled >= end && !finish)
+		return;
+	em.SetRNA(rna);
+	if (static_dispatch)
+		Advance(DevirtualizedModel<NNAffineModel>(em), end, finish, emit);
+	else
+		Advance(em, end, finish, emit);
+}
+
+template<typename ModelT>
+void librnary::NNAffineScanner::Advance(const ModelT &m, int end, bool finish, const WindowCallback &emit) {
+	for (; filled < end; ++filled) {
+		const int j = filled;
+		ML[0][j][j] = m.MLUnpairedCost();
+		for (int i = j - 1; i >= 0 && j - i < width; --i) {
+			// Cells past the max span keep the no pair energy they were prepared or shifted with.
+			if (j - i <= max_span)
+				FillCell(m, i, j);
+			if (stacking)
+				X[i][j] = ExteriorCoax(m, i, j, nullptr);
+		}
+		const int a = j - width + 1;
+		if (a >= 0 && (base + a) % step == 0)
+			EmitWindow(m, a, j, emit);
+	}
+	const size_t total = base + rna.size();
+	if (finish && emitted_end < total)
+		EmitWindow(m, static_cast<int>(rna.size()) - min(width, static_cast<int>(total)), filled - 1, emit);
+}
+
+template<typename ModelT>
+librnary::energy_t librnary::NNAffineScanner::FillWindow(const ModelT &m, int a, int b) {
+	WE.assign(static_cast<size_t>(b - a + 2), 0);
+	// WE[0] is the empty fragment, and WE[1] the fragment of just a, which cannot pair.
+	for (int i = a + 1; i <= b; ++i) {
+		energy_t best = WE[i - a];
+		for (int k = a - 1; k < i; ++k) {
+			energy_t decomp = WE[k - a + 1];
+			best = min(best, decomp + SSScore(m, k + 1, i));
+			if (stacking) {
+				if (k + 2 < i)
+					best = min(best, decomp + SSScore(m, k + 2, i) + m.FiveDangle(k + 2, i));
+				if (k + 1 < i - 1)
+					best = min(best, decomp + SSScore(m, k + 1, i - 1) + m.ThreeDangle(k + 1, i - 1));
+				if (k + 2 < i - 1)
+					best = min(best, decomp + SSScore(m, k + 2, i - 1) + m.Mismatch(k + 2, i - 1));
+				best = min(best, decomp + X[k + 1][i]);
+			}
+		}
+		WE[i - a + 1] = best;
+	}
+	return WE[b - a + 1];
+}
+
+librnary::Matching librnary::NNAffineScanner::TraceWindow(int a, int b) {
+	Matching m = EmptyMatching(static_cast<unsigned>(b - a + 1));
+	stack<TState> s;
+	// Walk the exterior loop from the 3' end, as NNAffineFolder::TraceE does.
+	for (int i = b; i > a;) {
+		int next = i - 1; // Unpaired 3'.
+		energy_t be = WE[i - a], e;
+		vector<TState> best_decomp;
+		int coax_k = -2;
+		for (int k = a - 1; k < i; ++k) {
+			energy_t decomp = WE[k - a + 1];
+			e = decomp + SSScore(em, k + 1, i);
+			if (e < be) {
+				be = e;
+				next = k;
+				best_decomp = {TState(PT, k + 1, i)};
+			}
+			if (!stacking)
+				continue;
+			if (k + 2 < i) {
+				e = decomp + SSScore(em, k + 2, i) + em.FiveDangle(k + 2, i);
+				if (e < be) {
+					be = e;
+					next = k;
+					best_decomp = {TState(PT, k + 2, i)};
+				}
+			}
+			if (k + 1 < i - 1) {
+				e = decomp + SSScore(em, k + 1, i - 1) + em.ThreeDangle(k + 1, i - 1);
+				if (e < be) {
+					be = e;
+					next = k;
+					best_decomp = {TState(PT, k + 1, i - 1)};
+				}
+			}
+			if (k + 2 < i - 1) {
+				e = decomp + SSScore(em, k + 2, i - 1) + em.Mismatch(k + 2, i - 1);
+				if (e < be) {
+					be = e;
+					next = k;
+					best_decomp = {TState(PT, k + 2, i - 1)};
+				}
+			}
+			e = decomp + X[k + 1][i];
+			if (e < be) {
+				be = e;
+				next = k;
+				coax_k = k;
+				best_decomp.clear();
+			}
+		}
+		if (best_decomp.empty() && coax_k == next)
+			ExteriorCoax(em, coax_k + 1, i, &best_decomp);
+		for (const auto &state : best_decomp)
+			s.push(state);
+		i = next;
+	}
+
+	while (!s.empty()) {
+		if (s.top().t == PT) {
+			m[s.top().i - a] = s.top().j - a;
+			m[s.top().j - a] = s.top().i - a;
+			TraceP(s);
+		} else if (s.top().t == MLT) {
+			TraceML(s);
+		} else // s.top().t == CxT
+			TraceCx(s);
+	}
+	return m;
+}
+
+template<typename ModelT>
+void librnary::NNAffineScanner::EmitWindow(const ModelT &m, int a, int b, const WindowCallback &emit) {
+	ScanWindow w;
+	w.start = base + a;
+	w.mfe = FillWindow(m, a, b);
+	w.structure = TraceWindow(a, b);
+	emitted_end = base + b + 1;
+	emit(w);
+}
@@ -0,0 +1,196 @@
+#include "folders/nn_affine_sparse_folder.hpp"
+
+using namespace std;
+
+librnary::NNAffineSparseFolder::NNAffineSparseFolder(const NNAffineModel &_em)
+	: NNAffineFolder(_em) {}
+
+librnary::NNAffineSparseFolder::NNAffineSparseFolder(const NNAffineFolder &folder)
+	: NNAffineFolder(SettingsOf(folder)) {
+	// Traceback reads every row of the tables.
+	energy_only = false;
+}
+
+size_t librnary::NNAffineSparseFolder::Candidates() const {
+	size_t res = 0;
+	for (const auto &column : branch_candidates)
+		res += column.size();
+	for (const auto &column : coax_candidates)
+		res += column.size();
+	return res;
+}
+
+size_t librnary::NNAffineSparseFolder::TableBytes() const {
+	size_t bytes = NNAffineFolder::TableBytes();
+	for (const auto &lists : {&branch_candidates, &coax_candidates})
+		for (const auto &column : *lists)
+			bytes += column.capacity() * sizeof(Candidate);
+	for (const auto &index : {&five_partners, &three_partners})
+		for (const auto &partners : *index)
+			bytes += partners.capacity() * sizeof(int);
+	return bytes;
+}
+
+void librnary::NNAffineSparseFolder::IndexPairs() {
+	const auto N = static_cast<int>(rna.size());
+	five_partners.assign(rna.size(), vector<int>());
+	three_partners.assign(rna.size(), vector<int>());
+	for (int j = 0; j < N; ++j)
+		for (int i = j - 1; i >= 0 && InSpan(i, j); --i)
+			if (CanPair(i, j)) {
+				five_partners[j].push_back(i);
+				three_partners[i].push_back(j);
+			}
+}
+
+template<typename ModelT>
+void librnary::NNAffineSparseFolder::FillCell(const ModelT &m, int i, int j) {
+	if (CanPair(i, j))
+		FillPaired(m, i, j);
+
+	// The coaxial stack table, over the branches the pair-capable index holds. The 5' branch is (i,k), or (i+1,k-1)
+	// with a mismatch, and the 3' branch (k+1,j), or (k+2,j-1) with a mismatch.
+	energy_t best = m.MaxMFE();
+	if (stacking) {
+		for (int k : three_partners[i]) {
+			if (k + 1 >= j)
+				break;
+			if (CanPair(k + 1, j))
+				best = min(best, m.FlushCoax(i, k, k + 1, j) + MLSSScore(m, i, k) + MLSSScore(m, k + 1, j));
+			if (k + 2 < j - 1 && CanPair(k + 2, j - 1))
+				best = min(best,
+						   m.MismatchCoax(k + 2, j - 1, i, k) + MLSSScore(m, i, k) + MLSSScore(m, k + 2, j - 1)
+							   + m.MLUnpairedCost() * 2);
+		}
+		for (int c : three_partners[i + 1]) {
+			const int k = c + 1;
+			if (k + 1 >= j)
+				break;
+			if (i + 1 < k - 1 && CanPair(k + 1, j))
+				best = min(best,
+						   m.MismatchCoax(i + 1, k - 1, k + 1, j) + MLSSScore(m, i + 1, k - 1) + MLSSScore(m, k + 1, j)
+							   + m.MLUnpairedCost() * 2);
+		}
+	}
+	Cx[i][j] = best;
+
+	// The end on branch cases.
+	const energy_t branch = MLBranchScore(m, i, j);
+
+	// The decompositions into 5' ML fragment i..s-1 and 3' branch s..j, over the candidates of column j. Every one
+	// has s > i, as rows are filled with i descending.
+	const energy_t none = numeric_limits<energy_t>::max();
+	energy_t split0 = none, split1 = none, split_cx = none;
+	for (const auto &c : branch_candidates[j]) {
+		split0 = min(split0, ML[0][i][c.s - 1] + c.e);
+		split1 = min(split1, ML[1][i][c.s - 1] + c.e);
+	}
+	for (const auto &c : coax_candidates[j])
+		split_cx = min(split_cx, ML[0][i][c.s - 1] + c.e);
+	for (int b = 0; b < 3; ++b) { // b is the branches needed for valid ML.
+		best = ML[b][i][j - 1] + m.MLUnpairedCost();
+		if (b < 2) // End on branch cases.
+			best = min(best, branch);
+		// End on coaxial stack.
+		if (stacking) {
+			best = min(best, Cx[i][j]);
+		}
+		// bprime = max(0, b - 1) is the number of branches required after one has been placed.
+		best = min(best, b < 2 ? split0 : split1);
+		best = min(best, split_cx);
+		ML[b][i][j] = best;
+	}
+
+	// (i,j) is a candidate if it beats every split of i..j into an ML fragment and a later candidate. Those with no
+	// structure, which stay above MaxMFE / 2, never win, so are left out.
+	if (branch < split0 && branch < m.MaxMFE() / 2)
+		branch_candidates[j].push_back({i, branch});
+	if (Cx[i][j] < split_cx && Cx[i][j] < m.MaxMFE() / 2)
+		coax_candidates[j].push_back({i, Cx[i][j]});
+}
+
+template<typename ModelT>
+void librnary::NNAffineSparseFolder::FillExterior(const ModelT &m) {
+	const auto N = static_cast<int>(rna.size());
+	// The exterior loop fragment 0..k, which is empty for k = -1.
+	auto decomp = [&](int k) {
+		return k == -1 ? 0 : E[k];
+	};
+	for (int i = 1; i < N; ++i) {
+		energy_t best = E[i - 1];
+		// A branch (c,i), alone or with a 5' dangle.
+		for (int c : five_partners[i]) {
+			best = min(best, decomp(c - 1) + SSScore(m, c, i));
+			if (stacking && c >= 1)
+				best = min(best, decomp(c - 2) + SSScore(m, c, i) + m.FiveDangle(c, i));
+		}
+		if (stacking) {
+			// A branch (c,i-1) with a 3' dangle or a mismatch.
+			for (int c : five_partners[i - 1]) {
+				best = min(best, decomp(c - 1) + SSScore(m, c, i - 1) + m.ThreeDangle(c, i - 1));
+				if (c >= 1)
+					best = min(best, decomp(c - 2) + SSScore(m, c, i - 1) + m.Mismatch(c, i - 1));
+			}
+			// Coaxial stacks whose 3' branch is (a,i), after a 5' branch (c,a-1), or (c,a-2) with a mismatch.
+			for (int a : five_partners[i]) {
+				if (a >= 1)
+					for (int c : five_partners[a - 1])
+						best = min(best, decomp(c - 1) + m.FlushCoax(c, a - 1, a, i)
+							+ SSScore(m, c, a - 1) + SSScore(m, a, i));
+				if (a >= 2)
+					for (int c : five_partners[a - 2])
+						if (c >= 1)
+							best = min(best, decomp(c - 2) + m.MismatchCoax(c, a - 2, a, i)
+								+ SSScore(m, c, a - 2) + SSScore(m, a, i));
+			}
+			// Coaxial stacks whose 3' branch is (a,i-1) with a mismatch, after a 5' branch (c,a-2).
+			for (int a : five_partners[i - 1])
+				if (a >= 2)
+					for (int c : five_partners[a - 2])
+						best = min(best, decomp(c - 1) + m.MismatchCoax(a, i - 1, c, a - 2)
+							+ SSScore(m, c, a - 2) + SSScore(m, a, i - 1));
+		}
+		E[i] = best;
+	}
+}
+
+template<typename ModelT>
+librnary::energy_t librnary::NNAffineSparseFolder::Fill(const ModelT &m) {
+	const auto N = static_cast<int>(rna.size());
+	for (int i = N - 2; i >= 0; --i) { // i is 5' nucleotide.
+		ML[0][i][i] = m.MLUnpairedCost();
+		for (int j = i + 1; j < N && InSpan(i, j); ++j) // j is 3' nucleotide.
+			FillCell(m, i, j);
+	}
+	ML[0][N - 1][N - 1] = m.MLUnpairedCost();
+	FillExterior(m);
+	return E[N - 1];
+}
+
+librnary::energy_t librnary::NNAffineSparseFolder::Fold(const PrimeStructure &_rna) {
+	em.SetRNA(_rna);
+	rna = _rna;
+	const size_t RSZ = rna.size();
+	const auto N = static_cast<int>(RSZ);
+	branch_candidates.assign(RSZ, vector<Candidate>());
+	coax_candidates.assign(RSZ, vector<Candidate>());
+	IndexPairs();
+	if (N == 0)
+		return 0;
+
+	// Cells (i,j) are only needed for j - i <= max_span. The candidate lists take the place of the column-major
+	// shadows of NNAffineFolder.
+	const size_t band = static_cast<size_t>(max_span) + 1;
+	PrepareTable(workspace, P, RSZ, em.MaxMFE(), band);
+	PrepareTable(workspace, Cx, RSZ, em.MaxMFE(), band);
+	MLBrCol.Clear();
+	CxCol.Clear();
+	ML.resize(3);
+	for (auto &tbl : ML)
+		PrepareTable(workspace, tbl, RSZ, RSZ, em.MaxMFE(), band);
+	E.assign(RSZ, 0);
+
+	if (static_dispatch)
+		return Fill(DevirtualizedModel<NNAffineModel>(em));
+	return Fill(em);
+}
@@ -40,19 +40,22 @@ void librnary::NNUnpairedFolder::TraceE(stack<TState> &s) {
 	// Maintain best decomposition.
 	vector<TState> best_decomp = {TState(i - 1)}; // Unpaired 3'.
 	energy_t be = E[i - 1];
-	for (int k = -1; k < i; ++k) {
+	for (int k = max(-1, i - ExteriorReach(max_span, stacking)); k < i; ++k) {
 		int decomp = k == -1 ? 0 : E[k];
 		vector<TState> decomp_state;
 		if (k != -1)
 			decomp_state.push_back(TState(k));
-		energy_t e = decomp + SSScore(k + 1, i);
-		if (e < be) {
-			be = e;
-			best_decomp = {TState(k + 1, i)};
-			best_decomp.insert(best_decomp.end(), decomp_state.begin(), decomp_state.end());
+		energy_t e;
+		if (InSpan(k + 1, i)) {
+			e = decomp + SSScore(k + 1, i);
+			if (e < be) {
+				be = e;
+				best_decomp = {TState(k + 1, i)};
+				best_decomp.insert(best_decomp.end(), decomp_state.begin(), decomp_state.end());
+			}
 		}
 		if (stacking) {
-			if (k + 2 < i) {
+			if (k + 2 < i && InSpan(k + 2, i)) {
 				e = decomp + SSScore(k + 2, i) + em.FiveDangle(k + 2, i);
 				if (e < be) {
 					be = e;
@@ -60,7 +63,7 @@ void librnary::NNUnpairedFolder::TraceE(stack<TState> &s) {
 					best_decomp.insert(best_decomp.end(), decomp_state.begin(), decomp_state.end());
 				}
 			}
-			if (k + 1 < i - 1) {
+			if (k + 1 < i - 1 && InSpan(k + 1, i - 1)) {
 				e = decomp + SSScore(k + 1, i - 1) + em.ThreeDangle(k + 1, i - 1);
 				if (e < be) {
 					be = e;
@@ -68,7 +71,7 @@ void librnary::NNUnpairedFolder::TraceE(stack<TState> &s) {
 					best_decomp.insert(best_decomp.end(), decomp_state.begin(), decomp_state.end());
 				}
 			}
-			if (k + 2 < i - 1) {
+			if (k + 2 < i - 1 && InSpan(k + 2, i - 1)) {
 				e = decomp + SSScore(k + 2, i - 1) + em.Mismatch(k + 2, i - 1);
 				if (e < be) {
 					be = e;
@@ -78,8 +81,8 @@ void librnary::NNUnpairedFolder::TraceE(stack<TState> &s) {
 			}
 
 			// Coaxial stack decompositions.
-			for (int j = k + 1; j + 1 < i; ++j) {
-				if (k + 1 < j) {
+			for (int j = max(k + 1, i - max_span - 3); j + 1 < i && j - k <= max_span + 3; ++j) {
+				if (k + 1 < j && InSpan(k + 1, j) && InSpan(j + 1, i)) {
 					e = decomp + em.FlushCoax(k + 1, j, j + 1, i)
 						+ SSScore(k + 1, j) + SSScore(j + 1, i);
 					if (e < be) {
@@ -88,7 +91,7 @@ void librnary::NNUnpairedFolder::TraceE(stack<TState> &s) {
 						best_decomp.insert(best_decomp.end(), decomp_state.begin(), decomp_state.end());
 					}
 				}
-				if (k + 2 < j - 1) {
+				if (k + 2 < j - 1 && InSpan(k + 2, j - 1) && InSpan(j + 1, i)) {
 					e = decomp + em.MismatchCoax(k + 2, j - 1, j + 1, i)
 						+ SSScore(k + 2, j - 1) + SSScore(j + 1, i);
 					if (e < be) {
@@ -97,7 +100,7 @@ void librnary::NNUnpairedFolder::TraceE(stack<TState> &s) {
 						best_decomp.insert(best_decomp.end(), decomp_state.begin(), decomp_state.end());
 					}
 				}
-				if (j + 2 < i - 1 && k + 1 < j) {
+				if (j + 2 < i - 1 && k + 1 < j && InSpan(k + 1, j) && InSpan(j + 2, i - 1)) {
 					e = decomp + em.MismatchCoax(j + 2, i - 1, k + 1, j)
 						+ SSScore(k + 1, j) + SSScore(j + 2, i - 1);
 					if (e < be) {
@@ -124,8 +127,9 @@ void librnary::NNUnpairedFolder::TraceP(stack<TState> &s) {
 	vector<TState> best_decomp; // Unpaired 3'.
 	energy_t be = em.OneLoop(i, j);
 	energy_t e;
+	const energy_t branch = em.Branch(i, j) + em.MLBranchCost();
 	for (int up = 0; up < min(max_multi_unpaired + 1, j - i); ++up) { // Multiloops.
-		int init = em.MLClosure(up) + em.Branch(i, j) + em.MLBranchCost();
+		int init = em.MLClosure(up) + branch;
 		e = ML[2][up][i + 1][j - 1] + init;
 		if (e < be) {
 			be = e;
@@ -459,21 +463,34 @@ librnary::energy_t librnary::NNUnpairedFolder::Fold(const PrimeStructure &primar
 		return 0;
 	}
 
-	// Clear the DP tables.
-	P.clear();
-	ML.clear();
-	E.clear();
-	CxFl.clear();
-	CxMM.clear();
-
 	// Reset the DP tables.
-	P.resize(RSZ, VE(RSZ, em.MaxMFE()));
-	ML.resize(3, VVVE(min(RSZ, (unsigned long) max_multi_unpaired) + 1,
-					  VVE(RSZ, VE(RSZ, em.MaxMFE()))));
-	E.resize(RSZ, 0);
+	if (workspace != nullptr)
+		workspace->Rewind();
+	// Cells (i,j) are only needed for j - i <= max_span, so ML fragments have at most max_span + 1 unpaired.
+	const size_t band = static_cast<size_t>(max_span) + 1;
+	PrepareTable(workspace, P, RSZ, em.MaxMFE(), band);
+	ML.resize(3);
+	for (auto &by_up : ML) {
+		by_up.resize(min(RSZ, (unsigned long) min(max_multi_unpaired, max_span + 1)) + 1);
+		for (auto &tbl : by_up)
+			PrepareTable(workspace, tbl, RSZ, em.MaxMFE(), band);
+	}
+	PrepareTable(workspace, MLBrCol, RSZ, em.MaxMFE(), band);
+	E.assign(RSZ, 0);
 	if (stacking) {
-		CxFl.resize(RSZ, VE(RSZ, em.MaxMFE()));
-		CxMM.resize(RSZ, VE(RSZ, em.MaxMFE()));
+		PrepareTable(workspace, CxFl, RSZ, em.MaxMFE(), band);
+		PrepareTable(workspace, CxMM, RSZ, em.MaxMFE(), band);
+		PrepareTable(workspace, MLBrDangleCol, RSZ, em.MaxMFE(), band);
+		PrepareTable(workspace, MLBrMismatchCol, RSZ, em.MaxMFE(), band);
+		PrepareTable(workspace, CxFlCol, RSZ, em.MaxMFE(), band);
+		PrepareTable(workspace, CxMMCol, RSZ, em.MaxMFE(), band);
+	} else {
+		CxFl.Clear();
+		CxMM.Clear();
+		MLBrDangleCol.Clear();
+		MLBrMismatchCol.Clear();
+		CxFlCol.Clear();
+		CxMMCol.Clear();
 	}
 
 	// Special base case for ML table.
@@ -481,71 +498,73 @@ librnary::energy_t librnary::NNUnpairedFolder::Fold(const PrimeStructure &primar
 	for (int i = 0; i < N; ++i)
 		ML[0][1][i][i] = 0;
 
+	// Multi-loop closure costs by unpaired count, covering every up below since SetRNA was just called.
+	const energy_t *ml_closure = em.MLClosureTable().data();
+	assert(em.MLClosureTable().size() >= RSZ);
+
 	for (int i = N - 2; i >= 0; --i) { // i is 5' nucleotide.
-		for (int j = i + 1; j < N; ++j) { // j is 3' nucleotide.
+		for (int j = i + 1; j < N && InSpan(i, j); ++j) { // j is 3' nucleotide.
 			if (ValidPair(rna[i], rna[j]) &&
 				(lonely_pairs || !MustBeLonelyPair(rna, i, j, em.MIN_HAIRPIN_UNPAIRED))) {
 				energy_t best = em.OneLoop(i, j); // Hairpin.
+				const energy_t branch = em.Branch(i, j) + em.MLBranchCost();
 				for (int up = 0; up < min(max_multi_unpaired + 1, j - i); ++up) { // Multiloops.
-					int init = em.MLClosure(up) + em.Branch(i, j) + em.MLBranchCost();
-					best = min(best, ML[2][up][i + 1][j - 1] + init);
+					// Every decomposition for this up pays the same closure, so it is added once at the end.
+					energy_t best_up = ML[2][up][i + 1][j - 1];
 					// The rest is stacking.
 					if (stacking) {
 						if (i + 2 < j - 1 && up >= 1) // Left dangle.
-							best = min(best, ML[2][up - 1][i + 2][j - 1]
-								+ init + em.ClosingThreeDangle(i, j));
+							best_up = min(best_up, ML[2][up - 1][i + 2][j - 1]
+								+ em.ClosingThreeDangle(i, j));
 						if (i + 1 < j - 2 && up >= 1) // Right dangle.
-							best = min(best, ML[2][up - 1][i + 1][j - 2]
-								+ init + em.ClosingFiveDangle(i, j));
+							best_up = min(best_up, ML[2][up - 1][i + 1][j - 2]
+								+ em.ClosingFiveDangle(i, j));
 						if (i + 2 < j - 2 && up >= 2) // Mismatch.
-							best = min(best, ML[2][up - 2][i + 2][j - 2]
-								+ init + em.ClosingMismatch(i, j));
+							best_up = min(best_up, ML[2][up - 2][i + 2][j - 2]
+								+ em.ClosingMismatch(i, j));
 						// Coaxial stack.
 						for (int k = i + 1; k < j; ++k) {
 							// Five prime.
 							// ((_)_)
 							//    ^ <- k
 							if (k + 1 < j - 1 && i + 1 < k)
-								best = min(best, ML[1][up][k + 1][j - 1] + init
+								best_up = min(best_up, ML[1][up][k + 1][j - 1]
 									+ em.FlushCoax(i, j, i + 1, k) +
 									MLSSScore(i + 1, k));
 							if (up >= 2) {
 								// (.(_)_.)
 								if (i + 2 < k && k + 1 < j - 2)
-									best = min(best, ML[1][up - 2][k + 1][j - 2] + init
-										+
-											em.MismatchCoax(i, j, i + 2, k) +
+									best_up = min(best_up, ML[1][up - 2][k + 1][j - 2]
+										+ em.MismatchCoax(i, j, i + 2, k) +
 										MLSSScore(i + 2, k));
 								// (.(_)._)
 								if (i + 2 < k && k + 2 < j)
-									best = min(best, ML[1][up - 2][k + 2][j - 1] + init
-										+
-											em.MismatchCoax(i + 2, k, i, j) +
+									best_up = min(best_up, ML[1][up - 2][k + 2][j - 1]
+										+ em.MismatchCoax(i + 2, k, i, j) +
 										MLSSScore(i + 2, k));
 							}
 							// Three prime.
 							// (_(_))
 							//   ^ <- k
 							if (i + 1 < k - 1 && k < j - 1)
-								best = min(best, ML[1][up][i + 1][k - 1] + init
+								best_up = min(best_up, ML[1][up][i + 1][k - 1]
 									+ em.FlushCoax(i, j, k, j - 1) +
 									MLSSScore(k, j - 1));
 							if (up >= 2) {
 								// (._(_).)
 								if (k < j - 2 && i + 2 < k - 1)
-									best = min(best, ML[1][up - 2][i + 2][k - 1] + init
-										+
-											em.MismatchCoax(i, j, k, j - 2) +
+									best_up = min(best_up, ML[1][up - 2][i + 2][k - 1]
+										+ em.MismatchCoax(i, j, k, j - 2) +
 										MLSSScore(k, j - 2));
 								// (_.(_).)
 								if (k < j - 2 && i + 1 < k - 2)
-									best = min(best, ML[1][up - 2][i + 1][k - 2] + init
-										+
-											em.MismatchCoax(k, j - 2, i, j) +
+									best_up = min(best_up, ML[1][up - 2][i + 1][k - 2]
+										+ em.MismatchCoax(k, j - 2, i, j) +
 										MLSSScore(k, j - 2));
 							}
 						}
 					}
+					best = min(best, best_up + ml_closure[up] + branch);
 				}
 				// Two loops for the two-loops (stack, bulge, or internal loop).
 				for (int k = i + 1; k + 1 < j && (k - i - 1) <= max_twoloop_unpaired; ++k)
@@ -566,27 +585,56 @@ librnary::energy_t librnary::NNUnpairedFolder::Fold(const PrimeStructure &primar
 						+ MLSSScore(i, k) + MLSSScore(k + 2, j - 1));
 			}
 
-			for (int b = 0; b < 3; ++b) // b is the branches needed for valid ML.
-				for (int up = 0;
-					 up <= min(max_multi_unpaired, j - i + 1);
-					 ++up) { // up is the number of unpaired needed for valid ML.
+			// The column-major shadows of the branch terms at (i,j). Each is also an end on branch case.
+			MLBrCol(i, j) = MLSSScore(i, j);
+			if (stacking) {
+				CxFlCol(i, j) = CxFl[i][j];
+				CxMMCol(i, j) = CxMM[i][j];
+				if (i + 1 < j)
+					MLBrDangleCol(i, j) = min(MLSSScore(i + 1, j) + em.FiveDangle(i + 1, j),
+											  MLSSScore(i, j - 1) + em.ThreeDangle(i, j - 1));
+				if (i + 1 < j - 1)
+					MLBrMismatchCol(i, j) = MLSSScore(i + 1, j - 1) + em.Mismatch(i + 1, j - 1);
+			}
+
+			const energy_t none = numeric_limits<energy_t>::max();
+			// The decompositions into 5' ML fragment i..k and 3' branch k+1..j. A dangle needs k+1 < j-1, and a
+			// mismatch k+2 < j-1, so they try fewer splits.
+			const int splits = j - 1 - i;
+			for (int up = 0; up <= min(max_multi_unpaired, j - i + 1); ++up) { // up is the unpaired needed.
+				// The best split for each bprime, the number of branches required after one has been placed, as
+				// min-plus products of a row of ML and a column of the shadows.
+				energy_t split[2];
+				for (int bprime = 0; bprime < 2; ++bprime) {
+					split[bprime] = MinPlus(&ML[bprime][up](i, i), &MLBrCol(i + 1, j), splits, none);
+					// From here on is stacking.
+					if (stacking && up >= 1)
+						split[bprime] = MinPlus(&ML[bprime][up - 1](i, i), &MLBrDangleCol(i + 1, j),
+												max(0, splits - 1), split[bprime]);
+					if (stacking && up >= 2)
+						split[bprime] = MinPlus(&ML[bprime][up - 2](i, i), &MLBrMismatchCol(i + 1, j),
+												max(0, splits - 2), split[bprime]);
+				}
+				// Coaxial stack decomposition.
+				energy_t split_cx = none;
+				if (stacking) {
+					split_cx = MinPlus(&ML[0][up](i, i), &CxFlCol(i + 1, j), splits, none);
+					if (up >= 2)
+						split_cx = MinPlus(&ML[0][up - 2](i, i), &CxMMCol(i + 1, j), splits, split_cx);
+				}
+
+				for (int b = 0; b < 3; ++b) { // b is the branches needed for valid ML.
 					energy_t best = em.MaxMFE();
 					if (up > 0) // Single stranded.
 						best = ML[b][up - 1][i][j - 1];
 					if (b < 2) { // End on branch cases.
 						if (up == 0)
-							best = min(best, MLSSScore(i, j));
+							best = min(best, MLBrCol(i, j));
 						if (stacking) {
-							if (i + 1 < j && up == 1) {
-								best = min(best,
-										   MLSSScore(i + 1, j) + em.FiveDangle(i + 1, j));
-								best = min(best,
-										   MLSSScore(i, j - 1) + em.ThreeDangle(i, j - 1));
-							}
-							if (i + 1 < j - 1 && up == 2) {
-								best = min(best, MLSSScore(i + 1, j - 1) +
-									em.Mismatch(i + 1, j - 1));
-							}
+							if (i + 1 < j && up == 1)
+								best = min(best, MLBrDangleCol(i, j));
+							if (i + 1 < j - 1 && up == 2)
+								best = min(best, MLBrMismatchCol(i, j));
 						}
 					}
 					// End on coaxial stack.
@@ -596,53 +644,36 @@ librnary::energy_t librnary::NNUnpairedFolder::Fold(const PrimeStructure &primar
 						else if (up == 0)
 							best = min(best, CxFl[i][j]);
 					}
-					// bprime is the number of branches required after one has been placed.
-					int bprime = max(0, b - 1);
-					for (int k = i; k + 2 <= j; ++k) { // Try all decompositions into 5' ML fragment and 3' branch.
-						best = min(best, ML[bprime][up][i][k] + MLSSScore(k + 1, j));
-						// From here on is stacking.
-						if (stacking) {
-							if (k + 2 < j && up >= 1)
-								best = min(best, ML[bprime][up - 1][i][k] + MLSSScore(k + 2, j) +
-									em.FiveDangle(k + 2, j));
-							if (k + 1 < j - 1 && up >= 1)
-								best = min(best, ML[bprime][up - 1][i][k] + MLSSScore(k + 1, j - 1) +
-									em.ThreeDangle(k + 1, j - 1));
-							if (k + 2 < j - 1 && up >= 2)
-								best = min(best, ML[bprime][up - 2][i][k] + MLSSScore(k + 2, j - 1) +
-									em.Mismatch(k + 2, j - 1));
-							// Coaxial stack decomposition.
-							best = min(best, ML[0][up][i][k] + CxFl[k + 1][j]);
-							if (up >= 2)
-								best = min(best, ML[0][up - 2][i][k] + CxMM[k + 1][j]);
-						}
-					}
+					best = min(best, split[max(0, b - 1)]);
+					best = min(best, split_cx);
 					ML[b][up][i][j] = best;
 				}
+			}
 		}
 	}
 
 	for (int i = 1; i < N; ++i) {
 		energy_t best = E[i - 1];
-		for (int k = -1; k < i; ++k) {
+		for (int k = max(-1, i - ExteriorReach(max_span, stacking)); k < i; ++k) {
 			energy_t decomp = k == -1 ? 0 : E[k];
-			best = min(best, decomp + SSScore(k + 1, i));
+			if (InSpan(k + 1, i))
+				best = min(best, decomp + SSScore(k + 1, i));
 			if (stacking) {
-				if (k + 2 < i)
+				if (k + 2 < i && InSpan(k + 2, i))
 					best = min(best, decomp + SSScore(k + 2, i) + em.FiveDangle(k + 2, i));
-				if (k + 1 < i - 1)
+				if (k + 1 < i - 1 && InSpan(k + 1, i - 1))
 					best = min(best, decomp + SSScore(k + 1, i - 1) + em.ThreeDangle(k + 1, i - 1));
-				if (k + 2 < i - 1)
+				if (k + 2 < i - 1 && InSpan(k + 2, i - 1))
 					best = min(best, decomp + SSScore(k + 2, i - 1) + em.Mismatch(k + 2, i - 1));
 				// Coaxial stack decompositions.
-				for (int j = k + 1; j + 1 < i; ++j) {
-					if (k + 1 < j)
+				for (int j = max(k + 1, i - max_span - 3); j + 1 < i && j - k <= max_span + 3; ++j) {
+					if (k + 1 < j && InSpan(k + 1, j) && InSpan(j + 1, i))
 						best = min(best, decomp + em.FlushCoax(k + 1, j, j + 1, i)
 							+ SSScore(k + 1, j) + SSScore(j + 1, i));
-					if (k + 2 < j - 1)
+					if (k + 2 < j - 1 && InSpan(k + 2, j - 1) && InSpan(j + 1, i))
 						best = min(best, decomp + em.MismatchCoax(k + 2, j - 1, j + 1, i)
 							+ SSScore(k + 2, j - 1) + SSScore(j + 1, i));
-					if (k + 1 < j && j + 2 < i - 1)
+					if (k + 1 < j && j + 2 < i - 1 && InSpan(k + 1, j) && InSpan(j + 2, i - 1))
 						best = min(best, decomp + em.MismatchCoax(j + 2, i - 1, k + 1, j)
 							+ SSScore(k + 1, j) + SSScore(j + 2, i - 1));
 				}
@@ -655,7 +686,7 @@ librnary::energy_t librnary::NNUnpairedFolder::Fold(const PrimeStructure &primar
 }
 
 librnary::VVE librnary::NNUnpairedFolder::GetP() const {
-	return P;
+	return P.ToNested(em.MaxMFE());
 }
 
 librnary::VE librnary::NNUnpairedFolder::GetE() const {
@@ -678,10 +709,22 @@ void librnary::NNUnpairedFolder::SetMaxTwoLoop(unsigned max_up) {
 	max_twoloop_unpaired = max_up;
 }
 
+void librnary::NNUnpairedFolder::SetWorkspace(FoldWorkspace *ws) {
+	workspace = ws;
+}
+
 int librnary::NNUnpairedFolder::MaxTwoLoop() const {
 	return max_twoloop_unpaired;
 }
 
+void librnary::NNUnpairedFolder::SetMaxSpan(unsigned span) {
+	max_span = static_cast<int>(min<unsigned>(span, numeric_limits<int>::max() / 3));
+}
+
+int librnary::NNUnpairedFolder::MaxSpan() const {
+	return max_span;
+}
+
 void librnary::NNUnpairedFolder::SetLonelyPairs(bool v) {
 	lonely_pairs = v;
 }
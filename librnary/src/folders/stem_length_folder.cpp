@@ -3,6 +3,7 @@
 //
 
 #include "folders/stem_length_folder.hpp"
+#include <stdexcept>
 
 using namespace std;
 
@@ -28,16 +29,67 @@ void StemLengthFolder::SetMaxTwoLoop(unsigned max_up) {
 	max_twoloop_unpaired = max_up;
 }
 
+void StemLengthFolder::SetWorkspace(FoldWorkspace *ws) {
+	workspace = ws;
+}
+
 int StemLengthFolder::MaxTwoLoop() const {
 	return max_twoloop_unpaired;
 }
 
-librnary::energy_t StemLengthFolder::SSScore(int i, int j) const {
-	return em.Branch(i, j) + S[i][j];
+void StemLengthFolder::SetStaticDispatch(bool v) {
+	static_dispatch = v;
+}
+
+bool StemLengthFolder::StaticDispatch() const {
+	return static_dispatch;
+}
+
+void StemLengthFolder::SetEnergyOnly(bool v) {
+	energy_only = v;
 }
 
-librnary::energy_t StemLengthFolder::MLSSScore(int i, int j) const {
-	return SSScore(i, j) + em.MLBranchCost();
+bool StemLengthFolder::EnergyOnly() const {
+	return energy_only;
+}
+
+void StemLengthFolder::SetMaxSpan(unsigned span) {
+	max_span = static_cast<int>(min<unsigned>(span, numeric_limits<int>::max() / 3));
+}
+
+int StemLengthFolder::MaxSpan() const {
+	return max_span;
+}
+
+size_t StemLengthFolder::TableBytes() const {
+	size_t bytes = S.Bytes() + L.Bytes() + Cx.Bytes() + MLBrCol.Bytes() + CxCol.Bytes() + E.size() * sizeof(energy_t);
+	for (const auto &tbl : ML)
+		bytes += tbl.Bytes();
+	return bytes;
+}
+
+template<typename ModelT>
+librnary::energy_t StemLengthFolder::SSScore(const ModelT &m, int i, int j) const {
+	return m.Branch(i, j) + S[i][j];
+}
+
+template<typename ModelT>
+librnary::energy_t StemLengthFolder::MLSSScore(const ModelT &m, int i, int j) const {
+	return SSScore(m, i, j) + m.MLBranchCost();
+}
+
+template<typename ModelT>
+librnary::energy_t StemLengthFolder::MLBranchScore(const ModelT &m, int i, int j) const {
+	energy_t branch = MLSSScore(m, i, j);
+	if (stacking) {
+		if (i + 1 < j) {
+			branch = min(branch, MLSSScore(m, i + 1, j) + m.FiveDangle(i + 1, j) + m.MLUnpairedCost());
+			branch = min(branch, MLSSScore(m, i, j - 1) + m.ThreeDangle(i, j - 1) + m.MLUnpairedCost());
+		}
+		if (i + 1 < j - 1)
+			branch = min(branch, MLSSScore(m, i + 1, j - 1) + m.Mismatch(i + 1, j - 1) + m.MLUnpairedCost() * 2);
+	}
+	return branch;
 }
 
 
@@ -59,36 +111,39 @@ void StemLengthFolder::TraceE(stack<TState> &s) {
 	// Maintain best decomposition.
 	vector<TState> best_decomp = {TState(i - 1)}; // Unpaired 3'.
 	energy_t be = E[i - 1];
-	for (int k = -1; k < i; ++k) {
+	for (int k = max(-1, i - ExteriorReach(max_span, stacking)); k < i; ++k) {
 		int decomp = k == -1 ? 0 : E[k];
 		vector<TState> decomp_state;
 		if (k != -1)
 			decomp_state.emplace_back(k);
-		energy_t e = decomp + SSScore(k + 1, i);
-		if (e < be) {
-			be = e;
-			best_decomp = {TState(ST, k + 1, i)};
-			best_decomp.insert(best_decomp.end(), decomp_state.begin(), decomp_state.end());
+		energy_t e;
+		if (InSpan(k + 1, i)) {
+			e = decomp + SSScore(em, k + 1, i);
+			if (e < be) {
+				be = e;
+				best_decomp = {TState(ST, k + 1, i)};
+				best_decomp.insert(best_decomp.end(), decomp_state.begin(), decomp_state.end());
+			}
 		}
 		if (stacking) {
-			if (k + 2 < i) {
-				e = decomp + SSScore(k + 2, i) + em.FiveDangle(k + 2, i);
+			if (k + 2 < i && InSpan(k + 2, i)) {
+				e = decomp + SSScore(em, k + 2, i) + em.FiveDangle(k + 2, i);
 				if (e < be) {
 					be = e;
 					best_decomp = {TState(ST, k + 2, i)};
 					best_decomp.insert(best_decomp.end(), decomp_state.begin(), decomp_state.end());
 				}
 			}
-			if (k + 1 < i - 1) {
-				e = decomp + SSScore(k + 1, i - 1) + em.ThreeDangle(k + 1, i - 1);
+			if (k + 1 < i - 1 && InSpan(k + 1, i - 1)) {
+				e = decomp + SSScore(em, k + 1, i - 1) + em.ThreeDangle(k + 1, i - 1);
 				if (e < be) {
 					be = e;
 					best_decomp = {TState(ST, k + 1, i - 1)};
 					best_decomp.insert(best_decomp.end(), decomp_state.begin(), decomp_state.end());
 				}
 			}
-			if (k + 2 < i - 1) {
-				e = decomp + SSScore(k + 2, i - 1) + em.Mismatch(k + 2, i - 1);
+			if (k + 2 < i - 1 && InSpan(k + 2, i - 1)) {
+				e = decomp + SSScore(em, k + 2, i - 1) + em.Mismatch(k + 2, i - 1);
 				if (e < be) {
 					be = e;
 					best_decomp = {TState(ST, k + 2, i - 1)};
@@ -97,28 +152,28 @@ void StemLengthFolder::TraceE(stack<TState> &s) {
 			}
 
 			// Coaxial stack decompositions.
-			for (int j = k + 1; j + 1 < i; ++j) {
-				if (k + 1 < j) {
+			for (int j = max(k + 1, i - max_span - 3); j + 1 < i && j - k <= max_span + 3; ++j) {
+				if (k + 1 < j && InSpan(k + 1, j) && InSpan(j + 1, i)) {
 					e = decomp + em.FlushCoax(k + 1, j, j + 1, i)
-						+ SSScore(k + 1, j) + SSScore(j + 1, i);
+						+ SSScore(em, k + 1, j) + SSScore(em, j + 1, i);
 					if (e < be) {
 						be = e;
 						best_decomp = {TState(ST, k + 1, j), TState(ST, j + 1, i)};
 						best_decomp.insert(best_decomp.end(), decomp_state.begin(), decomp_state.end());
 					}
 				}
-				if (k + 2 < j - 1) {
+				if (k + 2 < j - 1 && InSpan(k + 2, j - 1) && InSpan(j + 1, i)) {
 					e = decomp + em.MismatchCoax(k + 2, j - 1, j + 1, i)
-						+ SSScore(k + 2, j - 1) + SSScore(j + 1, i);
+						+ SSScore(em, k + 2, j - 1) + SSScore(em, j + 1, i);
 					if (e < be) {
 						be = e;
 						best_decomp = {TState(ST, k + 2, j - 1), TState(ST, j + 1, i)};
 						best_decomp.insert(best_decomp.end(), decomp_state.begin(), decomp_state.end());
 					}
 				}
-				if (j + 2 < i - 1 && k + 1 < j) {
+				if (j + 2 < i - 1 && k + 1 < j && InSpan(k + 1, j) && InSpan(j + 2, i - 1)) {
 					e = decomp + em.MismatchCoax(j + 2, i - 1, k + 1, j)
-						+ SSScore(k + 1, j) + SSScore(j + 2, i - 1);
+						+ SSScore(em, k + 1, j) + SSScore(em, j + 2, i - 1);
 					if (e < be) {
 						be = e;
 						best_decomp = {TState(ST, k + 1, j), TState(ST, j + 2, i - 1)};
@@ -234,7 +289,7 @@ void StemLengthFolder::TraceL(std::stack<TState> &s) {
 			// ((_)_)
 			//    ^ <- k
 			if (k + 1 < j - 1 && i + 1 < k) {
-				e = ML[1][k + 1][j - 1] + init + em.FlushCoax(i, j, i + 1, k) + MLSSScore(i + 1, k);
+				e = ML[1][k + 1][j - 1] + init + em.FlushCoax(i, j, i + 1, k) + MLSSScore(em, i + 1, k);
 				if (e < be) {
 					be = e;
 					best_decomp = {TState(1, k + 1, j - 1), TState(ST, i + 1, k)};
@@ -242,7 +297,7 @@ void StemLengthFolder::TraceL(std::stack<TState> &s) {
 			}
 			// (.(_)_.)
 			if (i + 2 < k && k + 1 < j - 2) {
-				e = ML[1][k + 1][j - 2] + init + em.MismatchCoax(i, j, i + 2, k) + MLSSScore(i + 2, k)
+				e = ML[1][k + 1][j - 2] + init + em.MismatchCoax(i, j, i + 2, k) + MLSSScore(em, i + 2, k)
 					+ em.MLUnpairedCost() * 2;
 				if (e < be) {
 					be = e;
@@ -251,7 +306,7 @@ void StemLengthFolder::TraceL(std::stack<TState> &s) {
 			}
 			// (.(_)._)
 			if (i + 2 < k && k + 2 < j - 1) {
-				e = ML[1][k + 2][j - 1] + init + em.MismatchCoax(i + 2, k, i, j) + MLSSScore(i + 2, k)
+				e = ML[1][k + 2][j - 1] + init + em.MismatchCoax(i + 2, k, i, j) + MLSSScore(em, i + 2, k)
 					+ em.MLUnpairedCost() * 2;
 				if (e < be) {
 					be = e;
@@ -262,7 +317,7 @@ void StemLengthFolder::TraceL(std::stack<TState> &s) {
 			// (_(_))
 			//   ^ <- k
 			if (i + 1 < k - 1 && k < j - 1) {
-				e = ML[1][i + 1][k - 1] + init + em.FlushCoax(i, j, k, j - 1) + MLSSScore(k, j - 1);
+				e = ML[1][i + 1][k - 1] + init + em.FlushCoax(i, j, k, j - 1) + MLSSScore(em, k, j - 1);
 				if (e < be) {
 					be = e;
 					best_decomp = {TState(1, i + 1, k - 1), TState(ST, k, j - 1)};
@@ -270,7 +325,7 @@ void StemLengthFolder::TraceL(std::stack<TState> &s) {
 			}
 			// (._(_).)
 			if (k < j - 2 && i + 2 < k - 1) {
-				e = ML[1][i + 2][k - 1] + init + em.MismatchCoax(i, j, k, j - 2) + MLSSScore(k, j - 2)
+				e = ML[1][i + 2][k - 1] + init + em.MismatchCoax(i, j, k, j - 2) + MLSSScore(em, k, j - 2)
 					+ em.MLUnpairedCost() * 2;
 				if (e < be) {
 					be = e;
@@ -279,7 +334,7 @@ void StemLengthFolder::TraceL(std::stack<TState> &s) {
 			}
 			// (_.(_).)
 			if (k < j - 2 && i + 1 < k - 2) {
-				e = ML[1][i + 1][k - 2] + init + em.MismatchCoax(k, j - 2, i, j) + MLSSScore(k, j - 2)
+				e = ML[1][i + 1][k - 2] + init + em.MismatchCoax(k, j - 2, i, j) + MLSSScore(em, k, j - 2)
 					+ em.MLUnpairedCost() * 2;
 				if (e < be) {
 					be = e;
@@ -325,13 +380,13 @@ void StemLengthFolder::TraceCx(std::stack<TState> &s) {
 	energy_t be = em.MaxMFE(), e;
 
 	for (int k = i + 1; k + 1 < j; ++k) {
-		e = em.FlushCoax(i, k, k + 1, j) + MLSSScore(i, k) + MLSSScore(k + 1, j);
+		e = em.FlushCoax(i, k, k + 1, j) + MLSSScore(em, i, k) + MLSSScore(em, k + 1, j);
 		if (e < be) {
 			be = e;
 			best_decomp = {TState(ST, i, k), TState(ST, k + 1, j)};
 		}
 		if (i + 1 < k - 1) {
-			e = em.MismatchCoax(i + 1, k - 1, k + 1, j) + MLSSScore(i + 1, k - 1) + MLSSScore(k + 1, j)
+			e = em.MismatchCoax(i + 1, k - 1, k + 1, j) + MLSSScore(em, i + 1, k - 1) + MLSSScore(em, k + 1, j)
 				+ em.MLUnpairedCost() * 2;
 			if (e < be) {
 				be = e;
@@ -339,7 +394,7 @@ void StemLengthFolder::TraceCx(std::stack<TState> &s) {
 			}
 		}
 		if (k + 2 < j - 1) {
-			e = em.MismatchCoax(k + 2, j - 1, i, k) + MLSSScore(i, k) + MLSSScore(k + 2, j - 1)
+			e = em.MismatchCoax(k + 2, j - 1, i, k) + MLSSScore(em, i, k) + MLSSScore(em, k + 2, j - 1)
 				+ em.MLUnpairedCost() * 2;
 			if (e < be) {
 				be = e;
@@ -373,26 +428,26 @@ void StemLengthFolder::TraceML(std::stack<TState> &s) {
 	energy_t be = ML[b][i][j - 1] + em.MLUnpairedCost(), e;
 
 	if (b < 2) { // End on branch cases.
-		e = MLSSScore(i, j);
+		e = MLSSScore(em, i, j);
 		if (e < be) {
 			be = e;
 			best_decomp = {TState(ST, i, j)};
 		}
 		if (stacking) {
 			if (i + 1 < j) {
-				e = MLSSScore(i + 1, j) + em.FiveDangle(i + 1, j) + em.MLUnpairedCost();
+				e = MLSSScore(em, i + 1, j) + em.FiveDangle(i + 1, j) + em.MLUnpairedCost();
 				if (e < be) {
 					be = e;
 					best_decomp = {TState(ST, i + 1, j)};
 				}
-				e = MLSSScore(i, j - 1) + em.ThreeDangle(i, j - 1) + em.MLUnpairedCost();
+				e = MLSSScore(em, i, j - 1) + em.ThreeDangle(i, j - 1) + em.MLUnpairedCost();
 				if (e < be) {
 					be = e;
 					best_decomp = {TState(ST, i, j - 1)};
 				}
 			}
 			if (i + 1 < j - 1) {
-				e = MLSSScore(i + 1, j - 1) + em.Mismatch(i + 1, j - 1) + em.MLUnpairedCost() * 2;
+				e = MLSSScore(em, i + 1, j - 1) + em.Mismatch(i + 1, j - 1) + em.MLUnpairedCost() * 2;
 				if (e < be) {
 					be = e;
 					best_decomp = {TState(ST, i + 1, j - 1)};
@@ -411,7 +466,7 @@ void StemLengthFolder::TraceML(std::stack<TState> &s) {
 	// bprime is the number of branches required after one has been placed.
 	int bprime = max(0, b - 1);
 	for (int k = i; k + 2 <= j; ++k) { // Try all decompositions into 5' ML fragment and 3' branch.
-		e = ML[bprime][i][k] + MLSSScore(k + 1, j);
+		e = ML[bprime][i][k] + MLSSScore(em, k + 1, j);
 		if (e < be) {
 			be = e;
 			best_decomp = {TState(bprime, i, k), TState(ST, k + 1, j)};
@@ -419,21 +474,21 @@ void StemLengthFolder::TraceML(std::stack<TState> &s) {
 		// From here on is stacking.
 		if (stacking) {
 			if (k + 2 < j) {
-				e = ML[bprime][i][k] + MLSSScore(k + 2, j) + em.FiveDangle(k + 2, j) + em.MLUnpairedCost();
+				e = ML[bprime][i][k] + MLSSScore(em, k + 2, j) + em.FiveDangle(k + 2, j) + em.MLUnpairedCost();
 				if (e < be) {
 					be = e;
 					best_decomp = {TState(bprime, i, k), TState(ST, k + 2, j)};
 				}
 			}
 			if (k + 1 < j - 1) {
-				e = ML[bprime][i][k] + MLSSScore(k + 1, j - 1) + em.ThreeDangle(k + 1, j - 1) + em.MLUnpairedCost();
+				e = ML[bprime][i][k] + MLSSScore(em, k + 1, j - 1) + em.ThreeDangle(k + 1, j - 1) + em.MLUnpairedCost();
 				if (e < be) {
 					be = e;
 					best_decomp = {TState(bprime, i, k), TState(ST, k + 1, j - 1)};
 				}
 			}
 			if (k + 2 < j - 1) {
-				e = ML[bprime][i][k] + MLSSScore(k + 2, j - 1) + em.Mismatch(k + 2, j - 1) + em.MLUnpairedCost() * 2;
+				e = ML[bprime][i][k] + MLSSScore(em, k + 2, j - 1) + em.Mismatch(k + 2, j - 1) + em.MLUnpairedCost() * 2;
 				if (e < be) {
 					be = e;
 					best_decomp = {TState(bprime, i, k), TState(ST, k + 2, j - 1)};
@@ -456,6 +511,8 @@ void StemLengthFolder::TraceML(std::stack<TState> &s) {
 
 
 librnary::Matching StemLengthFolder::Traceback() {
+	if (energy_only) // The multi-loop tables no longer hold every row.
+		throw logic_error("Traceback after an energy-only fold");
 	const int N = static_cast<int>(rna.size());
 	Matching m = EmptyMatching(static_cast<unsigned>(rna.size()));
 	if (N == 0) {
@@ -495,44 +552,67 @@ librnary::energy_t StemLengthFolder::Fold(const PrimeStructure &_rna) {
 		return 0;
 	}
 
-	// Clear the DP tables.
-	S.clear();
-	L.clear();
-	ML.clear();
-	Cx.clear();
-	E.clear();
-
 	// Initialize the DP tables.
-	S.resize(RSZ, VE(RSZ, em.MaxMFE()));
-	Cx = L = S;
-	ML.resize(3, VVE(RSZ, VE(RSZ, em.MaxMFE())));
-	E.resize(RSZ, 0);
+	if (workspace != nullptr)
+		workspace->Rewind();
+	// Cells (i,j) are only needed for j - i <= max_span.
+	const size_t band = static_cast<size_t>(max_span) + 1;
+	PrepareTable(workspace, S, RSZ, em.MaxMFE(), band);
+	PrepareTable(workspace, L, RSZ, em.MaxMFE(), band);
+	PrepareTable(workspace, Cx, RSZ, em.MaxMFE(), band);
+	if (energy_only) {
+		// The shadows would take as much memory as the tables they mirror.
+		MLBrCol.Clear();
+		CxCol.Clear();
+	} else {
+		PrepareTable(workspace, MLBrCol, RSZ, em.MaxMFE(), band);
+		PrepareTable(workspace, CxCol, RSZ, em.MaxMFE(), band);
+	}
+	ML.resize(3);
+	const size_t ml_windows[3] = {energy_only ? 1 : RSZ, RSZ, energy_only ? 3 : RSZ};
+	for (int b = 0; b < 3; ++b)
+		PrepareTable(workspace, ML[b], RSZ, ml_windows[b], em.MaxMFE(), band);
+	E.assign(RSZ, 0);
+
+	if (static_dispatch)
+		return Fill(DevirtualizedModel<StemLengthModel>(em));
+	return Fill(em);
+}
+
+template<typename ModelT>
+librnary::energy_t StemLengthFolder::Fill(const ModelT &m) {
+	const auto N = static_cast<int>(rna.size());
 
 	// Special base for for ML. End on a single unpaired.
 	for (int i = 0; i < N; ++i)
-		ML[0][i][i] = em.MLUnpairedCost();
+		ML[0][i][i] = m.MLUnpairedCost();
 
 	for (int i = N - 2; i >= 0; --i) { // i is 5' nucleotide.
-		for (int j = i + 1; j < N; ++j) { // j is 3' nucleotide.
+		// Windowed tables hand row i the storage of a row that can no longer be read.
+		for (auto &tbl : ML)
+			if (tbl.Windowed())
+				tbl.ResetRow(i, m.MaxMFE());
+		ML[0][i][i] = m.MLUnpairedCost();
+		for (int j = i + 1; j < N && InSpan(i, j); ++j) { // j is 3' nucleotide.
 			if (ValidPair(rna[i], rna[j]) &&
-				(lonely_pairs || !MustBeLonelyPair(rna, i, j, em.MIN_HAIRPIN_UNPAIRED))) {
+				(lonely_pairs || !MustBeLonelyPair(rna, i, j, m.MIN_HAIRPIN_UNPAIRED))) {
 				// The L (Loop) table.
-				energy_t best = em.OneLoop(i, j); // Hairpin.
+				energy_t best = m.OneLoop(i, j); // Hairpin.
 				// Multi-loops.
-				int init = em.MLInitCost() + em.Branch(i, j) + em.MLBranchCost();
+				int init = m.MLInitCost() + m.Branch(i, j) + m.MLBranchCost();
 				// No stacking interactions
 				best = min(best, init + ML[2][i + 1][j - 1]);
 				// Try stacking interactions with closing branch.
 				if (stacking) {
 					if (i + 2 < j - 1) // Left dangle.
 						best = min(best,
-								   init + ML[2][i + 2][j - 1] + em.ClosingThreeDangle(i, j) + em.MLUnpairedCost());
+								   init + ML[2][i + 2][j - 1] + m.ClosingThreeDangle(i, j) + m.MLUnpairedCost());
 					if (i + 1 < j - 2) // Right dangle.
 						best = min(best,
-								   init + ML[2][i + 1][j - 2] + em.ClosingFiveDangle(i, j) + em.MLUnpairedCost());
+								   init + ML[2][i + 1][j - 2] + m.ClosingFiveDangle(i, j) + m.MLUnpairedCost());
 					if (i + 2 < j - 2) // Mismatch.
 						best = min(best,
-								   init + ML[2][i + 2][j - 2] + em.ClosingMismatch(i, j) + em.MLUnpairedCost() * 2);
+								   init + ML[2][i + 2][j - 2] + m.ClosingMismatch(i, j) + m.MLUnpairedCost() * 2);
 					// Coaxial stack.
 					for (int k = i + 1; k < j; ++k) {
 						// Five prime.
@@ -540,35 +620,35 @@ librnary::energy_t StemLengthFolder::Fold(const PrimeStructure &_rna) {
 						//    ^ <- k
 						if (k + 1 < j - 1 && i + 1 < k)
 							best = min(best,
-									   ML[1][k + 1][j - 1] + init + em.FlushCoax(i, j, i + 1, k)
-										   + MLSSScore(i + 1, k));
+									   ML[1][k + 1][j - 1] + init + m.FlushCoax(i, j, i + 1, k)
+										   + MLSSScore(m, i + 1, k));
 						// (.(_)_.)
 						if (i + 2 < k && k + 1 < j - 2)
 							best = min(best,
-									   ML[1][k + 1][j - 2] + init + em.MismatchCoax(i, j, i + 2, k)
-										   + MLSSScore(i + 2, k) + em.MLUnpairedCost() * 2);
+									   ML[1][k + 1][j - 2] + init + m.MismatchCoax(i, j, i + 2, k)
+										   + MLSSScore(m, i + 2, k) + m.MLUnpairedCost() * 2);
 						// (.(_)._)
 						if (i + 2 < k && k + 2 < j - 1)
 							best = min(best,
-									   ML[1][k + 2][j - 1] + init + em.MismatchCoax(i + 2, k, i, j)
-										   + MLSSScore(i + 2, k) + em.MLUnpairedCost() * 2);
+									   ML[1][k + 2][j - 1] + init + m.MismatchCoax(i + 2, k, i, j)
+										   + MLSSScore(m, i + 2, k) + m.MLUnpairedCost() * 2);
 						// Three prime.
 						// (_(_))
 						//   ^ <- k
 						if (i + 1 < k - 1 && k < j - 1)
 							best = min(best,
-									   ML[1][i + 1][k - 1] + init + em.FlushCoax(i, j, k, j - 1)
-										   + MLSSScore(k, j - 1));
+									   ML[1][i + 1][k - 1] + init + m.FlushCoax(i, j, k, j - 1)
+										   + MLSSScore(m, k, j - 1));
 						// (._(_).)
 						if (k < j - 2 && i + 2 < k - 1)
 							best = min(best,
-									   ML[1][i + 2][k - 1] + init + em.MismatchCoax(i, j, k, j - 2)
-										   + MLSSScore(k, j - 2) + em.MLUnpairedCost() * 2);
+									   ML[1][i + 2][k - 1] + init + m.MismatchCoax(i, j, k, j - 2)
+										   + MLSSScore(m, k, j - 2) + m.MLUnpairedCost() * 2);
 						// (_.(_).)
 						if (k < j - 2 && i + 1 < k - 2)
 							best = min(best,
-									   ML[1][i + 1][k - 2] + init + em.MismatchCoax(k, j - 2, i, j)
-										   + MLSSScore(k, j - 2) + em.MLUnpairedCost() * 2);
+									   ML[1][i + 1][k - 2] + init + m.MismatchCoax(k, j - 2, i, j)
+										   + MLSSScore(m, k, j - 2) + m.MLUnpairedCost() * 2);
 					}
 				}
 				// Two loops for the two-loops (bulge or internal loop).
@@ -579,20 +659,20 @@ librnary::energy_t StemLengthFolder::Fold(const PrimeStructure &_rna) {
 						if ((k - i - 1) + (j - l - 1) <= 0) {
 							continue;
 						}
-						best = min(best, S[k][l] + em.TwoLoop(i, k, l, j));
+						best = min(best, S[k][l] + m.TwoLoop(i, k, l, j));
 					}
 				}
 				L[i][j] = best;
 
 				// Now the S (Stacking) table.
-				best = em.MaxMFE();
+				best = m.MaxMFE();
 				// Try all helices.
 				int ip = i, jp = j, sz = 1;
 				energy_t fe = 0;
 				while (ip < jp && ValidPair(rna[ip], rna[jp])) {
-					best = min(best, fe + L[ip][jp] + em.StemLengthCost(sz));
+					best = min(best, fe + L[ip][jp] + m.StemLengthCost(sz));
 					if (ip + 1 < jp - 1)
-						fe += em.TwoLoop(ip, ip + 1, jp - 1, jp);
+						fe += m.TwoLoop(ip, ip + 1, jp - 1, jp);
 					++sz;
 					++ip;
 					--jp;
@@ -601,61 +681,58 @@ librnary::energy_t StemLengthFolder::Fold(const PrimeStructure &_rna) {
 			}
 
 			// Fill the coaxial stack table if stacking is enabled.
-			energy_t best = em.MaxMFE();
+			energy_t best = m.MaxMFE();
 			for (int k = i + 1; k + 1 < j && stacking; ++k) {
-				best = min(best, em.FlushCoax(i, k, k + 1, j) + MLSSScore(i, k) + MLSSScore(k + 1, j));
+				best = min(best, m.FlushCoax(i, k, k + 1, j) + MLSSScore(m, i, k) + MLSSScore(m, k + 1, j));
 				if (i + 1 < k - 1)
 					best = min(best,
-							   em.MismatchCoax(i + 1, k - 1, k + 1, j) + MLSSScore(i + 1, k - 1) + MLSSScore(k + 1, j)
-								   + em.MLUnpairedCost() * 2);
+							   m.MismatchCoax(i + 1, k - 1, k + 1, j) + MLSSScore(m, i + 1, k - 1) + MLSSScore(m, k + 1, j)
+								   + m.MLUnpairedCost() * 2);
 				if (k + 2 < j - 1)
 					best = min(best,
-							   em.MismatchCoax(k + 2, j - 1, i, k) + MLSSScore(i, k) + MLSSScore(k + 2, j - 1)
-								   + em.MLUnpairedCost() * 2);
+							   m.MismatchCoax(k + 2, j - 1, i, k) + MLSSScore(m, i, k) + MLSSScore(m, k + 2, j - 1)
+								   + m.MLUnpairedCost() * 2);
 			}
 			Cx[i][j] = best;
 
-			for (int b = 0; b < 3; ++b) { // b is the branches needed for valid ML.
-				best = ML[b][i][j - 1] + em.MLUnpairedCost();
-				if (b < 2) { // End on branch cases.
-					best = min(best, MLSSScore(i, j));
-					if (stacking) {
-						if (i + 1 < j) {
-							best = min(best, MLSSScore(i + 1, j) + em.FiveDangle(i + 1, j) + em.MLUnpairedCost());
-							best = min(best, MLSSScore(i, j - 1) + em.ThreeDangle(i, j - 1) + em.MLUnpairedCost());
-						}
-						if (i + 1 < j - 1) {
-							best = min(best,
-									   MLSSScore(i + 1, j - 1) + em.Mismatch(i + 1, j - 1) + em.MLUnpairedCost() * 2);
-						}
-					}
+			// The end on branch cases.
+			const energy_t branch = MLBranchScore(m, i, j);
+
+			// Try all decompositions into 5' ML fragment and 3' branch, as NNAffineFolder does.
+			const energy_t none = numeric_limits<energy_t>::max();
+			energy_t split0 = none, split1 = none, split_cx = none;
+			if (energy_only) {
+				// Energy-only folds keep no shadows, so each k is tried in turn.
+				for (int k = i; k + 2 <= j; ++k) {
+					const energy_t br = MLBranchScore(m, k + 1, j);
+					split0 = min(split0, ML[0][i][k] + br);
+					split1 = min(split1, ML[1][i][k] + br);
+					// Coaxial stack decomposition.
+					if (stacking)
+						split_cx = min(split_cx, ML[0][i][k] + Cx[k + 1][j]);
 				}
+			} else {
+				// Min-plus products of a row of ML and a column of the shadows.
+				CxCol(i, j) = Cx[i][j];
+				MLBrCol(i, j) = branch;
+				const int splits = j - 1 - i;
+				split0 = MinPlus(&ML[0][i][i], &MLBrCol(i + 1, j), splits, none);
+				split1 = MinPlus(&ML[1][i][i], &MLBrCol(i + 1, j), splits, none);
+				// Coaxial stack decomposition.
+				if (stacking)
+					split_cx = MinPlus(&ML[0][i][i], &CxCol(i + 1, j), splits, none);
+			}
+			for (int b = 0; b < 3; ++b) { // b is the branches needed for valid ML.
+				best = ML[b][i][j - 1] + m.MLUnpairedCost();
+				if (b < 2) // End on branch cases.
+					best = min(best, branch);
 				// End on coaxial stack.
 				if (stacking) {
 					best = min(best, Cx[i][j]);
 				}
-				// bprime is the number of branches required after one has been placed.
-				int bprime = max(0, b - 1);
-				for (int k = i; k + 2 <= j; ++k) { // Try all decompositions into 5' ML fragment and 3' branch.
-					best = min(best, ML[bprime][i][k] + MLSSScore(k + 1, j));
-					// From here on is stacking.
-					if (stacking) {
-						if (k + 2 < j)
-							best = min(best,
-									   ML[bprime][i][k] + MLSSScore(k + 2, j) + em.FiveDangle(k + 2, j)
-										   + em.MLUnpairedCost());
-						if (k + 1 < j - 1)
-							best = min(best,
-									   ML[bprime][i][k] + MLSSScore(k + 1, j - 1) + em.ThreeDangle(k + 1, j - 1)
-										   + em.MLUnpairedCost());
-						if (k + 2 < j - 1)
-							best = min(best,
-									   ML[bprime][i][k] + MLSSScore(k + 2, j - 1) + em.Mismatch(k + 2, j - 1)
-										   + em.MLUnpairedCost() * 2);
-						// Coaxial stack decomposition.
-						best = min(best, ML[0][i][k] + Cx[k + 1][j]);
-					}
-				}
+				// bprime = max(0, b - 1) is the number of branches required after one has been placed.
+				best = min(best, b < 2 ? split0 : split1);
+				best = min(best, split_cx);
 				ML[b][i][j] = best;
 			}
 		}
@@ -664,27 +741,28 @@ librnary::energy_t StemLengthFolder::Fold(const PrimeStructure &_rna) {
 
 	for (int i = 1; i < N; ++i) {
 		energy_t best = E[i - 1];
-		for (int k = -1; k < i; ++k) {
+		for (int k = max(-1, i - ExteriorReach(max_span, stacking)); k < i; ++k) {
 			energy_t decomp = k == -1 ? 0 : E[k];
-			best = min(best, decomp + SSScore(k + 1, i));
+			if (InSpan(k + 1, i))
+				best = min(best, decomp + SSScore(m, k + 1, i));
 			if (stacking) {
-				if (k + 2 < i)
-					best = min(best, decomp + SSScore(k + 2, i) + em.FiveDangle(k + 2, i));
-				if (k + 1 < i - 1)
-					best = min(best, decomp + SSScore(k + 1, i - 1) + em.ThreeDangle(k + 1, i - 1));
-				if (k + 2 < i - 1)
-					best = min(best, decomp + SSScore(k + 2, i - 1) + em.Mismatch(k + 2, i - 1));
+				if (k + 2 < i && InSpan(k + 2, i))
+					best = min(best, decomp + SSScore(m, k + 2, i) + m.FiveDangle(k + 2, i));
+				if (k + 1 < i - 1 && InSpan(k + 1, i - 1))
+					best = min(best, decomp + SSScore(m, k + 1, i - 1) + m.ThreeDangle(k + 1, i - 1));
+				if (k + 2 < i - 1 && InSpan(k + 2, i - 1))
+					best = min(best, decomp + SSScore(m, k + 2, i - 1) + m.Mismatch(k + 2, i - 1));
 				// Coaxial stack decompositions.
-				for (int j = k + 1; j + 1 < i; ++j) {
-					if (k + 1 < j)
-						best = min(best, decomp + em.FlushCoax(k + 1, j, j + 1, i)
-							+ SSScore(k + 1, j) + SSScore(j + 1, i));
-					if (k + 2 < j - 1)
-						best = min(best, decomp + em.MismatchCoax(k + 2, j - 1, j + 1, i)
-							+ SSScore(k + 2, j - 1) + SSScore(j + 1, i));
-					if (k + 1 < j && j + 2 < i - 1)
-						best = min(best, decomp + em.MismatchCoax(j + 2, i - 1, k + 1, j)
-							+ SSScore(k + 1, j) + SSScore(j + 2, i - 1));
+				for (int j = max(k + 1, i - max_span - 3); j + 1 < i && j - k <= max_span + 3; ++j) {
+					if (k + 1 < j && InSpan(k + 1, j) && InSpan(j + 1, i))
+						best = min(best, decomp + m.FlushCoax(k + 1, j, j + 1, i)
+							+ SSScore(m, k + 1, j) + SSScore(m, j + 1, i));
+					if (k + 2 < j - 1 && InSpan(k + 2, j - 1) && InSpan(j + 1, i))
+						best = min(best, decomp + m.MismatchCoax(k + 2, j - 1, j + 1, i)
+							+ SSScore(m, k + 2, j - 1) + SSScore(m, j + 1, i));
+					if (k + 1 < j && j + 2 < i - 1 && InSpan(k + 1, j) && InSpan(j + 2, i - 1))
+						best = min(best, decomp + m.MismatchCoax(j + 2, i - 1, k + 1, j)
+							+ SSScore(m, k + 1, j) + SSScore(m, j + 2, i - 1));
 				}
 			}
 		}
@@ -6,7 +6,7 @@
 
 using namespace std;
 
-librnary::energy_t librnary::AalbertsModel::MLInit(int N, int M) const {
+librnary::energy_t librnary::AalbertsModel::ComputeMLInit(int N, int M) const {
 	// log_mult*ln(N^(6/5)*a^2 + M^(6/5)*b^2) + C
 	// Multiply by ten to get tenths of kcal/mol.
 	// Be careful to round AFTER this.
@@ -38,30 +38,35 @@ librnary::energy_t librnary::AalbertsModel::MLClosure(const librnary::Surface &s
 }
 void librnary::AalbertsModel::SetLogMultiplier(librnary::kcalmol_t v) {
 	log_mult = v;
+	InvalidateMLInitTable();
 }
 librnary::kcalmol_t librnary::AalbertsModel::LogMultiplier() const {
 	return log_mult;
 }
 void librnary::AalbertsModel::SetAdditiveConstant(librnary::kcalmol_t v) {
 	C = v;
+	InvalidateMLInitTable();
 }
 librnary::kcalmol_t librnary::AalbertsModel::AdditiveConstant() const {
 	return C;
 }
 void librnary::AalbertsModel::SetNCoeffBase(librnary::kcalmol_t v) {
 	a = v;
+	InvalidateMLInitTable();
 }
 double librnary::AalbertsModel::NCoeffBase() const {
 	return a;
 }
 void librnary::AalbertsModel::SetMCoeffBase(double v) {
 	b = v;
+	InvalidateMLInitTable();
 }
 double librnary::AalbertsModel::MCoeffBase() const {
 	return b;
 }
 void librnary::AalbertsModel::SetPower(double v) {
 	power = v;
+	InvalidateMLInitTable();
 }
 double librnary::AalbertsModel::Power() const {
 	return power;
@@ -76,4 +81,39 @@ void librnary::AalbertsModel::SetMLParams(librnary::kcalmol_t _log_mult,
 	this->a = _a;
 	this->b = _b;
 	this->power = _power;
+	InvalidateMLInitTable();
+}
+
+void librnary::AalbertsModel::SetRNA(const librnary::PrimeStructure &primary) {
+	NNModel::SetRNA(primary);
+	GrowMLInitTable(static_cast<int>(primary.size()));
+}
+
+void librnary::AalbertsModel::GrowMLInitTable(int n) {
+	if (!use_ml_init_table || (n + 2 <= ml_init_rows && n / 2 + 2 <= ml_init_cols))
+		return;
+	ml_init_rows = max(ml_init_rows, n + 2);
+	ml_init_cols = max(ml_init_cols, n / 2 + 2);
+	ml_init_table.resize(static_cast<size_t>(ml_init_rows) * ml_init_cols);
+	for (int N = 0; N < ml_init_rows; ++N)
+		for (int M = 0; M < ml_init_cols; ++M)
+			ml_init_table[N * ml_init_cols + M] = ComputeMLInit(N, M);
+}
+
+void librnary::AalbertsModel::InvalidateMLInitTable() {
+	ml_init_rows = ml_init_cols = 0;
+}
+
+void librnary::AalbertsModel::SetMLInitTable(bool v) {
+	use_ml_init_table = v;
+	if (use_ml_init_table) {
+		GrowMLInitTable(static_cast<int>(rna.size()));
+	} else {
+		InvalidateMLInitTable();
+		ml_init_table.clear();
+	}
+}
+
+bool librnary::AalbertsModel::MLInitTable() const {
+	return use_ml_init_table;
 }
\ No newline at end of file
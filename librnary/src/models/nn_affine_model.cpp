@@ -20,18 +20,6 @@ librnary::energy_t librnary::NNAffineModel::MLClosure(int branches, int unpaired
 }
 
 
-librnary::energy_t librnary::NNAffineModel::MLInitCost() const {
-	return ml_init;
-}
-
-librnary::energy_t librnary::NNAffineModel::MLBranchCost() const {
-	return ml_branch;
-}
-
-librnary::energy_t librnary::NNAffineModel::MLUnpairedCost() const {
-	return ml_unpiared;
-}
-
 void librnary::NNAffineModel::SetMLInitCost(librnary::energy_t v) {
 	ml_init = v;
 }
@@ -4,8 +4,11 @@
 
 #include "models/nn_model.hpp"
 
+#include <cmath>
+
 using namespace std;
 
+
 librnary::energy_t librnary::NNModel::OneLoop(int i, int j) const {
 	assert(i < j);
 	assert(ValidPair(rna[i], rna[j]));
@@ -16,18 +19,24 @@ librnary::energy_t librnary::NNModel::OneLoop(int i, int j) const {
 
 librnary::energy_t librnary::NNModel::TwoLoop(int i, int k, int l, int j) const {
 	assert(i < j && k < l && i < k && l < j);
+	if (compiled)
+		return CompiledTwoLoop(i, k, l, j);
 	if (k == i + 1 && l == j - 1)
 		return erg1(i + 1, j + 1, k + 1, l + 1, struc.get(), dt.get());
 	return erg2(i + 1, j + 1, k + 1, l + 1, struc.get(), dt.get(), 0, 0);
 }
 
 librnary::energy_t librnary::NNModel::Branch(int i, int j) const {
+	if (compiled)
+		return CompiledBranch(i, j);
 	return penalty(i + 1, j + 1, struc.get(), dt.get());
 }
 
 
 librnary::energy_t librnary::NNModel::FlushCoax(int i, int j, int k, int l) const {
 	assert(i < j && k < l && (k == j + 1 || k == i + 1 || l == j - 1));
+	if (compiled)
+		return CompiledFlushCoax(i, j, k, l);
 	if (i < k && l < j) // i,j close a multi-loop.
 		return erg1(i + 1, j + 1, k + 1, l + 1, struc.get(), dt.get());
 	return erg1(j + 1, i + 1, k + 1, l + 1, struc.get(), dt.get());
@@ -35,6 +44,8 @@ librnary::energy_t librnary::NNModel::FlushCoax(int i, int j, int k, int l) cons
 
 librnary::energy_t librnary::NNModel::MismatchCoax(int i, int j, int k, int l) const {
 	assert(i < j && k < l && (abs(i - k) == 2 || abs(i - l) == 2 || abs(j - k) == 2 || abs(j - l) == 2));
+	if (compiled)
+		return CompiledMismatchCoax(i, j, k, l);
 	// i,j is mismatched stacked with k,l
 	// Mismatch is off i,j
 	i += 1;
@@ -61,37 +72,86 @@ librnary::energy_t librnary::NNModel::MismatchCoax(int i, int j, int k, int l) c
 
 librnary::energy_t librnary::NNModel::FiveDangle(int i, int j) const {
 	assert(i < j && i > 0);
+	if (compiled)
+		return CompiledFiveDangle(i, j);
 	return erg4(j + 1, i + 1, i, 2, struc.get(), dt.get(), false);
 }
 
 librnary::energy_t librnary::NNModel::ClosingFiveDangle(int i, int j) const {
 	assert(i < j);
+	if (compiled)
+		return CompiledClosingFiveDangle(i, j);
 	return erg4(i + 1, j + 1, j, 2, struc.get(), dt.get(), false);
 }
 
 librnary::energy_t librnary::NNModel::ThreeDangle(int i, int j) const {
 	assert(i < j && j + 1 < static_cast<int>(rna.size()));
+	if (compiled)
+		return CompiledThreeDangle(i, j);
 	return erg4(j + 1, i + 1, j + 2, 1, struc.get(), dt.get(), false);
 }
 
 librnary::energy_t librnary::NNModel::ClosingThreeDangle(int i, int j) const {
 	assert(i < j);
+	if (compiled)
+		return CompiledClosingThreeDangle(i, j);
 	return erg4(i + 1, j + 1, i + 2, 1, struc.get(), dt.get(), false);
 }
 
 librnary::energy_t librnary::NNModel::Mismatch(int i, int j) const {
 	assert(i < j);
+	if (compiled)
+		return CompiledMismatch(i, j);
 	return dt->tstkm[struc->numseq[j + 1]][struc->numseq[i + 1]][struc->numseq[j + 2]][struc->numseq[i]];
 }
 
 librnary::energy_t librnary::NNModel::ClosingMismatch(int i, int j) const {
 	assert(i < j);
+	if (compiled)
+		return CompiledClosingMismatch(i, j);
 	return dt->tstkm[struc->numseq[i + 1]][struc->numseq[j + 1]][struc->numseq[i + 2]][struc->numseq[j]];
 }
 
 void librnary::NNModel::SetRNA(const librnary::PrimeStructure &primary) {
 	this->rna = primary;
 	this->struc = librnary::LoadStructure(rna);
+	if (compiled)
+		Compile();
+}
+
+void librnary::NNModel::SetBase(int i, Base b) {
+	assert(i >= 0 && i < static_cast<int>(rna.size()));
+	rna[i] = b;
+	if (struc.use_count() > 1)
+		struc = librnary::LoadStructure(rna);
+	else
+		librnary::SetStructureBase(*struc, i, b);
+	if (compiled)
+		codes[i + 1] = struc->numseq[i + 1];
+}
+
+void librnary::NNModel::SetCompiled(bool v) {
+	compiled = v;
+	if (compiled && struc != nullptr)
+		Compile();
+}
+
+bool librnary::NNModel::Compiled() const {
+	return compiled;
+}
+
+void librnary::NNModel::Compile() {
+	const auto n = static_cast<int>(rna.size());
+	codes.assign(static_cast<size_t>(n + 2), 0);
+	for (int k = 1; k <= n; ++k)
+		codes[k] = struc->numseq[k];
+	// The expressions below are copied from erg2 so the rounding is identical.
+	loginc.assign(static_cast<size_t>(n + 1), 0);
+	for (int size = 31; size <= n; ++size)
+		loginc[size] = int((dt->prelog) * log(double((size) / 30.0)));
+	bulge_states.assign(static_cast<size_t>(n + 2), 0);
+	for (int count = 1; count <= n + 1; ++count)
+		bulge_states[count] = (int) round(dt->RT * conversionfactor * log((double) count));
 }
 
 librnary::PrimeStructure librnary::NNModel::RNA() const {
@@ -8,9 +8,6 @@ librnary::energy_t librnary::NNUnpairedModel::MLBranchCost() const {
 	return ml_br_cost;
 }
 
-librnary::energy_t librnary::NNUnpairedModel::MLClosure(int unpaired) const {
-	return MLClosure(unpaired, 0);
-}
 librnary::energy_t librnary::NNUnpairedModel::MLClosure(int unpaired, int branches) const {
 	assert(branches >= 0);
 	assert(unpaired >= 0);
@@ -43,6 +40,7 @@ void librnary::NNUnpairedModel::SetMLParams(librnary::energy_t _ml_init,
 	this->ml_up_cost = _ml_up_cost;
 	this->ml_log_mult = _ml_log_mult;
 	this->ml_up_pivot = _ml_up_pivot;
+	InvalidateMLClosureTable();
 }
 
 librnary::energy_t librnary::NNUnpairedModel::MLInitConstant() const {
@@ -50,27 +48,47 @@ librnary::energy_t librnary::NNUnpairedModel::MLInitConstant() const {
 }
 void librnary::NNUnpairedModel::SetMLInitConstant(librnary::energy_t v) {
 	NNUnpairedModel::ml_init = v;
+	InvalidateMLClosureTable();
 }
 void librnary::NNUnpairedModel::SetMLBranchCost(librnary::energy_t v) {
 	NNUnpairedModel::ml_br_cost = v;
+	InvalidateMLClosureTable();
 }
 librnary::energy_t librnary::NNUnpairedModel::MLUnpairedCost() const {
 	return ml_up_cost;
 }
 void librnary::NNUnpairedModel::SetMLUnpairedCost(librnary::energy_t v) {
 	NNUnpairedModel::ml_up_cost = v;
+	InvalidateMLClosureTable();
 }
 librnary::kcalmol_t librnary::NNUnpairedModel::MLLogMultiplier() const {
 	return ml_log_mult;
 }
 void librnary::NNUnpairedModel::SetMLLogMultiplier(librnary::kcalmol_t v) {
 	NNUnpairedModel::ml_log_mult = v;
+	InvalidateMLClosureTable();
 }
 int librnary::NNUnpairedModel::MLUnpairedPivot() const {
 	return ml_up_pivot;
 }
 void librnary::NNUnpairedModel::SetMLUnpairedPivot(int v) {
 	NNUnpairedModel::ml_up_pivot = v;
+	InvalidateMLClosureTable();
+}
+
+void librnary::NNUnpairedModel::SetRNA(const librnary::PrimeStructure &primary) {
+	NNModel::SetRNA(primary);
+	// MLClosure(up, branches) is virtual, so subclasses get their own costs tabulated.
+	for (int up = static_cast<int>(ml_closure_table.size()); up <= static_cast<int>(primary.size()); ++up)
+		ml_closure_table.push_back(MLClosure(up, 0));
+}
+
+const std::vector<librnary::energy_t> &librnary::NNUnpairedModel::MLClosureTable() const {
+	return ml_closure_table;
+}
+
+void librnary::NNUnpairedModel::InvalidateMLClosureTable() {
+	ml_closure_table.clear();
 }
 
 librnary::energy_t librnary::StrainedUnpairedModel::MLStrain() const {
@@ -79,6 +97,7 @@ librnary::energy_t librnary::StrainedUnpairedModel::MLStrain() const {
 
 void librnary::StrainedUnpairedModel::SetMLStrain(librnary::energy_t v) {
 	strain = v;
+	InvalidateMLClosureTable();
 }
 
 librnary::energy_t librnary::StrainedUnpairedModel::MLClosure(int unpaired, int branches) const {
@@ -0,0 +1,136 @@
+#include "parallel.hpp"
+
+#include <map>
+
+using namespace std;
+
+namespace {
+/// The pool whose job the current thread is running, if any. Used to run nested ParallelFor calls serially.
+thread_local const librnary::ThreadPool *running_pool = nullptr;
+}
+
+librnary::ThreadPool::ThreadPool(size_t threads)
+	: ranges(new Range[max<size_t>(threads, 1)]) {
+	for (size_t t = 1; t < threads; ++t)
+		workers.emplace_back(&ThreadPool::WorkerLoop, this, t);
+}
+
+librnary::ThreadPool::~ThreadPool() {
+	{
+		lock_guard<mutex> lock(state_mutex);
+		stopping = true;
+	}
+	start_cv.notify_all();
+	for (auto &w : workers)
+		w.join();
+}
+
+size_t librnary::ThreadPool::Size() const {
+	return workers.size() + 1;
+}
+
+bool librnary::ThreadPool::Take(size_t slot, size_t &lo, size_t &hi) {
+	Range &r = ranges[slot];
+	lock_guard<mutex> lock(r.m);
+	if (r.lo == r.hi)
+		return false;
+	lo = r.lo;
+	hi = min(r.hi, r.lo + grain);
+	r.lo = hi;
+	return true;
+}
+
+bool librnary::ThreadPool::Steal(size_t slot, size_t &lo, size_t &hi) {
+	size_t n = Size();
+	for (size_t off = 1; off < n; ++off) {
+		Range &victim = ranges[(slot + off) % n];
+		size_t s_lo, s_hi;
+		{
+			lock_guard<mutex> lock(victim.m);
+			if (victim.lo == victim.hi)
+				continue;
+			s_lo = victim.lo + (victim.hi - victim.lo) / 2;
+			s_hi = victim.hi;
+			victim.hi = s_lo;
+		}
+		{
+			Range &own = ranges[slot];
+			lock_guard<mutex> lock(own.m);
+			own.lo = s_lo;
+			own.hi = s_hi;
+		}
+		return Take(slot, lo, hi);
+	}
+	return false;
+}
+
+void librnary::ThreadPool::RunJob(size_t slot) {
+	const ThreadPool *outer = running_pool;
+	running_pool = this;
+	size_t lo, hi;
+	while (Take(slot, lo, hi) || Steal(slot, lo, hi))
+		for (size_t i = lo; i < hi; ++i)
+			(*job)(i);
+	running_pool = outer;
+}
+
+void librnary::ThreadPool::WorkerLoop(size_t slot) {
+	size_t seen = 0;
+	while (true) {
+		{
+			unique_lock<mutex> lock(state_mutex);
+			start_cv.wait(lock, [&]() { return stopping || generation != seen; });
+			if (stopping)
+				return;
+			seen = generation;
+		}
+		RunJob(slot);
+		{
+			lock_guard<mutex> lock(state_mutex);
+			--busy;
+		}
+		done_cv.notify_one();
+	}
+}
+
+void librnary::ThreadPool::ParallelFor(size_t begin, size_t end, const function<void(size_t)> &f, size_t _grain) {
+	if (begin >= end)
+		return;
+	// Not worth waking the workers for a single index, and nested calls would deadlock waiting for themselves.
+	if (workers.empty() || end - begin == 1 || running_pool == this) {
+		for (size_t i = begin; i < end; ++i)
+			f(i);
+		return;
+	}
+	lock_guard<mutex> job_lock(job_mutex);
+	size_t n = Size(), len = end - begin;
+	{
+		lock_guard<mutex> lock(state_mutex);
+		job = &f;
+		// Small enough that stealing can even out the load, large enough to keep the range locks cold.
+		grain = _grain != 0 ? _grain : max<size_t>(1, len / (n * 64));
+		for (size_t t = 0; t < n; ++t) {
+			lock_guard<mutex> range_lock(ranges[t].m);
+			ranges[t].lo = begin + len * t / n;
+			ranges[t].hi = begin + len * (t + 1) / n;
+		}
+		busy = workers.size();
+		++generation;
+	}
+	start_cv.notify_all();
+	RunJob(0);
+	unique_lock<mutex> lock(state_mutex);
+	done_cv.wait(lock, [&]() { return busy == 0; });
+	job = nullptr;
+}
+
+librnary::ThreadPool &librnary::SharedThreadPool(size_t threads) {
+	static mutex pools_mutex;
+	static map<size_t, unique_ptr<ThreadPool>> pools;
+	threads = max<size_t>(threads, 1);
+	lock_guard<mutex> lock(pools_mutex);
+	auto &pool = pools[threads];
+	if (pool == nullptr)
+		pool.reset(new ThreadPool(threads));
+	return *pool;
+}
@@ -67,3 +67,18 @@ librnary::PrimeStructure librnary::RandomPrimary(default_random_engine &re, unsi
 }
 
 
+
+librnary::PrimeStructure librnary::Mutate(PrimeStructure primary, const vector<PointMutation> &mutations) {
+	for (const auto &mut : mutations)
+		primary[mut.pos] = mut.base;
+	return primary;
+}
+
+vector<vector<librnary::PointMutation>> librnary::SingleMutants(const PrimeStructure &primary) {
+	vector<vector<PointMutation>> mutants;
+	for (int pos = 0; pos < static_cast<int>(primary.size()); ++pos)
+		for (Base b : {A, U, G, C})
+			if (b != primary[pos])
+				mutants.push_back({{pos, b}});
+	return mutants;
+}
@@ -40,18 +40,21 @@ unique_ptr<structure> librnary::LoadStructure(const librnary::PrimeStructure &pr
 	unique_ptr<structure> seq(new structure());
 	seq->allocate(static_cast<int>(primary.size()));
 	for (int i = 1; i <= seq->GetSequenceLength(); ++i) {
-		librnary::Base nuc = primary[i - 1];
-		if (nuc == librnary::A) seq->numseq[i] = 1;
-		else if (nuc == librnary::C) seq->numseq[i] = 2;
-		else if (nuc == librnary::G) seq->numseq[i] = 3;
-		else if (nuc == librnary::U) seq->numseq[i] = 4;
-		else seq->numseq[i] = 0;
-		seq->nucs[i] = librnary::BaseToChar(nuc);
+		SetStructureBase(*seq, i - 1, primary[i - 1]);
 		seq->hnumber[i] = static_cast<short>(i);
 	}
 	return seq;
 }
 
+void librnary::SetStructureBase(structure &struc, int i, librnary::Base b) {
+	if (b == librnary::A) struc.numseq[i + 1] = 1;
+	else if (b == librnary::C) struc.numseq[i + 1] = 2;
+	else if (b == librnary::G) struc.numseq[i + 1] = 3;
+	else if (b == librnary::U) struc.numseq[i + 1] = 4;
+	else struc.numseq[i + 1] = 0;
+	struc.nucs[i + 1] = librnary::BaseToChar(b);
+}
+
 std::unique_ptr<structure> librnary::LoadStructure(const librnary::PrimeStructure &primary_seq,
 												   const librnary::Matching &match) {
 	assert(primary_seq.size() == match.size()); // Ensure there are no indexing issues later.
@@ -109,6 +109,24 @@ vector<BondPair> MatchingToBondPairs(const Matching &match) {
 	return bonds;
 }
 
+uint64_t MatchingHash(const Matching &match) {
+	// Each paired base is mixed with its partner and position by a splitmix64 finaliser, then the results are
+	// combined with a multiply-add chain so order matters.
+	uint64_t h = 0x9E3779B97F4A7C15ULL ^ match.size();
+	for (size_t i = 0; i < match.size(); ++i) {
+		if (match[i] == static_cast<int>(i))
+			continue;
+		uint64_t x = (static_cast<uint64_t>(i) << 32) ^ static_cast<uint32_t>(match[i]);
+		x ^= x >> 30;
+		x *= 0xBF58476D1CE4E5B9ULL;
+		x ^= x >> 27;
+		x *= 0x94D049BB133111EBULL;
+		x ^= x >> 31;
+		h = h * 0x100000001B3ULL + x;
+	}
+	return h;
+}
+
 bool ContainsPseudoknot(const Matching &match) {
 	stack<int> open;
 	for (int i = 0; i < static_cast<int>(match.size()); ++i) {
@@ -133,6 +151,10 @@ bool MustBeLonelyPair(const PrimeStructure &rna, int i, int j, int min_hairpin_u
 		&& !(j - i - 3 >= min_hairpin_unpaired && ValidPair(rna[i + 1], rna[j - 1]));
 }
 
+int ExteriorReach(int max_span, bool stacking) {
+	return stacking ? 2 * max_span + 4 : max_span + 3;
+}
+
 std::vector<Stem> ExtractStems(const Matching &match) {
 	std::vector<Stem> stems;
 	std::vector<int> marked(match.size());
@@ -0,0 +1,414 @@
+#include "training/param_search.hpp"
+#include "parallel.hpp"
+
+#include <cassert>
+#include <chrono>
+#include <iomanip>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+using namespace std;
+
+namespace {
+typedef chrono::steady_clock Clock;
+
+/// Whether the parameter set at index i with score s beats the one at best_i with score best_s.
+bool Better(double s, size_t i, double best_s, size_t best_i) {
+	return s > best_s || (s == best_s && i < best_i);
+}
+
+/// The grid to search: grid itself, or one dimension of n if grid is empty.
+librnary::ParamGrid EffectiveGrid(const librnary::ParamGrid &grid, size_t n) {
+	if (grid.Dimensions() == 0)
+		return librnary::ParamGrid({n});
+	if (grid.Size() != n)
+		throw invalid_argument("Parameter grid size does not match the number of parameter sets");
+	return grid;
+}
+
+/// Scores indices in parallel and returns the best, with its score.
+pair<double, size_t> ScoreBest(const vector<size_t> &indices, const librnary::ParamSearch::ScoreFn &score,
+							   size_t threads, librnary::SearchReport &report) {
+	vector<double> res(indices.size());
+	librnary::parallel_for(0, indices.size(), [&](size_t k) {
+		res[k] = score(indices[k]);
+	}, threads);
+	report.evaluations += indices.size();
+	pair<double, size_t> best(-numeric_limits<double>::infinity(), numeric_limits<size_t>::max());
+	for (size_t k = 0; k < indices.size(); ++k)
+		if (Better(res[k], indices[k], best.first, best.second))
+			best = make_pair(res[k], indices[k]);
+	return best;
+}
+
+/**
+ * Scores parameter sets by index, remembering every score so nothing is scored twice.
+ */
+class ScoreCache {
+	const librnary::ParamSearch::ScoreFn &score;
+	size_t threads;
+	librnary::SearchReport &report;
+	unordered_map<size_t, double> scores;
+
+public:
+	ScoreCache(const librnary::ParamSearch::ScoreFn &_score, size_t _threads, librnary::SearchReport &_report)
+		: score(_score), threads(_threads), report(_report) {}
+
+	/// Scores every index not scored before, and returns the best of indices.
+	pair<double, size_t> Best(const vector<size_t> &indices) {
+		vector<size_t> todo;
+		for (size_t i : indices)
+			if (scores.count(i) == 0)
+				todo.push_back(i);
+		vector<double> res(todo.size());
+		librnary::parallel_for(0, todo.size(), [&](size_t k) {
+			res[k] = score(todo[k]);
+		}, threads);
+		report.evaluations += todo.size();
+		for (size_t k = 0; k < todo.size(); ++k)
+			scores[todo[k]] = res[k];
+
+		pair<double, size_t> best(-numeric_limits<double>::infinity(), numeric_limits<size_t>::max());
+		for (size_t i : indices)
+			if (Better(scores[i], i, best.first, best.second))
+				best = make_pair(scores[i], i);
+		return best;
+	}
+};
+
+/// Calls f on every combination of one value from each of values.
+template<typename Func>
+void ForEachCombination(const vector<vector<size_t>> &values, const Func &f) {
+	vector<size_t> pos(values.size(), 0), coords(values.size());
+	for (auto &v : values)
+		if (v.empty())
+			return;
+	while (true) {
+		for (size_t d = 0; d < values.size(); ++d)
+			coords[d] = values[d][pos[d]];
+		f(coords);
+		size_t d = values.size();
+		while (d > 0 && ++pos[d - 1] == values[d - 1].size())
+			pos[--d] = 0;
+		if (d == 0)
+			return;
+	}
+}
+}
+
+librnary::ParamGrid::ParamGrid(const vector<size_t> &_extents) {
+	for (size_t e : _extents)
+		AddDimension(e);
+}
+
+librnary::ParamGrid &librnary::ParamGrid::AddDimension(size_t extent, bool is_monotone) {
+	assert(extent > 0);
+	extents.push_back(extent);
+	monotone.push_back(is_monotone);
+	return *this;
+}
+
+size_t librnary::ParamGrid::Dimensions() const {
+	return extents.size();
+}
+
+size_t librnary::ParamGrid::Extent(size_t d) const {
+	return extents[d];
+}
+
+bool librnary::ParamGrid::Monotone(size_t d) const {
+	return monotone[d];
+}
+
+size_t librnary::ParamGrid::Size() const {
+	size_t sz = 1;
+	for (size_t e : extents)
+		sz *= e;
+	return extents.empty() ? 0 : sz;
+}
+
+size_t librnary::ParamGrid::Index(const vector<size_t> &coords) const {
+	assert(coords.size() == extents.size());
+	size_t index = 0;
+	for (size_t d = 0; d < extents.size(); ++d) {
+		assert(coords[d] < extents[d]);
+		index = index * extents[d] + coords[d];
+	}
+	return index;
+}
+
+vector<size_t> librnary::ParamGrid::Coords(size_t index) const {
+	vector<size_t> coords(extents.size());
+	for (size_t d = extents.size(); d > 0; --d) {
+		coords[d - 1] = index % extents[d - 1];
+		index /= extents[d - 1];
+	}
+	return coords;
+}
+
+std::ostream &librnary::operator<<(std::ostream &os, const SearchReport &r) {
+	auto flags = os.flags();
+	auto precision = os.precision();
+	os << r.evaluations << " of " << r.points << " parameter sets scored (" << fixed << setprecision(2)
+	   << (r.points > 0 ? 100.0 * r.evaluations / r.points : 0.0) << "%), " << r.bounds << " bounds, "
+	   << setprecision(3) << r.seconds << "s";
+	os.flags(flags);
+	os.precision(precision);
+	return os;
+}
+
+size_t librnary::ExhaustiveSearch::Search(const ParamGrid &, size_t n, size_t, const ScoreFn &score,
+										  const BoundFn &, size_t threads, SearchReport &report) const {
+	auto start_time = Clock::now();
+	typedef pair<double, size_t> Scored;
+	Scored best = parallel_reduce(0, n, Scored(-numeric_limits<double>::infinity(), n), [&](size_t i) {
+		return Scored(score(i), i);
+	}, [](const Scored &a, const Scored &b) {
+		return Better(b.first, b.second, a.first, a.second) ? b : a;
+	}, threads);
+	report = SearchReport();
+	report.evaluations = report.points = n;
+	report.seconds = chrono::duration<double>(Clock::now() - start_time).count();
+	return best.second;
+}
+
+bool librnary::ExhaustiveSearch::Exact() const {
+	return true;
+}
+
+string librnary::ExhaustiveSearch::Name() const {
+	return "exhaustive";
+}
+
+size_t librnary::CoordinateDescentSearch::Search(const ParamGrid &grid, size_t n, size_t start, const ScoreFn &score,
+												 const BoundFn &, size_t threads, SearchReport &report) const {
+	auto start_time = Clock::now();
+	report = SearchReport();
+	report.points = n;
+	ParamGrid g = EffectiveGrid(grid, n);
+	ScoreCache cache(score, threads, report);
+
+	auto best = cache.Best({start});
+	for (bool improved = true; improved;) {
+		improved = false;
+		for (size_t d = 0; d < g.Dimensions(); ++d) {
+			auto coords = g.Coords(best.second);
+			vector<size_t> line;
+			for (coords[d] = 0; coords[d] < g.Extent(d); ++coords[d])
+				line.push_back(g.Index(coords));
+			auto line_best = cache.Best(line);
+			if (line_best.second != best.second) {
+				best = line_best;
+				improved = true;
+			}
+		}
+	}
+	report.seconds = chrono::duration<double>(Clock::now() - start_time).count();
+	return best.second;
+}
+
+bool librnary::CoordinateDescentSearch::Exact() const {
+	return false;
+}
+
+string librnary::CoordinateDescentSearch::Name() const {
+	return "coordinate";
+}
+
+librnary::MultiResolutionSearch::MultiResolutionSearch(size_t _max_coarse_points)
+	: max_coarse_points(_max_coarse_points) {}
+
+size_t librnary::MultiResolutionSearch::Search(const ParamGrid &grid, size_t n, size_t start, const ScoreFn &score,
+											   const BoundFn &, size_t threads, SearchReport &report) const {
+	auto start_time = Clock::now();
+	report = SearchReport();
+	report.points = n;
+	ParamGrid g = EffectiveGrid(grid, n);
+	const size_t D = g.Dimensions();
+	ScoreCache cache(score, threads, report);
+
+	// Values of each dimension on the coarse grid with the given stride, always including the last.
+	auto coarse_values = [&](size_t stride) -> vector<vector<size_t>> {
+		vector<vector<size_t>> values(D);
+		for (size_t d = 0; d < D; ++d) {
+			for (size_t v = 0; v < g.Extent(d); v += stride)
+				values[d].push_back(v);
+			if (values[d].back() != g.Extent(d) - 1)
+				values[d].push_back(g.Extent(d) - 1);
+		}
+		return values;
+	};
+	size_t stride = 1;
+	while (true) {
+		auto values = coarse_values(stride);
+		size_t points = 1;
+		for (const auto &v : values)
+			points *= v.size();
+		if (points <= max_coarse_points || points == 1)
+			break;
+		stride *= 2;
+	}
+
+	vector<size_t> coarse = {start};
+	ForEachCombination(coarse_values(stride), [&](const vector<size_t> &coords) {
+		coarse.push_back(g.Index(coords));
+	});
+	auto best = cache.Best(coarse);
+
+	for (; stride > 1;) {
+		stride /= 2;
+		// Climb at this stride until no neighbour is better.
+		for (bool moved = true; moved;) {
+			auto centre = g.Coords(best.second);
+			vector<vector<size_t>> values(D);
+			for (size_t d = 0; d < D; ++d) {
+				if (centre[d] >= stride)
+					values[d].push_back(centre[d] - stride);
+				values[d].push_back(centre[d]);
+				if (centre[d] + stride < g.Extent(d))
+					values[d].push_back(centre[d] + stride);
+			}
+			vector<size_t> neighbours;
+			ForEachCombination(values, [&](const vector<size_t> &coords) {
+				neighbours.push_back(g.Index(coords));
+			});
+			auto next = cache.Best(neighbours);
+			moved = next.second != best.second;
+			best = next;
+		}
+	}
+	report.seconds = chrono::duration<double>(Clock::now() - start_time).count();
+	return best.second;
+}
+
+bool librnary::MultiResolutionSearch::Exact() const {
+	return false;
+}
+
+string librnary::MultiResolutionSearch::Name() const {
+	return "multires";
+}
+
+librnary::BranchAndBoundSearch::BranchAndBoundSearch(size_t _leaf_points)
+	: leaf_points(max<size_t>(_leaf_points, 1)) {}
+
+size_t librnary::BranchAndBoundSearch::Search(const ParamGrid &grid, size_t n, size_t start, const ScoreFn &score,
+											  const BoundFn &bound, size_t threads, SearchReport &report) const {
+	ParamGrid g = EffectiveGrid(grid, n);
+	if (!bound)
+		return ExhaustiveSearch().Search(grid, n, start, score, bound, threads, report);
+
+	auto start_time = Clock::now();
+	report = SearchReport();
+	report.points = n;
+	const size_t D = g.Dimensions();
+
+	struct Box {
+		vector<size_t> lo, hi;
+		double bound;
+		/// Lowest index in the box.
+		size_t first;
+	};
+
+	// Bounds a box, unless it spans several values of a non-monotone dimension.
+	auto make_box = [&](vector<size_t> lo, vector<size_t> hi) -> Box {
+		Box box{move(lo), move(hi), numeric_limits<double>::infinity(), 0};
+		box.first = g.Index(box.lo);
+		vector<vector<size_t>> corner_values(D);
+		for (size_t d = 0; d < D; ++d) {
+			if (box.lo[d] != box.hi[d] && !g.Monotone(d))
+				return box;
+			corner_values[d].push_back(box.lo[d]);
+			if (box.hi[d] != box.lo[d])
+				corner_values[d].push_back(box.hi[d]);
+		}
+		vector<size_t> corners;
+		ForEachCombination(corner_values, [&](const vector<size_t> &coords) {
+			corners.push_back(g.Index(coords));
+		});
+		box.bound = bound(corners);
+		++report.bounds;
+		return box;
+	};
+
+	auto best = ScoreBest({start}, score, threads, report);
+	auto prunable = [&](const Box &box) {
+		return box.bound < best.first || (box.bound == best.first && box.first > best.second);
+	};
+
+	vector<size_t> root_hi(D);
+	for (size_t d = 0; d < D; ++d)
+		root_hi[d] = g.Extent(d) - 1;
+	vector<Box> stack;
+	stack.push_back(make_box(vector<size_t>(D, 0), root_hi));
+	while (!stack.empty()) {
+		Box box = move(stack.back());
+		stack.pop_back();
+		if (prunable(box))
+			continue;
+
+		// Split non-monotone dimensions first, since boxes spanning them cannot be bounded, then the widest.
+		size_t points = 1, split = D;
+		for (size_t d = 0; d < D; ++d) {
+			size_t width = box.hi[d] - box.lo[d] + 1;
+			points *= width;
+			if (width == 1)
+				continue;
+			if (split == D || (!g.Monotone(d) && g.Monotone(split))
+				|| (g.Monotone(d) == g.Monotone(split) && width > box.hi[split] - box.lo[split] + 1))
+				split = d;
+		}
+		if (points <= leaf_points || split == D) {
+			vector<vector<size_t>> values(D);
+			for (size_t d = 0; d < D; ++d)
+				for (size_t v = box.lo[d]; v <= box.hi[d]; ++v)
+					values[d].push_back(v);
+			vector<size_t> indices;
+			ForEachCombination(values, [&](const vector<size_t> &coords) {
+				indices.push_back(g.Index(coords));
+			});
+			auto leaf_best = ScoreBest(indices, score, threads, report);
+			if (Better(leaf_best.first, leaf_best.second, best.first, best.second))
+				best = leaf_best;
+			continue;
+		}
+
+		size_t mid = box.lo[split] + (box.hi[split] - box.lo[split]) / 2;
+		auto left_hi = box.hi, right_lo = box.lo;
+		left_hi[split] = mid;
+		right_lo[split] = mid + 1;
+		Box left = make_box(box.lo, left_hi), right = make_box(right_lo, box.hi);
+		// Explore the more promising half first, so good parameter sets are found early and prune more.
+		if (Better(left.bound, left.first, right.bound, right.first)) {
+			stack.push_back(move(right));
+			stack.push_back(move(left));
+		} else {
+			stack.push_back(move(left));
+			stack.push_back(move(right));
+		}
+	}
+	report.seconds = chrono::duration<double>(Clock::now() - start_time).count();
+	return best.second;
+}
+
+bool librnary::BranchAndBoundSearch::Exact() const {
+	return true;
+}
+
+string librnary::BranchAndBoundSearch::Name() const {
+	return "bnb";
+}
+
+std::shared_ptr<const librnary::ParamSearch> librnary::MakeParamSearch(const string &name) {
+	if (name == "exhaustive")
+		return make_shared<ExhaustiveSearch>();
+	if (name == "coordinate")
+		return make_shared<CoordinateDescentSearch>();
+	if (name == "multires")
+		return make_shared<MultiResolutionSearch>();
+	if (name == "bnb")
+		return make_shared<BranchAndBoundSearch>();
+	return nullptr;
+}
@@ -0,0 +1,20 @@
+/*
+ * Contains functions for reading the data set used by librnary tests.
+ */
+
+#ifndef RNARK_DATA_SET_HPP
+#define RNARK_DATA_SET_HPP
+
+#include <vector>
+
+#include "read_cts.hpp"
+
+namespace librnary {
+/*
+ * Reads every RNA of data_set/small.ctset, in order. The file holds several sets, which ReadAllCTs does not allow,
+ * so the sets are read one by one and joined.
+ */
+std::vector<CTData> ReadSmallCTSet();
+}
+
+#endif //RNARK_DATA_SET_HPP
@@ -146,3 +146,34 @@ TEST(AalbertsFolder, MultiLoopOrder3FlushCoaxialStackInside) {
 }
 
 // TODO: Tests for limited feature size.
+
+TEST(AalbertsFolder, MaxSpanLimitsPairs) {
+	auto re = librnary::RandomEngineForTests();
+	librnary::AalbertsModel model(DATA_TABLE_PATH);
+	librnary::AalbertsScorer scorer(model);
+	librnary::AalbertsFolder full(model), banded(model);
+	for (auto *f : {&full, &banded}) {
+		f->SetMaxALength(10);
+		f->SetMaxBLength(5);
+	}
+	for (unsigned len : {1u, 45u}) {
+		auto prim = librnary::RandomPrimary(re, len);
+		scorer.SetRNA(prim);
+		librnary::energy_t full_mfe = full.Fold(prim), prev_mfe = model.MaxMFE();
+		for (int span : {4, 15, 30, 1000}) {
+			banded.SetMaxSpan(static_cast<unsigned>(span));
+			librnary::energy_t mfe = banded.Fold(prim);
+			auto m = banded.Traceback();
+			for (int i = 0; i < static_cast<int>(m.size()); ++i)
+				EXPECT_LE(abs(m[i] - i), span);
+			EXPECT_EQ(mfe, scorer.ScoreExterior(librnary::SSTree(m).RootSurface()));
+			EXPECT_LE(mfe, prev_mfe);
+			EXPECT_LE(full_mfe, mfe);
+			prev_mfe = mfe;
+			if (span >= static_cast<int>(len)) {
+				EXPECT_EQ(full_mfe, mfe);
+				EXPECT_EQ(full.Traceback(), m);
+			}
+		}
+	}
+}
@@ -14,4 +14,30 @@ TEST(AalbertsModel, Eqn3FromPaper) {
 	// Gfjc2(11,0) - Gfjc2(12,4) == -1
 	EXPECT_EQ(model.MLInit(11, 0) - model.MLInit(12, 4), -10);
 	EXPECT_EQ(model.MLInitUpBr(11, 0) - model.MLInitUpBr(8, 4), -10);
-}
\ No newline at end of file
+}
+
+TEST(AalbertsModel, MLInitTableMatchesDirect) {
+	librnary::AalbertsModel table(DATA_TABLE_PATH), direct(DATA_TABLE_PATH);
+	direct.SetMLInitTable(false);
+	EXPECT_TRUE(table.MLInitTable());
+	EXPECT_FALSE(direct.MLInitTable());
+	auto rna = librnary::StringToPrimary("GGGAAAUCCCAGCUUCGGCUGGGAAACCCAAAAGGGAUUUCCC");
+	auto check = [&]() {
+		int n = static_cast<int>(rna.size());
+		for (int N = 0; N < n + 4; ++N)
+			for (int M = 0; M < n / 2 + 4; ++M)
+				ASSERT_EQ(direct.MLInit(N, M), table.MLInit(N, M)) << N << " " << M;
+	};
+	table.SetRNA(rna);
+	direct.SetRNA(rna);
+	check();
+	// Parameter changes must not leave stale values behind.
+	for (auto *m : {&table, &direct}) {
+		m->SetMLParams(2.5, 3.7, 1.1, 1.4, 0.8);
+		m->SetRNA(rna);
+	}
+	check();
+	table.SetPower(0.6);
+	direct.SetPower(0.6);
+	check();
+}
@@ -7,8 +7,11 @@
 #include "folders/nn_unpaired_folder.hpp"
 #include "scorers/average_asym_scorer.hpp"
 
+#include "data_set.hpp"
 #include "random.hpp"
 
+#include <map>
+
 using namespace std;
 
 const string DATA_TABLE_PATH = "../../data_tables/";
@@ -433,4 +436,131 @@ TEST(AverageAsymmetryFolder, MaxNonCLosingAsymmetryLeft) {
 	EXPECT_GT(folder.Fold(prim), umfe);
 
 	clog << librnary::MatchingToDotBracket(folder.Traceback()) << endl;
-}
\ No newline at end of file
+}
+
+TEST(AverageAsymmetryFolder, EnergyOnlyMatchesFullFold) {
+	auto re = librnary::RandomEngineForTests();
+	librnary::AverageAsymmetryModel model(DATA_TABLE_PATH);
+	librnary::AverageAsymmetryFolder full(model), energy_only(model);
+	for (auto *f : {&full, &energy_only}) {
+		f->SetUnpairedGap(3);
+		f->SetMaxMLBranches(5);
+		f->SetMaxMLNonClosingAsym(4);
+		f->SetMaxTwoLoop(10);
+	}
+	energy_only.SetEnergyOnly(true);
+	for (unsigned len : {0u, 1u, 12u, 40u}) {
+		auto prim = librnary::RandomPrimary(re, len);
+		EXPECT_EQ(full.Fold(prim), energy_only.Fold(prim));
+		EXPECT_THROW(energy_only.Traceback(), logic_error);
+		if (len >= 40) {
+			EXPECT_LT(energy_only.TableBytes(), full.TableBytes());
+		}
+	}
+}
+
+TEST(AverageAsymmetryFolder, MaxSpanLimitsPairs) {
+	auto re = librnary::RandomEngineForTests();
+	librnary::AverageAsymmetryModel model(DATA_TABLE_PATH);
+	librnary::AverageAsymmetryFolder full(model), banded(model), banded_energy(model);
+	for (auto *f : {&full, &banded, &banded_energy}) {
+		f->SetUnpairedGap(3);
+		f->SetMaxMLBranches(5);
+		f->SetMaxMLNonClosingAsym(4);
+		f->SetMaxTwoLoop(10);
+	}
+	banded_energy.SetEnergyOnly(true);
+	for (unsigned len : {1u, 40u}) {
+		auto prim = librnary::RandomPrimary(re, len);
+		librnary::energy_t full_mfe = full.Fold(prim), prev_mfe = model.MaxMFE();
+		for (int span : {4, 15, 30, 1000}) {
+			banded.SetMaxSpan(static_cast<unsigned>(span));
+			banded_energy.SetMaxSpan(static_cast<unsigned>(span));
+			librnary::energy_t mfe = banded.Fold(prim);
+			auto m = banded.Traceback();
+			for (int i = 0; i < static_cast<int>(m.size()); ++i)
+				EXPECT_LE(abs(m[i] - i), span);
+			EXPECT_EQ(mfe, banded_energy.Fold(prim));
+			EXPECT_LE(mfe, prev_mfe);
+			EXPECT_LE(full_mfe, mfe);
+			prev_mfe = mfe;
+			if (span >= static_cast<int>(len)) {
+				EXPECT_EQ(full_mfe, mfe);
+				EXPECT_EQ(full.Traceback(), m);
+			}
+		}
+	}
+}
+
+TEST(AverageAsymmetryFolder, CompactTablesMatchFullTables) {
+	auto re = librnary::RandomEngineForTests();
+	librnary::AverageAsymmetryModel model(DATA_TABLE_PATH);
+	librnary::AverageAsymmetryFolder full(model), compact(model);
+	for (auto *f : {&full, &compact}) {
+		f->SetUnpairedGap(3);
+		f->SetMaxMLBranches(5);
+		f->SetMaxMLNonClosingAsym(4);
+		f->SetMaxTwoLoop(10);
+	}
+	compact.SetCompactTables(true);
+	librnary::FoldWorkspace ws;
+	for (bool use_ws : {false, true}) {
+		compact.SetWorkspace(use_ws ? &ws : nullptr);
+		for (unsigned len : {0u, 1u, 12u, 40u}) {
+			auto prim = librnary::RandomPrimary(re, len);
+			EXPECT_EQ(full.Fold(prim), compact.Fold(prim));
+			EXPECT_EQ(full.Traceback(), compact.Traceback());
+			if (len >= 40) {
+				EXPECT_TRUE(compact.UsedCompactTables());
+				EXPECT_LT(compact.TableBytes(), full.TableBytes() * 3 / 5);
+			}
+		}
+	}
+}
+
+TEST(AverageAsymmetryFolder, CompactTablesFallBackOnOverflow) {
+	auto re = librnary::RandomEngineForTests();
+	librnary::AverageAsymmetryModel model(DATA_TABLE_PATH);
+	// Two unpaired nucleotides in a multi-loop cost more than 16 bits hold.
+	model.SetMLUnpairedCost(20000);
+	librnary::AverageAsymmetryFolder full(model), compact(model);
+	for (auto *f : {&full, &compact}) {
+		f->SetUnpairedGap(3);
+		f->SetMaxMLBranches(5);
+		f->SetMaxMLNonClosingAsym(4);
+		f->SetMaxTwoLoop(10);
+	}
+	compact.SetCompactTables(true);
+	auto prim = librnary::RandomPrimary(re, 30);
+	EXPECT_EQ(full.Fold(prim), compact.Fold(prim));
+	EXPECT_FALSE(compact.UsedCompactTables());
+	EXPECT_EQ(full.Traceback(), compact.Traceback());
+	EXPECT_EQ(full.TableBytes(), compact.TableBytes());
+}
+
+TEST(AverageAsymmetryFolder, CompactTablesHoldDataSet) {
+	const auto cts = librnary::ReadSmallCTSet();
+	ASSERT_FALSE(cts.empty());
+	librnary::AverageAsymmetryModel model(DATA_TABLE_PATH);
+	librnary::AverageAsymmetryFolder full(model), compact(model);
+	// Limits that keep a fold of each RNA to a fraction of a second. The span is not limited, so multi-loops can
+	// reach across the whole RNA.
+	for (auto *f : {&full, &compact}) {
+		f->SetUnpairedGap(2);
+		f->SetMaxMLBranches(4);
+		f->SetMaxMLNonClosingAsym(3);
+		f->SetMaxTwoLoop(10);
+	}
+	compact.SetCompactTables(true);
+	// Every STRIDE'th RNA of each family (the prefix of its name) that is short enough to fold whole quickly. The
+	// multi-loop energies of real RNAs stay far from the 16-bit limits.
+	const size_t STRIDE = 1000;
+	map<string, size_t> family_count;
+	for (const auto &ct : cts) {
+		if (ct.primary.size() > 150 || family_count[ct.name.substr(0, ct.name.find('_'))]++ % STRIDE != 0)
+			continue;
+		EXPECT_EQ(full.Fold(ct.primary), compact.Fold(ct.primary)) << ct.name;
+		EXPECT_TRUE(compact.UsedCompactTables()) << ct.name;
+		EXPECT_EQ(full.Traceback(), compact.Traceback()) << ct.name;
+	}
+}
@@ -0,0 +1,102 @@
+#include <gtest/gtest.h>
+
+#include "folders/batch_fold.hpp"
+#include "folders/nn_affine_folder.hpp"
+#include "random.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <sstream>
+
+using namespace std;
+
+const string DATA_TABLE_PATH = "../../data_tables/";
+
+TEST(BatchFold, CostGrowsWithLength) {
+	EXPECT_LT(librnary::EstimateFoldCost(76, 30), librnary::EstimateFoldCost(120, 30));
+	EXPECT_LT(librnary::EstimateFoldCost(1500, 30), librnary::EstimateFoldCost(2900, 30));
+	// The two-loop cap only matters once the RNA is longer than it.
+	EXPECT_EQ(librnary::EstimateFoldCost(20, 30), librnary::EstimateFoldCost(20, 1000));
+	EXPECT_LT(librnary::EstimateFoldCost(200, 30), librnary::EstimateFoldCost(200, 1000));
+	EXPECT_EQ(0, librnary::EstimateFoldCost(0, 30));
+}
+
+TEST(BatchFold, LongestFirstOnOneThread) {
+	vector<double> costs = {3, 10, 1, 10, 7};
+	vector<size_t> order;
+	auto r = librnary::ScheduleLongestFirst(costs, [&](size_t i) {
+		order.push_back(i);
+	}, 1);
+	// Ties keep input order.
+	EXPECT_EQ(vector<size_t>({1, 3, 4, 0, 2}), order);
+	EXPECT_EQ(5u, r.items);
+	EXPECT_EQ(1u, r.threads);
+	EXPECT_GE(r.makespan, 0);
+}
+
+TEST(BatchFold, EveryItemRunsOnce) {
+	auto re = librnary::RandomEngineForTests();
+	for (size_t threads : {1, 2, 3, 8}) {
+		vector<double> costs(200);
+		for (auto &c : costs)
+			c = re() % 50;
+		vector<atomic<int>> visits(costs.size());
+		for (auto &v : visits)
+			v = 0;
+		auto r = librnary::ScheduleLongestFirst(costs, [&](size_t i) {
+			++visits[i];
+		}, threads);
+		for (auto &v : visits)
+			EXPECT_EQ(1, v);
+		EXPECT_EQ(threads, r.threads);
+		EXPECT_LE(r.longest_item, r.total_work);
+		EXPECT_LE(r.static_makespan, r.total_work + 1e-9);
+		EXPECT_GE(r.IdealMakespan(), r.longest_item);
+	}
+	auto empty = librnary::ScheduleLongestFirst({}, [](size_t) {
+		FAIL();
+	}, 4);
+	EXPECT_EQ(0u, empty.items);
+	EXPECT_EQ(1, empty.Efficiency());
+}
+
+TEST(BatchFold, MatchesSerialFoldsInInputOrder) {
+	auto re = librnary::RandomEngineForTests();
+	librnary::NNAffineModel model(DATA_TABLE_PATH);
+	librnary::NNAffineFolder folder(model);
+	vector<librnary::PrimeStructure> rnas;
+	for (unsigned len : {10u, 120u, 30u, 0u, 90u, 60u})
+		rnas.push_back(librnary::RandomPrimary(re, len));
+	librnary::BatchReport report;
+	auto batch = librnary::BatchFold(folder, rnas, 3, &report);
+	ASSERT_EQ(rnas.size(), batch.size());
+	for (size_t i = 0; i < rnas.size(); ++i) {
+		folder.Fold(rnas[i]);
+		EXPECT_EQ(folder.Traceback(), batch[i]);
+	}
+	EXPECT_EQ(rnas.size(), report.items);
+	stringstream ss;
+	ss << report;
+	EXPECT_NE(string::npos, ss.str().find("makespan"));
+}
+
+TEST(BatchFold, BucketsOfSimilarLength) {
+	vector<size_t> lengths = {76, 75, 120, 77, 76, 400, 74, 76, 73, 76, 75, 80};
+	auto groups = librnary::BucketByLength(lengths, 4);
+	vector<int> seen(lengths.size(), 0);
+	for (const auto &g : groups) {
+		EXPECT_LE(g.size(), 4u);
+		size_t lo = lengths[g.front()], hi = lo;
+		for (size_t r : g) {
+			++seen[r];
+			lo = min(lo, lengths[r]);
+			hi = max(hi, lengths[r]);
+		}
+		EXPECT_LE(hi, lo + lo / 8);
+	}
+	for (int s : seen)
+		EXPECT_EQ(1, s);
+	// The ten tRNA lengths fill three groups, and the long RNAs go alone.
+	EXPECT_EQ(5u, groups.size());
+	EXPECT_TRUE(librnary::BucketByLength({}, 8).empty());
+}
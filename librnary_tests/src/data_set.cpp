@@ -0,0 +1,16 @@
+#include <fstream>
+#include <string>
+
+#include "data_set.hpp"
+
+using namespace std;
+
+const string DATA_SET_PATH = "../../data_set/";
+
+vector<librnary::CTData> librnary::ReadSmallCTSet() {
+	ifstream ctset(DATA_SET_PATH + "small.ctset");
+	vector<CTData> cts;
+	for (const auto &set : ReadFilesInCTSetFormat(DATA_SET_PATH + "ct_files/", ctset))
+		cts.insert(cts.end(), set.begin(), set.end());
+	return cts;
+}
@@ -0,0 +1,97 @@
+#include <gtest/gtest.h>
+
+#include "folders/fold_workspace.hpp"
+#include "folders/nn_affine_folder.hpp"
+#include "folders/nn_unpaired_folder.hpp"
+#include "random.hpp"
+
+using namespace std;
+
+const string DATA_TABLE_PATH = "../../data_tables/";
+
+TEST(FoldWorkspace, GrowsOnlyWhenLarger) {
+	librnary::FoldWorkspace ws;
+	librnary::TriangularArray<librnary::energy_t> a, b;
+	ws.Rewind();
+	ws.Bind(a, 100, 7);
+	ws.Bind(b, 50, 3);
+	size_t warm = ws.BytesAllocated();
+	EXPECT_GT(warm, 0u);
+	EXPECT_EQ(warm, ws.BytesReserved());
+	EXPECT_FALSE(a.Owner());
+	// Smaller or equal shapes reuse the buffers.
+	for (int n = 100; n >= 0; n -= 10) {
+		ws.Rewind();
+		ws.Bind(a, static_cast<size_t>(n), -1);
+		ws.Bind(b, static_cast<size_t>(n / 2), -2);
+		EXPECT_EQ(warm, ws.BytesAllocated());
+		for (int i = 0; i < n; ++i)
+			for (int j = i - 1; j < n; ++j)
+				ASSERT_EQ(-1, a[i][j]);
+	}
+	// A larger shape grows the buffer it lands in.
+	ws.Rewind();
+	ws.Bind(a, 101, 0);
+	EXPECT_GT(ws.BytesAllocated(), warm);
+	ws.Release();
+	EXPECT_EQ(0u, ws.BytesReserved());
+}
+
+TEST(FoldWorkspace, PrepareTableWithoutWorkspaceOwns) {
+	librnary::TriangularArray<librnary::energy_t> tbl;
+	librnary::PrepareTable(nullptr, tbl, 20, 5);
+	EXPECT_TRUE(tbl.Owner());
+	EXPECT_EQ(20u, tbl.Size());
+	EXPECT_EQ(5, tbl[3][10]);
+}
+
+TEST(FoldWorkspace, PoolReusesReleased) {
+	librnary::FoldWorkspacePool pool;
+	auto *a = pool.Acquire();
+	auto *b = pool.Acquire();
+	EXPECT_NE(a, b);
+	pool.Release(a);
+	EXPECT_EQ(a, pool.Acquire());
+	pool.Release(a);
+	pool.Release(b);
+	EXPECT_EQ(2u, pool.Size());
+}
+
+TEST(FoldWorkspace, NNAffineFolderMatchesOwnedTables) {
+	const int TESTS = 20;
+	auto re = librnary::RandomEngineForTests();
+	librnary::NNAffineModel model(DATA_TABLE_PATH);
+	librnary::NNAffineFolder owned(model), adopted(model);
+	librnary::FoldWorkspace ws;
+	adopted.SetWorkspace(&ws);
+	// Warm the workspace up on the longest RNA, after which nothing else should be allocated.
+	adopted.Fold(librnary::RandomPrimary(re, 80));
+	size_t warm = ws.BytesAllocated();
+	uniform_int_distribution<unsigned> len_dist(0, 80);
+	for (int t = 0; t < TESTS; ++t) {
+		auto prim = librnary::RandomPrimary(re, len_dist(re));
+		EXPECT_EQ(owned.Fold(prim), adopted.Fold(prim));
+		EXPECT_EQ(owned.Traceback(), adopted.Traceback());
+	}
+	EXPECT_EQ(warm, ws.BytesAllocated());
+}
+
+TEST(FoldWorkspace, NNUnpairedFolderMatchesOwnedTables) {
+	const int TESTS = 10;
+	auto re = librnary::RandomEngineForTests();
+	librnary::NNUnpairedModel model(DATA_TABLE_PATH);
+	librnary::NNUnpairedFolder owned(model), adopted(model);
+	owned.SetMaxMulti(5);
+	adopted.SetMaxMulti(5);
+	librnary::FoldWorkspace ws;
+	adopted.SetWorkspace(&ws);
+	adopted.Fold(librnary::RandomPrimary(re, 60));
+	size_t warm = ws.BytesAllocated();
+	uniform_int_distribution<unsigned> len_dist(0, 60);
+	for (int t = 0; t < TESTS; ++t) {
+		auto prim = librnary::RandomPrimary(re, len_dist(re));
+		EXPECT_EQ(owned.Fold(prim), adopted.Fold(prim));
+		EXPECT_EQ(owned.Traceback(), adopted.Traceback());
+	}
+	EXPECT_EQ(warm, ws.BytesAllocated());
+}
@@ -0,0 +1,152 @@
+#include <gtest/gtest.h>
+
+#include "training/linear_ibf_table.hpp"
+#include "random.hpp"
+
+using namespace std;
+
+namespace {
+typedef librnary::LinearIBFTable<3> Table;
+
+struct Structure {
+	librnary::energy_t base;
+	Table::Features f;
+	double fscore;
+};
+
+struct TestRNA {
+	Structure truth;
+	vector<Structure> falses;
+};
+
+librnary::energy_t Energy(const Structure &s, const Table::Weights &w) {
+	return s.base + w[0] * s.f[0] + w[1] * s.f[1] + w[2] * s.f[2];
+}
+
+/// The scan IBFMultiLoop::FindBestParams does, written out directly.
+double ReferenceScore(const vector<vector<TestRNA>> &groups, const Table::Weights &w) {
+	double sum_averages = 0;
+	for (const auto &group : groups) {
+		double sum_fscores = 0;
+		for (const auto &rna : group) {
+			librnary::energy_t min_e = Energy(rna.truth, w);
+			double fscore = 1;
+			for (const auto &s : rna.falses) {
+				if (Energy(s, w) <= min_e) {
+					min_e = Energy(s, w);
+					fscore = s.fscore;
+				}
+			}
+			sum_fscores += fscore;
+		}
+		sum_averages += sum_fscores / group.size();
+	}
+	return sum_averages / groups.size();
+}
+}
+
+TEST(LinearIBFTable, MatchesDirectScan) {
+	auto re = librnary::RandomEngineForTests();
+	auto small = [&](int hi) {
+		return static_cast<int>(re() % hi);
+	};
+	auto random_structure = [&]() {
+		// Few distinct values, so merged features and energy ties are common.
+		return Structure{small(6) - 3, {{small(3), small(4) + 3, small(5)}}, small(100) / 100.0};
+	};
+	for (int TC = 0; TC < 20; ++TC) {
+		vector<vector<TestRNA>> groups(small(3) + 1);
+		Table table;
+		vector<vector<size_t>> ids(groups.size());
+		for (size_t g = 0; g < groups.size(); ++g) {
+			size_t group = table.AddGroup();
+			groups[g].resize(small(5) + 1);
+			for (auto &rna : groups[g]) {
+				rna.truth = random_structure();
+				ids[g].push_back(table.AddRNA(group, rna.truth.base, rna.truth.f));
+			}
+		}
+		// Add false structures over several rounds, like epochs of training.
+		for (int round = 0; round < 4; ++round) {
+			for (size_t g = 0; g < groups.size(); ++g) {
+				for (size_t i = 0; i < groups[g].size(); ++i) {
+					for (int n = small(4); n > 0; --n) {
+						groups[g][i].falses.push_back(random_structure());
+						const auto &s = groups[g][i].falses.back();
+						table.AddFalse(ids[g][i], s.base, s.f, s.fscore);
+					}
+					EXPECT_EQ(static_cast<int>(groups[g][i].falses.size()), table.FalseStructures(ids[g][i]));
+				}
+			}
+			table.Pack();
+			for (int p = 0; p < 50; ++p) {
+				Table::Weights w{{small(7) - 3, small(7) - 3, small(7) - 3}};
+				EXPECT_EQ(ReferenceScore(groups, w), table.Score(w));
+			}
+		}
+	}
+}
+
+TEST(LinearIBFTable, MergesEqualFeatures) {
+	Table table;
+	size_t group = table.AddGroup();
+	size_t rna = table.AddRNA(group, 0, {{1, 3, 0}});
+	table.AddFalse(rna, 5, {{1, 3, 2}}, 0.5);
+	table.AddFalse(rna, 4, {{1, 3, 2}}, 0.25);
+	table.AddFalse(rna, 1, {{2, 6, 0}}, 0.75);
+	EXPECT_EQ(3u, table.Rows());
+	EXPECT_EQ(3, table.FalseStructures(rna));
+	EXPECT_EQ(3u, table.DistinctFeatures());
+	table.Pack();
+	// Only the unpaired weight differs: the merged candidate (base 4) wins when unpaired is cheap enough.
+	EXPECT_EQ(0.25, table.Score({{0, 0, -3}}));
+	// The true structure loses the tie with the merged candidate.
+	EXPECT_EQ(0.25, table.Score({{0, 0, -2}}));
+	EXPECT_EQ(1.0, table.Score({{0, 0, 0}}));
+	EXPECT_EQ(0.75, table.Score({{-10, 0, 0}}));
+}
+
+TEST(LinearIBFTable, InternsFeaturesAcrossRNAs) {
+	Table table;
+	size_t group = table.AddGroup();
+	size_t a = table.AddRNA(group, 0, {{1, 3, 0}});
+	size_t b = table.AddRNA(group, 2, {{1, 3, 0}});
+	table.AddFalse(a, -1, {{0, 0, 0}}, 0.5);
+	table.AddFalse(b, 1, {{0, 0, 0}}, 0.0);
+	EXPECT_EQ(4u, table.Rows());
+	EXPECT_EQ(2u, table.DistinctFeatures());
+	table.Pack();
+	EXPECT_EQ(0.25, table.Score({{0, 0, 0}}));
+	EXPECT_EQ(1.0, table.Score({{-3, 0, 0}}));
+}
+
+TEST(LinearIBFTable, BoundCoversBox) {
+	auto re = librnary::RandomEngineForTests();
+	auto small = [&](int hi) {
+		return static_cast<int>(re() % hi);
+	};
+	for (int TC = 0; TC < 20; ++TC) {
+		Table table;
+		for (int g = small(3) + 1; g > 0; --g) {
+			size_t group = table.AddGroup();
+			for (int n = small(4) + 1; n > 0; --n) {
+				size_t rna = table.AddRNA(group, small(6) - 3, {{small(3), small(4), small(5)}});
+				for (int f = small(6); f > 0; --f)
+					table.AddFalse(rna, small(6) - 3, {{small(3), small(4), small(5)}}, small(100) / 100.0);
+			}
+		}
+		table.Pack();
+		for (int p = 0; p < 20; ++p) {
+			Table::Weights lo{{small(7) - 3, small(7) - 3, small(7) - 3}}, hi = lo;
+			for (auto &h : hi)
+				h += small(3);
+			double bound = table.Bound(lo, hi);
+			for (int a = lo[0]; a <= hi[0]; ++a)
+				for (int b = lo[1]; b <= hi[1]; ++b)
+					for (int c = lo[2]; c <= hi[2]; ++c)
+						EXPECT_LE(table.Score({{a, b, c}}), bound);
+			// A box of one point bounds no better than that point allows: every candidate that ties the MFE counts.
+			EXPECT_GE(table.Bound(lo, lo), table.Score(lo));
+		}
+	}
+}
@@ -0,0 +1,107 @@
+#include <gtest/gtest.h>
+
+#include "folders/min_plus.hpp"
+#include "folders/nn_affine_folder.hpp"
+#include "folders/nn_unpaired_folder.hpp"
+#include "folders/stem_length_folder.hpp"
+#include "random.hpp"
+
+using namespace std;
+
+const string DATA_TABLE_PATH = "../../data_tables/";
+
+namespace {
+const librnary::MinPlusKernel KERNELS[] = {librnary::MinPlusKernel::Scalar, librnary::MinPlusKernel::SSE41,
+										   librnary::MinPlusKernel::AVX2};
+
+/// Folds every RNA with each supported kernel, and checks the MFEs and tracebacks are those of the scalar one.
+template<typename FolderT>
+void ExpectKernelsFoldAlike(FolderT folder, const vector<librnary::PrimeStructure> &rnas) {
+	const auto active = librnary::ActiveMinPlusKernel();
+	librnary::SetMinPlusKernel(librnary::MinPlusKernel::Scalar);
+	vector<librnary::energy_t> mfes;
+	vector<librnary::Matching> structures;
+	for (const auto &rna : rnas) {
+		mfes.push_back(folder.Fold(rna));
+		structures.push_back(folder.Traceback());
+	}
+	for (auto k : KERNELS) {
+		if (!librnary::MinPlusKernelSupported(k))
+			continue;
+		librnary::SetMinPlusKernel(k);
+		for (size_t r = 0; r < rnas.size(); ++r) {
+			EXPECT_EQ(mfes[r], folder.Fold(rnas[r])) << librnary::MinPlusKernelName(k);
+			EXPECT_EQ(structures[r], folder.Traceback()) << librnary::MinPlusKernelName(k);
+		}
+	}
+	librnary::SetMinPlusKernel(active);
+}
+}
+
+TEST(MinPlus, KernelsMatchScalar) {
+	auto re = librnary::RandomEngineForTests();
+	uniform_int_distribution<librnary::energy_t> dist(-2000, 2000);
+	const auto active = librnary::ActiveMinPlusKernel();
+	// Every length up to a few vectors, so each kernel's tail is exercised.
+	for (int n = 0; n <= 70; ++n) {
+		vector<librnary::energy_t> a(n), b(n);
+		for (int t = 0; t < n; ++t) {
+			a[t] = dist(re);
+			// Some cells infinite, as in the tables.
+			b[t] = re() % 5 == 0 ? numeric_limits<librnary::energy_t>::max() / 3 : dist(re);
+		}
+		librnary::energy_t expected = numeric_limits<librnary::energy_t>::max();
+		for (int t = 0; t < n; ++t)
+			expected = min(expected, a[t] + b[t]);
+		for (auto k : KERNELS) {
+			if (!librnary::MinPlusKernelSupported(k))
+				continue;
+			librnary::SetMinPlusKernel(k);
+			EXPECT_EQ(expected, librnary::MinPlus(a.data(), b.data(), n, numeric_limits<librnary::energy_t>::max()))
+				<< librnary::MinPlusKernelName(k) << " n=" << n;
+			// The initial value bounds the result.
+			EXPECT_EQ(min(expected, -1500), librnary::MinPlus(a.data(), b.data(), n, -1500))
+				<< librnary::MinPlusKernelName(k) << " n=" << n;
+		}
+	}
+	librnary::SetMinPlusKernel(active);
+}
+
+TEST(MinPlus, UnsupportedKernelFallsBack) {
+	const auto active = librnary::ActiveMinPlusKernel();
+	EXPECT_TRUE(librnary::MinPlusKernelSupported(active));
+	EXPECT_TRUE(librnary::MinPlusKernelSupported(librnary::MinPlusKernel::Scalar));
+	for (auto k : KERNELS) {
+		librnary::SetMinPlusKernel(k);
+		EXPECT_TRUE(librnary::MinPlusKernelSupported(librnary::ActiveMinPlusKernel()));
+		if (librnary::MinPlusKernelSupported(k)) {
+			EXPECT_EQ(k, librnary::ActiveMinPlusKernel());
+		}
+	}
+	librnary::SetMinPlusKernel(active);
+}
+
+TEST(MinPlus, FoldersMatchAcrossKernels) {
+	auto re = librnary::RandomEngineForTests();
+	vector<librnary::PrimeStructure> rnas;
+	for (unsigned len : {0u, 1u, 7u, 40u, 90u})
+		rnas.push_back(librnary::RandomPrimary(re, len));
+
+	librnary::NNAffineFolder affine{librnary::NNAffineModel(DATA_TABLE_PATH)};
+	affine.SetMaxTwoLoop(30);
+	ExpectKernelsFoldAlike(affine, rnas);
+	affine.SetStacking(false);
+	affine.SetMaxSpan(30);
+	ExpectKernelsFoldAlike(affine, rnas);
+
+	librnary::StemLengthFolder stem_length{librnary::StemLengthModel(DATA_TABLE_PATH)};
+	stem_length.SetMaxTwoLoop(30);
+	ExpectKernelsFoldAlike(stem_length, rnas);
+
+	librnary::NNUnpairedFolder unpaired{librnary::NNUnpairedModel(DATA_TABLE_PATH)};
+	unpaired.SetMaxMulti(6);
+	rnas.pop_back();
+	ExpectKernelsFoldAlike(unpaired, rnas);
+	unpaired.SetStacking(false);
+	ExpectKernelsFoldAlike(unpaired, rnas);
+}
@@ -174,4 +174,173 @@ TEST(MultiArray, CopyTest4D) {
 	auto test = arr;
 	EXPECT_EQ(test[2][8][1][10], 3);
 	EXPECT_EQ(test[9][7][8][12], 8);
-}
\ No newline at end of file
+}
+TEST(MultiArray, TriangularFuzzAgainstVector2D) {
+	const int N = 97, CASES = 50000;
+	librnary::VVI vec(N + 1, librnary::VI(N + 1, 0));
+	librnary::TriangularArray<int> row_arr(N, 0);
+	librnary::TriangularArray<int, librnary::TriangularLayout::DiagonalMajor> diag_arr(N, 0);
+	librnary::TriangularArray<int, librnary::TriangularLayout::ColumnMajor> col_arr(N, 0);
+	auto re = librnary::RandomEngineForTests();
+	for (int tc = 0; tc < CASES; ++tc) {
+		int i = re() % N, j = i - 1 + re() % (N - i + 1), v = re() % 100 - 50;
+		EXPECT_EQ(vec[i + 1][j + 1], row_arr[i][j]);
+		EXPECT_EQ(vec[i + 1][j + 1], diag_arr[i][j]);
+		EXPECT_EQ(vec[i + 1][j + 1], col_arr[i][j]);
+		vec[i + 1][j + 1] = v;
+		row_arr[i][j] = v;
+		diag_arr(i, j) = v;
+		col_arr(i, j) = v;
+	}
+}
+
+TEST(MultiArray, TriangularCellsAreDistinct) {
+	const int N = 40;
+	librnary::TriangularArray<int> row_arr(N, -1);
+	librnary::TriangularArray<int, librnary::TriangularLayout::DiagonalMajor> diag_arr(N, -1);
+	librnary::TriangularArray<int, librnary::TriangularLayout::ColumnMajor> col_arr(N, -1);
+	int id = 0;
+	for (int i = 0; i <= N; ++i) {
+		for (int j = max(i - 1, 0); j < N; ++j, ++id) {
+			row_arr[i][j] = id;
+			diag_arr[i][j] = id;
+			col_arr[i][j] = id;
+		}
+	}
+	id = 0;
+	for (int i = 0; i <= N; ++i) {
+		for (int j = max(i - 1, 0); j < N; ++j, ++id) {
+			EXPECT_EQ(row_arr[i][j], id);
+			EXPECT_EQ(diag_arr[i][j], id);
+			EXPECT_EQ(col_arr[i][j], id);
+		}
+	}
+	// The cells of a column are contiguous.
+	for (int j = 0; j < N; ++j)
+		for (int i = 0; i <= j; ++i)
+			EXPECT_EQ(&col_arr(0, j) + i, &col_arr(i, j));
+}
+
+TEST(MultiArray, TriangularAlignedAndCompact) {
+	librnary::TriangularArray<int> arr(1000, 0);
+	EXPECT_EQ(reinterpret_cast<uintptr_t>(arr.Data()) % 64, 0u);
+	// Less than 51% of the equivalent square table.
+	EXPECT_LT(arr.Bytes(), 1000 * 1000 * sizeof(int) * 51 / 100);
+	arr.Assign(10, 7);
+	EXPECT_EQ(arr.Size(), 10u);
+	EXPECT_EQ(arr[3][9], 7);
+	EXPECT_DEBUG_DEATH(arr[5][2], "");
+}
+
+TEST(MultiArray, CopyTestTriangular) {
+	librnary::TriangularArray<int> arr(10, 8);
+	arr[2][8] = 3;
+	auto test = arr;
+	EXPECT_EQ(test[2][8], 3);
+	EXPECT_EQ(test[9][9], 8);
+	EXPECT_EQ(test.ToNested(0)[2][8], 3);
+	EXPECT_EQ(test.ToNested(0)[8][2], 0);
+}
+
+TEST(MultiArray, RowWindowFullMatchesTriangular) {
+	const int N = 53;
+	librnary::TriangularArray<int> tri(N, -1);
+	librnary::RowWindowArray<int> win;
+	win.Assign(N, N + 10, -1);
+	EXPECT_FALSE(win.Windowed());
+	EXPECT_EQ(tri.Bytes(), win.Bytes());
+	int id = 0;
+	for (int i = 0; i <= N; ++i)
+		for (int j = max(i - 1, 0); j < N; ++j, ++id) {
+			tri[i][j] = id;
+			win[i][j] = id;
+		}
+	for (int i = 0; i <= N; ++i)
+		for (int j = max(i - 1, 0); j < N; ++j)
+			EXPECT_EQ(tri[i][j], win(i, j));
+}
+
+TEST(MultiArray, RowWindowKeepsRecentRows) {
+	const int N = 40, W = 3;
+	librnary::RowWindowArray<int> win;
+	win.Assign(N, W, -1);
+	EXPECT_TRUE(win.Windowed());
+	EXPECT_EQ(static_cast<size_t>(W * (N + 1)) * sizeof(int), win.Bytes());
+	for (int i = N - 1; i >= 0; --i) {
+		win.ResetRow(i, -1);
+		for (int j = i - 1; j < N; ++j) {
+			EXPECT_EQ(-1, win[i][j]);
+			win[i][j] = i * N + j;
+		}
+		// Every row still in the window is intact.
+		for (int r = i; r < min(N, i + W); ++r)
+			for (int j = r - 1; j < N; ++j)
+				ASSERT_EQ(r * N + j, win[r][j]);
+	}
+}
+
+TEST(MultiArray, TriangularBandKeepsNearDiagonal) {
+	const int N = 50, B = 7;
+	librnary::TriangularArray<int> row_arr;
+	librnary::TriangularArray<int, librnary::TriangularLayout::DiagonalMajor> diag_arr;
+	librnary::TriangularArray<int, librnary::TriangularLayout::ColumnMajor> col_arr;
+	row_arr.Assign(N, -1, B);
+	diag_arr.Assign(N, -1, B);
+	col_arr.Assign(N, -1, B);
+	EXPECT_EQ(row_arr.Bytes(), col_arr.Bytes());
+	EXPECT_EQ(static_cast<size_t>(B), row_arr.Band());
+	EXPECT_EQ(static_cast<size_t>((N + 1) * (B + 1)) * sizeof(int), row_arr.Bytes());
+	EXPECT_LT(diag_arr.Bytes(), row_arr.Bytes());
+	int id = 0;
+	for (int i = 0; i <= N; ++i)
+		for (int j = i - 1; j < min(N, i + B); ++j, ++id) {
+			if (j < 0)
+				continue;
+			row_arr[i][j] = id;
+			diag_arr[i][j] = id;
+			col_arr[i][j] = id;
+		}
+	id = 0;
+	for (int i = 0; i <= N; ++i)
+		for (int j = i - 1; j < min(N, i + B); ++j, ++id) {
+			if (j < 0)
+				continue;
+			EXPECT_EQ(id, row_arr(i, j));
+			EXPECT_EQ(id, diag_arr(i, j));
+			EXPECT_EQ(id, col_arr(i, j));
+		}
+	EXPECT_EQ(-1, row_arr.ToNested(-1)[3][3 + B]);
+	EXPECT_DEBUG_DEATH(row_arr[3][3 + B], "");
+	// A band as wide as the table is no band at all.
+	row_arr.Assign(N, 0, N);
+	EXPECT_EQ(librnary::TriangularArray<int>(N, 0).Bytes(), row_arr.Bytes());
+}
+
+TEST(MultiArray, RowWindowBandKeepsRecentRows) {
+	const int N = 40, W = 3, B = 6;
+	librnary::RowWindowArray<int> win;
+	win.Assign(N, W, -1, B);
+	EXPECT_TRUE(win.Windowed());
+	EXPECT_EQ(static_cast<size_t>(W * (B + 1)) * sizeof(int), win.Bytes());
+	for (int i = N - 1; i >= 0; --i) {
+		win.ResetRow(i, -1);
+		for (int j = i - 1; j < min(N, i + B); ++j) {
+			EXPECT_EQ(-1, win[i][j]);
+			win[i][j] = i * N + j;
+		}
+		for (int r = i; r < min(N, i + W); ++r)
+			for (int j = r - 1; j < min(N, r + B); ++j)
+				ASSERT_EQ(r * N + j, win[r][j]);
+	}
+	EXPECT_DEBUG_DEATH(win[3][3 + B], "");
+	// Banded but keeping every row.
+	win.Assign(N, N, -1, B);
+	EXPECT_FALSE(win.Windowed());
+	EXPECT_EQ(static_cast<size_t>((N + 1) * (B + 1)) * sizeof(int), win.Bytes());
+	for (int i = 0; i < N; ++i)
+		for (int j = i - 1; j < min(N, i + B); ++j)
+			win(i, j) = i * N + j;
+	for (int i = 0; i < N; ++i)
+		for (int j = i - 1; j < min(N, i + B); ++j)
+			ASSERT_EQ(i * N + j, win[i][j]);
+}
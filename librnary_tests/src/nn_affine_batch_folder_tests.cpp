@@ -0,0 +1,54 @@
+#include <gtest/gtest.h>
+
+#include "folders/nn_affine_batch_folder.hpp"
+#include "random.hpp"
+
+using namespace std;
+
+const string DATA_TABLE_PATH = "../../data_tables/";
+
+namespace {
+/// Checks every lane of batch folds as folder does.
+void ExpectMatchesFolder(librnary::NNAffineFolder folder, const vector<librnary::PrimeStructure> &rnas) {
+	librnary::NNAffineBatchFolder batch(folder);
+	auto mfes = batch.Fold(rnas);
+	ASSERT_EQ(rnas.size(), mfes.size());
+	for (size_t w = 0; w < rnas.size(); ++w) {
+		EXPECT_EQ(folder.Fold(rnas[w]), mfes[w]);
+		EXPECT_EQ(folder.Traceback(), batch.Traceback(w));
+	}
+}
+}
+
+TEST(NNAffineBatchFolder, MatchesNNAffineFolder) {
+	auto re = librnary::RandomEngineForTests();
+	librnary::NNAffineFolder folder{librnary::NNAffineModel(DATA_TABLE_PATH)};
+	for (int tc = 0; tc < 8; ++tc) {
+		folder.SetStacking(tc % 2 == 0);
+		folder.SetLonelyPairs(tc % 4 < 2);
+		folder.SetMaxTwoLoop(tc < 4 ? 30 : 1000);
+		vector<librnary::PrimeStructure> rnas;
+		for (int w = 0; w < librnary::NNAffineBatchFolder::Width; ++w)
+			rnas.push_back(librnary::RandomPrimary(re, 60));
+		ExpectMatchesFolder(folder, rnas);
+	}
+}
+
+TEST(NNAffineBatchFolder, MixedLengthsAndPartialBatches) {
+	auto re = librnary::RandomEngineForTests();
+	librnary::NNAffineModel model(DATA_TABLE_PATH);
+	model.SetMLParams(34, 0, 4);
+	librnary::NNAffineFolder folder(model);
+	folder.SetMaxTwoLoop(30);
+	vector<librnary::PrimeStructure> rnas;
+	for (int w = 0; w < librnary::NNAffineBatchFolder::Width; ++w)
+		rnas.push_back(librnary::RandomPrimary(re, 70 + re() % 12));
+	ExpectMatchesFolder(folder, rnas);
+	// Fewer RNAs than lanes, including very short and empty ones.
+	ExpectMatchesFolder(folder, {librnary::RandomPrimary(re, 90), librnary::PrimeStructure(),
+								 librnary::RandomPrimary(re, 3), librnary::RandomPrimary(re, 45)});
+	// A span limit bands the lane tables as it does the scalar ones.
+	folder.SetMaxSpan(25);
+	ExpectMatchesFolder(folder, rnas);
+	EXPECT_TRUE(librnary::NNAffineBatchFolder(folder).Fold({}).empty());
+}
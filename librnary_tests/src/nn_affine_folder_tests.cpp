@@ -6,6 +6,11 @@
 
 #include "folders/nn_affine_folder.hpp"
 #include "scorers/nn_scorer.hpp"
+#include "random.hpp"
+#include "folders/brute_folder.hpp"
+
+#include <map>
+#include <set>
 
 using namespace std;
 
@@ -63,4 +68,252 @@ TEST(NNAffineFolder, MLInitBonus) {
 	scorer.SetRNA(prim);
 	EXPECT_EQ(fold_mfe, -523);
 	EXPECT_EQ(fold_mfe, scorer.ScoreExterior(sstree.RootSurface()));
-}
\ No newline at end of file
+}
+
+TEST(NNAffineFolder, StaticDispatchMatchesVirtual) {
+	auto re = librnary::RandomEngineForTests();
+	librnary::NNAffineModel model(DATA_TABLE_PATH);
+	model.SetMLParams(-183, 11, 1);
+	librnary::NNAffineFolder static_folder(model), virtual_folder(model);
+	virtual_folder.SetStaticDispatch(false);
+	ASSERT_TRUE(static_folder.StaticDispatch());
+	for (int t = 0; t < 5; ++t) {
+		auto prim = librnary::RandomPrimary(re, 80);
+		EXPECT_EQ(virtual_folder.Fold(prim), static_folder.Fold(prim));
+		EXPECT_EQ(virtual_folder.Traceback(), static_folder.Traceback());
+	}
+}
+
+TEST(NNAffineFolder, ParallelFillMatchesSerial) {
+	auto re = librnary::RandomEngineForTests();
+	librnary::NNAffineModel model(DATA_TABLE_PATH);
+	librnary::NNAffineFolder serial(model), parallel(model);
+	parallel.SetThreads(4);
+	ASSERT_EQ(1u, serial.Threads());
+	ASSERT_EQ(4u, parallel.Threads());
+	for (unsigned len : {0u, 1u, 5u, 60u, 150u}) {
+		auto prim = librnary::RandomPrimary(re, len);
+		EXPECT_EQ(serial.Fold(prim), parallel.Fold(prim));
+		EXPECT_EQ(serial.Traceback(), parallel.Traceback());
+	}
+	// The virtual dispatch path shares the fill code, but check it anyway.
+	parallel.SetStaticDispatch(false);
+	auto prim = librnary::RandomPrimary(re, 100);
+	EXPECT_EQ(serial.Fold(prim), parallel.Fold(prim));
+	EXPECT_EQ(serial.Traceback(), parallel.Traceback());
+}
+
+TEST(NNAffineFolder, EnergyOnlyMatchesFullFold) {
+	auto re = librnary::RandomEngineForTests();
+	librnary::NNAffineModel model(DATA_TABLE_PATH);
+	model.SetMLParams(-183, 11, 1);
+	librnary::NNAffineFolder full(model), energy_only(model);
+	energy_only.SetEnergyOnly(true);
+	// Energy-only folds ignore the thread count, as their tables must be filled row by row.
+	energy_only.SetThreads(2);
+	for (unsigned len : {0u, 1u, 5u, 60u, 150u}) {
+		auto prim = librnary::RandomPrimary(re, len);
+		EXPECT_EQ(full.Fold(prim), energy_only.Fold(prim));
+		EXPECT_THROW(energy_only.Traceback(), logic_error);
+		// Two of the five triangular tables are reduced to a few rows, and the shadows MinPlus reads are dropped.
+		if (len >= 60) {
+			EXPECT_LT(energy_only.TableBytes(), full.TableBytes() * 65 / 100);
+		}
+	}
+}
+
+TEST(NNAffineFolder, MaxSpanLimitsPairs) {
+	auto re = librnary::RandomEngineForTests();
+	librnary::NNAffineModel model(DATA_TABLE_PATH);
+	librnary::NNScorer<librnary::NNAffineModel> scorer(model);
+	librnary::NNAffineFolder full(model), banded(model), banded_parallel(model), banded_energy(model);
+	banded_parallel.SetThreads(2);
+	banded_energy.SetEnergyOnly(true);
+	for (unsigned len : {0u, 1u, 40u, 150u}) {
+		auto prim = librnary::RandomPrimary(re, len);
+		scorer.SetRNA(prim);
+		librnary::energy_t full_mfe = full.Fold(prim), prev_mfe = model.MaxMFE();
+		for (int span : {4, 25, 60, 149, 1000}) {
+			for (auto *folder : {&banded, &banded_parallel, &banded_energy})
+				folder->SetMaxSpan(static_cast<unsigned>(span));
+			librnary::energy_t mfe = banded.Fold(prim);
+			auto m = banded.Traceback();
+			for (int i = 0; i < static_cast<int>(m.size()); ++i)
+				EXPECT_LE(abs(m[i] - i), span);
+			EXPECT_EQ(mfe, scorer.ScoreExterior(librnary::SSTree(m).RootSurface()));
+			EXPECT_EQ(mfe, banded_parallel.Fold(prim));
+			EXPECT_EQ(m, banded_parallel.Traceback());
+			EXPECT_EQ(mfe, banded_energy.Fold(prim));
+			// Widening the span can only find better structures.
+			EXPECT_LE(mfe, prev_mfe);
+			EXPECT_LE(full_mfe, mfe);
+			prev_mfe = mfe;
+			if (span >= static_cast<int>(len)) {
+				EXPECT_EQ(full_mfe, mfe);
+				EXPECT_EQ(full.Traceback(), m);
+			}
+		}
+		// The banded tables are O(N * span).
+		banded.SetMaxSpan(25);
+		banded.Fold(prim);
+		if (len >= 150) {
+			EXPECT_LT(banded.TableBytes(), full.TableBytes() * 40 / 100);
+		}
+	}
+}
+
+TEST(NNAffineFolder, FoldMutantsMatchesFold) {
+	auto re = librnary::RandomEngineForTests();
+	librnary::NNAffineModel model(DATA_TABLE_PATH);
+	librnary::NNAffineFolder base(model), fresh(model);
+	auto prim = librnary::RandomPrimary(re, 45);
+	auto variants = librnary::SingleMutants(prim);
+	ASSERT_EQ(3 * prim.size(), variants.size());
+	variants.push_back({});
+	for (int v = 0; v < 20; ++v) {
+		vector<librnary::PointMutation> muts;
+		for (int k = 0; k < 3; ++k)
+			muts.push_back({static_cast<int>(re() % prim.size()), librnary::RandomPrimary(re, 1)[0]});
+		variants.push_back(muts);
+	}
+	// Threads, lonely pairs, and maximum span.
+	const struct {
+		size_t threads;
+		bool lonely;
+		unsigned span;
+	} configs[] = {{1, true, 1000}, {3, false, 1000}, {1, false, 20}};
+	for (const auto &config : configs) {
+		for (auto *folder : {&base, &fresh}) {
+			folder->SetLonelyPairs(config.lonely);
+			folder->SetMaxSpan(config.span);
+		}
+		base.SetThreads(config.threads);
+		librnary::energy_t mfe = base.Fold(prim);
+		auto m = base.Traceback();
+		vector<librnary::Matching> structures;
+		auto mfes = base.FoldMutants(variants, &structures);
+		ASSERT_EQ(variants.size(), mfes.size());
+		for (size_t v = 0; v < variants.size(); ++v) {
+			EXPECT_EQ(fresh.Fold(librnary::Mutate(prim, variants[v])), mfes[v]);
+			EXPECT_EQ(fresh.Traceback(), structures[v]);
+		}
+		// The folder's own fold is untouched.
+		EXPECT_EQ(m, base.Traceback());
+		EXPECT_EQ(mfe, base.FoldMutants({{}})[0]);
+	}
+	// The C bulge of this 5S rRNA counts the places it could slide to, along the run of Cs up to the mutation.
+	prim = librnary::StringToPrimary("GAUCUGGUGGCCAUGGCGGGGCGCAAUCACCCGAUCCCAUCCCGAACUCGGCCGUCAAAUGCCCCAGCGCCCAUGAUACUCUGCCUC"
+											 "AAGGCACGGAAAAGUCGGUCGCCGCCAGAUCC");
+	for (auto *folder : {&base, &fresh}) {
+		folder->SetLonelyPairs(true);
+		folder->SetMaxSpan(1000);
+	}
+	base.Fold(prim);
+	variants = {{{64, librnary::G}}};
+	EXPECT_EQ(fresh.Fold(librnary::Mutate(prim, variants[0])), base.FoldMutants(variants)[0]);
+	// An energy-only fold has none of the rows to reuse.
+	base.SetEnergyOnly(true);
+	base.Fold(prim);
+	EXPECT_THROW(base.FoldMutants(variants), logic_error);
+}
+
+TEST(NNAffineFolder, SuboptimalMatchesBrute) {
+	auto re = librnary::RandomEngineForTests();
+	librnary::NNAffineModel model(DATA_TABLE_PATH);
+	librnary::NNScorer<librnary::NNAffineModel> scorer(model);
+	librnary::BruteFolder brute(librnary::StructureEnumerator(3));
+	librnary::NNAffineFolder folder(model);
+	const librnary::energy_t delta = 30;
+	for (bool stacking : {true, false}) {
+		folder.SetStacking(stacking);
+		scorer.SetStacking(stacking);
+		for (int tc = 0; tc < 4; ++tc) {
+			auto prim = librnary::RandomPrimary(re, 16 + 2 * tc);
+			librnary::energy_t mfe = folder.Fold(prim);
+			map<librnary::Matching, librnary::energy_t> found;
+			size_t visited = folder.Suboptimal(delta, [&](librnary::energy_t e, const librnary::Matching &m) {
+				EXPECT_TRUE(found.emplace(m, e).second);
+				return true;
+			});
+			EXPECT_EQ(found.size(), visited);
+			auto expected = brute.FoldMFE(scorer, prim, delta);
+			EXPECT_EQ(expected.size(), found.size());
+			for (const auto &t : expected) {
+				auto it = found.find(get<1>(t));
+				ASSERT_NE(found.end(), it);
+				EXPECT_EQ(get<0>(t), it->second);
+			}
+			EXPECT_EQ(mfe, found[folder.Traceback()]);
+		}
+	}
+}
+
+TEST(NNAffineFolder, SuboptimalStopsWhenAsked) {
+	auto re = librnary::RandomEngineForTests();
+	librnary::NNAffineModel model(DATA_TABLE_PATH);
+	librnary::NNAffineFolder folder(model);
+	librnary::energy_t mfe = folder.Fold(librnary::RandomPrimary(re, 120));
+	size_t calls = 0;
+	size_t visited = folder.Suboptimal(1000, [&](librnary::energy_t e, const librnary::Matching &) {
+		EXPECT_LE(mfe, e);
+		EXPECT_LE(e, mfe + 1000);
+		return ++calls < 5;
+	});
+	EXPECT_EQ(5u, visited);
+	EXPECT_EQ(5u, calls);
+	// Only the MFE structures are within 0 of the MFE.
+	folder.Suboptimal(0, [&](librnary::energy_t e, const librnary::Matching &) {
+		EXPECT_EQ(mfe, e);
+		return true;
+	});
+	// An energy-only fold cannot be enumerated.
+	folder.SetEnergyOnly(true);
+	folder.Fold(librnary::RandomPrimary(re, 40));
+	EXPECT_THROW(folder.Suboptimal(0, [](librnary::energy_t, const librnary::Matching &) {
+		return true;
+	}), logic_error);
+}
+
+TEST(NNAffineFolder, TracebackKBestMatchesBrute) {
+	auto re = librnary::RandomEngineForTests();
+	librnary::NNAffineModel model(DATA_TABLE_PATH);
+	librnary::NNScorer<librnary::NNAffineModel> scorer(model);
+	librnary::BruteFolder brute(librnary::StructureEnumerator(3));
+	librnary::NNAffineFolder folder(model);
+	const size_t k = 25;
+	for (bool stacking : {true, false}) {
+		folder.SetStacking(stacking);
+		scorer.SetStacking(stacking);
+		for (int tc = 0; tc < 4; ++tc) {
+			auto prim = librnary::RandomPrimary(re, 16 + 2 * tc);
+			librnary::energy_t mfe = folder.Fold(prim);
+			auto kbest = folder.TracebackKBest(k);
+			ASSERT_EQ(k, kbest.size());
+			EXPECT_EQ(mfe, get<0>(kbest.front()));
+			scorer.SetRNA(prim);
+			set<librnary::Matching> distinct;
+			vector<librnary::energy_t> energies;
+			for (size_t x = 0; x < kbest.size(); ++x) {
+				if (x > 0) {
+					EXPECT_LE(get<0>(kbest[x - 1]), get<0>(kbest[x]));
+				}
+				EXPECT_TRUE(distinct.insert(get<1>(kbest[x])).second);
+				EXPECT_EQ(scorer.ScoreExterior(librnary::SSTree(get<1>(kbest[x])).RootSurface()), get<0>(kbest[x]));
+				energies.push_back(get<0>(kbest[x]));
+			}
+			vector<librnary::energy_t> expected;
+			for (const auto &t : brute.FoldN(scorer, prim, k))
+				expected.push_back(get<0>(t));
+			sort(expected.begin(), expected.end());
+			EXPECT_EQ(expected, energies);
+		}
+	}
+	// Asking for more structures than there are gives all of them.
+	auto prim = librnary::RandomPrimary(re, 10);
+	folder.Fold(prim);
+	EXPECT_EQ(brute.FoldN(scorer, prim, 1000).size(), folder.TracebackKBest(1000).size());
+	// An energy-only fold cannot be traced back.
+	folder.SetEnergyOnly(true);
+	folder.Fold(prim);
+	EXPECT_THROW(folder.TracebackKBest(k), logic_error);
+}
@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+
+#include "folders/nn_affine_param_batch_folder.hpp"
+#include "random.hpp"
+
+using namespace std;
+
+const string DATA_TABLE_PATH = "../../data_tables/";
+
+namespace {
+typedef librnary::NNAffineParamBatchFolder::MLParams MLParams;
+
+/// Checks every lane of a batch fold as folder does with the lane's multi-loop parameters.
+void ExpectMatchesFolder(librnary::NNAffineModel model, librnary::NNAffineFolder folder,
+						 const librnary::PrimeStructure &rna, const vector<MLParams> &params) {
+	librnary::NNAffineParamBatchFolder batch(folder);
+	auto mfes = batch.Fold(rna, params);
+	ASSERT_EQ(params.size(), mfes.size());
+	for (size_t w = 0; w < params.size(); ++w) {
+		model.SetMLParams(params[w].init, params[w].branch, params[w].unpaired);
+		folder.SetModel(model);
+		EXPECT_EQ(folder.Fold(rna), mfes[w]);
+		EXPECT_EQ(folder.Traceback(), batch.Traceback(w));
+	}
+}
+
+/// Multi-loop parameters from the ranges train_linear searches.
+vector<MLParams> RandomParams(default_random_engine &re, size_t count) {
+	vector<MLParams> params;
+	for (size_t w = 0; w < count; ++w)
+		params.push_back({static_cast<librnary::energy_t>(30 + re() % 171),
+						  static_cast<librnary::energy_t>(-60 + static_cast<int>(re() % 91)),
+						  static_cast<librnary::energy_t>(-60 + static_cast<int>(re() % 91))});
+	return params;
+}
+}
+
+TEST(NNAffineParamBatchFolder, MatchesNNAffineFolder) {
+	auto re = librnary::RandomEngineForTests();
+	librnary::NNAffineModel model(DATA_TABLE_PATH);
+	librnary::NNAffineFolder folder(model);
+	for (int tc = 0; tc < 8; ++tc) {
+		folder.SetStacking(tc % 2 == 0);
+		folder.SetLonelyPairs(tc % 4 < 2);
+		folder.SetMaxTwoLoop(tc < 4 ? 30 : 1000);
+		auto params = RandomParams(re, librnary::NNAffineParamBatchFolder::Width);
+		// The model's own parameters too.
+		params[0] = {model.MLInitCost(), model.MLBranchCost(), model.MLUnpairedCost()};
+		ExpectMatchesFolder(model, folder, librnary::RandomPrimary(re, 80), params);
+	}
+}
+
+TEST(NNAffineParamBatchFolder, PartialBatchesAndShortRNAs) {
+	auto re = librnary::RandomEngineForTests();
+	librnary::NNAffineModel model(DATA_TABLE_PATH);
+	librnary::NNAffineFolder folder(model);
+	folder.SetMaxTwoLoop(30);
+	folder.SetLonelyPairs(false);
+	ExpectMatchesFolder(model, folder, librnary::RandomPrimary(re, 90), RandomParams(re, 3));
+	ExpectMatchesFolder(model, folder, librnary::RandomPrimary(re, 3), RandomParams(re, 2));
+	ExpectMatchesFolder(model, folder, librnary::PrimeStructure(), RandomParams(re, 1));
+	// A span limit bands the lane tables as it does the scalar ones.
+	folder.SetMaxSpan(25);
+	ExpectMatchesFolder(model, folder, librnary::RandomPrimary(re, 90), RandomParams(re, 5));
+}
+
+TEST(NNAffineParamBatchFolder, RejectsBadParamCounts) {
+	auto re = librnary::RandomEngineForTests();
+	librnary::NNAffineModel model(DATA_TABLE_PATH);
+	librnary::NNAffineParamBatchFolder batch(model);
+	auto rna = librnary::RandomPrimary(re, 20);
+	EXPECT_THROW(batch.Fold(rna, vector<MLParams>()), invalid_argument);
+	EXPECT_THROW(batch.Fold(rna, RandomParams(re, librnary::NNAffineParamBatchFolder::Width + 1)), invalid_argument);
+}
@@ -0,0 +1,304 @@
+#include <gtest/gtest.h>
+
+#include "folders/nn_affine_pf_folder.hpp"
+#include "folders/brute_folder.hpp"
+#include "scorers/nn_scorer.hpp"
+#include "random.hpp"
+
+#include <cmath>
+#include <map>
+#include <unordered_map>
+
+using namespace std;
+
+const string DATA_TABLE_PATH = "../../data_tables/";
+
+namespace {
+/// Checks every probability is in [0, 1], and so is the probability of each nucleotide being paired.
+void ExpectValidProbabilities(const librnary::TriangularArray<double> &probs, int n, int band) {
+	vector<double> paired(static_cast<size_t>(n), 0.0);
+	for (int i = 0; i < n; ++i)
+		for (int j = i + 1; j < n && j - i < band; ++j) {
+			EXPECT_LE(0.0, probs[i][j]);
+			paired[i] += probs[i][j];
+			paired[j] += probs[i][j];
+		}
+	for (double p : paired)
+		EXPECT_LE(p, 1.0 + 1e-9);
+}
+
+/**
+ * Enumerates the states NNAffinePFFolder sums over: every traceback of the decomposition of NNAffineFolder, each a
+ * structure with one choice of its dangles and coaxial stacks.
+ */
+class StackingStateEnumerator : public librnary::NNAffineFolder {
+	/// Whether each state, by StateKey, has any traceback.
+	unordered_map<uint64_t, bool> derivable;
+	vector<TState> todo;
+	librnary::Matching match;
+
+	bool Derivable(const TState &s) {
+		auto it = derivable.find(StateKey(s));
+		if (it != derivable.end())
+			return it->second;
+		bool any = false;
+		// Pairs too close for a hairpin leave the states inside them empty.
+		if ((s.t == ET || s.i <= s.j) && (s.t != PT || CanPair(s.i, s.j))) {
+			Decompositions(em, s, [&](librnary::energy_t e, initializer_list<TState> children) {
+				if (e >= em.MaxMFE())
+					return;
+				for (const auto &c : children)
+					if (!Derivable(c))
+						return;
+				any = true;
+			});
+		}
+		derivable[StateKey(s)] = any;
+		return any;
+	}
+
+	template<typename F>
+	void Expand(librnary::energy_t energy, const F &f) {
+		if (todo.empty()) {
+			f(energy, match);
+			return;
+		}
+		const TState s = todo.back();
+		todo.pop_back();
+		if (s.t == PT) {
+			match[s.i] = s.j;
+			match[s.j] = s.i;
+		}
+		Decompositions(em, s, [&](librnary::energy_t e, initializer_list<TState> children) {
+			if (e >= em.MaxMFE())
+				return;
+			for (const auto &c : children)
+				if (!Derivable(c))
+					return;
+			todo.insert(todo.end(), children.begin(), children.end());
+			Expand(energy + e, f);
+			todo.erase(todo.end() - children.size(), todo.end());
+		});
+		if (s.t == PT) {
+			match[s.i] = s.i;
+			match[s.j] = s.j;
+		}
+		todo.push_back(s);
+	}
+
+public:
+	explicit StackingStateEnumerator(const librnary::NNAffineModel &model)
+		: NNAffineFolder(model) {}
+
+	/// Calls f(e, match) for each stacking state of prim, with its free energy change.
+	template<typename F>
+	void Enumerate(const librnary::PrimeStructure &prim, const F &f) {
+		rna = prim;
+		em.SetRNA(prim);
+		derivable.clear();
+		match = librnary::EmptyMatching(static_cast<unsigned>(prim.size()));
+		todo = {TState(static_cast<int>(prim.size()) - 1)};
+		Expand(0, f);
+	}
+};
+}
+
+TEST(NNAffinePFFolder, EmptyRNA) {
+	librnary::NNAffineModel model(DATA_TABLE_PATH);
+	librnary::NNAffinePFFolder folder(model);
+	EXPECT_EQ(0.0, folder.Fold(librnary::PrimeStructure()));
+	EXPECT_EQ(0.0, folder.LogPartitionFunction());
+}
+
+TEST(NNAffinePFFolder, MatchesBruteWithoutStacking) {
+	auto re = librnary::RandomEngineForTests();
+	librnary::NNAffineModel model(DATA_TABLE_PATH);
+	librnary::NNScorer<librnary::NNAffineModel> scorer(model);
+	scorer.SetStacking(false);
+	librnary::BruteFolder brute(librnary::StructureEnumerator(3));
+	librnary::NNAffinePFFolder folder(model);
+	folder.SetStacking(false);
+	for (int tc = 0; tc < 6; ++tc) {
+		folder.SetStaticDispatch(tc % 2 == 0);
+		auto prim = librnary::RandomPrimary(re, 14 + 2 * tc);
+		vector<vector<double>> weights;
+		const double z = brute.PartitionFunction(scorer, prim, librnary::RT37, &weights);
+		const librnary::kcalmol_t g = folder.Fold(prim);
+		EXPECT_NEAR(log(z), folder.LogPartitionFunction(), 1e-9);
+		EXPECT_NEAR(-librnary::RT37 * log(z), g, 1e-9);
+		auto probs = folder.BasePairProbabilities();
+		for (size_t i = 0; i < prim.size(); ++i)
+			for (size_t j = i + 1; j < prim.size(); ++j)
+				EXPECT_NEAR(weights[i][j] / z, probs[i][j], 1e-9);
+	}
+}
+
+TEST(NNAffinePFFolder, StackingCountsEveryStacking) {
+	auto re = librnary::RandomEngineForTests();
+	librnary::NNAffineModel model(DATA_TABLE_PATH);
+	librnary::NNScorer<librnary::NNAffineModel> scorer(model);
+	librnary::BruteFolder brute(librnary::StructureEnumerator(3));
+	librnary::NNAffinePFFolder folder(model);
+	for (int tc = 0; tc < 4; ++tc) {
+		auto prim = librnary::RandomPrimary(re, 14 + 2 * tc);
+		// Each structure has at least the weight of its best stacking.
+		const double z = brute.PartitionFunction(scorer, prim, librnary::RT37);
+		folder.SetKT(librnary::RT37);
+		folder.Fold(prim);
+		EXPECT_LE(log(z), folder.LogPartitionFunction() + 1e-9);
+		ExpectValidProbabilities(folder.BasePairProbabilities(), static_cast<int>(prim.size()),
+								 static_cast<int>(prim.size()));
+		// Near absolute zero only the MFE states count. Much colder and the weights of some loops underflow.
+		folder.SetKT(0.02);
+		EXPECT_NEAR(librnary::EnergyToKCal(folder.MFE()), folder.Fold(prim), 0.1);
+	}
+}
+
+TEST(NNAffinePFFolder, MatchesStackingStateEnumeration) {
+	auto re = librnary::RandomEngineForTests();
+	librnary::NNAffineModel model(DATA_TABLE_PATH);
+	librnary::NNScorer<librnary::NNAffineModel> scorer(model);
+	librnary::BruteFolder brute(librnary::StructureEnumerator(3));
+	StackingStateEnumerator enumerator(model);
+	librnary::NNAffinePFFolder folder(model);
+	for (int tc = 0; tc < 4; ++tc) {
+		auto prim = librnary::RandomPrimary(re, 16 + 2 * tc);
+		const size_t n = prim.size();
+		double z = 0.0;
+		vector<vector<double>> weights(n, vector<double>(n, 0.0));
+		map<librnary::Matching, librnary::energy_t> best;
+		enumerator.Enumerate(prim, [&](librnary::energy_t e, const librnary::Matching &m) {
+			const double w = exp(-librnary::EnergyToKCal(e) / librnary::RT37);
+			z += w;
+			for (size_t i = 0; i < n; ++i)
+				if (m[i] > static_cast<int>(i))
+					weights[i][m[i]] += w;
+			auto it = best.emplace(m, e).first;
+			it->second = min(it->second, e);
+		});
+		// The states are exactly the stackings of the structures, the best of which scores the structure.
+		auto structures = brute.FoldN(scorer, prim, 1000000);
+		EXPECT_EQ(structures.size(), best.size());
+		for (const auto &t : structures) {
+			auto it = best.find(get<1>(t));
+			ASSERT_NE(best.end(), it);
+			EXPECT_EQ(get<0>(t), it->second);
+		}
+		folder.Fold(prim);
+		EXPECT_NEAR(log(z), folder.LogPartitionFunction(), 1e-9);
+		auto probs = folder.BasePairProbabilities();
+		for (size_t i = 0; i < n; ++i)
+			for (size_t j = i + 1; j < n; ++j)
+				EXPECT_NEAR(weights[i][j] / z, probs[i][j], 1e-9);
+	}
+}
+
+TEST(NNAffinePFFolder, ThreadsAndSpanKeepResults) {
+	auto re = librnary::RandomEngineForTests();
+	librnary::NNAffineModel model(DATA_TABLE_PATH);
+	librnary::NNAffinePFFolder folder(model);
+	auto prim = librnary::RandomPrimary(re, 90);
+	const auto n = static_cast<int>(prim.size());
+	const librnary::kcalmol_t g = folder.Fold(prim);
+	EXPECT_LE(g, librnary::EnergyToKCal(folder.MFE()));
+	auto probs = folder.BasePairProbabilities();
+	ExpectValidProbabilities(probs, n, n);
+
+	folder.SetThreads(3);
+	EXPECT_EQ(g, folder.Fold(prim));
+	auto threaded = folder.BasePairProbabilities();
+	for (int i = 0; i < n; ++i)
+		for (int j = i + 1; j < n; ++j)
+			EXPECT_EQ(probs[i][j], threaded[i][j]);
+
+	// A span as long as the RNA changes nothing, and a shorter one only leaves out states.
+	folder.SetMaxSpan(static_cast<unsigned>(n));
+	EXPECT_EQ(g, folder.Fold(prim));
+	folder.SetMaxSpan(20);
+	EXPECT_LE(g, folder.Fold(prim));
+	ExpectValidProbabilities(folder.BasePairProbabilities(), n, 21);
+}
+
+TEST(NNAffinePFFolder, TakesSettingsOfFolder) {
+	auto re = librnary::RandomEngineForTests();
+	librnary::NNAffineModel model(DATA_TABLE_PATH);
+	librnary::NNAffineFolder mfe_folder(model);
+	mfe_folder.SetMaxTwoLoop(12);
+	mfe_folder.SetLonelyPairs(false);
+	mfe_folder.SetStacking(false);
+	mfe_folder.SetMaxSpan(30);
+	librnary::NNAffinePFFolder from_folder(mfe_folder), by_hand(model);
+	by_hand.SetMaxTwoLoop(12);
+	by_hand.SetLonelyPairs(false);
+	by_hand.SetStacking(false);
+	by_hand.SetMaxSpan(30);
+	EXPECT_EQ(12, from_folder.MaxTwoLoop());
+	EXPECT_FALSE(from_folder.LonelyPairs());
+	EXPECT_FALSE(from_folder.Stacking());
+	EXPECT_EQ(30, from_folder.MaxSpan());
+	auto prim = librnary::RandomPrimary(re, 60);
+	EXPECT_EQ(by_hand.Fold(prim), from_folder.Fold(prim));
+}
+
+TEST(NNAffinePFFolder, LongRNAStaysInRange) {
+	auto re = librnary::RandomEngineForTests();
+	librnary::NNAffineModel model(DATA_TABLE_PATH);
+	librnary::NNAffinePFFolder folder(model);
+	folder.SetMaxSpan(60);
+	folder.SetMaxTwoLoop(30);
+	auto prim = librnary::RandomPrimary(re, 2000);
+	const librnary::kcalmol_t g = folder.Fold(prim);
+	EXPECT_TRUE(std::isfinite(folder.LogPartitionFunction()));
+	EXPECT_LE(g, librnary::EnergyToKCal(folder.MFE()));
+	EXPECT_GT(g, librnary::EnergyToKCal(folder.MFE()) - 100.0);
+}
+
+TEST(NNAffinePFFolder, SamplesFollowBoltzmann) {
+	auto re = librnary::RandomEngineForTests();
+	librnary::NNAffineModel model(DATA_TABLE_PATH);
+	librnary::NNScorer<librnary::NNAffineModel> scorer(model);
+	scorer.SetStacking(false);
+	librnary::NNAffinePFFolder folder(model);
+	folder.SetStacking(false);
+	auto prim = librnary::RandomPrimary(re, 20);
+	folder.Fold(prim);
+	const size_t count = 20000;
+	map<librnary::Matching, size_t> drawn;
+	for (const auto &m : folder.Sample(count, re))
+		++drawn[m];
+	// Every structure drawn at least 2% of the time should be drawn in proportion to its Boltzmann weight.
+	const double log_z = folder.LogPartitionFunction();
+	scorer.SetRNA(prim);
+	for (const auto &kv : drawn) {
+		if (kv.second < count / 50)
+			continue;
+		const librnary::energy_t e = scorer.ScoreExterior(librnary::SSTree(kv.first).RootSurface());
+		const double p = exp(-librnary::EnergyToKCal(e) / librnary::RT37 - log_z);
+		EXPECT_NEAR(p, static_cast<double>(kv.second) / count, 0.015);
+	}
+}
+
+TEST(NNAffinePFFolder, SampledPairsMatchProbabilities) {
+	auto re = librnary::RandomEngineForTests();
+	librnary::NNAffineModel model(DATA_TABLE_PATH);
+	librnary::NNAffinePFFolder folder(model);
+	auto prim = librnary::RandomPrimary(re, 60);
+	const auto n = static_cast<int>(prim.size());
+	folder.Fold(prim);
+	auto probs = folder.BasePairProbabilities();
+	const size_t count = 10000;
+	auto samples = folder.Sample(count, re);
+	ASSERT_EQ(count, samples.size());
+	librnary::TriangularArray<double> freqs(prim.size(), 0.0);
+	for (const auto &m : samples) {
+		for (int i = 0; i < n; ++i)
+			if (m[i] > i)
+				freqs[i][m[i]] += 1.0 / count;
+	}
+	for (int i = 0; i < n; ++i)
+		for (int j = i + 1; j < n; ++j)
+			EXPECT_NEAR(probs[i][j], freqs[i][j], 0.03);
+	// The same engine state draws the same structures.
+	auto re_copy = re;
+	EXPECT_EQ(folder.Sample(100, re), folder.Sample(100, re_copy));
+}
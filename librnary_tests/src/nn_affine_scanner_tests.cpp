@@ -0,0 +1,137 @@
+#include <gtest/gtest.h>
+
+#include "folders/nn_affine_scanner.hpp"
+#include "scorers/nn_scorer.hpp"
+#include "random.hpp"
+
+using namespace std;
+
+const string DATA_TABLE_PATH = "../../data_tables/";
+
+namespace {
+/// Scans prim, pushing it in pieces of random length up to max_piece.
+vector<librnary::ScanWindow> Scan(librnary::NNAffineScanner &scanner, const librnary::PrimeStructure &prim,
+								  default_random_engine &re, size_t max_piece) {
+	vector<librnary::ScanWindow> windows;
+	auto emit = [&](const librnary::ScanWindow &w) {
+		windows.push_back(w);
+	};
+	for (size_t pos = 0; pos < prim.size();) {
+		size_t len = min(prim.size() - pos, static_cast<size_t>(re() % max_piece + 1));
+		scanner.Push(librnary::PrimeStructure(prim.begin() + pos, prim.begin() + pos + len), emit);
+		pos += len;
+	}
+	scanner.Finish(emit);
+	return windows;
+}
+}
+
+TEST(NNAffineScanner, WindowsMatchFolder) {
+	auto re = librnary::RandomEngineForTests();
+	librnary::NNAffineModel model(DATA_TABLE_PATH);
+	librnary::NNScorer<librnary::NNAffineModel> scorer(model);
+	librnary::NNAffineFolder folder(model);
+	for (unsigned width : {1u, 12u, 35u}) {
+		for (unsigned step : {1u, 7u}) {
+			librnary::NNAffineScanner scanner(model, width, step);
+			auto prim = librnary::RandomPrimary(re, 140);
+			auto windows = Scan(scanner, prim, re, 50);
+			ASSERT_FALSE(windows.empty());
+			EXPECT_EQ(prim.size(), windows.back().start + windows.back().structure.size());
+			for (size_t w = 0; w < windows.size(); ++w) {
+				const auto &win = windows[w];
+				ASSERT_EQ(width, win.structure.size());
+				if (w + 1 < windows.size()) {
+					EXPECT_EQ(w * step, win.start);
+				}
+				// A G before the window can give a pair at its start the GU closure bonus, which needs GG before it,
+				// and a single nucleotide bulge can slide along a run crossing either end.
+				const size_t end = win.start + width;
+				if (win.start > 0 && (prim[win.start - 1] == librnary::G || prim[win.start - 1] == prim[win.start]))
+					continue;
+				if (end < prim.size() && prim[end] == prim[end - 1])
+					continue;
+				librnary::PrimeStructure sub(prim.begin() + win.start, prim.begin() + win.start + width);
+				EXPECT_EQ(folder.Fold(sub), win.mfe);
+				scorer.SetRNA(sub);
+				EXPECT_EQ(win.mfe, scorer.ScoreExterior(librnary::SSTree(win.structure).RootSurface()));
+			}
+		}
+	}
+}
+
+TEST(NNAffineScanner, PiecesDoNotChangeWindows) {
+	auto re = librnary::RandomEngineForTests();
+	librnary::NNAffineModel model(DATA_TABLE_PATH);
+	librnary::NNAffineScanner scanner(model, 30, 3);
+	scanner.SetLonelyPairs(false);
+	auto prim = librnary::RandomPrimary(re, 200);
+	auto whole = Scan(scanner, prim, re, 1000), pieces = Scan(scanner, prim, re, 3);
+	ASSERT_EQ(whole.size(), pieces.size());
+	for (size_t w = 0; w < whole.size(); ++w) {
+		EXPECT_EQ(whole[w].start, pieces[w].start);
+		EXPECT_EQ(whole[w].mfe, pieces[w].mfe);
+		EXPECT_EQ(whole[w].structure, pieces[w].structure);
+	}
+	// Without stacking, through the model's virtual interface.
+	scanner.SetStacking(false);
+	scanner.SetStaticDispatch(false);
+	scanner.SetLonelyPairs(true);
+	librnary::NNAffineFolder folder(model);
+	folder.SetStacking(false);
+	prim = librnary::RandomPrimary(re, 60);
+	for (const auto &win : Scan(scanner, prim, re, 10)) {
+		const size_t end = win.start + 30;
+		if (win.start > 0 && (prim[win.start - 1] == librnary::G || prim[win.start - 1] == prim[win.start]))
+			continue;
+		if (end < prim.size() && prim[end] == prim[end - 1])
+			continue;
+		EXPECT_EQ(folder.Fold(librnary::PrimeStructure(prim.begin() + win.start, prim.begin() + win.start + 30)),
+				  win.mfe);
+	}
+}
+
+TEST(NNAffineScanner, MaxSpanMatchesFolder) {
+	auto re = librnary::RandomEngineForTests();
+	librnary::NNAffineModel model(DATA_TABLE_PATH);
+	librnary::NNAffineFolder folder(model);
+	folder.SetMaxSpan(9);
+	librnary::NNAffineScanner scanner(model, 30, 4);
+	scanner.SetMaxSpan(9);
+	auto prim = librnary::RandomPrimary(re, 120);
+	for (const auto &win : Scan(scanner, prim, re, 25)) {
+		const size_t end = win.start + 30;
+		if (win.start > 0 && (prim[win.start - 1] == librnary::G || prim[win.start - 1] == prim[win.start]))
+			continue;
+		if (end < prim.size() && prim[end] == prim[end - 1])
+			continue;
+		for (size_t i = 0; i < win.structure.size(); ++i)
+			EXPECT_LE(static_cast<int>(win.structure[i]) - static_cast<int>(i), 9);
+		EXPECT_EQ(folder.Fold(librnary::PrimeStructure(prim.begin() + win.start, prim.begin() + win.start + 30)),
+				  win.mfe);
+	}
+}
+
+TEST(NNAffineScanner, ShortSequenceIsOneWindow) {
+	auto re = librnary::RandomEngineForTests();
+	librnary::NNAffineModel model(DATA_TABLE_PATH);
+	librnary::NNAffineFolder folder(model);
+	librnary::NNAffineScanner scanner(model, 80);
+	auto prim = librnary::RandomPrimary(re, 50);
+	auto windows = Scan(scanner, prim, re, 20);
+	ASSERT_EQ(1u, windows.size());
+	EXPECT_EQ(0u, windows[0].start);
+	EXPECT_EQ(folder.Fold(prim), windows[0].mfe);
+	EXPECT_EQ(folder.Traceback(), windows[0].structure);
+	EXPECT_TRUE(Scan(scanner, librnary::PrimeStructure(), re, 1).empty());
+}
+
+TEST(NNAffineScanner, MemoryDoesNotGrowWithLength) {
+	auto re = librnary::RandomEngineForTests();
+	librnary::NNAffineModel model(DATA_TABLE_PATH);
+	librnary::NNAffineScanner scanner(model, 25, 25);
+	Scan(scanner, librnary::RandomPrimary(re, 100), re, 100);
+	size_t bytes = scanner.TableBytes();
+	Scan(scanner, librnary::RandomPrimary(re, 3000), re, 100);
+	EXPECT_EQ(bytes, scanner.TableBytes());
+}
@@ -0,0 +1,56 @@
+#include <gtest/gtest.h>
+
+#include "folders/nn_affine_sparse_folder.hpp"
+#include "data_set.hpp"
+#include "random.hpp"
+
+using namespace std;
+
+const string DATA_TABLE_PATH = "../../data_tables/";
+
+TEST(NNAffineSparseFolder, MatchesNNAffineFolder) {
+	auto re = librnary::RandomEngineForTests();
+	librnary::NNAffineFolder folder{librnary::NNAffineModel(DATA_TABLE_PATH)};
+	for (int tc = 0; tc < 16; ++tc) {
+		folder.SetStacking(tc % 2 == 0);
+		folder.SetLonelyPairs(tc % 4 < 2);
+		folder.SetMaxTwoLoop(tc % 8 < 4 ? 30 : 6);
+		folder.SetMaxSpan(tc < 8 ? numeric_limits<int>::max() / 3 : 25);
+		librnary::NNAffineSparseFolder sparse(folder);
+		for (unsigned len : {0u, 1u, 5u, 20u, 60u, 110u}) {
+			auto rna = librnary::RandomPrimary(re, len);
+			EXPECT_EQ(folder.Fold(rna), sparse.Fold(rna)) << "tc=" << tc << " len=" << len;
+			EXPECT_EQ(folder.Traceback(), sparse.Traceback()) << "tc=" << tc << " len=" << len;
+		}
+	}
+}
+
+TEST(NNAffineSparseFolder, MatchesDynamicDispatch) {
+	auto re = librnary::RandomEngineForTests();
+	librnary::NNAffineSparseFolder sparse{librnary::NNAffineModel(DATA_TABLE_PATH)};
+	auto rna = librnary::RandomPrimary(re, 80);
+	const auto mfe = sparse.Fold(rna);
+	const auto structure = sparse.Traceback();
+	sparse.SetStaticDispatch(false);
+	EXPECT_EQ(mfe, sparse.Fold(rna));
+	EXPECT_EQ(structure, sparse.Traceback());
+}
+
+TEST(NNAffineSparseFolder, FewCandidatesOnDataSet) {
+	const auto cts = librnary::ReadSmallCTSet();
+	ASSERT_FALSE(cts.empty());
+	librnary::NNAffineFolder folder{librnary::NNAffineModel(DATA_TABLE_PATH)};
+	folder.SetMaxTwoLoop(30);
+	librnary::NNAffineSparseFolder sparse(folder);
+	// A sample of every family, of RNAs short enough to fold quickly.
+	const size_t STRIDE = 200;
+	for (size_t c = 0; c < cts.size(); c += STRIDE) {
+		const auto &rna = cts[c].primary;
+		if (rna.size() > 200)
+			continue;
+		EXPECT_EQ(folder.Fold(rna), sparse.Fold(rna)) << cts[c].name;
+		EXPECT_EQ(folder.Traceback(), sparse.Traceback()) << cts[c].name;
+		// The branch and coaxial stack lists together hold fewer than the split points of one decomposition.
+		EXPECT_LT(sparse.Candidates(), rna.size() * (rna.size() - 1) / 2) << cts[c].name;
+	}
+}
@@ -5,6 +5,8 @@
 #include <gtest/gtest.h>
 #include "models/nn_unpaired_model.hpp"
 #include "models/nn_affine_model.hpp"
+#include "data_set.hpp"
+#include "random.hpp"
 
 using namespace std;
 
@@ -98,4 +100,94 @@ TEST(NNModel, MismatchCoax_AGCGGU) {
 	auto primary = librnary::StringToPrimary("AGCGGU");
 	librnary::NNAffineModel nn_model(DATA_TABLE_PATH, primary);
 	EXPECT_EQ(nn_model.MismatchCoax(0, 5, 2, 3), -30);
-}
\ No newline at end of file
+}
+
+/**
+ * Checks that every energy function with a compiled path agrees with the RNAstructure path on every valid argument.
+ * Two-loops are checked up to max_twoloop unpaired.
+ */
+void ExpectCompiledMatches(const librnary::PrimeStructure &primary, int max_twoloop) {
+	librnary::NNAffineModel plain(DATA_TABLE_PATH, primary), compiled(DATA_TABLE_PATH, primary);
+	compiled.SetCompiled(true);
+	const auto N = static_cast<int>(primary.size());
+	auto valid = [&](int i, int j) {
+		return i >= 0 && j < N && i < j && librnary::ValidPair(primary[i], primary[j]);
+	};
+	for (int i = 0; i < N; ++i) {
+		for (int j = i + 1; j < N; ++j) {
+			if (!valid(i, j))
+				continue;
+			ASSERT_EQ(plain.Branch(i, j), compiled.Branch(i, j));
+			ASSERT_EQ(plain.ClosingFiveDangle(i, j), compiled.ClosingFiveDangle(i, j));
+			ASSERT_EQ(plain.ClosingThreeDangle(i, j), compiled.ClosingThreeDangle(i, j));
+			ASSERT_EQ(plain.ClosingMismatch(i, j), compiled.ClosingMismatch(i, j));
+			if (i > 0) {
+				ASSERT_EQ(plain.FiveDangle(i, j), compiled.FiveDangle(i, j));
+			}
+			if (j + 1 < N) {
+				ASSERT_EQ(plain.ThreeDangle(i, j), compiled.ThreeDangle(i, j));
+			}
+			if (i > 0 && j + 1 < N) {
+				ASSERT_EQ(plain.Mismatch(i, j), compiled.Mismatch(i, j));
+			}
+			for (int k = i + 1; k < j && k - i - 1 <= max_twoloop; ++k)
+				for (int l = j - 1; l > k && (k - i - 1) + (j - l - 1) <= max_twoloop; --l)
+					if (valid(k, l)) {
+						ASSERT_EQ(plain.TwoLoop(i, k, l, j), compiled.TwoLoop(i, k, l, j));
+					}
+			// Coaxial stacks involving i,j in every orientation MismatchCoax and FlushCoax distinguish.
+			for (int l = 0; l < N; ++l) {
+				if (valid(j + 1, l)) {
+					ASSERT_EQ(plain.FlushCoax(i, j, j + 1, l), compiled.FlushCoax(i, j, j + 1, l));
+				}
+				if (valid(j + 2, l) && i > 0) {
+					ASSERT_EQ(plain.MismatchCoax(i, j, j + 2, l), compiled.MismatchCoax(i, j, j + 2, l));
+				}
+				if (valid(i + 1, l) && l < j - 1) {
+					ASSERT_EQ(plain.FlushCoax(i, j, i + 1, l), compiled.FlushCoax(i, j, i + 1, l));
+				}
+				if (valid(i + 2, l) && l < j - 1) {
+					ASSERT_EQ(plain.MismatchCoax(i, j, i + 2, l), compiled.MismatchCoax(i, j, i + 2, l));
+				}
+				if (valid(l, j - 1) && l > i + 1) {
+					ASSERT_EQ(plain.FlushCoax(i, j, l, j - 1), compiled.FlushCoax(i, j, l, j - 1));
+				}
+				if (valid(l, j - 2) && l > i + 1) {
+					ASSERT_EQ(plain.MismatchCoax(i, j, l, j - 2), compiled.MismatchCoax(i, j, l, j - 2));
+				}
+				if (valid(l, i - 2) && j + 1 < N) {
+					ASSERT_EQ(plain.MismatchCoax(i, j, l, i - 2), compiled.MismatchCoax(i, j, l, i - 2));
+				}
+				if (valid(i - 2, l) && l > j + 1) {
+					ASSERT_EQ(plain.MismatchCoax(i, j, i - 2, l), compiled.MismatchCoax(i, j, i - 2, l));
+				}
+				if (valid(l, j + 2) && l < i - 1) {
+					ASSERT_EQ(plain.MismatchCoax(i, j, l, j + 2), compiled.MismatchCoax(i, j, l, j + 2));
+				}
+			}
+		}
+	}
+}
+
+TEST(NNModel, CompiledMatchesRNAstructureOnDataSetSample) {
+	const auto cts = librnary::ReadSmallCTSet();
+	ASSERT_FALSE(cts.empty());
+	// Only every 20th RNA, which still covers every family. Checking all of it takes over a minute.
+	// Two-loops larger than 6 unpaired are checked on random RNAs by CompiledMatchesRNAstructureOnLargeLoops.
+	const size_t STRIDE = 20;
+	for (size_t c = 0; c < cts.size(); c += STRIDE) {
+		ExpectCompiledMatches(cts[c].primary, 6);
+		if (HasFatalFailure())
+			return;
+	}
+}
+
+TEST(NNModel, CompiledMatchesRNAstructureOnLargeLoops) {
+	const int TESTS = 5, RNA_LEN = 90;
+	auto re = librnary::RandomEngineForTests();
+	for (int t = 0; t < TESTS; ++t) {
+		ExpectCompiledMatches(librnary::RandomPrimary(re, RNA_LEN), RNA_LEN);
+		if (HasFatalFailure())
+			return;
+	}
+}
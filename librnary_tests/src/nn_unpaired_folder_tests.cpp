@@ -147,3 +147,29 @@ TEST(NNUnpairedFolder, SensitiveToMultiUnpaired) {
 //	EXPECT_NE(fold_trace, folder.Traceback());
 //}
 
+TEST(NNUnpairedFolder, MaxSpanLimitsPairs) {
+	auto re = librnary::RandomEngineForTests();
+	librnary::NNUnpairedModel model(DATA_TABLE_PATH);
+	librnary::NNScorer<librnary::NNUnpairedModel> scorer(model);
+	librnary::NNUnpairedFolder full(model), banded(model);
+	for (unsigned len : {1u, 40u, 90u}) {
+		auto prim = librnary::RandomPrimary(re, len);
+		scorer.SetRNA(prim);
+		librnary::energy_t full_mfe = full.Fold(prim), prev_mfe = model.MaxMFE();
+		for (int span : {4, 20, 50, 1000}) {
+			banded.SetMaxSpan(static_cast<unsigned>(span));
+			librnary::energy_t mfe = banded.Fold(prim);
+			auto m = banded.Traceback();
+			for (int i = 0; i < static_cast<int>(m.size()); ++i)
+				EXPECT_LE(abs(m[i] - i), span);
+			EXPECT_EQ(mfe, scorer.ScoreExterior(librnary::SSTree(m).RootSurface()));
+			EXPECT_LE(mfe, prev_mfe);
+			EXPECT_LE(full_mfe, mfe);
+			prev_mfe = mfe;
+			if (span >= static_cast<int>(len)) {
+				EXPECT_EQ(full_mfe, mfe);
+				EXPECT_EQ(full.Traceback(), m);
+			}
+		}
+	}
+}
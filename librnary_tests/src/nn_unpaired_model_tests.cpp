@@ -55,4 +55,29 @@ TEST(NNUnpairedModel, StrainedThreeWay) {
 	model.SetMLStrain(23);
 	EXPECT_EQ(model.MLClosure(sst.RootSurface().Child(0)),
 			  99 - 45 * 3 + 2 + 23);
-}
\ No newline at end of file
+}
+
+TEST(NNUnpairedModel, ClosureTableFollowsSetters) {
+	librnary::NNUnpairedModel model(DATA_TABLE_PATH);
+	auto rna = librnary::StringToPrimary("GGGAAAUCCCAGCUUCGGCUGGGAAACCCAAAAGGG");
+	auto check = [&]() {
+		ASSERT_EQ(rna.size() + 1, model.MLClosureTable().size());
+		for (int up = 0; up <= static_cast<int>(rna.size()); ++up) {
+			EXPECT_EQ(model.MLClosure(up, 0), model.MLClosureTable()[up]);
+			EXPECT_EQ(model.MLClosure(up, 0), model.MLClosure(up));
+		}
+	};
+	model.SetRNA(rna);
+	check();
+	model.SetMLParams(103, -45, 2, 1.2, 3);
+	EXPECT_TRUE(model.MLClosureTable().empty());
+	model.SetRNA(rna);
+	check();
+	model.SetMLLogMultiplier(2.1);
+	model.SetMLUnpairedPivot(5);
+	model.SetRNA(rna);
+	check();
+	// A shorter RNA keeps the longer table.
+	model.SetRNA(librnary::StringToPrimary("GGGAAACCC"));
+	EXPECT_EQ(rna.size() + 1, model.MLClosureTable().size());
+}
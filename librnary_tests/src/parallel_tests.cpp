@@ -7,6 +7,9 @@
 #include "parallel.hpp"
 #include "random.hpp"
 
+#include <atomic>
+#include <numeric>
+
 using namespace std;
 
 TEST(Parallel, SmallVectorsTransform) {
@@ -69,4 +72,178 @@ TEST(Parallel, LargeVectorsMinMax) {
 		EXPECT_EQ(std::max_element(A.begin(), A.end()), librnary::parallel_max_element(A.begin(), A.end()));
 		EXPECT_EQ(std::min_element(A.begin(), A.end()), librnary::parallel_min_element(A.begin(), A.end()));
 	}
-}
\ No newline at end of file
+}
+
+TEST(ThreadPool, ParallelForVisitsEveryIndexOnce) {
+	librnary::ThreadPool pool(4);
+	EXPECT_EQ(4u, pool.Size());
+	for (size_t n : {0, 1, 2, 7, 1000}) {
+		vector<atomic<int>> visits(n + 3);
+		for (auto &v : visits)
+			v = 0;
+		// Run the pool many times to catch jobs leaking into each other.
+		for (int rep = 0; rep < 50; ++rep) {
+			pool.ParallelFor(3, n + 3, [&](size_t i) {
+				++visits[i];
+			});
+		}
+		for (size_t i = 0; i < visits.size(); ++i)
+			EXPECT_EQ(i < 3 ? 0 : 50, visits[i]);
+	}
+}
+
+TEST(ThreadPool, SingleThreadRunsInline) {
+	librnary::ThreadPool pool(1);
+	EXPECT_EQ(1u, pool.Size());
+	auto caller = this_thread::get_id();
+	pool.ParallelFor(0, 10, [&](size_t) {
+		EXPECT_EQ(caller, this_thread::get_id());
+	});
+}
+
+TEST(ThreadPool, UnevenWorkIsStolen) {
+	librnary::ThreadPool pool(4);
+	const size_t n = 400;
+	auto work = [n](size_t i) {
+		// All the expensive indices start in the first thread's part of the range.
+		long acc = 0;
+		for (long k = 0; k < (i < n / 4 ? 20000 : 10); ++k)
+			acc += k % 7;
+		return acc;
+	};
+	vector<long> res(n);
+	vector<atomic<int>> visits(n);
+	for (auto &v : visits)
+		v = 0;
+	pool.ParallelFor(0, n, [&](size_t i) {
+		res[i] = work(i);
+		++visits[i];
+	}, 1);
+	for (size_t i = 0; i < n; ++i) {
+		EXPECT_EQ(1, visits[i]);
+		EXPECT_EQ(work(i), res[i]);
+	}
+}
+
+TEST(ThreadPool, NestedParallelForRunsSerially) {
+	librnary::ThreadPool pool(3);
+	vector<atomic<int>> visits(20 * 20);
+	for (auto &v : visits)
+		v = 0;
+	pool.ParallelFor(0, 20, [&](size_t i) {
+		auto outer = this_thread::get_id();
+		pool.ParallelFor(0, 20, [&](size_t j) {
+			EXPECT_EQ(outer, this_thread::get_id());
+			++visits[i * 20 + j];
+		});
+	});
+	for (auto &v : visits)
+		EXPECT_EQ(1, v);
+}
+
+TEST(ThreadPool, ConcurrentCallersShareThePool) {
+	librnary::ThreadPool pool(4);
+	vector<long> sums(4, 0);
+	vector<thread> callers;
+	for (size_t c = 0; c < sums.size(); ++c) {
+		callers.emplace_back([&, c]() {
+			for (int rep = 0; rep < 50; ++rep) {
+				vector<long> vals(100);
+				pool.ParallelFor(0, vals.size(), [&](size_t i) {
+					vals[i] = static_cast<long>(i * (c + 1));
+				});
+				sums[c] += accumulate(vals.begin(), vals.end(), 0L);
+			}
+		});
+	}
+	for (auto &t : callers)
+		t.join();
+	for (size_t c = 0; c < sums.size(); ++c)
+		EXPECT_EQ(50L * 4950 * static_cast<long>(c + 1), sums[c]);
+}
+
+TEST(Parallel, ForAndTransformWithManyThreadCounts) {
+	auto re = librnary::RandomEngineForTests();
+	for (size_t threads = 1; threads <= 8; ++threads) {
+		for (size_t n : {0, 1, 3, 64, 1001}) {
+			vector<long> A(n), res(n), res2(n);
+			for (auto &a : A)
+				a = re();
+			std::transform(A.begin(), A.end(), res.begin(), [](long e) {
+				return e / 3 + 1;
+			});
+			librnary::parallel_transform(A, res2, [](long e) {
+				return e / 3 + 1;
+			}, threads);
+			EXPECT_EQ(res, res2);
+			vector<atomic<int>> visits(n);
+			for (auto &v : visits)
+				v = 0;
+			librnary::parallel_for(0, n, [&](size_t i) {
+				++visits[i];
+			}, threads);
+			for (auto &v : visits)
+				EXPECT_EQ(1, v);
+		}
+	}
+}
+
+TEST(Parallel, ReduceIsDeterministic) {
+	auto re = librnary::RandomEngineForTests();
+	std::uniform_real_distribution<double> dist(-1e6, 1e6);
+	vector<double> A(5000);
+	for (auto &a : A)
+		a = dist(re);
+	auto plus = [](double a, double b) {
+		return a + b;
+	};
+	auto at = [&](size_t i) {
+		return A[i];
+	};
+	for (size_t threads = 1; threads <= 8; ++threads) {
+		double first = librnary::parallel_reduce(0, A.size(), 0.0, at, plus, threads);
+		EXPECT_NEAR(accumulate(A.begin(), A.end(), 0.0), first, 1e-3);
+		for (int rep = 0; rep < 20; ++rep)
+			EXPECT_EQ(first, librnary::parallel_reduce(0, A.size(), 0.0, at, plus, threads));
+	}
+	EXPECT_EQ(7, librnary::parallel_reduce(5, 5, 7, at, plus));
+	long sum = librnary::parallel_reduce(0, 1000, 0L, [](size_t i) {
+		return static_cast<long>(i);
+	}, [](long a, long b) {
+		return a + b;
+	}, 3);
+	EXPECT_EQ(499500L, sum);
+}
+
+TEST(Parallel, ArgmaxPrefersFirstOfTies) {
+	auto re = librnary::RandomEngineForTests();
+	for (size_t TC = 0; TC < 100; ++TC) {
+		// Few distinct values, so there are lots of ties.
+		vector<int> A(re() % 300 + 1);
+		for (auto &a : A)
+			a = static_cast<int>(re() % 5);
+		size_t threads = TC % 8 + 1;
+		auto expected = static_cast<size_t>(distance(A.begin(), std::max_element(A.begin(), A.end())));
+		EXPECT_EQ(expected, librnary::parallel_argmax(0, A.size(), [&](size_t i) {
+			return A[i];
+		}, threads));
+		EXPECT_EQ(std::max_element(A.begin(), A.end()), librnary::parallel_max_element(A.begin(), A.end(), threads));
+		EXPECT_EQ(std::min_element(A.begin(), A.end()), librnary::parallel_min_element(A.begin(), A.end(), threads));
+	}
+	EXPECT_EQ(4u, librnary::parallel_argmax(4, 4, [](size_t i) {
+		return i;
+	}));
+}
+
+TEST(Parallel, ArgmaxScoresEachIndexOnce) {
+	vector<atomic<int>> calls(1000);
+	for (auto &c : calls)
+		c = 0;
+	size_t best = librnary::parallel_argmax(0, calls.size(), [&](size_t i) {
+		++calls[i];
+		return static_cast<int>((i * 37) % 1000);
+	}, 4);
+	EXPECT_EQ(27u, best);
+	for (size_t i = 0; i < calls.size(); ++i)
+		EXPECT_EQ(1, calls[i]);
+}
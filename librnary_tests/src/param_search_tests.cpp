@@ -0,0 +1,142 @@
+#include <gtest/gtest.h>
+
+#include "training/param_search.hpp"
+#include "random.hpp"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+/// Scores that are a function of the grid coordinates, with few distinct values so ties are common.
+struct GridScores {
+	librnary::ParamGrid grid;
+	vector<double> scores;
+
+	/// The largest score in the box spanned by the corners, optionally plus some slack.
+	double Bound(const vector<size_t> &corners, double slack) const {
+		size_t D = grid.Dimensions();
+		vector<size_t> lo = grid.Coords(corners[0]), hi = lo;
+		for (size_t c : corners) {
+			auto coords = grid.Coords(c);
+			for (size_t d = 0; d < D; ++d) {
+				lo[d] = min(lo[d], coords[d]);
+				hi[d] = max(hi[d], coords[d]);
+			}
+		}
+		double best = -1;
+		for (size_t i = 0; i < scores.size(); ++i) {
+			auto coords = grid.Coords(i);
+			bool inside = true;
+			for (size_t d = 0; d < D; ++d)
+				inside = inside && lo[d] <= coords[d] && coords[d] <= hi[d];
+			if (inside)
+				best = max(best, scores[i]);
+		}
+		return best + slack;
+	}
+};
+
+size_t ExhaustiveBest(const vector<double> &scores) {
+	return static_cast<size_t>(max_element(scores.begin(), scores.end()) - scores.begin());
+}
+}
+
+TEST(ParamSearch, GridIndexRoundTrips) {
+	librnary::ParamGrid grid({3, 4, 5});
+	EXPECT_EQ(60u, grid.Size());
+	EXPECT_EQ(0u, grid.Index({0, 0, 0}));
+	EXPECT_EQ(1u, grid.Index({0, 0, 1}));
+	EXPECT_EQ(5u, grid.Index({0, 1, 0}));
+	EXPECT_EQ(20u, grid.Index({1, 0, 0}));
+	for (size_t i = 0; i < grid.Size(); ++i)
+		EXPECT_EQ(i, grid.Index(grid.Coords(i)));
+}
+
+TEST(ParamSearch, ExactSearchesMatchExhaustive) {
+	auto re = librnary::RandomEngineForTests();
+	for (int TC = 0; TC < 40; ++TC) {
+		GridScores gs;
+		size_t D = re() % 3 + 1;
+		for (size_t d = 0; d < D; ++d)
+			gs.grid.AddDimension(re() % 7 + 1, re() % 3 != 0);
+		for (size_t i = 0; i < gs.grid.Size(); ++i)
+			gs.scores.push_back((re() % 8) / 8.0);
+		size_t expected = ExhaustiveBest(gs.scores);
+		auto score = [&](size_t i) {
+			return gs.scores[i];
+		};
+		size_t start = re() % gs.scores.size();
+		for (double slack : {0.0, 0.1}) {
+			auto bound = [&](const vector<size_t> &corners) {
+				return gs.Bound(corners, slack);
+			};
+			librnary::SearchReport r;
+			EXPECT_EQ(expected, librnary::ExhaustiveSearch().Search(gs.grid, gs.scores.size(), start, score, bound, 2, r));
+			EXPECT_EQ(gs.scores.size(), r.evaluations);
+			EXPECT_EQ(expected, librnary::BranchAndBoundSearch(4).Search(gs.grid, gs.scores.size(), start, score,
+																		 bound, 2, r));
+			EXPECT_LE(r.evaluations, gs.scores.size() + 1);
+		}
+		librnary::SearchReport r;
+		EXPECT_EQ(expected, librnary::BranchAndBoundSearch().Search(gs.grid, gs.scores.size(), start, score, nullptr,
+																	 2, r));
+	}
+}
+
+TEST(ParamSearch, BranchAndBoundPrunes) {
+	// A single peak with a tight bound: most boxes should never be scored.
+	GridScores gs;
+	gs.grid = librnary::ParamGrid({40, 40, 40});
+	for (size_t i = 0; i < gs.grid.Size(); ++i) {
+		auto c = gs.grid.Coords(i);
+		gs.scores.push_back(i == gs.grid.Index({17, 3, 29}) ? 1.0 : (c[0] + c[1]) / 200.0);
+	}
+	librnary::SearchReport r;
+	size_t best = librnary::BranchAndBoundSearch().Search(gs.grid, gs.scores.size(), 0, [&](size_t i) {
+		return gs.scores[i];
+	}, [&](const vector<size_t> &corners) {
+		return gs.Bound(corners, 0);
+	}, 1, r);
+	EXPECT_EQ(gs.grid.Index({17, 3, 29}), best);
+	EXPECT_LT(r.evaluations, gs.scores.size() / 10);
+	EXPECT_GT(r.bounds, 0u);
+}
+
+TEST(ParamSearch, LocalSearchesClimbToPeak) {
+	// Concave scores, so any local optimum is the global one.
+	librnary::ParamGrid grid({30, 50, 20});
+	auto score = [&](size_t i) {
+		auto c = grid.Coords(i);
+		double a = c[0] - 21.0, b = c[1] - 7.0, d = c[2] - 13.0;
+		return -(a * a + 2 * b * b + d * d);
+	};
+	size_t peak = grid.Index({21, 7, 13});
+	librnary::SearchReport r;
+	EXPECT_EQ(peak, librnary::CoordinateDescentSearch().Search(grid, grid.Size(), 0, score, nullptr, 2, r));
+	EXPECT_LT(r.evaluations, grid.Size());
+	EXPECT_EQ(peak, librnary::MultiResolutionSearch(64).Search(grid, grid.Size(), 0, score, nullptr, 2, r));
+	EXPECT_LT(r.evaluations, grid.Size());
+	// Without a grid the parameter list is one dimension.
+	EXPECT_EQ(peak, librnary::CoordinateDescentSearch().Search(librnary::ParamGrid(), grid.Size(), 0, score, nullptr,
+															   2, r));
+}
+
+TEST(ParamSearch, RejectsMismatchedGrid) {
+	librnary::ParamGrid grid({3, 4});
+	auto score = [](size_t i) {
+		return static_cast<double>(i);
+	};
+	librnary::SearchReport r;
+	for (string name : {"coordinate", "multires", "bnb"})
+		EXPECT_THROW(librnary::MakeParamSearch(name)->Search(grid, grid.Size() + 1, 0, score, nullptr, 1, r),
+					 invalid_argument);
+}
+
+TEST(ParamSearch, MakeByName) {
+	for (string name : {"exhaustive", "coordinate", "multires", "bnb"})
+		EXPECT_EQ(name, librnary::MakeParamSearch(name)->Name());
+	EXPECT_EQ(nullptr, librnary::MakeParamSearch("simulated annealing"));
+	EXPECT_TRUE(librnary::MakeParamSearch("bnb")->Exact());
+	EXPECT_FALSE(librnary::MakeParamSearch("multires")->Exact());
+}
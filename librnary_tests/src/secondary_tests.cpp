@@ -11,6 +11,7 @@
 #include "secondary_structure.hpp"
 #include "ss_enumeration.hpp"
 #include "random.hpp"
+#include "training/structure_hash_set.hpp"
 
 using namespace std;
 
@@ -113,4 +114,25 @@ TEST(SecondaryStructure, ExtractStems) {
 	}
 }
 
+// Every structure of a few random RNAs hashes differently, and the hash set finds exactly the ones inserted.
+TEST(SecondaryStructure, MatchingHashDistinguishesStructures) {
+	auto re = RandomEngineForTests();
+	StructureEnumerator se(0);
+	for (int TC = 0; TC < 5; ++TC) {
+		auto rna = RandomPrimary(re, 14);
+		vector<Matching> structures;
+		auto f = [&](const Matching &m) {
+			structures.push_back(m);
+		};
+		se.Enumerate(rna, f);
+		StructureHashSet set;
+		for (size_t i = 0; i < structures.size(); i += 2)
+			EXPECT_TRUE(set.Insert(structures[i]));
+		EXPECT_EQ((structures.size() + 1) / 2, set.Size());
+		for (size_t i = 0; i < structures.size(); ++i)
+			EXPECT_EQ(i % 2 == 0, set.Contains(structures[i]));
+		EXPECT_FALSE(set.Insert(structures[0]));
+	}
+}
+
 }
\ No newline at end of file
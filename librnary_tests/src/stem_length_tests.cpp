@@ -8,6 +8,7 @@
 
 #include "scorers/stem_length_scorer.hpp"
 #include "paths.hpp"
+#include "random.hpp"
 
 namespace librnary {
 
@@ -147,4 +148,63 @@ TEST(StemLengthFolder, UGGCGUUC) {
 	EXPECT_EQ(folder.Traceback(), match);
 }
 
-}
\ No newline at end of file
+TEST(StemLengthFolder, StaticDispatchMatchesVirtual) {
+	auto re = RandomEngineForTests();
+	StemLengthModel em(DATA_TABLE_PATH);
+	em.SetLengthCosts({2, -61, 69, 18});
+	StemLengthFolder static_folder(em), virtual_folder(em);
+	virtual_folder.SetStaticDispatch(false);
+	for (int t = 0; t < 5; ++t) {
+		auto prim = RandomPrimary(re, 80);
+		EXPECT_EQ(virtual_folder.Fold(prim), static_folder.Fold(prim));
+		EXPECT_EQ(virtual_folder.Traceback(), static_folder.Traceback());
+	}
+}
+
+TEST(StemLengthFolder, EnergyOnlyMatchesFullFold) {
+	auto re = RandomEngineForTests();
+	StemLengthModel em(DATA_TABLE_PATH);
+	em.SetLengthCosts({2, -61, 69, 18});
+	StemLengthFolder full(em), energy_only(em);
+	energy_only.SetEnergyOnly(true);
+	for (unsigned len : {0u, 1u, 5u, 60u, 120u}) {
+		auto prim = RandomPrimary(re, len);
+		EXPECT_EQ(full.Fold(prim), energy_only.Fold(prim));
+		EXPECT_THROW(energy_only.Traceback(), std::logic_error);
+		if (len >= 60) {
+			EXPECT_LT(energy_only.TableBytes(), full.TableBytes() * 7 / 10);
+		}
+	}
+}
+
+TEST(StemLengthFolder, MaxSpanLimitsPairs) {
+	auto re = RandomEngineForTests();
+	StemLengthModel em(DATA_TABLE_PATH);
+	em.SetLengthCosts({2, -61, 69, 18});
+	StemLengthFolder full(em), banded(em);
+	for (unsigned len : {1u, 40u, 120u}) {
+		auto prim = RandomPrimary(re, len);
+		energy_t full_mfe = full.Fold(prim), prev_mfe = em.MaxMFE();
+		for (int span : {4, 20, 60, 1000}) {
+			banded.SetMaxSpan(static_cast<unsigned>(span));
+			energy_t mfe = banded.Fold(prim);
+			auto m = banded.Traceback();
+			for (int i = 0; i < static_cast<int>(m.size()); ++i)
+				EXPECT_LE(abs(m[i] - i), span);
+			EXPECT_LE(mfe, prev_mfe);
+			EXPECT_LE(full_mfe, mfe);
+			prev_mfe = mfe;
+			if (span >= static_cast<int>(len)) {
+				EXPECT_EQ(full_mfe, mfe);
+				EXPECT_EQ(full.Traceback(), m);
+			}
+		}
+		banded.SetMaxSpan(20);
+		banded.Fold(prim);
+		if (len >= 120) {
+			EXPECT_LT(banded.TableBytes(), full.TableBytes() * 45 / 100);
+		}
+	}
+}
+
+}
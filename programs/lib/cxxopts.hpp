@@ -33,6 +33,7 @@ THE SOFTWARE.
 #include <iostream>
 #include <map>
 #include <memory>
+#include <limits>
 #include <regex>
 #include <sstream>
 #include <string>
@@ -0,0 +1,94 @@
+#include "cxxopts.hpp"
+#include "folders/aalberts_folder.hpp"
+#include "read_cts.hpp"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <string>
+
+using namespace std;
+
+int main(int argc, char **argv) {
+    cxxopts::Options
+            options("Aalberts MLInit Table Benchmark",
+                    "Times AalbertsFolder on each RNA with the model's MLInit table on, then with MLInit evaluated "
+                    "directly, and checks the results are identical. "
+                    "Expects a .ctset file as input on standard in.");
+
+    options.add_options()
+            ("d,data_path", "Path to data_tables", cxxopts::value<string>()->default_value("data_tables/"))
+            ("c,ct_path", "Path to the folder of CTs", cxxopts::value<string>()->default_value("data_set/ct_files/"))
+            ("m,max_length", "Skip RNAs longer than this many nucleotides",
+             cxxopts::value<int>()->default_value("150"))
+            ("t,two_loop_max_size",
+             "The maximum number of unpaired nucleotides allowed in a two-loop.",
+             cxxopts::value<int>()->default_value("30"))
+            ("a,max_alength", "The maximum number of length-a segments in a multi-loop",
+             cxxopts::value<int>()->default_value(std::to_string(numeric_limits<int>::max() / 3)))
+            ("b,max_blength", "The maximum number of length-b segments in a multi-loop",
+             cxxopts::value<int>()->default_value(std::to_string(numeric_limits<int>::max() / 3)))
+            ("h,help", "Print help");
+
+    string data_tables, ct_path;
+    int max_length, max_two_loop_size, max_alength, max_blength;
+
+    try {
+        options.parse(argc, argv);
+        data_tables = options["data_path"].as<string>();
+        ct_path = options["ct_path"].as<string>();
+        max_length = options["max_length"].as<int>();
+        max_two_loop_size = options["two_loop_max_size"].as<int>();
+        max_alength = options["max_alength"].as<int>();
+        max_blength = options["max_blength"].as<int>();
+        if (options.count("help") == 1) {
+            cout << options.help({"", "Group"}) << endl;
+            return 0;
+        }
+
+    } catch (const cxxopts::OptionException &e) {
+        cout << "Argument parsing error: " << e.what() << endl;
+        return 1;
+    }
+
+    typedef chrono::steady_clock Clock;
+    librnary::AalbertsFolder folder{librnary::AalbertsModel(data_tables)};
+    folder.SetMaxTwoLoop(static_cast<unsigned>(max_two_loop_size));
+    folder.SetMaxALength(static_cast<unsigned>(max_alength));
+    folder.SetMaxBLength(static_cast<unsigned>(max_blength));
+
+    int mismatches = 0;
+    double total[2] = {0, 0};
+    for (const auto &ct : librnary::ReadAllCTs(ct_path, cin)) {
+        if (static_cast<int>(ct.primary.size()) > max_length)
+            continue;
+        double seconds[2];
+        librnary::energy_t energies[2];
+        librnary::Matching structures[2];
+        for (int pass = 0; pass < 2; ++pass) {
+            auto model = folder.GetEM();
+            model.SetMLInitTable(pass == 0);
+            folder.SetModel(model);
+            auto start = Clock::now();
+            energies[pass] = folder.Fold(ct.primary);
+            structures[pass] = folder.Traceback();
+            seconds[pass] = chrono::duration<double>(Clock::now() - start).count();
+            total[pass] += seconds[pass];
+        }
+        if (energies[0] != energies[1] || structures[0] != structures[1]) {
+            cerr << ct.name << ": MLInit table changed the result" << endl;
+            ++mismatches;
+        }
+        cout << fixed << setprecision(3) << ct.name << " (" << ct.primary.size() << " nt): table " << seconds[0]
+             << "s, direct " << seconds[1] << "s, speedup " << seconds[1] / seconds[0] << "x" << endl;
+    }
+    cout << fixed << setprecision(3) << "Total: table " << total[0] << "s, direct " << total[1] << "s, speedup "
+         << total[1] / total[0] << "x" << endl;
+
+    if (mismatches != 0) {
+        cout << mismatches << " RNAs folded differently with the MLInit table" << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,135 @@
+#include "cxxopts.hpp"
+#include "folders/batch_fold.hpp"
+#include "folders/nn_affine_batch_folder.hpp"
+#include "folders/nn_affine_param_batch_folder.hpp"
+#include "read_cts.hpp"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+int main(int argc, char **argv) {
+    cxxopts::Options
+            options("Batch Folding Benchmark",
+                    "Times NNAffineFolder folding each RNA on its own, then NNAffineBatchFolder folding RNAs of "
+                    "similar length together, and checks the MFEs and structures are identical. Then does the same "
+                    "for folding each RNA under several multi-loop parameter sets, one at a time and with "
+                    "NNAffineParamBatchFolder. "
+                    "Expects a .ctset file as input on standard in.");
+
+    options.add_options()
+            ("d,data_path", "Path to data_tables", cxxopts::value<string>()->default_value("data_tables/"))
+            ("c,ct_path", "Path to the folder of CTs", cxxopts::value<string>()->default_value("data_set/ct_files/"))
+            ("m,max_length", "Skip RNAs longer than this many nucleotides",
+             cxxopts::value<int>()->default_value("150"))
+            ("t,two_loop_max_size",
+             "The maximum number of unpaired nucleotides allowed in a two-loop.",
+             cxxopts::value<int>()->default_value("30"))
+            ("h,help", "Print help");
+
+    string data_tables, ct_path;
+    int max_length, max_two_loop_size;
+
+    try {
+        options.parse(argc, argv);
+        data_tables = options["data_path"].as<string>();
+        ct_path = options["ct_path"].as<string>();
+        max_length = options["max_length"].as<int>();
+        max_two_loop_size = options["two_loop_max_size"].as<int>();
+        if (options.count("help") == 1) {
+            cout << options.help({"", "Group"}) << endl;
+            return 0;
+        }
+
+    } catch (const cxxopts::OptionException &e) {
+        cout << "Argument parsing error: " << e.what() << endl;
+        return 1;
+    }
+
+    typedef chrono::steady_clock Clock;
+    librnary::NNAffineFolder folder{librnary::NNAffineModel(data_tables)};
+    folder.SetMaxTwoLoop(static_cast<unsigned>(max_two_loop_size));
+    folder.SetLonelyPairs(false);
+
+    vector<librnary::PrimeStructure> rnas;
+    vector<size_t> lengths;
+    for (const auto &ct : librnary::ReadAllCTs(ct_path, cin)) {
+        if (static_cast<int>(ct.primary.size()) > max_length)
+            continue;
+        rnas.push_back(ct.primary);
+        lengths.push_back(ct.primary.size());
+    }
+
+    auto start = Clock::now();
+    vector<librnary::energy_t> mfes;
+    vector<librnary::Matching> structures;
+    for (const auto &rna : rnas) {
+        mfes.push_back(folder.Fold(rna));
+        structures.push_back(folder.Traceback());
+    }
+    const double single_seconds = chrono::duration<double>(Clock::now() - start).count();
+
+    start = Clock::now();
+    auto groups = librnary::BucketByLength(lengths, librnary::NNAffineBatchFolder::Width);
+    librnary::NNAffineBatchFolder batch_folder(folder);
+    int mismatches = 0;
+    for (const auto &g : groups) {
+        vector<librnary::PrimeStructure> primaries;
+        for (size_t r : g)
+            primaries.push_back(rnas[r]);
+        auto batch_mfes = batch_folder.Fold(primaries);
+        for (size_t lane = 0; lane < g.size(); ++lane) {
+            if (batch_mfes[lane] != mfes[g[lane]] || batch_folder.Traceback(lane) != structures[g[lane]])
+                ++mismatches;
+        }
+    }
+    const double batch_seconds = chrono::duration<double>(Clock::now() - start).count();
+
+    cout << fixed << setprecision(3) << rnas.size() << " RNAs in " << groups.size() << " groups: one at a time "
+         << single_seconds << "s, " << librnary::NNAffineBatchFolder::Width << " lanes " << batch_seconds
+         << "s, speedup " << single_seconds / batch_seconds << "x" << endl;
+
+    // Multi-loop parameter sets spread over the ranges train_linear searches.
+    const int K = librnary::NNAffineParamBatchFolder::Width;
+    vector<librnary::NNAffineParamBatchFolder::MLParams> params;
+    for (int k = 0; k < K; ++k)
+        params.push_back({30 + 20 * k, -40 + 10 * k, -10 + 5 * k});
+
+    start = Clock::now();
+    librnary::NNAffineModel model(data_tables);
+    mfes.clear();
+    structures.clear();
+    for (const auto &rna : rnas) {
+        for (const auto &p : params) {
+            model.SetMLParams(p.init, p.branch, p.unpaired);
+            folder.SetModel(model);
+            mfes.push_back(folder.Fold(rna));
+            structures.push_back(folder.Traceback());
+        }
+    }
+    const double single_param_seconds = chrono::duration<double>(Clock::now() - start).count();
+
+    start = Clock::now();
+    librnary::NNAffineParamBatchFolder param_folder(folder);
+    for (size_t r = 0; r < rnas.size(); ++r) {
+        auto batch_mfes = param_folder.Fold(rnas[r], params);
+        for (size_t lane = 0; lane < params.size(); ++lane) {
+            if (batch_mfes[lane] != mfes[r * K + lane] || param_folder.Traceback(lane) != structures[r * K + lane])
+                ++mismatches;
+        }
+    }
+    const double param_seconds = chrono::duration<double>(Clock::now() - start).count();
+
+    cout << rnas.size() << " RNAs under " << K << " parameter sets: one at a time " << single_param_seconds
+         << "s, " << K << " lanes " << param_seconds << "s, speedup " << single_param_seconds / param_seconds << "x"
+         << endl;
+
+    if (mismatches != 0) {
+        cout << mismatches << " folds differed" << endl;
+        return 1;
+    }
+    return 0;
+}
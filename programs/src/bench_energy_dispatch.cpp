@@ -0,0 +1,108 @@
+#include "cxxopts.hpp"
+#include "folders/nn_affine_folder.hpp"
+#include "folders/stem_length_folder.hpp"
+#include "read_cts.hpp"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+/**
+ * Folds every RNA with static dispatch on and then off, and prints the time taken by each.
+ * Returns the number of RNAs whose MFE or traceback differed between the two.
+ */
+template<typename FolderT>
+int Benchmark(const string &name, FolderT folder, const vector<librnary::CTData> &cts) {
+    typedef chrono::steady_clock Clock;
+    vector<librnary::energy_t> energies(cts.size());
+    vector<librnary::Matching> structures(cts.size());
+    double seconds[2];
+    int mismatches = 0;
+
+    for (int pass = 0; pass < 2; ++pass) {
+        bool static_dispatch = pass == 0;
+        folder.SetStaticDispatch(static_dispatch);
+        auto start = Clock::now();
+        for (size_t i = 0; i < cts.size(); ++i) {
+            librnary::energy_t e = folder.Fold(cts[i].primary);
+            librnary::Matching m = folder.Traceback();
+            if (static_dispatch) {
+                energies[i] = e;
+                structures[i] = m;
+            } else if (e != energies[i] || m != structures[i]) {
+                cerr << name << ": dispatch mismatch on " << cts[i].name << endl;
+                ++mismatches;
+            }
+        }
+        seconds[pass] = chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    cout << fixed << setprecision(3)
+         << name << ": static " << seconds[0] << "s, virtual " << seconds[1] << "s, speedup "
+         << seconds[1] / seconds[0] << "x" << endl;
+    return mismatches;
+}
+
+int main(int argc, char **argv) {
+    cxxopts::Options
+            options("Energy Dispatch Benchmark",
+                    "Times the MFE folders with their fill loops compiled against DevirtualizedModel (static) "
+                    "and against the energy model's virtual functions, and checks the results are identical. "
+                    "Expects a .ctset file as input on standard in, e.g. data_set/large.ctset.");
+
+    options.add_options()
+            ("d,data_path", "Path to data_tables", cxxopts::value<string>()->default_value("data_tables/"))
+            ("c,ct_path", "Path to the folder of CTs", cxxopts::value<string>()->default_value("data_set/ct_files/"))
+            ("m,max_length", "Skip RNAs longer than this many nucleotides",
+             cxxopts::value<int>()->default_value("150"))
+            ("t,two_loop_max_size",
+             "The maximum number of unpaired nucleotides allowed in a two-loop.",
+             cxxopts::value<int>()->default_value("30"))
+            ("h,help", "Print help");
+
+    string data_tables, ct_path;
+    int max_length, max_two_loop_size;
+
+    try {
+        options.parse(argc, argv);
+        data_tables = options["data_path"].as<string>();
+        ct_path = options["ct_path"].as<string>();
+        max_length = options["max_length"].as<int>();
+        max_two_loop_size = options["two_loop_max_size"].as<int>();
+        if (options.count("help") == 1) {
+            cout << options.help({"", "Group"}) << endl;
+            return 0;
+        }
+
+    } catch (const cxxopts::OptionException &e) {
+        cout << "Argument parsing error: " << e.what() << endl;
+        return 1;
+    }
+
+    vector<librnary::CTData> cts;
+    size_t nucleotides = 0;
+    for (const auto &ct : librnary::ReadAllCTs(ct_path, cin)) {
+        if (static_cast<int>(ct.primary.size()) <= max_length) {
+            cts.push_back(ct);
+            nucleotides += ct.primary.size();
+        }
+    }
+    cout << "Folding " << cts.size() << " RNAs (" << nucleotides << " nt)" << endl;
+
+    librnary::NNAffineFolder linear_folder{librnary::NNAffineModel(data_tables)};
+    linear_folder.SetMaxTwoLoop(static_cast<unsigned>(max_two_loop_size));
+    librnary::StemLengthFolder stem_length_folder{librnary::StemLengthModel(data_tables)};
+    stem_length_folder.SetMaxTwoLoop(static_cast<unsigned>(max_two_loop_size));
+
+    int mismatches = Benchmark("NNAffineFolder", linear_folder, cts);
+    mismatches += Benchmark("StemLengthFolder", stem_length_folder, cts);
+
+    if (mismatches != 0) {
+        cout << mismatches << " RNAs folded differently under static dispatch" << endl;
+        return 1;
+    }
+    return 0;
+}
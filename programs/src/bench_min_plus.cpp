@@ -0,0 +1,160 @@
+#include "cxxopts.hpp"
+#include "folders/min_plus.hpp"
+#include "folders/nn_affine_folder.hpp"
+#include "folders/nn_unpaired_folder.hpp"
+#include "folders/stem_length_folder.hpp"
+#include "read_cts.hpp"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+const librnary::MinPlusKernel KERNELS[] = {librnary::MinPlusKernel::Scalar, librnary::MinPlusKernel::SSE41,
+                                           librnary::MinPlusKernel::AVX2};
+
+/**
+ * Times each supported kernel on its own, on random rows and columns of each length, and prints the nanoseconds per
+ * call. The lengths are those of the split decompositions of cells with that span.
+ */
+void BenchmarkKernels(int calls) {
+    default_random_engine re(42);
+    uniform_int_distribution<librnary::energy_t> dist(-2000, 2000);
+    cout << "Kernel ns/call:" << endl;
+    for (int n : {8, 32, 128, 512, 2048}) {
+        vector<librnary::energy_t> a(n), b(n);
+        for (int t = 0; t < n; ++t) {
+            a[t] = dist(re);
+            b[t] = dist(re);
+        }
+        cout << "  n=" << setw(4) << n;
+        for (auto k : KERNELS) {
+            if (!librnary::MinPlusKernelSupported(k))
+                continue;
+            librnary::SetMinPlusKernel(k);
+            // Each call waits on the result of the last, so the calls cannot be overlapped or dropped.
+            librnary::energy_t acc = 0;
+            auto start = Clock::now();
+            for (int c = 0; c < calls; ++c)
+                acc = librnary::MinPlus(a.data(), b.data(), n, acc + 1);
+            double ns = chrono::duration<double, nano>(Clock::now() - start).count() / calls;
+            cout << "  " << librnary::MinPlusKernelName(k) << " " << fixed << setprecision(1) << ns;
+        }
+        cout << endl;
+    }
+}
+
+/**
+ * Folds every RNA with each supported kernel, and prints the time taken by each.
+ * Returns the number of RNAs whose MFE or traceback differed from that with the scalar kernel.
+ */
+template<typename FolderT>
+int BenchmarkFolds(const string &name, FolderT folder, const vector<librnary::CTData> &cts) {
+    vector<librnary::energy_t> energies(cts.size());
+    vector<librnary::Matching> structures(cts.size());
+    int mismatches = 0;
+
+    cout << name << ":";
+    for (auto k : KERNELS) {
+        if (!librnary::MinPlusKernelSupported(k))
+            continue;
+        librnary::SetMinPlusKernel(k);
+        auto start = Clock::now();
+        for (size_t i = 0; i < cts.size(); ++i) {
+            librnary::energy_t e = folder.Fold(cts[i].primary);
+            librnary::Matching m = folder.Traceback();
+            if (k == librnary::MinPlusKernel::Scalar) {
+                energies[i] = e;
+                structures[i] = m;
+            } else if (e != energies[i] || m != structures[i]) {
+                cerr << name << ": " << librnary::MinPlusKernelName(k) << " mismatch on " << cts[i].name << endl;
+                ++mismatches;
+            }
+        }
+        double seconds = chrono::duration<double>(Clock::now() - start).count();
+        cout << " " << librnary::MinPlusKernelName(k) << " " << fixed << setprecision(3) << seconds << "s";
+    }
+    cout << endl;
+    return mismatches;
+}
+
+int main(int argc, char **argv) {
+    cxxopts::Options
+            options("Min-Plus Kernel Benchmark",
+                    "Times each min-plus kernel the CPU supports on its own, then folds with the MFE folders whose "
+                    "multi-loop splits use it under each kernel, and checks the results are identical. "
+                    "Expects a .ctset file as input on standard in, e.g. data_set/large.ctset.");
+
+    options.add_options()
+            ("d,data_path", "Path to data_tables", cxxopts::value<string>()->default_value("data_tables/"))
+            ("c,ct_path", "Path to the folder of CTs", cxxopts::value<string>()->default_value("data_set/ct_files/"))
+            ("m,max_length", "Skip RNAs longer than this many nucleotides",
+             cxxopts::value<int>()->default_value("150"))
+            ("t,two_loop_max_size",
+             "The maximum number of unpaired nucleotides allowed in a two-loop.",
+             cxxopts::value<int>()->default_value("30"))
+            ("u,max_multi_unpaired", "The maximum number of unpaired nucleotides NNUnpairedFolder allows in a "
+                                     "multi-loop.", cxxopts::value<int>()->default_value("8"))
+            ("k,kernel_calls", "Calls of each kernel to time per length",
+             cxxopts::value<int>()->default_value("200000"))
+            ("h,help", "Print help");
+
+    string data_tables, ct_path;
+    int max_length, max_two_loop_size, max_multi_unpaired, kernel_calls;
+
+    try {
+        options.parse(argc, argv);
+        data_tables = options["data_path"].as<string>();
+        ct_path = options["ct_path"].as<string>();
+        max_length = options["max_length"].as<int>();
+        max_two_loop_size = options["two_loop_max_size"].as<int>();
+        max_multi_unpaired = options["max_multi_unpaired"].as<int>();
+        kernel_calls = options["kernel_calls"].as<int>();
+        if (options.count("help") == 1) {
+            cout << options.help({"", "Group"}) << endl;
+            return 0;
+        }
+
+    } catch (const cxxopts::OptionException &e) {
+        cout << "Argument parsing error: " << e.what() << endl;
+        return 1;
+    }
+
+    const auto best = librnary::ActiveMinPlusKernel();
+    cout << "Dispatching to " << librnary::MinPlusKernelName(best) << endl;
+    BenchmarkKernels(kernel_calls);
+
+    vector<librnary::CTData> cts;
+    size_t nucleotides = 0;
+    for (const auto &ct : librnary::ReadAllCTs(ct_path, cin)) {
+        if (static_cast<int>(ct.primary.size()) <= max_length) {
+            cts.push_back(ct);
+            nucleotides += ct.primary.size();
+        }
+    }
+    cout << "Folding " << cts.size() << " RNAs (" << nucleotides << " nt)" << endl;
+
+    librnary::NNAffineFolder linear_folder{librnary::NNAffineModel(data_tables)};
+    linear_folder.SetMaxTwoLoop(static_cast<unsigned>(max_two_loop_size));
+    librnary::StemLengthFolder stem_length_folder{librnary::StemLengthModel(data_tables)};
+    stem_length_folder.SetMaxTwoLoop(static_cast<unsigned>(max_two_loop_size));
+    librnary::NNUnpairedFolder unpaired_folder{librnary::NNUnpairedModel(data_tables)};
+    unpaired_folder.SetMaxTwoLoop(static_cast<unsigned>(max_two_loop_size));
+    unpaired_folder.SetMaxMulti(static_cast<unsigned>(max_multi_unpaired));
+
+    int mismatches = BenchmarkFolds("NNAffineFolder", linear_folder, cts);
+    mismatches += BenchmarkFolds("StemLengthFolder", stem_length_folder, cts);
+    mismatches += BenchmarkFolds("NNUnpairedFolder", unpaired_folder, cts);
+    librnary::SetMinPlusKernel(best);
+
+    if (mismatches != 0) {
+        cout << mismatches << " RNAs folded differently under another kernel" << endl;
+        return 1;
+    }
+    return 0;
+}
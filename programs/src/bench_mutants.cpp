@@ -0,0 +1,91 @@
+#include "cxxopts.hpp"
+#include "folders/nn_affine_folder.hpp"
+#include "read_cts.hpp"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+int main(int argc, char **argv) {
+    cxxopts::Options
+            options("Mutant Folding Benchmark",
+                    "Times NNAffineFolder folding every single point mutant of each RNA from scratch, then with "
+                    "FoldMutants reusing the fold of the original, and checks the results are identical. "
+                    "Expects a .ctset file as input on standard in.");
+
+    options.add_options()
+            ("d,data_path", "Path to data_tables", cxxopts::value<string>()->default_value("data_tables/"))
+            ("c,ct_path", "Path to the folder of CTs", cxxopts::value<string>()->default_value("data_set/ct_files/"))
+            ("m,max_length", "Skip RNAs longer than this many nucleotides",
+             cxxopts::value<int>()->default_value("150"))
+            ("t,two_loop_max_size",
+             "The maximum number of unpaired nucleotides allowed in a two-loop.",
+             cxxopts::value<int>()->default_value("30"))
+            ("p,threads", "Threads to spread the mutants over", cxxopts::value<int>()->default_value("1"))
+            ("h,help", "Print help");
+
+    string data_tables, ct_path;
+    int max_length, max_two_loop_size, threads;
+
+    try {
+        options.parse(argc, argv);
+        data_tables = options["data_path"].as<string>();
+        ct_path = options["ct_path"].as<string>();
+        max_length = options["max_length"].as<int>();
+        max_two_loop_size = options["two_loop_max_size"].as<int>();
+        threads = options["threads"].as<int>();
+        if (options.count("help") == 1) {
+            cout << options.help({"", "Group"}) << endl;
+            return 0;
+        }
+
+    } catch (const cxxopts::OptionException &e) {
+        cout << "Argument parsing error: " << e.what() << endl;
+        return 1;
+    }
+
+    typedef chrono::steady_clock Clock;
+    librnary::NNAffineFolder folder{librnary::NNAffineModel(data_tables)};
+    folder.SetMaxTwoLoop(static_cast<unsigned>(max_two_loop_size));
+    folder.SetThreads(static_cast<size_t>(max(threads, 1)));
+
+    int mismatches = 0;
+    double total[2] = {0, 0};
+    for (const auto &ct : librnary::ReadAllCTs(ct_path, cin)) {
+        if (static_cast<int>(ct.primary.size()) > max_length)
+            continue;
+        const auto variants = librnary::SingleMutants(ct.primary);
+
+        auto start = Clock::now();
+        vector<librnary::energy_t> naive;
+        for (const auto &variant : variants)
+            naive.push_back(folder.Fold(librnary::Mutate(ct.primary, variant)));
+        double naive_seconds = chrono::duration<double>(Clock::now() - start).count();
+
+        start = Clock::now();
+        folder.Fold(ct.primary);
+        auto reused = folder.FoldMutants(variants);
+        double reused_seconds = chrono::duration<double>(Clock::now() - start).count();
+
+        total[0] += naive_seconds;
+        total[1] += reused_seconds;
+        if (naive != reused) {
+            cerr << ct.name << ": FoldMutants disagreed with folding from scratch" << endl;
+            ++mismatches;
+        }
+        cout << fixed << setprecision(3) << ct.name << " (" << ct.primary.size() << " nt, " << variants.size()
+             << " mutants): scratch " << naive_seconds << "s, FoldMutants " << reused_seconds << "s, speedup "
+             << naive_seconds / reused_seconds << "x" << endl;
+    }
+    cout << fixed << setprecision(3) << "Total: scratch " << total[0] << "s, FoldMutants " << total[1]
+         << "s, speedup " << total[0] / total[1] << "x" << endl;
+
+    if (mismatches != 0) {
+        cout << mismatches << " RNAs had mutants folded differently" << endl;
+        return 1;
+    }
+    return 0;
+}
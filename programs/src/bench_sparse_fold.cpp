@@ -0,0 +1,109 @@
+#include "cxxopts.hpp"
+#include "folders/nn_affine_sparse_folder.hpp"
+#include "read_cts.hpp"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+using namespace std;
+
+int main(int argc, char **argv) {
+    cxxopts::Options
+            options("Sparse Folding Benchmark",
+                    "Times NNAffineFolder and NNAffineSparseFolder folding each RNA, prints the time and table "
+                    "memory of each, and checks the MFEs and structures are identical. "
+                    "Expects a .ctset file as input on standard in, e.g. data_set/complete.ctset.");
+
+    options.add_options()
+            ("d,data_path", "Path to data_tables", cxxopts::value<string>()->default_value("data_tables/"))
+            ("c,ct_path", "Path to the folder of CTs", cxxopts::value<string>()->default_value("data_set/ct_files/"))
+            ("m,max_length", "Skip RNAs longer than this many nucleotides",
+             cxxopts::value<int>()->default_value("3000"))
+            ("t,two_loop_max_size",
+             "The maximum number of unpaired nucleotides allowed in a two-loop.",
+             cxxopts::value<int>()->default_value("30"))
+            ("p,prefixes", "Comma separated prefixes of the names of the RNAs to fold",
+             cxxopts::value<string>()->default_value("16s_,23s_"))
+            ("s,max_span", "The maximum span of a pair, or 0 for no limit", cxxopts::value<int>()->default_value("0"))
+            ("h,help", "Print help");
+
+    string data_tables, ct_path, prefix_list;
+    int max_length, max_two_loop_size, max_span;
+
+    try {
+        options.parse(argc, argv);
+        data_tables = options["data_path"].as<string>();
+        ct_path = options["ct_path"].as<string>();
+        max_length = options["max_length"].as<int>();
+        max_two_loop_size = options["two_loop_max_size"].as<int>();
+        prefix_list = options["prefixes"].as<string>();
+        max_span = options["max_span"].as<int>();
+        if (options.count("help") == 1) {
+            cout << options.help({"", "Group"}) << endl;
+            return 0;
+        }
+
+    } catch (const cxxopts::OptionException &e) {
+        cout << "Argument parsing error: " << e.what() << endl;
+        return 1;
+    }
+
+    vector<string> prefixes;
+    istringstream prefix_stream(prefix_list);
+    for (string prefix; getline(prefix_stream, prefix, ',');)
+        prefixes.push_back(prefix);
+
+    typedef chrono::steady_clock Clock;
+    librnary::NNAffineFolder folder{librnary::NNAffineModel(data_tables)};
+    folder.SetMaxTwoLoop(static_cast<unsigned>(max_two_loop_size));
+    if (max_span > 0)
+        folder.SetMaxSpan(max_span);
+    librnary::NNAffineSparseFolder sparse(folder);
+
+    int mismatches = 0;
+    double seconds[2] = {0, 0}, peak_mb[2] = {0, 0};
+    for (const auto &ct : librnary::ReadAllCTs(ct_path, cin)) {
+        bool wanted = prefixes.empty();
+        for (const auto &prefix : prefixes)
+            wanted = wanted || ct.name.compare(0, prefix.size(), prefix) == 0;
+        if (!wanted || static_cast<int>(ct.primary.size()) > max_length)
+            continue;
+
+        auto start = Clock::now();
+        librnary::energy_t dense_mfe = folder.Fold(ct.primary);
+        librnary::Matching dense_structure = folder.Traceback();
+        double dense_seconds = chrono::duration<double>(Clock::now() - start).count();
+        double dense_mb = folder.TableBytes() / 1e6;
+
+        start = Clock::now();
+        librnary::energy_t sparse_mfe = sparse.Fold(ct.primary);
+        librnary::Matching sparse_structure = sparse.Traceback();
+        double sparse_seconds = chrono::duration<double>(Clock::now() - start).count();
+        double sparse_mb = sparse.TableBytes() / 1e6;
+
+        seconds[0] += dense_seconds;
+        seconds[1] += sparse_seconds;
+        peak_mb[0] = max(peak_mb[0], dense_mb);
+        peak_mb[1] = max(peak_mb[1], sparse_mb);
+        if (dense_mfe != sparse_mfe || dense_structure != sparse_structure) {
+            cerr << ct.name << ": NNAffineSparseFolder disagreed with NNAffineFolder" << endl;
+            ++mismatches;
+        }
+        cout << fixed << setprecision(3) << ct.name << " (" << ct.primary.size() << " nt): dense "
+             << dense_seconds << "s " << setprecision(1) << dense_mb << "MB, sparse " << setprecision(3)
+             << sparse_seconds << "s " << setprecision(1) << sparse_mb << "MB, " << sparse.Candidates()
+             << " candidates, speedup " << setprecision(2) << dense_seconds / sparse_seconds << "x" << endl;
+    }
+    cout << fixed << setprecision(3) << "Total: dense " << seconds[0] << "s, sparse " << seconds[1] << "s, speedup "
+         << setprecision(2) << seconds[0] / seconds[1] << "x; peak tables: dense " << setprecision(1) << peak_mb[0]
+         << "MB, sparse " << peak_mb[1] << "MB" << endl;
+
+    if (mismatches != 0) {
+        cout << mismatches << " RNAs folded differently" << endl;
+        return 1;
+    }
+    return 0;
+}
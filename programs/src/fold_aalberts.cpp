@@ -4,6 +4,7 @@
 
 
 #include <iostream>
+#include <limits>
 
 #include "cxxopts.hpp"
 #include "folders/aalberts_folder.hpp"
@@ -30,6 +31,9 @@ int main(int argc, char **argv) {
              "The maximum number of unpaired nucleotides allowed in a two-loop. "
              "(Set this to a very large number for unlimited)",
              cxxopts::value<int>()->default_value("30"))
+            ("w,max_span", "The maximum distance j - i between paired nucleotides i and j. Folds only local "
+                           "structure, with DP tables banded to this width",
+             cxxopts::value<int>()->default_value(to_string(numeric_limits<int>::max() / 3)))
             ("l,lonely_pairs", "Setting this flag will disable the no lonely pairs heuristic")
             ("h,help", "Print help");
 
@@ -37,7 +41,7 @@ int main(int argc, char **argv) {
     double lengtha, lengthb;
     librnary::kcalmol_t C;
     bool lonely_pairs = false;
-    int max_two_loop_size;
+    int max_two_loop_size, max_span;
 
     try {
         options.parse(argc, argv);
@@ -46,6 +50,7 @@ int main(int argc, char **argv) {
         lengthb = options["lengthb"].as<double>();
         C = options["Cval"].as<librnary::kcalmol_t>();
         max_two_loop_size = options["two_loop_max_size"].as<int>();
+        max_span = options["max_span"].as<int>();
         if (options.count("lonely_pairs") == 1) {
             lonely_pairs = true;
         }
@@ -66,6 +71,7 @@ int main(int argc, char **argv) {
 
     librnary::AalbertsFolder folder(model);
     folder.SetMaxTwoLoop(max_two_loop_size);
+    folder.SetMaxSpan(max_span);
     folder.SetLonelyPairs(lonely_pairs);
 
     string primary_str;
@@ -7,6 +7,7 @@
 
 #include <string>
 #include <iostream>
+#include <limits>
 
 using namespace std;
 
@@ -38,7 +39,12 @@ int main(int argc, char **argv) {
              "The maximum number of unpaired nucleotides allowed in a two-loop. "
              "(Set this to a very large number for unlimited)",
              cxxopts::value<int>()->default_value("30"))
+            ("w,max_span", "The maximum distance j - i between paired nucleotides i and j. Folds only local "
+                           "structure, with DP tables banded to this width",
+             cxxopts::value<int>()->default_value(to_string(numeric_limits<int>::max() / 3)))
             ("l,lonely_pairs", "Setting this flag will disable the no lonely pairs heuristic")
+            ("e,energy_only", "Setting this flag only computes the MFE, not a structure, keeping just the DP table "
+                              "rows still needed. The peak DP table memory is reported for each sequence")
             ("h,help", "Print help");
 
     string data_tables;
@@ -46,7 +52,8 @@ int main(int argc, char **argv) {
     librnary::kcalmol_t ml_avg_asym_cost;
     double ml_max_avg_asym;
     bool lonely_pairs = false;
-    int max_two_loop_size;
+    int max_two_loop_size, max_span;
+    bool energy_only = false;
 
     try {
         options.parse(argc, argv);
@@ -58,9 +65,13 @@ int main(int argc, char **argv) {
         ml_max_avg_asym = options["ml_max_avg_asym"].as<double>();
         ml_avg_asym_cost = options["ml_avg_asym_cost"].as<librnary::kcalmol_t>();
         max_two_loop_size = options["two_loop_max_size"].as<int>();
+        max_span = options["max_span"].as<int>();
         if (options.count("lonely_pairs") == 1) {
             lonely_pairs = true;
         }
+        if (options.count("energy_only") == 1) {
+            energy_only = true;
+        }
         if (options.count("help") == 1) {
             cout << options.help({"", "Group"}) << endl;
             return 0;
@@ -82,14 +93,19 @@ int main(int argc, char **argv) {
 
     librnary::AverageAsymmetryFolder folder(model);
     folder.SetMaxTwoLoop(max_two_loop_size);
+    folder.SetMaxSpan(max_span);
+    folder.SetEnergyOnly(energy_only);
     folder.SetLonelyPairs(lonely_pairs);
 
     string primary_str;
     while (cin >> primary_str) {
         auto primary = librnary::StringToPrimary(primary_str);
         librnary::energy_t e = folder.Fold(primary);
-        cout << librnary::MatchingToDotBracket(folder.Traceback()) << endl;
+        if (!energy_only)
+            cout << librnary::MatchingToDotBracket(folder.Traceback()) << endl;
         cout << "MFE: " << librnary::EnergyToKCal(e) << " (kcal/mol)" << endl;
+        if (energy_only)
+            cout << "Peak DP table memory: " << folder.TableBytes() << " bytes" << endl;
     }
 
 }
@@ -4,9 +4,15 @@
 
 #include "cxxopts.hpp"
 #include "folders/nn_affine_folder.hpp"
+#include "folders/nn_affine_scanner.hpp"
+#include "folders/nn_affine_pf_folder.hpp"
 
+#include <cctype>
 #include <string>
 #include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
 
 using namespace std;
 
@@ -32,13 +38,45 @@ int main(int argc, char **argv) {
              "The maximum number of unpaired nucleotides allowed in a two-loop. "
              "(Set this to a very large number for unlimited)",
              cxxopts::value<int>()->default_value("30"))
+            ("w,max_span", "The maximum distance j - i between paired nucleotides i and j. Folds only local "
+                           "structure, with DP tables banded to this width",
+             cxxopts::value<int>()->default_value(to_string(numeric_limits<int>::max() / 3)))
             ("l,lonely_pairs", "Setting this flag will disable the no lonely pairs heuristic")
+            ("c,compiled", "Setting this flag evaluates energies from tables precomputed per sequence instead of "
+                           "calling RNAstructure. Results are identical")
+            ("threads", "Number of threads used to fill the DP tables of each fold",
+             cxxopts::value<int>()->default_value("1"))
+            ("e,energy_only", "Setting this flag only computes the MFE, not a structure, keeping just the DP table "
+                              "rows still needed. The peak DP table memory is reported for each sequence")
+            ("s,scan", "Treats standard input as one sequence, ignoring whitespace, and folds every window of "
+                       "this many nucleotides along it. The input is read in chunks and the DP tables only span "
+                       "the last two windows, so any length of sequence can be scanned. Prints the start (from 1) "
+                       "of each window, its structure and its MFE",
+             cxxopts::value<int>()->default_value("0"))
+            ("scan_step", "Nucleotides between the starts of consecutive windows when scanning",
+             cxxopts::value<int>()->default_value("1"))
+            ("o,subopt", "Also prints every structure within this many tenth kcal/mol of the MFE, and its free "
+                         "energy, in no particular order",
+             cxxopts::value<librnary::energy_t>()->default_value("-1"))
+            ("k,kbest", "Also prints this many lowest free energy structures, best first, and their free energies",
+             cxxopts::value<int>()->default_value("0"))
+            ("p,pf", "Setting this flag computes the partition function instead of the MFE. Prints the ensemble free "
+                     "energy, and each base pair with a probability of at least pf_cutoff as i j probability, with "
+                     "nucleotides numbered from 1")
+            ("pf_cutoff", "The least probability of a base pair printed by --pf",
+             cxxopts::value<double>()->default_value("0.1"))
+            ("pf_samples", "With --pf, also prints this many structures drawn from the ensemble",
+             cxxopts::value<int>()->default_value("0"))
             ("h,help", "Print help");
 
     string data_tables;
-    librnary::energy_t ml_init, ml_branch, ml_unpaired;
-    int max_two_loop_size;
+    librnary::energy_t ml_init, ml_branch, ml_unpaired, subopt;
+    int max_two_loop_size, max_span, threads, scan, scan_step, pf_samples, kbest;
+    double pf_cutoff;
+    bool energy_only = false;
+    bool pf = false;
     bool lonely_pairs = false;
+    bool compiled = false;
 
     try {
         options.parse(argc, argv);
@@ -47,9 +85,26 @@ int main(int argc, char **argv) {
         ml_branch = options["ml_branch"].as<librnary::energy_t>();
         ml_unpaired = options["ml_unpaired"].as<librnary::energy_t>();
         max_two_loop_size = options["two_loop_max_size"].as<int>();
+        max_span = options["max_span"].as<int>();
+        threads = options["threads"].as<int>();
+        scan = options["scan"].as<int>();
+        scan_step = options["scan_step"].as<int>();
+        subopt = options["subopt"].as<librnary::energy_t>();
+        pf_cutoff = options["pf_cutoff"].as<double>();
+        pf_samples = options["pf_samples"].as<int>();
+        kbest = options["kbest"].as<int>();
         if (options.count("lonely_pairs") == 1) {
             lonely_pairs = true;
         }
+        if (options.count("compiled") == 1) {
+            compiled = true;
+        }
+        if (options.count("energy_only") == 1) {
+            energy_only = true;
+        }
+        if (options.count("pf") == 1) {
+            pf = true;
+        }
         if (options.count("help") == 1) {
             cout << options.help({"", "Group"}) << endl;
             return 0;
@@ -64,16 +119,79 @@ int main(int argc, char **argv) {
     model.SetMLInitCost(ml_init);
     model.SetMLBranchCost(ml_branch);
     model.SetMLUnpairedCost(ml_unpaired);
+    model.SetCompiled(compiled);
+
+    if (scan > 0) {
+        librnary::NNAffineScanner scanner(model, static_cast<unsigned>(scan),
+                                          static_cast<unsigned>(max(scan_step, 1)));
+        scanner.SetMaxTwoLoop(max_two_loop_size);
+        scanner.SetMaxSpan(max_span);
+        scanner.SetLonelyPairs(lonely_pairs);
+        auto print = [](const librnary::ScanWindow &w) {
+            cout << w.start + 1 << " " << librnary::MatchingToDotBracket(w.structure) << " "
+                 << librnary::EnergyToKCal(w.mfe) << endl;
+        };
+        vector<char> buffer(1 << 16);
+        string chunk;
+        while (cin.read(buffer.data(), buffer.size()) || cin.gcount() > 0) {
+            chunk.clear();
+            for (streamsize k = 0; k < cin.gcount(); ++k)
+                if (!isspace(static_cast<unsigned char>(buffer[k])))
+                    chunk.push_back(buffer[k]);
+            scanner.Push(librnary::StringToPrimary(chunk), print);
+        }
+        scanner.Finish(print);
+        return 0;
+    }
+
+    string primary_str;
+    if (pf) {
+        librnary::NNAffinePFFolder pf_folder(model);
+        pf_folder.SetMaxTwoLoop(max_two_loop_size);
+        pf_folder.SetMaxSpan(max_span);
+        pf_folder.SetLonelyPairs(lonely_pairs);
+        pf_folder.SetThreads(static_cast<size_t>(max(threads, 1)));
+        default_random_engine re;
+        while (cin >> primary_str) {
+            auto primary = librnary::StringToPrimary(primary_str);
+            librnary::kcalmol_t g = pf_folder.Fold(primary);
+            cout << "Ensemble free energy: " << g << " (kcal/mol)" << endl;
+            auto probs = pf_folder.BasePairProbabilities();
+            for (int i = 0; i < static_cast<int>(primary.size()); ++i)
+                for (int j = i + 1; j < static_cast<int>(primary.size()) && j - i <= max_span; ++j)
+                    if (probs[i][j] >= pf_cutoff)
+                        cout << i + 1 << " " << j + 1 << " " << probs[i][j] << endl;
+            for (const auto &m : pf_folder.Sample(static_cast<size_t>(max(pf_samples, 0)), re))
+                cout << librnary::MatchingToDotBracket(m) << endl;
+        }
+        return 0;
+    }
 
     librnary::NNAffineFolder folder(model);
     folder.SetMaxTwoLoop(max_two_loop_size);
+    folder.SetMaxSpan(max_span);
+    folder.SetEnergyOnly(energy_only);
     folder.SetLonelyPairs(lonely_pairs);
+    folder.SetThreads(static_cast<size_t>(max(threads, 1)));
 
-    string primary_str;
     while (cin >> primary_str) {
         auto primary = librnary::StringToPrimary(primary_str);
         librnary::energy_t e = folder.Fold(primary);
-        cout << librnary::MatchingToDotBracket(folder.Traceback()) << endl;
+        if (!energy_only)
+            cout << librnary::MatchingToDotBracket(folder.Traceback()) << endl;
         cout << "MFE: " << librnary::EnergyToKCal(e) << " (kcal/mol)" << endl;
+        if (subopt >= 0 && !energy_only) {
+            size_t count = folder.Suboptimal(subopt, [](librnary::energy_t se, const librnary::Matching &m) {
+                cout << librnary::MatchingToDotBracket(m) << " " << librnary::EnergyToKCal(se) << endl;
+                return true;
+            });
+            cout << "Suboptimal structures: " << count << endl;
+        }
+        if (kbest > 0 && !energy_only) {
+            for (const auto &t : folder.TracebackKBest(static_cast<size_t>(kbest)))
+                cout << librnary::MatchingToDotBracket(get<1>(t)) << " " << librnary::EnergyToKCal(get<0>(t)) << endl;
+        }
+        if (energy_only)
+            cout << "Peak DP table memory: " << folder.TableBytes() << " bytes" << endl;
     }
 }
\ No newline at end of file
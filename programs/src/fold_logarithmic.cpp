@@ -6,6 +6,7 @@
 
 #include <string>
 #include <iostream>
+#include <limits>
 
 using namespace std;
 
@@ -40,13 +41,16 @@ int main(int argc, char **argv) {
              "The maximum number of unpaired nucleotides allowed in a two-loop. "
              "(Set this to a very large number for unlimited)",
              cxxopts::value<int>()->default_value("30"))
+            ("w,max_span", "The maximum distance j - i between paired nucleotides i and j. Folds only local "
+                           "structure, with DP tables banded to this width",
+             cxxopts::value<int>()->default_value(to_string(numeric_limits<int>::max() / 3)))
             ("l,lonely_pairs", "Setting this flag will disable the no lonely pairs heuristic")
             ("h,help", "Print help");
 
     string data_tables;
     librnary::energy_t ml_init, ml_branch, ml_unpaired;
     librnary::kcalmol_t ml_log_mult;
-    int max_two_loop_size, ml_pivot;
+    int max_two_loop_size, max_span, ml_pivot;
     bool lonely_pairs = false;
 
     try {
@@ -58,6 +62,7 @@ int main(int argc, char **argv) {
         ml_log_mult = options["ml_log_mult"].as<librnary::kcalmol_t>();
         ml_pivot = options["ml_pivot"].as<int>();
         max_two_loop_size = options["two_loop_max_size"].as<int>();
+        max_span = options["max_span"].as<int>();
         if (options.count("lonely_pairs") == 1) {
             lonely_pairs = true;
         }
@@ -80,6 +85,7 @@ int main(int argc, char **argv) {
 
     librnary::NNUnpairedFolder folder(model);
     folder.SetMaxTwoLoop(max_two_loop_size);
+    folder.SetMaxSpan(max_span);
     folder.SetLonelyPairs(lonely_pairs);
 
     string primary_str;
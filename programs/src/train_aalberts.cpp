@@ -66,9 +66,12 @@ int main(int argc, char **argv) {
             ("t,threads",
              "Number of threads to use",
              cxxopts::value<int>()->default_value(std::to_string(std::thread::hardware_concurrency())))
+            ("s,search",
+             "How to search the parameter sets each epoch: exhaustive, coordinate, multires or bnb",
+             cxxopts::value<string>()->default_value("exhaustive"))
             ("h,help", "Print help");
 
-    string data_tables, ct_path;
+    string data_tables, ct_path, search_name;
     size_t threads;
 
     try {
@@ -76,6 +79,7 @@ int main(int argc, char **argv) {
         data_tables = options["data_path"].as<string>();
         ct_path = options["ct_path"].as<string>();
         threads = static_cast<size_t>(options["threads"].as<int>());
+        search_name = options["search"].as<string>();
         if (options.count("help") == 1) {
             cout << options.help({"", "Group"}) << endl;
             return 0;
@@ -85,6 +89,11 @@ int main(int argc, char **argv) {
         cout << "Argument parsing error: " << e.what() << endl;
         return 1;
     }
+    auto search = librnary::MakeParamSearch(search_name);
+    if (search == nullptr) {
+        cout << "Unknown search: " << search_name << endl;
+        return 1;
+    }
 
     // Read CTs.
     auto cts = librnary::ReadFilesInCTSetFormat(ct_path, cin);
@@ -102,6 +111,11 @@ int main(int argc, char **argv) {
         }
     }
 
+    // One grid dimension per loop above, outermost first. The energy depends on the squares of a and b, which both
+    // change sign within their ranges, so energy bounds cannot be taken across them.
+    librnary::ParamGrid grid;
+    grid.AddDimension(50 + 100 + 1, false).AddDimension(50 + 50 + 1, false).AddDimension(50 + 50 + 1);
+
     // Set up needed instances.
     librnary::AalbertsFolder folder(model);
     folder.SetMaxTwoLoop(30);
@@ -116,6 +130,7 @@ int main(int argc, char **argv) {
     librnary::IBFMultiLoopAalberts<AalbertsParameterSet> trainer(model, cts, clog);
     trainer.SetNumStructureSeeds(5);
     trainer.SetThreads(threads);
+    trainer.SetParamSearch(search, grid);
     auto best_params = trainer.Train(params, params.back(), folder, 50);
 
     cout << "Best parameters: " << best_params.to_string() << endl;
@@ -2,14 +2,18 @@
 // Created by max on 10/23/18.
 //
 
+#include <array>
 #include <string>
 #include <sstream>
 
 #include "cxxopts.hpp"
 
-#include "training/IBF_multiloop.hpp"
+#include "training/IBF_multiloop_linear.hpp"
 #include "models/nn_affine_model.hpp"
 #include "folders/nn_affine_folder.hpp"
+#include "folders/nn_affine_batch_folder.hpp"
+#include "folders/nn_affine_param_batch_folder.hpp"
+#include "folders/nn_affine_pf_folder.hpp"
 #include "scorers/nn_scorer.hpp"
 
 using namespace std;
@@ -32,6 +36,9 @@ public:
     void LoadInto(librnary::NNAffineModel &model) const {
         model.SetMLParams(init, branch, unpaired);
     }
+    array<librnary::energy_t, 3> Weights() const {
+        return {{init, branch, unpaired}};
+    }
     class MultiInfo {
     protected:
         int branches{}, unpaired{};
@@ -45,6 +52,9 @@ public:
         librnary::energy_t MLClosure(const librnary::NNAffineModel &model) const {
             return model.MLClosure(branches, unpaired);
         }
+        array<int, 3> Features() const {
+            return {{1, branches, unpaired}};
+        }
     };
 };
 
@@ -61,16 +71,36 @@ int main(int argc, char **argv) {
             ("t,threads",
              "Number of threads to use",
              cxxopts::value<int>()->default_value(std::to_string(std::thread::hardware_concurrency())))
+            ("s,search",
+             "How to search the parameter sets each epoch: exhaustive, coordinate, multires or bnb",
+             cxxopts::value<string>()->default_value("exhaustive"))
+            ("sampled_seeds", "If positive, seeds the decoy structures with this many structures of each RNA drawn "
+                              "from its Boltzmann ensemble, instead of five folds with random parameters",
+             cxxopts::value<int>()->default_value("0"))
+            ("kbest_seeds", "If positive, seeds the decoy structures with this many lowest free energy structures of "
+                            "each RNA, from a single fold each, instead of five folds with random parameters",
+             cxxopts::value<int>()->default_value("0"))
+            ("lockstep", "Setting this flag folds RNAs of similar length together, several at once in the SIMD lanes "
+                         "of a batch folder, which gives the same structures faster")
+            ("lockstep_seeds", "Setting this flag folds each RNA under all the seed parameter sets at once, in the "
+                               "SIMD lanes of a batch folder, which gives the same seed structures faster")
             ("h,help", "Print help");
 
-    string data_tables, ct_path;
+    string data_tables, ct_path, search_name;
     size_t threads;
+    int sampled_seeds, kbest_seeds;
+    bool lockstep, lockstep_seeds;
 
     try {
         options.parse(argc, argv);
         data_tables = options["data_path"].as<string>();
         ct_path = options["ct_path"].as<string>();
         threads = static_cast<size_t>(options["threads"].as<int>());
+        search_name = options["search"].as<string>();
+        sampled_seeds = options["sampled_seeds"].as<int>();
+        kbest_seeds = options["kbest_seeds"].as<int>();
+        lockstep = options.count("lockstep") == 1;
+        lockstep_seeds = options.count("lockstep_seeds") == 1;
         if (options.count("help") == 1) {
             cout << options.help({"", "Group"}) << endl;
             return 0;
@@ -80,6 +110,11 @@ int main(int argc, char **argv) {
         cout << "Argument parsing error: " << e.what() << endl;
         return 1;
     }
+    auto search = librnary::MakeParamSearch(search_name);
+    if (search == nullptr) {
+        cout << "Unknown search: " << search_name << endl;
+        return 1;
+    }
 
     // Read CTs.
     auto cts = librnary::ReadFilesInCTSetFormat(ct_path, cin);
@@ -95,6 +130,9 @@ int main(int argc, char **argv) {
         }
     }
 
+    // One grid dimension per loop above, outermost first.
+    librnary::ParamGrid grid({200 - 30 + 1, 30 + 60 + 1, 30 + 60 + 1});
+
     // Set up needed instances.
     librnary::NNAffineModel model(data_tables);
     librnary::NNAffineFolder folder(model);
@@ -105,12 +143,63 @@ int main(int argc, char **argv) {
     model.SetMLParams(0, 0, 0);
 
     // Make the trainer and train!
-    librnary::IBFMultiLoop<LinearParameterSet,
+    librnary::IBFMultiLoopLinear<LinearParameterSet,
             librnary::NNAffineModel,
             librnary::NNScorer<librnary::NNAffineModel>,
             librnary::NNAffineFolder> trainer(model, cts, cout);
     trainer.SetNumStructureSeeds(5);
+    if (sampled_seeds > 0) {
+        trainer.SetSeedSampler([folder](const librnary::NNAffineModel &m, const librnary::PrimeStructure &primary,
+                                        size_t count, default_random_engine &re) {
+            librnary::NNAffinePFFolder pf_folder(folder);
+            pf_folder.SetModel(m);
+            pf_folder.Fold(primary);
+            return pf_folder.Sample(count, re);
+        }, sampled_seeds);
+    } else if (kbest_seeds > 0) {
+        trainer.SetSeedSampler([folder](const librnary::NNAffineModel &m, const librnary::PrimeStructure &primary,
+                                        size_t count, default_random_engine &) {
+            auto local_folder = folder;
+            local_folder.SetModel(m);
+            local_folder.Fold(primary);
+            vector<librnary::Matching> structures;
+            for (const auto &t : local_folder.TracebackKBest(count))
+                structures.push_back(get<1>(t));
+            // Seeding takes the same number of structures of every RNA, so repeat the last if there are too few.
+            structures.resize(count, structures.back());
+            return structures;
+        }, kbest_seeds);
+    }
+    if (lockstep) {
+        trainer.SetGroupFolder([](const librnary::NNAffineFolder &f, const librnary::NNAffineModel &m,
+                                  const vector<librnary::PrimeStructure> &primaries) {
+            librnary::NNAffineBatchFolder batch_folder(f);
+            batch_folder.SetModel(m);
+            batch_folder.Fold(primaries);
+            vector<librnary::Matching> structures;
+            for (size_t lane = 0; lane < primaries.size(); ++lane)
+                structures.push_back(batch_folder.Traceback(lane));
+            return structures;
+        }, librnary::NNAffineBatchFolder::Width);
+    }
+    if (lockstep_seeds) {
+        trainer.SetParamGroupFolder([](const librnary::NNAffineFolder &f, const vector<librnary::NNAffineModel> &models,
+                                       const librnary::PrimeStructure &primary) {
+            // The parameter sets only set the multi-loop parameters, so the first model has the rest.
+            librnary::NNAffineParamBatchFolder batch_folder(f);
+            batch_folder.SetModel(models.front());
+            vector<librnary::NNAffineParamBatchFolder::MLParams> ml_params;
+            for (const auto &m : models)
+                ml_params.push_back({m.MLInitCost(), m.MLBranchCost(), m.MLUnpairedCost()});
+            batch_folder.Fold(primary, ml_params);
+            vector<librnary::Matching> structures;
+            for (size_t lane = 0; lane < models.size(); ++lane)
+                structures.push_back(batch_folder.Traceback(lane));
+            return structures;
+        }, librnary::NNAffineParamBatchFolder::Width);
+    }
     trainer.SetThreads(threads);
+    trainer.SetParamSearch(search, grid);
     auto best_params = trainer.Train(params, params.front(), folder, 50);
 
     cout << "Best parameters: " << best_params.to_string() << endl;
@@ -70,9 +70,12 @@ int main(int argc, char **argv) {
             ("t,threads",
              "Number of threads to use",
              cxxopts::value<int>()->default_value(std::to_string(std::thread::hardware_concurrency())))
+            ("s,search",
+             "How to search the parameter sets each epoch: exhaustive, coordinate, multires or bnb",
+             cxxopts::value<string>()->default_value("exhaustive"))
             ("h,help", "Print help");
 
-    string data_tables, ct_path;
+    string data_tables, ct_path, search_name;
     size_t threads;
 
     try {
@@ -80,6 +83,7 @@ int main(int argc, char **argv) {
         data_tables = options["data_path"].as<string>();
         ct_path = options["ct_path"].as<string>();
         threads = static_cast<size_t>(options["threads"].as<int>());
+        search_name = options["search"].as<string>();
         if (options.count("help") == 1) {
             cout << options.help({"", "Group"}) << endl;
             return 0;
@@ -89,6 +93,11 @@ int main(int argc, char **argv) {
         cout << "Argument parsing error: " << e.what() << endl;
         return 1;
     }
+    auto search = librnary::MakeParamSearch(search_name);
+    if (search == nullptr) {
+        cout << "Unknown search: " << search_name << endl;
+        return 1;
+    }
 
     // Read CTs.
 
@@ -107,6 +116,9 @@ int main(int argc, char **argv) {
         }
     }
 
+    // One grid dimension per loop above, outermost first.
+    librnary::ParamGrid grid({205 - 40 + 1, 30 + 35 + 1, 30 + 35 + 1, 30 + 30 + 1});
+
     // Set up needed instances.
     librnary::AsymmetryModel model(data_tables);
     librnary::AsymmetryFolder folder(model);
@@ -122,6 +134,7 @@ int main(int argc, char **argv) {
             librnary::AsymmetryFolder> trainer(model, cts, clog);
     trainer.SetNumStructureSeeds(5);
     trainer.SetThreads(threads);
+    trainer.SetParamSearch(search, grid);
     auto best_params = trainer.Train(params, params.front(), folder, 50);
 
     cout << "Best parameters: " << best_params.to_string() << endl;
@@ -67,9 +67,12 @@ int main(int argc, char **argv) {
             ("t,threads",
              "Number of threads to use",
              cxxopts::value<int>()->default_value(std::to_string(std::thread::hardware_concurrency())))
+            ("s,search",
+             "How to search the parameter sets each epoch: exhaustive, coordinate, multires or bnb",
+             cxxopts::value<string>()->default_value("exhaustive"))
             ("h,help", "Print help");
 
-    string data_tables, ct_path;
+    string data_tables, ct_path, search_name;
     size_t threads;
 
     try {
@@ -77,6 +80,7 @@ int main(int argc, char **argv) {
         data_tables = options["data_path"].as<string>();
         ct_path = options["ct_path"].as<string>();
         threads = static_cast<size_t>(options["threads"].as<int>());
+        search_name = options["search"].as<string>();
         if (options.count("help") == 1) {
             cout << options.help({"", "Group"}) << endl;
             return 0;
@@ -86,6 +90,11 @@ int main(int argc, char **argv) {
         cout << "Argument parsing error: " << e.what() << endl;
         return 1;
     }
+    auto search = librnary::MakeParamSearch(search_name);
+    if (search == nullptr) {
+        cout << "Unknown search: " << search_name << endl;
+        return 1;
+    }
 
     // Read CTs.
     auto cts = librnary::ReadFilesInCTSetFormat(ct_path, cin);
@@ -106,6 +115,12 @@ int main(int argc, char **argv) {
         }
     }
 
+    // One grid dimension per loop above, outermost first. Moving the pivot can raise some loops' energies and lower
+    // others', so energy bounds cannot be taken across it.
+    librnary::ParamGrid grid;
+    grid.AddDimension(200 - 30 + 1).AddDimension(30 + 30 + 1).AddDimension(30 + 30 + 1).AddDimension(30 + 30 + 1)
+            .AddDimension(8, false);
+
     // Set up needed instances.
     librnary::NNUnpairedModel model(data_tables);
     librnary::NNUnpairedFolder folder(model);
@@ -122,6 +137,7 @@ int main(int argc, char **argv) {
             librnary::NNUnpairedFolder> trainer(model, cts, clog);
     trainer.SetNumStructureSeeds(5);
     trainer.SetThreads(threads);
+    trainer.SetParamSearch(search, grid);
     auto best_params = trainer.Train(params, params.front(), folder, 50);
 
     cout << "Best parameters: " << best_params.to_string() << endl;
@@ -3,11 +3,12 @@
 //
 
 
+#include <array>
 #include <string>
 #include <sstream>
 #include <scorers/stem_length_scorer.hpp>
 #include "folders/stem_length_folder.hpp"
-#include "training/generic_ibf_trainer.hpp"
+#include "training/generic_ibf_trainer_linear.hpp"
 #include "cxxopts.hpp"
 
 using namespace std;
@@ -35,6 +36,11 @@ public:
     void LoadInto(librnary::StemLengthModel &model) const {
         model.SetLengthCosts(length_costs);
     }
+    array<librnary::energy_t, STEM_LENGTH_COST_VECTOR_SIZE> Weights() const {
+        array<librnary::energy_t, STEM_LENGTH_COST_VECTOR_SIZE> w{};
+        copy(length_costs.begin(), length_costs.end(), w.begin());
+        return w;
+    }
     class SSInfo {
     protected:
         std::vector<int> stem_size_count;
@@ -57,6 +63,11 @@ public:
             }
             return sum;
         }
+        array<int, STEM_LENGTH_COST_VECTOR_SIZE> Features() const {
+            array<int, STEM_LENGTH_COST_VECTOR_SIZE> f{};
+            copy(stem_size_count.begin(), stem_size_count.end(), f.begin());
+            return f;
+        }
     };
 };
 
@@ -73,10 +84,13 @@ int main(int argc, char **argv) {
             ("t,threads",
              "Number of threads to use",
              cxxopts::value<int>()->default_value(std::to_string(std::thread::hardware_concurrency())))
+            ("s,search",
+             "How to search the parameter sets each epoch: exhaustive, coordinate, multires or bnb",
+             cxxopts::value<string>()->default_value("exhaustive"))
             ("l,disable_lonely_pairs", "Give lonely pairs a big energy penalty")
             ("h,help", "Print help");
 
-    string data_tables, ct_path;
+    string data_tables, ct_path, search_name;
     size_t threads;
     bool no_lonely_pairs = false;
 
@@ -85,6 +99,7 @@ int main(int argc, char **argv) {
         data_tables = options["data_path"].as<string>();
         ct_path = options["ct_path"].as<string>();
         threads = static_cast<size_t>(options["threads"].as<int>());
+        search_name = options["search"].as<string>();
         if (options.count("disable_lonely_pairs") == 1) {
             no_lonely_pairs = true;
         }
@@ -97,6 +112,11 @@ int main(int argc, char **argv) {
         cout << "Argument parsing error: " << e.what() << endl;
         return 1;
     }
+    auto search = librnary::MakeParamSearch(search_name);
+    if (search == nullptr) {
+        cout << "Unknown search: " << search_name << endl;
+        return 1;
+    }
 
     // Read CTs.
     auto cts = librnary::ReadFilesInCTSetFormat(ct_path, cin);
@@ -120,6 +140,9 @@ int main(int argc, char **argv) {
         }
     }
 
+    // One grid dimension per loop above, outermost first.
+    librnary::ParamGrid grid({static_cast<size_t>(a_max - a_min + 1), 41, 41, 41, 41});
+
     // Set up needed instances.
     librnary::StemLengthModel model(data_tables);  // Zero cost stems by default.
     librnary::StemLengthFolder folder(model);
@@ -127,12 +150,13 @@ int main(int argc, char **argv) {
     folder.SetLonelyPairs(true);
 
     // Make the trainer and train!
-    librnary::GenericIBFTrainer<StemLengthParamSet,
+    librnary::GenericIBFTrainerLinear<StemLengthParamSet,
             librnary::StemLengthModel,
             librnary::StemLengthScorer,
             librnary::StemLengthFolder> trainer(model, cts, cout);
     trainer.SetNumStructureSeeds(5);
     trainer.SetThreads(threads);
+    trainer.SetParamSearch(search, grid);
     auto best_params = trainer.Train(params, params.front(), folder, 50);
 
     cout << "Best parameters: " << best_params.to_string() << endl;